@@ -0,0 +1,146 @@
+// bench_dir.c - DIR /O: collecting and sorting a huge directory
+//
+//   gcc -O2 -pthread -o bench_dir bench/bench_dir.c
+//   ./bench_dir [entries] [dir]      (default 1000000 in /dev/shm/bench_dir)
+//
+// A small tmpfs may run out of inodes first; any directory on a disk does.
+// The files are kept, so a second run skips creating them.
+//
+// Fills a directory with empty, sparse files of assorted sizes and dates,
+// then times what DIR /O does before printing: the readdir/fstatat pass
+// into the arenas and the radix sort for each order. The same listing is
+// also built the obvious way, a malloc'd node and a strdup'd name per
+// entry sorted by qsort, for comparison of time and bytes per entry.
+#define main init_shell_main
+#include "../init/init_shell.c"
+#undef main
+
+#include <malloc.h>
+
+typedef struct Node {
+    char*    name;
+    uint64_t size;
+    int64_t  mtime;
+    int      is_dir;
+} Node;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+static int node_cmp_name(const void* a, const void* b) {
+    return strcasecmp((*(Node* const*)a)->name, (*(Node* const*)b)->name);
+}
+
+static int node_cmp_size(const void* a, const void* b) {
+    const Node* x = *(Node* const*)a;
+    const Node* y = *(Node* const*)b;
+    if (x->size != y->size) return x->size < y->size ? -1 : 1;
+    return strcasecmp(x->name, y->name);
+}
+
+static void populate(const char* dir, size_t n) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof path, "%s/%zu", dir, n - 1);
+    if (access(path, F_OK) == 0) return; // left by an earlier run
+
+    mkdir(dir, 0755);
+    uint64_t x = 0x9E3779B97F4A7C15ull;
+    double t0 = now_ms();
+    for (size_t i = 0; i < n; i++) {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        static const char* ext[] = { "", ".TXT", ".DAT", ".COM64", ".C", ".H" };
+        snprintf(path, sizeof path, "%s/F%07llX%s", dir, (unsigned long long)(x & 0xFFFFFFF),
+                 ext[x % 6]);
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) { perror(path); exit(1); }
+        if (ftruncate(fd, (off_t)(x >> 44)) != 0) { perror("ftruncate"); exit(1); }
+        struct timespec ts[2] = { { (time_t)(1500000000 + (x >> 36) % 300000000), 0 }, { 0, UTIME_OMIT } };
+        ts[1] = ts[0];
+        futimens(fd, ts);
+        close(fd);
+    }
+    // The last name doubles as the "already populated" marker
+    snprintf(path, sizeof path, "%s/%zu", dir, n - 1);
+    close(open(path, O_WRONLY | O_CREAT, 0644));
+    fprintf(stderr, "created %zu files in %.0f ms\n", n, now_ms() - t0);
+}
+
+int main(int argc, char** argv) {
+    size_t n = argc > 1 ? (size_t)strtoull(argv[1], NULL, 0) : 1000000;
+    const char* dir = argc > 2 ? argv[2] : "/dev/shm/bench_dir";
+    populate(dir, n);
+
+    // Warm the dentry and inode caches so both passes see the same state
+    DIR* d = opendir(dir);
+    if (!d) { perror(dir); return 1; }
+    while (readdir(d)) {}
+    closedir(d);
+
+    DirList l;
+    memset(&l, 0, sizeof l);
+    d = opendir(dir);
+    double t0 = now_ms();
+    if (dir_collect(d, "*", 0, &l) != 0) { fprintf(stderr, "arena full\n"); return 1; }
+    double t_collect = now_ms() - t0;
+    closedir(d);
+
+    size_t recs_used = l.recs.used;
+    printf("entries         %zu\n", l.n);
+    printf("collect         %8.1f ms\n", t_collect);
+    static const char orders[] = "NESD";
+    for (int i = 0; i < 4; i++) {
+        l.recs.used = recs_used; // drop the previous order's pairs
+        t0 = now_ms();
+        DirKey* k = dir_sort(&l, orders[i]);
+        double t = now_ms() - t0;
+        if (!k) { fprintf(stderr, "arena full\n"); return 1; }
+        printf("sort /O%c        %8.1f ms\n", orders[i], t);
+    }
+    size_t arena = l.recs.used + l.names.used;
+    printf("arena           %8.1f bytes/entry (records %zu, pairs %zu, names %.1f)\n",
+           (double)arena / (double)l.n, sizeof(DirRec), 2 * sizeof(DirKey),
+           (double)l.names.used / (double)l.n);
+    dir_list_free(&l);
+
+    // The obvious way: a node and a name per entry from malloc
+    struct mallinfo2 m0 = mallinfo2();
+    Node** nodes = malloc(n * sizeof *nodes);
+    size_t count = 0;
+    d = opendir(dir);
+    t0 = now_ms();
+    struct dirent* de;
+    while ((de = readdir(d)) != NULL) {
+        if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) continue;
+        struct stat st;
+        if (fstatat(dirfd(d), de->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+        Node* nd = malloc(sizeof *nd);
+        nd->name = strdup(de->d_name);
+        nd->size = (uint64_t)st.st_size;
+        nd->mtime = st.st_mtime;
+        nd->is_dir = S_ISDIR(st.st_mode);
+        if (count < n) nodes[count++] = nd;
+    }
+    double t_mcollect = now_ms() - t0;
+    closedir(d);
+    struct mallinfo2 m1 = mallinfo2();
+
+    t0 = now_ms();
+    qsort(nodes, count, sizeof *nodes, node_cmp_name);
+    double t_qn = now_ms() - t0;
+    t0 = now_ms();
+    qsort(nodes, count, sizeof *nodes, node_cmp_size);
+    double t_qs = now_ms() - t0;
+
+    printf("malloc collect  %8.1f ms\n", t_mcollect);
+    printf("qsort by name   %8.1f ms\n", t_qn);
+    printf("qsort by size   %8.1f ms\n", t_qs);
+    printf("malloc          %8.1f bytes/entry\n",
+           (double)(m1.uordblks + m1.hblkhd - m0.uordblks - m0.hblkhd) / (double)count);
+
+    for (size_t i = 0; i < count; i++) { free(nodes[i]->name); free(nodes[i]); }
+    free(nodes);
+    return 0;
+}
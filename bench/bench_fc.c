@@ -0,0 +1,86 @@
+// bench_fc.c - FC's text diff on large inputs, and a check of its results
+//
+//   gcc -O2 -pthread -o bench_fc bench/bench_fc.c
+//   ./bench_fc [lines]      (default 300000 per file)
+//
+// Runs the diff FC uses (fc_split_lines + fc_diff_range) in memory on:
+//   - two files with no line in common, the worst case for Myers: it must
+//     give up at FC_MAX_COST and mark everything changed, in well under a
+//     second rather than minutes;
+//   - one file against a copy with a line changed every 1000, which must
+//     still find exactly those lines;
+//   - FC /C on lines that differ only after an embedded NUL.
+// Exits non-zero if any result is wrong.
+#define main init_shell_main
+#include "../init/init_shell.c"
+#undef main
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+/* "<tag> <i>\n" for every line; every `every`-th line gets tag2 instead */
+static MappedFile make_text(long lines, const char *tag, const char *tag2, long every) {
+    size_t cap = (size_t)lines * 24 + 1;
+    char *p = malloc(cap);
+    if (!p) { perror("malloc"); exit(1); }
+    size_t n = 0;
+    for (long i = 0; i < lines; i++)
+        n += (size_t)snprintf(p + n, cap - n, "%s %ld\n", (every && i % every == every / 2) ? tag2 : tag, i);
+    MappedFile m = { (const uint8_t *)p, n };
+    return m;
+}
+
+/* Diff a against b; returns the changed line counts on each side */
+static double run_diff(const MappedFile *a, const MappedFile *b, int nocase, long *ca, long *cb) {
+    FcDiff d;
+    memset(&d, 0, sizeof d);
+    d.nocase = nocase;
+    if (fc_split_lines(a, nocase, &d.a) != 0 || fc_split_lines(b, nocase, &d.b) != 0) { perror("split"); exit(1); }
+    long vsz = d.a.count + d.b.count + 2;
+    d.v1 = malloc(sizeof(long) * (size_t)vsz);
+    d.v2 = malloc(sizeof(long) * (size_t)vsz);
+    if (!d.v1 || !d.v2) { perror("malloc"); exit(1); }
+
+    double t0 = now_ms();
+    fc_diff_range(&d, 0, d.a.count, 0, d.b.count);
+    double t = now_ms() - t0;
+
+    *ca = *cb = 0;
+    for (long i = 0; i < d.a.count; i++) *ca += d.a.chg[i];
+    for (long i = 0; i < d.b.count; i++) *cb += d.b.chg[i];
+    free(d.a.lines); free(d.a.chg);
+    free(d.b.lines); free(d.b.chg);
+    free(d.v1); free(d.v2);
+    return t;
+}
+
+int main(int argc, char **argv) {
+    long lines = argc > 1 ? strtol(argv[1], NULL, 0) : 300000;
+    int bad = 0;
+    long ca, cb;
+
+    MappedFile a = make_text(lines, "left", NULL, 0);
+    MappedFile b = make_text(lines, "right", NULL, 0);
+    double t = run_diff(&a, &b, 0, &ca, &cb);
+    printf("disjoint        %8.1f ms  %ld / %ld lines changed\n", t, ca, cb);
+    if (ca != lines || cb != lines) { fprintf(stderr, "disjoint: expected every line changed\n"); bad = 1; }
+
+    MappedFile c = make_text(lines, "left", "edit", 1000);
+    t = run_diff(&a, &c, 0, &ca, &cb);
+    printf("1 in 1000 edits %8.1f ms  %ld / %ld lines changed\n", t, ca, cb);
+    if (ca != lines / 1000 || cb != lines / 1000) { fprintf(stderr, "edits: expected %ld changed lines\n", lines / 1000); bad = 1; }
+
+    static const char x[] = "Same\0one\n", y[] = "SAME\0two\n";
+    MappedFile nx = { (const uint8_t *)x, sizeof x - 1 }, ny = { (const uint8_t *)y, sizeof y - 1 };
+    run_diff(&nx, &ny, 1, &ca, &cb);
+    printf("/C past a NUL             %ld / %ld lines changed\n", ca, cb);
+    if (ca != 1 || cb != 1) { fprintf(stderr, "/C: lines differing after a NUL compared equal\n"); bad = 1; }
+
+    free((void *)a.p);
+    free((void *)b.p);
+    free((void *)c.p);
+    return bad;
+}
@@ -0,0 +1,78 @@
+// bench_heap.c - the COM64 DosApi heap against glibc malloc
+//
+//   gcc -O2 -pthread -o bench_heap bench/bench_heap.c
+//   ./bench_heap
+//
+// Runs the same allocation patterns through the arena, the pools and
+// malloc/free in this process (the heap code is what a COM64 child runs),
+// and reports ns per allocation plus the heap's peak for each pattern.
+#define main init_shell_main
+#include "../init/init_shell.c"
+#undef main
+
+#define N 1000000
+
+static void* g_ptr[N];
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static size_t rnd_size(uint64_t* x) {
+    *x ^= *x << 13; *x ^= *x >> 7; *x ^= *x << 17;
+    return 8 + (size_t)(*x % 200);
+}
+
+// Build N small nodes, then drop them all: what a parser or DIR-style tool does
+static void pattern_bulk(void) {
+    uint64_t x = 1;
+    double t0 = now_ns();
+    for (int i = 0; i < N; i++) *(char*)(g_ptr[i] = heap_arena_alloc(rnd_size(&x))) = 1;
+    heap_arena_reset();
+    double t_arena = (now_ns() - t0) / N;
+
+    x = 1;
+    t0 = now_ns();
+    for (int i = 0; i < N; i++) *(char*)(g_ptr[i] = malloc(rnd_size(&x))) = 1;
+    for (int i = 0; i < N; i++) free(g_ptr[i]);
+    double t_malloc = (now_ns() - t0) / N;
+
+    printf("bulk build+drop   arena %6.1f ns   malloc %6.1f ns\n", t_arena, t_malloc);
+}
+
+// Steady churn: free a random live block and allocate a new one
+static void pattern_churn(void) {
+    static size_t sz[N / 10];
+    uint64_t x = 7;
+    for (int i = 0; i < N / 10; i++) g_ptr[i] = heap_pool_alloc(sz[i] = rnd_size(&x));
+    double t0 = now_ns();
+    for (int r = 0; r < N; r++) {
+        int i = (int)(rnd_size(&x) * 4099u % (N / 10));
+        heap_pool_free(g_ptr[i], sz[i]);
+        g_ptr[i] = heap_pool_alloc(sz[i] = rnd_size(&x));
+    }
+    double t_pool = (now_ns() - t0) / N;
+    for (int i = 0; i < N / 10; i++) heap_pool_free(g_ptr[i], sz[i]);
+
+    x = 7;
+    for (int i = 0; i < N / 10; i++) g_ptr[i] = malloc(sz[i] = rnd_size(&x));
+    t0 = now_ns();
+    for (int r = 0; r < N; r++) {
+        int i = (int)(rnd_size(&x) * 4099u % (N / 10));
+        free(g_ptr[i]);
+        g_ptr[i] = malloc(sz[i] = rnd_size(&x));
+    }
+    double t_malloc = (now_ns() - t0) / N;
+    for (int i = 0; i < N / 10; i++) free(g_ptr[i]);
+
+    printf("churn free+alloc  pool  %6.1f ns   malloc %6.1f ns\n", t_pool, t_malloc);
+}
+
+int main(void) {
+    pattern_bulk();
+    pattern_churn();
+    printf("heap peak %zu KB (pool slabs %zu KB)\n", g_heap.peak >> 10, g_heap.slabs >> 10);
+    return 0;
+}
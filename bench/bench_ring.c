@@ -0,0 +1,106 @@
+// bench_ring.c - the sdk/rt SPSC ring against a pipe, across two processes
+//
+//   gcc -O2 -I sdk -o bench_ring bench/bench_ring.c
+//   ./bench_ring [records] [record_bytes]
+//
+// A forked producer hands fixed-size records to the parent, once through
+// an RtRing in a MAP_SHARED memfd (what two COM64 programs sharing a
+// segment do) and once through a pipe, one write() per record.
+#define _GNU_SOURCE
+#include <linux/futex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../sdk/rt/rt_init.c"
+#include "../sdk/rt/rt_mem.c"
+#include "../sdk/rt/rt_ring.c"
+
+static int host_futex_wait(int* addr, int expected, int timeout_ms) {
+    (void)timeout_ms;
+    syscall(SYS_futex, addr, FUTEX_WAIT, expected, NULL, NULL, 0);
+    return 0;
+}
+
+static int host_futex_wake(int* addr, int n) {
+    return (int)syscall(SYS_futex, addr, FUTEX_WAKE, n, NULL, NULL, 0);
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char** argv) {
+    long n = argc > 1 ? atol(argv[1]) : 2000000;
+    uint32_t len = argc > 2 ? (uint32_t)atoi(argv[2]) : 64;
+    if (len < 8 || len > 4096) len = 64;
+
+    static DosApi api;
+    api.futex_wait = host_futex_wait;
+    api.futex_wake = host_futex_wake;
+    rt_init(&api);
+
+    size_t bytes = 1u << 20;
+    int fd = memfd_create("bench_ring", 0);
+    if (fd < 0 || ftruncate(fd, (off_t)bytes) != 0) { perror("memfd"); return 1; }
+    void* mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED) { perror("mmap"); return 1; }
+    RtRing* r = rt_ring_init(mem, bytes);
+
+    char rec[4096], got[4096];
+    memset(rec, 'x', sizeof rec);
+
+    double t0 = now_sec();
+    pid_t pid = fork();
+    if (pid == 0) {
+        for (long i = 0; i < n; i++) {
+            memcpy(rec, &i, 8);
+            rt_ring_push_wait(r, rec, len);
+        }
+        _exit(0);
+    }
+    for (long i = 0; i < n; i++) {
+        long g = rt_ring_pop_wait(r, got, sizeof got);
+        long v;
+        memcpy(&v, got, 8);
+        if (g != (long)len || v != i) { fprintf(stderr, "ring: bad record %ld\n", i); return 1; }
+    }
+    waitpid(pid, NULL, 0);
+    double t_ring = now_sec() - t0;
+
+    int pfd[2];
+    if (pipe(pfd) != 0) { perror("pipe"); return 1; }
+    t0 = now_sec();
+    pid = fork();
+    if (pid == 0) {
+        close(pfd[0]);
+        for (long i = 0; i < n; i++) {
+            memcpy(rec, &i, 8);
+            if (write(pfd[1], rec, len) != (ssize_t)len) _exit(1);
+        }
+        _exit(0);
+    }
+    close(pfd[1]);
+    for (long i = 0; i < n; i++) {
+        size_t have = 0;
+        while (have < len) {
+            ssize_t k = read(pfd[0], got + have, len - have);
+            if (k <= 0) { fprintf(stderr, "pipe: short read\n"); return 1; }
+            have += (size_t)k;
+        }
+    }
+    waitpid(pid, NULL, 0);
+    double t_pipe = now_sec() - t0;
+
+    printf("%ld records of %u bytes\n", n, len);
+    printf("ring  %8.1f ns/record  %8.1f MB/s\n", t_ring * 1e9 / n, n * (double)len / t_ring / 1e6);
+    printf("pipe  %8.1f ns/record  %8.1f MB/s\n", t_pipe * 1e9 / n, n * (double)len / t_pipe / 1e6);
+    return 0;
+}
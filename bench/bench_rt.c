@@ -0,0 +1,199 @@
+// bench_rt.c - microbenchmarks for the COM64 runtime (sdk/rt)
+//
+//   gcc -O2 -I sdk -o bench_rt bench/bench_rt.c
+//   ./bench_rt
+//
+// Every memory/string routine is first checked against the C library at
+// many sizes and alignments, then timed per variant the CPU supports
+// (scalar, SSE2, AVX2) next to glibc. The formatters are timed against
+// snprintf.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../sdk/rt/rt_init.c"
+#include "../sdk/rt/rt_mem.c"
+#include "../sdk/rt/rt_fmt.c"
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static volatile uintptr_t g_sink;
+
+static void null_print(const char *s) { g_sink += (uintptr_t)s[0]; }
+static DosApi g_null_api = { .print = null_print };
+
+#define BUF (1u << 21)
+static char *g_a, *g_b;
+
+static const struct { const char *name; unsigned cpu; } g_variants[] = {
+    { "scalar", 0 },
+    { "sse2", RT_CPU_SSE2 },
+    { "avx2", RT_CPU_SSE2 | RT_CPU_AVX2 | RT_CPU_ERMS },
+};
+
+static void fail(const char *what, size_t n, size_t off) {
+    fprintf(stderr, "MISMATCH %s n=%zu off=%zu\n", what, n, off);
+    exit(1);
+}
+
+static void check_variant(void) {
+    static char ref[4096 + 64], out[4096 + 64];
+    for (size_t n = 0; n <= 600; n = n < 80 ? n + 1 : n + 37) {
+        for (size_t off = 0; off < 33; off += 3) {
+            for (size_t i = 0; i < sizeof ref; i++) ref[i] = out[i] = (char)(i * 7 + n);
+
+            memcpy(ref + off, g_a + 5, n);
+            rt_memcpy(out + off, g_a + 5, n);
+            if (memcmp(ref, out, sizeof ref)) fail("memcpy", n, off);
+
+            memmove(ref + off, ref + 40, n);
+            rt_memmove(out + off, out + 40, n);
+            if (memcmp(ref, out, sizeof ref)) fail("memmove down", n, off);
+            memmove(ref + 40, ref + off, n);
+            rt_memmove(out + 40, out + off, n);
+            if (memcmp(ref, out, sizeof ref)) fail("memmove up", n, off);
+
+            memset(ref + off, 0x5A, n);
+            rt_memset(out + off, 0x5A, n);
+            if (memcmp(ref, out, sizeof ref)) fail("memset", n, off);
+
+            memcpy(out, ref, sizeof ref);
+            if (n) out[off + n - 1] ^= 1;
+            int r1 = memcmp(ref + off, out + off, n), r2 = rt_memcmp(ref + off, out + off, n);
+            if ((r1 > 0) != (r2 > 0) || (r1 < 0) != (r2 < 0)) fail("memcmp", n, off);
+
+            ref[off + n] = 0x11;
+            if (memchr(ref + off, 0x11, n + 1) != rt_memchr(ref + off, 0x11, n + 1)) fail("memchr", n, off);
+
+            memset(ref, 'a', sizeof ref);
+            ref[off + n] = 0;
+            if (strlen(ref + off) != rt_strlen(ref + off)) fail("strlen", n, off);
+        }
+    }
+}
+
+typedef void (*op_fn)(size_t n);
+
+static void op_memcpy(size_t n)  { g_sink += (uintptr_t)rt_memcpy(g_b, g_a, n); }
+static void op_memmove(size_t n) { g_sink += (uintptr_t)rt_memmove(g_a + 1, g_a, n); }
+static void op_memset(size_t n)  { g_sink += (uintptr_t)rt_memset(g_b, 2, n); }
+static void op_memcmp(size_t n)  { g_sink += (uintptr_t)rt_memcmp(g_b, g_a, n); }
+static void op_memchr(size_t n)  { g_sink += (uintptr_t)rt_memchr(g_a, 1, n); }
+static void op_strlen(size_t n)  { g_a[n] = 0; g_sink += rt_strlen(g_a); g_a[n] = 2; }
+
+static void lc_memcpy(size_t n)  { g_sink += (uintptr_t)memcpy(g_b, g_a, n); }
+static void lc_memmove(size_t n) { g_sink += (uintptr_t)memmove(g_a + 1, g_a, n); }
+static void lc_memset(size_t n)  { g_sink += (uintptr_t)memset(g_b, 2, n); }
+static void lc_memcmp(size_t n)  { g_sink += (uintptr_t)memcmp(g_b, g_a, n); }
+static void lc_memchr(size_t n)  { g_sink += (uintptr_t)memchr(g_a, 1, n); }
+static void lc_strlen(size_t n)  { g_a[n] = 0; g_sink += strlen(g_a); g_a[n] = 2; }
+
+static const struct { const char *name; op_fn rt, libc; } g_ops[] = {
+    { "memcpy", op_memcpy, lc_memcpy },
+    { "memmove", op_memmove, lc_memmove },
+    { "memset", op_memset, lc_memset },
+    { "memcmp", op_memcmp, lc_memcmp },
+    { "memchr", op_memchr, lc_memchr },
+    { "strlen", op_strlen, lc_strlen },
+};
+
+// GB/s over enough calls to run ~20 ms
+static double gbps(op_fn fn, size_t n) {
+    size_t reps = (size_t)(2e7 / (double)(n + 64)) + 1;
+    double t0 = now_ns();
+    for (size_t r = 0; r < reps; r++) fn(n);
+    return (double)n * (double)reps / (now_ns() - t0);
+}
+
+int main(void) {
+    g_a = aligned_alloc(64, BUF + 64);
+    g_b = aligned_alloc(64, BUF + 64);
+    if (!g_a || !g_b) return 1;
+    for (size_t i = 0; i < BUF + 64; i++) g_a[i] = g_b[i] = 2; // no 0s or 1s: full-length scans
+
+    rt_init(NULL);
+    unsigned have = rt_cpu;
+    printf("cpu features: %s%s%s\n", have & RT_CPU_SSE2 ? "sse2 " : "",
+           have & RT_CPU_AVX2 ? "avx2 " : "", have & RT_CPU_ERMS ? "erms" : "");
+
+    static const size_t sizes[] = { 16, 64, 256, 4096, 65536, 1u << 20 };
+    for (size_t v = 0; v < sizeof g_variants / sizeof g_variants[0]; v++) {
+        if ((g_variants[v].cpu & have) != g_variants[v].cpu) continue;
+        rt_cpu = g_variants[v].cpu;
+        rt_mem_select(rt_cpu);
+        check_variant();
+    }
+    printf("all variants match libc\n\n");
+
+    printf("%-8s %-7s", "GB/s", "");
+    for (size_t s = 0; s < sizeof sizes / sizeof sizes[0]; s++) printf(" %9zu", sizes[s]);
+    printf("\n");
+
+    for (size_t o = 0; o < sizeof g_ops / sizeof g_ops[0]; o++) {
+        for (size_t v = 0; v <= sizeof g_variants / sizeof g_variants[0]; v++) {
+            int libc = (v == sizeof g_variants / sizeof g_variants[0]);
+            if (!libc) {
+                if ((g_variants[v].cpu & have) != g_variants[v].cpu) continue;
+                rt_cpu = g_variants[v].cpu;
+                rt_mem_select(rt_cpu);
+            }
+            printf("%-8s %-7s", v ? "" : g_ops[o].name, libc ? "glibc" : g_variants[v].name);
+            for (size_t s = 0; s < sizeof sizes / sizeof sizes[0]; s++)
+                printf(" %9.2f", gbps(libc ? g_ops[o].libc : g_ops[o].rt, sizes[s]));
+            printf("\n");
+        }
+    }
+
+    // Formatting: the widest outputs, and RtOut never writing past its buffer
+    static const struct { double v; int prec; const char *want; } fmt_cases[] = {
+        { -18000000000000000000.0, 15, "-18000000000000000000.000000000000000" },
+        { -18446744073709549568.0, 15, "-18446744073709549568.000000000000000" },
+        { 1e300, 15, "1.000000000000000e+300" },
+        { -1.7976931348623157e308, 15, "-1.797693134862316e+308" },
+        { 1.8446744073709552e19, 6, "1.844674e+19" },
+        { 0.5, 0, "1" },
+    };
+    for (size_t i = 0; i < sizeof fmt_cases / sizeof fmt_cases[0]; i++) {
+        char out[RT_FMT_MAX + 1];
+        size_t n = rt_fmt_f64(out, fmt_cases[i].v, fmt_cases[i].prec);
+        if (n > RT_FMT_MAX || n != strlen(fmt_cases[i].want) || memcmp(out, fmt_cases[i].want, n) != 0) {
+            fprintf(stderr, "MISMATCH rt_fmt_f64: \"%.*s\", want \"%s\"\n", (int)n, out, fmt_cases[i].want);
+            return 1;
+        }
+    }
+    static struct { RtOut o; char guard[64]; } fo;
+    memset(fo.guard, 0x5A, sizeof fo.guard);
+    rt_out_init(&fo.o, &g_null_api);
+    for (int i = 0; i < 1000; i++) {
+        rt_out_str(&fo.o, "x"); // every fill level
+        rt_out_f64(&fo.o, -18000000000000000000.0, 15);
+    }
+    for (size_t i = 0; i < sizeof fo.guard; i++)
+        if (fo.guard[i] != 0x5A) { fprintf(stderr, "RtOut wrote past its buffer\n"); return 1; }
+
+    // Formatting: ns per number
+    char buf[64];
+    const int N = 2000000;
+    double t0 = now_ns();
+    for (int i = 0; i < N; i++) g_sink += rt_fmt_u64(buf, (uint64_t)i * 2654435761u);
+    double t_u = (now_ns() - t0) / N;
+    t0 = now_ns();
+    for (int i = 0; i < N; i++) g_sink += (uintptr_t)snprintf(buf, sizeof buf, "%llu", (unsigned long long)i * 2654435761u);
+    double t_us = (now_ns() - t0) / N;
+    t0 = now_ns();
+    for (int i = 0; i < N; i++) g_sink += rt_fmt_f64(buf, i * 0.37 - 1e5, 6);
+    double t_f = (now_ns() - t0) / N;
+    t0 = now_ns();
+    for (int i = 0; i < N; i++) g_sink += (uintptr_t)snprintf(buf, sizeof buf, "%.6f", i * 0.37 - 1e5);
+    double t_fs = (now_ns() - t0) / N;
+
+    printf("\nns/call            rt   snprintf\n");
+    printf("u64           %6.1f     %6.1f\n", t_u, t_us);
+    printf("f64 %%.6f      %6.1f     %6.1f\n", t_f, t_fs);
+    return 0;
+}
@@ -0,0 +1,87 @@
+// bench_screen.c - bytes per frame for the diff-based text screen
+//
+//   gcc -O2 -pthread -o bench_screen bench/bench_screen.c
+//   ./bench_screen > /dev/null     (results go to stderr)
+//
+// Each scenario draws the same frames twice: once through scr_present()
+// and once as a naive full repaint (home, then every cell with its SGR),
+// which is what a tool without a screen model has to send.
+#define main init_shell_main
+#include "../init/init_shell.c"
+#undef main
+
+#define COLS 80
+#define ROWS 25
+#define FRAMES 200
+
+static unsigned naive_frame_bytes(void) {
+    unsigned bytes = 3; // ESC [ H
+    int last = -1;
+    for (int i = 0; i < COLS * ROWS; i++) {
+        int a = g_scr.back[i].attr;
+        if (a != last) {
+            char seq[24];
+            bytes += (unsigned)snprintf(seq, sizeof seq, "\033[%d;%dm",
+                                        ansi_bg_code(a >> 4), ansi_fg_code(a & 15));
+            last = a;
+        }
+        bytes++;
+    }
+    return bytes;
+}
+
+static void draw_text_view(int top) {
+    char line[COLS + 1];
+    for (int y = 0; y < ROWS - 1; y++) {
+        snprintf(line, sizeof line, "%6d  The quick brown fox jumps over the lazy dog, line %d", top + y, top + y);
+        scr_fill(0, y, COLS, 1, ' ', 0x17);
+        scr_text(0, y, line, 0x17);
+    }
+}
+
+static void draw_status(int n) {
+    char st[COLS + 1];
+    snprintf(st, sizeof st, " EDIT  Ln %-6d Col %-4d  F1=Help", n, n % 80 + 1);
+    scr_fill(0, ROWS - 1, COLS, 1, ' ', 0x70);
+    scr_text(0, ROWS - 1, st, 0x70);
+}
+
+static void run(const char *name, void (*frame)(int)) {
+    scr_open_size(COLS, ROWS);
+    frame(0);
+    unsigned first = scr_present();
+
+    unsigned long long diff = 0, naive = 0;
+    for (int i = 1; i <= FRAMES; i++) {
+        frame(i);
+        naive += naive_frame_bytes();
+        diff += scr_present();
+    }
+    fprintf(stderr, "%-12s first %6u  diff %8.1f  naive %8.1f  bytes/frame\n",
+            name, first, (double)diff / FRAMES, (double)naive / FRAMES);
+    scr_release();
+}
+
+static void frame_typing(int i) {
+    if (i == 0) draw_text_view(1);
+    scr_put(8 + i % 60, 5, 'a' + i % 26, 0x17);
+    scr_cursor(9 + i % 60, 5);
+    draw_status(i);
+}
+
+static void frame_scroll(int i) {
+    draw_text_view(1 + i);
+    draw_status(i);
+}
+
+static void frame_idle(int i) {
+    if (i == 0) draw_text_view(1);
+    draw_status(0);
+}
+
+int main(void) {
+    run("typing", frame_typing);
+    run("scroll", frame_scroll);
+    run("idle", frame_idle);
+    return 0;
+}
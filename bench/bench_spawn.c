@@ -0,0 +1,71 @@
+// bench_spawn.c - launch latency of native programs while PID 1 holds a big cache
+//
+//   gcc -O2 -pthread -o bench_spawn bench/bench_spawn.c
+//   ./bench_spawn [cache_MiB] [runs] [program]
+//
+// Compares spawn_native() (posix_spawn, CLONE_VM|CLONE_VFORK underneath)
+// with the classic fork()+execv(). fork() has to copy the page tables of
+// everything the parent has mapped, so its cost grows with the cache;
+// the spawn path should stay flat.
+#define main init_shell_main
+#include "../init/init_shell.c"
+#undef main
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void wait_child(pid_t pid) {
+    int st;
+    if (pid < 0 || waitpid(pid, &st, 0) != pid || !WIFEXITED(st)) {
+        fprintf(stderr, "launch failed\n");
+        exit(1);
+    }
+}
+
+static pid_t launch_fork(const char *path, const char **argv) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        execv(path, (char *const *)argv);
+        _exit(127);
+    }
+    return pid;
+}
+
+static pid_t launch_spawn(const char *path, const char **argv) {
+    return spawn_native(path, argv, 0);
+}
+
+static double per_launch_us(pid_t (*launch)(const char *, const char **), const char *path, int runs) {
+    const char *argv[] = { path, NULL };
+    wait_child(launch(path, argv)); // warm the binary into the page cache
+
+    double t0 = now_sec();
+    for (int i = 0; i < runs; i++) wait_child(launch(path, argv));
+    return (now_sec() - t0) / runs * 1e6;
+}
+
+int main(int argc, char **argv) {
+    size_t mib = (argc > 1) ? (size_t)strtoul(argv[1], NULL, 0) : 1024;
+    int runs = (argc > 2) ? atoi(argv[2]) : 200;
+    const char *prog = (argc > 3) ? argv[3] : "/bin/true";
+
+    ev_block_signals();
+
+    printf("%-10s %10s %12s %12s\n", "cache MiB", "runs", "fork+exec", "posix_spawn");
+    for (size_t m = 0; m <= mib; m = m ? m * 4 : 64) {
+        // Touch every page so it is really mapped, like a warm cache would be
+        size_t bytes = m << 20;
+        uint8_t *cache = bytes ? malloc(bytes) : NULL;
+        if (bytes && !cache) { perror("malloc"); return 1; }
+        for (size_t i = 0; i < bytes; i += 4096) cache[i] = (uint8_t)i;
+
+        double f = per_launch_us(launch_fork, prog, runs);
+        double s = per_launch_us(launch_spawn, prog, runs);
+        printf("%-10zu %10d %10.1fus %10.1fus\n", m, runs, f, s);
+        free(cache);
+    }
+    return 0;
+}
@@ -0,0 +1,184 @@
+// bench_suite.c - times builtins and program launches against a synthetic C: tree
+//
+//   gcc -O2 -pthread -o bench_suite bench/bench_suite.c
+//   ./bench_suite [--json] [--runs N] [--dir DIR] [--tag LABEL] > results.csv
+//
+// The shell runs in host mode with C: moved to a scratch directory under
+// DIR (default /tmp). Each benchmark is a command line fed to run_command()
+// exactly as typed at the prompt; command output goes to /dev/null and only
+// the results reach stdout, one row per benchmark, so runs can be diffed or
+// loaded into a spreadsheet for regression tracking. bench/run_suite.sh
+// builds this and files the result under the current git revision.
+#define main init_shell_main
+#include "../init/init_shell.c"
+#undef main
+
+#define FILES_N   1000
+#define BIG_TXT   (4u << 20)
+#define BIG_DAT   (64u << 20)
+
+typedef struct Bench {
+    const char *name;
+    const char *cmd;
+    int         reps;                // iterations per --runs unit
+    void      (*setup)(void);        // before every iteration, untimed
+} Bench;
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+static void put_file(const char *name, const void *p, size_t n) {
+    int fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0755);
+    if (fd < 0 || write(fd, p, n) != (ssize_t)n) { perror(name); exit(1); }
+    close(fd);
+}
+
+static void make_files(const char *dir, int n) {
+    mkdir(dir, 0755);
+    char name[PATH_MAX], body[256];
+    for (int i = 0; i < n; i++) {
+        snprintf(name, sizeof name, "%s/F%04d.TXT", dir, i);
+        int len = snprintf(body, sizeof body, "file %d of %d\n", i, n);
+        put_file(name, body, (size_t)len);
+    }
+}
+
+static void setup_delme(void) { make_files("DELME", FILES_N); }
+static void setup_copy(void)  { unlink("COPY.DAT"); }
+
+static void build_tree(void) {
+    make_files("FILES", FILES_N);
+
+    char *buf = malloc(BIG_DAT);
+    if (!buf) { perror("malloc"); exit(1); }
+
+    size_t j = 0;
+    for (int line = 0; j + 80 < BIG_TXT; line++)
+        j += (size_t)snprintf(buf + j, 80, "%08d The quick brown fox jumps over the lazy dog.\n", line);
+    put_file("BIG.TXT", buf, j);
+
+    uint64_t x = 0x9E3779B97F4A7C15ull;
+    for (size_t i = 0; i < BIG_DAT; i += 8) {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        memcpy(buf + i, &x, 8);
+    }
+    put_file("BIG.DAT", buf, BIG_DAT);
+    free(buf);
+
+    // Smallest possible COM64: xor eax,eax; ret
+    uint8_t img[sizeof(Com64Hdr) + 3] = {0};
+    Com64Hdr *h = (Com64Hdr *)img;
+    memcpy(h->magic, "64DOSCOM", 8);
+    h->header_size = 64; // what the loader expects, though the struct is 56 bytes
+    memcpy(img + sizeof(Com64Hdr), "\x31\xc0\xc3", 3);
+    put_file("NOP.COM64", img, sizeof img);
+
+    // The same image as the only member of C:\COM64.LIB, named LNOP
+    static uint8_t lib[2 * COM64_LIB_ALIGN];
+    Com64LibHdr *lh = (Com64LibHdr *)lib;
+    Com64LibEntry *le = (Com64LibEntry *)(lib + sizeof *lh);
+    memcpy(lh->magic, "64DOSLIB", 8);
+    lh->version = 1;
+    lh->count = 1;
+    lh->index_off = sizeof *lh;
+    memcpy(le->name, "LNOP", 4);
+    le->offset = COM64_LIB_ALIGN - sizeof(Com64Hdr);
+    le->size = sizeof img;
+    memcpy(lib + le->offset, img, sizeof img);
+    put_file(COM64_LIB_NAME, lib, (size_t)(le->offset + le->size));
+
+    // Any native executable will do for the ELF launch path
+    int in = open("/bin/true", O_RDONLY);
+    int out = open("TRUE", O_WRONLY | O_CREAT | O_TRUNC, 0755);
+    if (in >= 0 && out >= 0) (void)copy_fd(in, out, NULL);
+    if (in >= 0) close(in);
+    if (out >= 0) close(out);
+}
+
+static const Bench g_benches[] = {
+    { "dir",          "DIR FILES",             5,  NULL },
+    { "dir_wild",     "DIR FILES\\F00*.TXT",   20, NULL },
+    { "type_4m",      "TYPE BIG.TXT",          1,  NULL },
+    { "copy_64m",     "COPY BIG.DAT COPY.DAT", 1,  setup_copy },
+    { "copy_v_64m",   "COPY /V BIG.DAT COPY.DAT", 1, setup_copy },
+    { "del_1k",       "DEL DELME\\*.TXT",      1,  setup_delme },
+    { "com64_launch", "NOP",                   50, NULL },
+    { "com64_lib",    "LNOP",                  50, NULL },
+    { "elf_launch",   "TRUE",                  50, NULL },
+};
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv) {
+    int json = 0, runs = 5;
+    const char *dir = "/tmp", *tag = "local";
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--json")) json = 1;
+        else if (!strcmp(argv[i], "--runs") && i + 1 < argc) runs = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--dir") && i + 1 < argc) dir = argv[++i];
+        else if (!strcmp(argv[i], "--tag") && i + 1 < argc) tag = argv[++i];
+        else { fprintf(stderr, "usage: %s [--json] [--runs N] [--dir DIR] [--tag LABEL]\n", argv[0]); return 2; }
+    }
+    if (runs < 1) runs = 1;
+
+    snprintf(g_c_root, sizeof g_c_root, "%s/64dos-bench.XXXXXX", dir);
+    if (!mkdtemp(g_c_root) || chdir(g_c_root) != 0) { perror(g_c_root); return 1; }
+    g_host = 1;
+    ev_block_signals();
+    build_tree();
+    lib_refresh();
+
+    // Results keep the real stdout; everything the shell prints is discarded
+    FILE *res = fdopen(dup(1), "w");
+    int nul = open("/dev/null", O_WRONLY);
+    if (!res || nul < 0) { perror("stdout"); return 1; }
+    dup2(nul, 1);
+    close(nul);
+
+    if (json) fprintf(res, "{\"tag\":\"%s\",\"results\":[", tag);
+    else fprintf(res, "tag,bench,iterations,min_us,median_us,mean_us,max_us\n");
+
+    size_t nb = sizeof g_benches / sizeof g_benches[0];
+    for (size_t b = 0; b < nb; b++) {
+        const Bench *bn = &g_benches[b];
+        if (!strcmp(bn->cmd, "TRUE") && !file_exists_regular("TRUE")) continue;
+
+        int iters = bn->reps * runs;
+        double *t = malloc(sizeof *t * (size_t)iters), sum = 0;
+        if (!t) return 1;
+
+        char line[256];
+        for (int i = -1; i < iters; i++) { // i == -1 warms caches, untimed
+            if (bn->setup) bn->setup();
+            snprintf(line, sizeof line, "%s", bn->cmd); // run_command edits its input
+            double t0 = now_us();
+            run_command(line);
+            con_flush();
+            if (i >= 0) sum += (t[i] = now_us() - t0);
+        }
+        qsort(t, (size_t)iters, sizeof *t, cmp_double);
+
+        if (json)
+            fprintf(res, "%s\n {\"bench\":\"%s\",\"iterations\":%d,"
+                         "\"min_us\":%.1f,\"median_us\":%.1f,\"mean_us\":%.1f,\"max_us\":%.1f}",
+                    b ? "," : "", bn->name, iters, t[0], t[iters / 2], sum / iters, t[iters - 1]);
+        else
+            fprintf(res, "%s,%s,%d,%.1f,%.1f,%.1f,%.1f\n", tag, bn->name, iters,
+                    t[0], t[iters / 2], sum / iters, t[iters - 1]);
+        fflush(res);
+        free(t);
+    }
+    if (json) fprintf(res, "\n]}\n");
+    fclose(res);
+
+    // Clean up the scratch C: tree
+    char rm[PATH_MAX + 16];
+    snprintf(rm, sizeof rm, "rm -rf '%s'", g_c_root);
+    return system(rm) == 0 ? 0 : 1;
+}
@@ -0,0 +1,28 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+# run_suite.sh
+# Build the host benchmark suite and record one run, named after the current
+# git revision, so results from different commits can be compared:
+#
+#   bench/run_suite.sh [--runs N] [--dir DIR]
+#   -> .build/bench/suite-<rev>.json
+
+HERE="$(cd "$(dirname "$0")/.." && pwd)"
+OUT_DIR="${OUT_DIR:-$HERE/.build/bench}"
+CFLAGS="${CFLAGS:--O2 -Wall -Wno-format-truncation}"
+
+mkdir -p "$OUT_DIR"
+
+TAG="$(git -C "$HERE" rev-parse --short HEAD 2>/dev/null || echo local)"
+if ! git -C "$HERE" diff --quiet 2>/dev/null; then
+  TAG="$TAG-dirty"
+fi
+
+echo "  building bench_suite..."
+# shellcheck disable=SC2086
+gcc $CFLAGS -pthread -o "$OUT_DIR/bench_suite" "$HERE/bench/bench_suite.c"
+
+OUT="$OUT_DIR/suite-$TAG.json"
+"$OUT_DIR/bench_suite" --json --tag "$TAG" "$@" > "$OUT"
+echo "  results: $OUT"
@@ -0,0 +1,133 @@
+// PARSUM.c - parallel checksum, a sample for the DosApi task pool
+//
+//   PARSUM [MiB]
+//
+// Fills a buffer from the arena (256 MiB unless told otherwise), then
+// checksums it in 1 MiB chunks twice: on the program's thread alone and
+// spread over every worker. Chunk sums are folded in chunk order, so both
+// runs must print the same checksum; the times show how far it scales.
+#include "rt.h"
+
+#define CHUNK (1u << 20)
+#define K1    0x9E3779B97F4A7C15ull
+#define K2    0xC2B2AE3D27D4EB4Full
+
+typedef struct Job {
+    uint64_t* p;
+    size_t    words;
+    uint64_t  seed;
+    uint64_t  sum;
+} Job;
+
+static uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// Four independent lanes, so the multiplies overlap
+static uint64_t chunk_sum(const uint64_t* p, size_t n) {
+    uint64_t a = K1, b = K2, c = ~K1, d = ~K2;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        a = rotl(a ^ p[i + 0], 31) * K1;
+        b = rotl(b ^ p[i + 1], 31) * K1;
+        c = rotl(c ^ p[i + 2], 31) * K1;
+        d = rotl(d ^ p[i + 3], 31) * K1;
+    }
+    for (; i < n; i++) a = rotl(a ^ p[i], 31) * K1;
+    return a ^ rotl(b, 17) ^ rotl(c, 29) ^ rotl(d, 43);
+}
+
+static void fill_task(void* arg) {
+    Job* j = arg;
+    uint64_t x = j->seed * K2 + 1;
+    for (size_t i = 0; i < j->words; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        j->p[i] = x;
+    }
+}
+
+static void sum_task(void* arg) {
+    Job* j = arg;
+    j->sum = chunk_sum(j->p, j->words);
+}
+
+static uint64_t fold(const Job* jobs, size_t n) {
+    uint64_t h = 0;
+    for (size_t i = 0; i < n; i++) h = rotl(h ^ jobs[i].sum, 27) * K2;
+    return h;
+}
+
+static uint64_t parse_u64(const char* s) {
+    uint64_t v = 0;
+    for (; *s >= '0' && *s <= '9'; s++) v = v * 10 + (uint64_t)(*s - '0');
+    return *s ? 0 : v;
+}
+
+static void out_line(RtOut* o, const char* what, int threads, uint64_t ns, uint64_t bytes) {
+    rt_out_str(o, what);
+    rt_out_u64(o, (uint64_t)threads);
+    rt_out_str(o, threads == 1 ? " thread   " : " threads  ");
+    rt_out_f64(o, (double)ns / 1e6, 1);
+    rt_out_str(o, " ms  ");
+    rt_out_f64(o, (double)bytes / (double)(ns ? ns : 1), 2);
+    rt_out_str(o, " GB/s\n");
+}
+
+int com64_main(DosApi* api, int argc, const char** argv) {
+    RtOut o;
+    rt_out_init(&o, api);
+
+    uint64_t mib = 256;
+    if (argc > 1) {
+        if ((argv[1][0] == '/' && argv[1][1] == '?') || !(mib = parse_u64(argv[1]))) {
+            rt_out_str(&o, "PARSUM [MiB]\n  Checksums MiB megabytes (default 256) on one thread, then on every worker.\n");
+            rt_out_flush(&o);
+            return argv[1][0] == '/' ? 0 : 1;
+        }
+    }
+
+    size_t n = (size_t)mib;
+    uint64_t* buf = api->arena_alloc(n * CHUNK);
+    Job* jobs = api->arena_alloc(n * sizeof(Job));
+    if (!buf || !jobs) {
+        rt_out_str(&o, "Insufficient memory\n");
+        rt_out_flush(&o);
+        return 1;
+    }
+
+    int workers = api->task_workers();
+    DosTaskGroup g = {0};
+    for (size_t i = 0; i < n; i++) {
+        jobs[i].p = buf + i * (CHUNK / 8);
+        jobs[i].words = CHUNK / 8;
+        jobs[i].seed = i;
+        api->task_spawn(&g, fill_task, &jobs[i]);
+    }
+    api->task_wait(&g);
+
+    uint64_t t0 = rt_clock_ns();
+    for (size_t i = 0; i < n; i++) sum_task(&jobs[i]);
+    uint64_t t_one = rt_clock_ns() - t0;
+    uint64_t one = fold(jobs, n);
+
+    for (size_t i = 0; i < n; i++) jobs[i].sum = 0;
+    t0 = rt_clock_ns();
+    for (size_t i = 0; i < n; i++) api->task_spawn(&g, sum_task, &jobs[i]);
+    api->task_wait(&g);
+    uint64_t t_all = rt_clock_ns() - t0;
+    uint64_t all = fold(jobs, n);
+
+    rt_out_u64(&o, mib);
+    rt_out_str(&o, " MiB, checksum ");
+    rt_out_hex(&o, all, 16);
+    rt_out_str(&o, all == one ? "\n" : " MISMATCH\n");
+    out_line(&o, "  ", 1, t_one, n * CHUNK);
+    out_line(&o, "  ", workers, t_all, n * CHUNK);
+    rt_out_str(&o, "  speed-up ");
+    rt_out_f64(&o, (double)t_one / (double)(t_all ? t_all : 1), 2);
+    rt_out_str(&o, "x\n");
+    rt_out_flush(&o);
+    return all == one ? 0 : 1;
+}
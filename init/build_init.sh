@@ -28,9 +28,13 @@ DOS_C_SRC="${DOS_C_SRC:-$HERE/dos_c}"
 
 # COM64 inputs
 COM64_SRC_DIR="${COM64_SRC_DIR:-$HERE/com64}"        # *.S and *.c live here
+SDK_DIR="${SDK_DIR:-$HERE/sdk}"                       # dosapi.h for COM64 programs
+RT_DIR="${RT_DIR:-$SDK_DIR/rt}"                       # runtime linked into every COM64
 TOOLS_DIR="${TOOLS_DIR:-$HERE/tools}"
 MKCOM64_C="${MKCOM64_C:-$TOOLS_DIR/mkcom64.c}"
 MKCOM64_BIN="${MKCOM64_BIN:-$BUILD_DIR/mkcom64}"
+MKCOM64_FLAGS="${MKCOM64_FLAGS:-}"                   # -z: LZ4-compress payloads
+COM64_LIB="${COM64_LIB:-0}"                          # 1: pack built programs into C:\COM64.LIB
 
 ROOTFS_IMG="${ROOTFS_IMG:-$IMAGES_DIR/rootfs.ext2}"
 
@@ -42,6 +46,7 @@ ROOTFS_DEVICE="${ROOTFS_DEVICE:-0}"
 need() { command -v "$1" >/dev/null 2>&1 || { echo "Missing: $1"; exit 1; }; }
 need gcc
 need ld
+need objcopy
 need VBoxManage
 need sudo
 
@@ -57,18 +62,49 @@ build_mkcom64() {
   gcc -O2 -s -o "$MKCOM64_BIN" "$MKCOM64_C"
 }
 
+# COM64 code is loaded anywhere and never relocated: it must be PIE
+COM64_CFLAGS=(-O2 -ffreestanding -fpie -nostdlib -fno-stack-protector
+              -fno-asynchronous-unwind-tables -fno-unwind-tables
+              -ffunction-sections -fdata-sections -I "$SDK_DIR" -I "$RT_DIR")
+
+# Runtime objects, built once per run; crt0.o must be linked first
+build_com64_rt() {
+  local rt_out="$BUILD_DIR/rt"
+  mkdir -p "$rt_out"
+  RT_OBJS=()
+
+  echo "  COM64 runtime"
+  gcc -c -o "$rt_out/crt0.o" "$RT_DIR/crt0.S"
+  for src in "$RT_DIR"/rt_*.c; do
+    local obj
+    obj="$rt_out/$(basename "$src" .c).o"
+    gcc -c "${COM64_CFLAGS[@]}" -fno-builtin -o "$obj" "$src"
+    RT_OBJS+=("$obj")
+  done
+}
+
 # Build one COM64 from an object file
 wrap_obj_to_com64() {
   local base="$1"
   local obj="$2"
+  local elf="$BUILD_DIR/${base}.elf"
   local bin="$BUILD_DIR/${base}.bin"
   local out="$DOS_C_SRC/${base}.COM64"
+  BUILT_COM64+=("$out")
+
+  # One flat image based at 0: crt0 (entry_rva 0), the program, the runtime
+  ld -nostdlib --gc-sections -T "$RT_DIR/com64.ld" -o "$elf" \
+     "$BUILD_DIR/rt/crt0.o" "$obj" "${RT_OBJS[@]}"
+  objcopy -O binary "$elf" "$bin"
 
-  # Link as a flat binary image with entry com64_main
-  ld -nostdlib -e com64_main -Ttext=0x0 --oformat=binary -o "$bin" "$obj"
+  # .bss is not in the flat file; the loader zeroes bss_size bytes after it
+  local bss_end size bss
+  bss_end=$((16#$(nm "$elf" | awk '$3 == "__bss_end" { print $1 }')))
+  size=$(stat -c %s "$bin")
+  bss=$(( bss_end > size ? bss_end - size : 0 ))
 
-  # Wrap with COM64 header (entry_rva=0, bss_size=0 for now)
-  "$MKCOM64_BIN" "$bin" "$out" 0 0
+  # shellcheck disable=SC2086
+  "$MKCOM64_BIN" $MKCOM64_FLAGS "$bin" "$out" 0 "$bss"
 }
 
 build_com64_programs() {
@@ -77,6 +113,8 @@ build_com64_programs() {
     build_mkcom64
   fi
 
+  build_com64_rt
+
   shopt -s nullglob
   local any=0
 
@@ -88,9 +126,7 @@ build_com64_programs() {
     obj="$BUILD_DIR/${base}.o"
 
     echo "  COM64 (C): $base"
-    gcc -c -O2 -ffreestanding -fno-pic -fno-pie -nostdlib \
-        -fno-asynchronous-unwind-tables -fno-unwind-tables \
-        -o "$obj" "$src"
+    gcc -c "${COM64_CFLAGS[@]}" -o "$obj" "$src"
 
     wrap_obj_to_com64 "$base" "$obj"
   done
@@ -103,7 +139,7 @@ build_com64_programs() {
     obj="$BUILD_DIR/${base}.o"
 
     echo "  COM64 (ASM): $base"
-    gcc -c -nostdlib -fno-pic -fno-pie -o "$obj" "$src"
+    gcc -c -nostdlib -fpie -o "$obj" "$src"
 
     wrap_obj_to_com64 "$base" "$obj"
   done
@@ -113,10 +149,20 @@ build_com64_programs() {
   if [[ "$any" -eq 0 ]]; then
     echo "  (no COM64 sources found in $COM64_SRC_DIR)"
   fi
+
+  # One library instead of one file per program
+  if [[ "$COM64_LIB" == "1" && "${#BUILT_COM64[@]}" -gt 0 ]]; then
+    echo "  COM64.LIB: ${#BUILT_COM64[@]} program(s)"
+    "$MKCOM64_BIN" -l "$DOS_C_SRC/COM64.LIB" "${BUILT_COM64[@]}"
+    rm -f "${BUILT_COM64[@]}"
+  fi
 }
 
+BUILT_COM64=()
+RT_OBJS=()
+
 echo "[1/6] Build init binary..."
-gcc -Os -static -s -o "$INIT_OUT" "$C_FILE"
+gcc -Os -static -s -pthread -o "$INIT_OUT" "$C_FILE"
 
 echo "[2/6] Build COM64 programs into dos_c/ ..."
 build_com64_programs
@@ -5,41 +5,159 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <linux/fiemap.h>
+#include <linux/futex.h>
+#include <linux/perf_event.h>
+#include <poll.h>
+#include <pthread.h>
+#include <setjmp.h>
 #include <signal.h>
+#include <spawn.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <sys/mman.h>
 #include <sys/mount.h>
+#include <sys/ioctl.h>
 #include <sys/reboot.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
 #include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <sys/wait.h>
 #include <termios.h>
 #include <time.h>
 #include <unistd.h>
 
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+/* Where C: lives. Override at build time with -DDOS_C_ROOT=... or at run
+   time with --root DIR (see main). */
+#ifndef DOS_C_ROOT
 #define DOS_C_ROOT "/dos/c"
+#endif
+
+static char g_c_root[PATH_MAX] = DOS_C_ROOT;
+static int  g_host = 0;   // not PID 1: no mounts, POWEROFF just exits
+static int  g_script = 0; // commands come from a file: echo them
 
-static volatile sig_atomic_t g_got_sigchld = 0;
 static int g_echo_on = 1;
 
 static int g_fg = 7; // DOS-ish default: light gray
 static int g_bg = 0; // DOS-ish default: black
 
-static void on_sigchld(int sig) {
-    (void)sig;
-    g_got_sigchld = 1;
+/* --- event sources ---
+   PID 1 sleeps in poll() on the console, a signalfd for SIGCHLD and a
+   periodic timerfd. Children are reaped the moment they exit instead of
+   when the next line is typed, and tick hooks run while the console is
+   idle. SIGCHLD stays blocked in PID 1 (signalfd needs that); forked
+   children restore the original mask with ev_child_unblock(). */
+
+#define EV_TICK_MS         500
+#define EV_MAX_TICK_HOOKS  16
+#define EV_MAX_CHILD_WATCH 64
+
+typedef void (*ev_tick_fn)(void);
+typedef void (*ev_child_fn)(pid_t pid, int status, void *ctx);
+
+typedef struct EvChildWatch {
+    pid_t       pid;
+    ev_child_fn fn;
+    void       *ctx;
+} EvChildWatch;
+
+static sigset_t     g_sigmask_orig;
+static int          g_sigfd = -1;
+static int          g_timerfd = -1;
+static ev_tick_fn   g_tick_hooks[EV_MAX_TICK_HOOKS];
+static int          g_tick_n = 0;
+static EvChildWatch g_child_watch[EV_MAX_CHILD_WATCH];
+
+/* Must run before any thread exists, so every thread inherits the mask */
+static void ev_block_signals(void) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &set, &g_sigmask_orig);
+}
+
+static void ev_child_unblock(void) {
+    sigprocmask(SIG_SETMASK, &g_sigmask_orig, NULL);
+}
+
+static void ev_init(void) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGCHLD);
+    g_sigfd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    g_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (g_timerfd >= 0) {
+        struct itimerspec its;
+        memset(&its, 0, sizeof its);
+        its.it_interval.tv_sec = EV_TICK_MS / 1000;
+        its.it_interval.tv_nsec = (long)(EV_TICK_MS % 1000) * 1000000L;
+        its.it_value = its.it_interval;
+        (void)timerfd_settime(g_timerfd, 0, &its, NULL);
+    }
 }
 
-static void reap_children_nonblock(void) {
-    int status;
-    pid_t p;
+static void ev_on_tick(ev_tick_fn fn) {
+    if (g_tick_n < EV_MAX_TICK_HOOKS) g_tick_hooks[g_tick_n++] = fn;
+}
+
+/* Ask to be told when a background child exits. Returns -1 if the table is full. */
+static int ev_watch_child(pid_t pid, ev_child_fn fn, void *ctx) {
+    for (int i = 0; i < EV_MAX_CHILD_WATCH; i++) {
+        if (g_child_watch[i].pid) continue;
+        g_child_watch[i].pid = pid;
+        g_child_watch[i].fn = fn;
+        g_child_watch[i].ctx = ctx;
+        return 0;
+    }
+    return -1;
+}
+
+/* Drain the signalfd and reap everything that has exited, including
+   orphans re-parented to PID 1. */
+static void ev_reap_children(void) {
+    if (g_sigfd >= 0) {
+        struct signalfd_siginfo si;
+        while (read(g_sigfd, &si, sizeof si) == (ssize_t)sizeof si) { }
+    }
+
     for (;;) {
-        p = waitpid(-1, &status, WNOHANG);
+        int status;
+        pid_t p = waitpid(-1, &status, WNOHANG);
         if (p <= 0) break;
+
+        for (int i = 0; i < EV_MAX_CHILD_WATCH; i++) {
+            if (g_child_watch[i].pid != p) continue;
+            EvChildWatch w = g_child_watch[i];
+            g_child_watch[i].pid = 0;
+            w.fn(p, status, w.ctx);
+            break;
+        }
     }
-    g_got_sigchld = 0;
+}
+
+static void ev_run_tick(void) {
+    if (g_timerfd >= 0) {
+        uint64_t expirations;
+        (void)read(g_timerfd, &expirations, sizeof expirations);
+    }
+    ev_reap_children(); // belt and braces if signalfd is unavailable
+    for (int i = 0; i < g_tick_n; i++) g_tick_hooks[i]();
 }
 
 static void ensure_stdio(void) {
@@ -51,20 +169,423 @@ static void ensure_stdio(void) {
     if (fd > 2) close(fd);
 }
 
-static void mount_basic_fs(void) {
+/* --- console output ---
+   Builtins never write(1, ...) directly. Output collects in one buffer
+   that is flushed when it fills, before anything reads the keyboard or
+   forks, and when the command finishes. IOSTAT ON reports the write()
+   calls and bytes each command cost. */
+
+#define CON_BUF_SIZE 8192
+
+static char   g_con_buf[CON_BUF_SIZE];
+static size_t g_con_len = 0;
+
+static int                g_con_stats = 0;
+static unsigned long long g_con_syscalls = 0;
+static unsigned long long g_con_bytes = 0;
+static long long          g_con_heap_peak = -1; // set when the command ran a COM64 program
+
+static void con_raw_write(const void *p, size_t n) {
+    const char *b = (const char *)p;
+    while (n) {
+        ssize_t w = write(1, b, n);
+        g_con_syscalls++;
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return; // console gone; nothing sensible left to do
+        }
+        b += w;
+        n -= (size_t)w;
+        g_con_bytes += (unsigned long long)w;
+    }
+}
+
+static void con_flush(void) {
+    if (!g_con_len) return;
+    con_raw_write(g_con_buf, g_con_len);
+    g_con_len = 0;
+}
+
+static void con_write(const void *p, size_t n) {
+    if (g_con_len + n > CON_BUF_SIZE) {
+        con_flush();
+        if (n >= CON_BUF_SIZE) { con_raw_write(p, n); return; }
+    }
+    memcpy(g_con_buf + g_con_len, p, n);
+    g_con_len += n;
+}
+
+/* --- console input ---
+   The main loop reads the console in whatever chunks it delivers and
+   splits them into lines. Anything after the line being executed stays
+   in g_con_in, so builtins that read the keyboard themselves (PAUSE,
+   COPY CON, SORT) must use con_read(), which drains that first. */
+
+#define CON_IN_SIZE 2048
+
+static char   g_con_in[CON_IN_SIZE];
+static size_t g_con_in_len = 0;
+static int    g_con_in_eof = 0;
+
+static ssize_t con_read(void *buf, size_t n) {
+    if (g_con_in_len) {
+        size_t k = (n < g_con_in_len) ? n : g_con_in_len;
+        memcpy(buf, g_con_in, k);
+        memmove(g_con_in, g_con_in + k, g_con_in_len - k);
+        g_con_in_len -= k;
+        return (ssize_t)k;
+    }
+    for (;;) {
+        ssize_t r = read(0, buf, n);
+        if (r < 0 && errno == EINTR) continue;
+        return r;
+    }
+}
+
+/* Pull more console input into g_con_in. Returns bytes read, 0 at EOF. */
+static ssize_t con_fill(void) {
+    if (g_con_in_len == sizeof g_con_in) return 1; // full: let the caller take a line
+    for (;;) {
+        ssize_t r = read(0, g_con_in + g_con_in_len, sizeof g_con_in - g_con_in_len);
+        if (r < 0 && errno == EINTR) continue;
+        if (r > 0) g_con_in_len += (size_t)r;
+        return r;
+    }
+}
+
+/* Take one complete line (terminator stripped). At EOF, or when a line
+   overflows the buffer, whatever is pending counts as a line. */
+static int con_take_line(char *line, size_t linesz) {
+    char *nl = memchr(g_con_in, '\n', g_con_in_len);
+    size_t take, used;
+    if (nl) {
+        take = (size_t)(nl - g_con_in);
+        used = take + 1;
+    } else if (g_con_in_len && (g_con_in_eof || g_con_in_len == sizeof g_con_in)) {
+        take = used = g_con_in_len;
+    } else {
+        return 0;
+    }
+
+    size_t k = (take < linesz - 1) ? take : linesz - 1;
+    memcpy(line, g_con_in, k);
+    line[k] = 0;
+    line[strcspn(line, "\r")] = 0;
+
+    memmove(g_con_in, g_con_in + used, g_con_in_len - used);
+    g_con_in_len -= used;
+    return 1;
+}
+
+/* Called once per command from the main loop */
+static void con_command_done(int ran) {
+    con_flush();
+    if (ran && g_con_stats) {
+        char msg[96];
+        int n = snprintf(msg, sizeof msg, "[IOSTAT] %llu write(s), %llu byte(s)\n",
+                         g_con_syscalls, g_con_bytes);
+        if (n > 0) (void)write(1, msg, (size_t)n);
+        if (g_con_heap_peak >= 0) {
+            n = snprintf(msg, sizeof msg, "[IOSTAT] heap peak %lld byte(s)\n", g_con_heap_peak);
+            if (n > 0) (void)write(1, msg, (size_t)n);
+        }
+    }
+    g_con_syscalls = 0;
+    g_con_bytes = 0;
+    g_con_heap_peak = -1;
+}
+
+/* --- command metrics ---
+   Every command line is counted under its first word (a program under
+   its base name): calls, errors, wall time in a log2 histogram of
+   microseconds, and the file bytes COPY and TYPE moved. Recording one
+   costs two vDSO clock reads and a probe into a small open-addressed
+   table, so it is always on. The table is written to STATS_PATH after
+   commands run; STATS shows it. A command has failed when it printed an
+   error through con_error() or its program exited non-zero. */
+
+#define STAT_SLOTS   256 // power of two; at most STAT_MAX names are kept
+#define STAT_MAX     192
+#define STAT_BUCKETS 32  // bucket b: under 2^b microseconds
+#define STATS_PATH   "/run/stats.txt"
+
+typedef struct CmdStat {
+    char     name[16];
+    uint64_t calls, errors;
+    uint64_t ns_total, ns_max;
+    uint64_t bytes_in, bytes_out;
+    uint32_t hist[STAT_BUCKETS];
+} CmdStat;
+
+static CmdStat  g_stat[STAT_SLOTS];
+static uint8_t  g_stat_order[STAT_MAX]; // slots in order of first use
+static int      g_stat_n = 0;
+static int      g_stat_dirty = 0;
+static CmdStat *g_stat_cur = NULL;      // the command running now
+static uint64_t g_stat_t0 = 0;
+
+/* Bumped by COPY and TYPE, charged to the command when it ends */
+static uint64_t g_stat_bytes_in = 0;
+static uint64_t g_stat_bytes_out = 0;
+
+static int g_con_error = 0; // set by con_error() and failed programs
+
+/* Same as con_write(), but marks the command as failed */
+static void con_error(const void *p, size_t n) {
+    g_con_error = 1;
+    con_write(p, n);
+}
+
+static uint64_t stat_clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static CmdStat *stat_slot(const char *name, size_t len) {
+    uint32_t h = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < len; i++) h = (h ^ (uint8_t)name[i]) * 16777619u;
+
+    for (uint32_t i = h & (STAT_SLOTS - 1);; i = (i + 1) & (STAT_SLOTS - 1)) {
+        CmdStat *s = &g_stat[i];
+        if (!s->name[0]) {
+            // the last two places are kept for "(OTHER)" and "(BAD COMMAND)"
+            if (g_stat_n >= STAT_MAX - (name[0] == '(' ? 0 : 2)) return NULL;
+            memcpy(s->name, name, len);
+            s->name[len] = 0;
+            g_stat_order[g_stat_n++] = (uint8_t)i;
+            return s;
+        }
+        if (!strncmp(s->name, name, len) && !s->name[len]) return s;
+    }
+}
+
+/* Before run_command(): "C:\BIN\FOO.COM64 x" counts as FOO */
+static void stat_begin(const char *line) {
+    char name[sizeof g_stat[0].name];
+    size_t n = 0;
+    const char *end = line + strcspn(line, " \t");
+    const char *p = end;
+    while (p > line && p[-1] != '\\' && p[-1] != '/' && !(p - line == 2 && p[-1] == ':')) p--;
+    if (p == end) p = line; // "D:" alone
+    for (; p < end && *p != '.' && n < sizeof name - 1; p++) name[n++] = (char)toupper((unsigned char)*p);
+    if (n == 0) name[n++] = '?';
+
+    g_stat_cur = stat_slot(name, n);
+    if (!g_stat_cur) g_stat_cur = stat_slot("(OTHER)", 7);
+    g_con_error = 0;
+    g_stat_bytes_in = g_stat_bytes_out = 0;
+    g_stat_t0 = stat_clock_ns();
+}
+
+/* The line named no command: count it under one shared name */
+static void stat_unknown(void) {
+    CmdStat *s = g_stat_cur;
+    // A slot made just now for this line is given back. Being the newest,
+    // no other name's probe sequence runs through it.
+    if (s && !s->calls && g_stat_n && g_stat_order[g_stat_n - 1] == (uint8_t)(s - g_stat)) {
+        g_stat_n--;
+        memset(s, 0, sizeof *s);
+    }
+    g_stat_cur = stat_slot("(BAD COMMAND)", 13);
+}
+
+static void stat_end(void) {
+    uint64_t ns = stat_clock_ns() - g_stat_t0;
+    CmdStat *s = g_stat_cur;
+    g_stat_cur = NULL;
+    if (!s) return;
+
+    uint64_t us = ns / 1000;
+    int b = us ? 64 - __builtin_clzll(us) : 0;
+    if (b >= STAT_BUCKETS) b = STAT_BUCKETS - 1;
+
+    s->calls++;
+    s->errors += (uint64_t)g_con_error;
+    s->ns_total += ns;
+    if (ns > s->ns_max) s->ns_max = ns;
+    s->bytes_in += g_stat_bytes_in;
+    s->bytes_out += g_stat_bytes_out;
+    s->hist[b]++;
+    g_stat_dirty = 1;
+}
+
+/* Upper bound, in ms, of the bucket holding the q-th fraction of calls
+   (or the slowest call, if that is lower) */
+static double stat_quantile_ms(const CmdStat *s, double q) {
+    uint64_t want = (uint64_t)((double)s->calls * q + 0.999999), seen = 0;
+    double max = (double)s->ns_max / 1e6;
+    for (int b = 0; b < STAT_BUCKETS; b++) {
+        seen += s->hist[b];
+        if (seen >= want) return (double)(1ull << b) / 1000.0 < max ? (double)(1ull << b) / 1000.0 : max;
+    }
+    return max;
+}
+
+static size_t stat_format(char *out, size_t outsz) {
+    size_t j = 0;
+    int n = snprintf(out, outsz, "Command       Calls Errs  Mean ms  p50<=ms  p99<=ms   Max ms   In KB  Out KB\n");
+    if (n > 0) j = (size_t)n;
+    for (int i = 0; i < g_stat_n && j < outsz; i++) {
+        const CmdStat *s = &g_stat[g_stat_order[i]];
+        if (!s->calls) continue;
+        n = snprintf(out + j, outsz - j, "%-13.13s%6llu%5llu%9.2f%9.2f%9.2f%9.2f%8llu%8llu\n",
+                     s->name, (unsigned long long)s->calls, (unsigned long long)s->errors,
+                     (double)s->ns_total / (double)s->calls / 1e6,
+                     stat_quantile_ms(s, 0.50), stat_quantile_ms(s, 0.99), (double)s->ns_max / 1e6,
+                     (unsigned long long)(s->bytes_in >> 10), (unsigned long long)(s->bytes_out >> 10));
+        if (n > 0) j += (size_t)n;
+    }
+    return j < outsz ? j : outsz - 1;
+}
+
+/* Tick hook, like the boot log: at most one write per tick */
+static void stat_tick(void) {
+    if (!g_stat_dirty || g_host) return; // /run is the host's
+    static char buf[STAT_MAX * 80 + 96];
+    size_t n = stat_format(buf, sizeof buf);
+    g_stat_dirty = 0;
+
+    int fd = open(STATS_PATH ".tmp", O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return;
+    (void)write(fd, buf, n);
+    close(fd);
+    (void)rename(STATS_PATH ".tmp", STATS_PATH);
+}
+
+/* --- boot timeline ---
+   Each init phase is stamped against CLOCK_BOOTTIME, so the first mark
+   also shows how long the kernel took to reach /init. The table is
+   written to BOOT_LOG_PATH once the prompt is up (and again whenever a
+   later phase adds to it); BOOTLOG shows it. */
+
+#define BOOT_MAX_MARKS 96
+#define BOOT_LOG_PATH  "/run/bootlog.txt"
+#define BOOT_NAME_MAX  64 // a phase name, NUL included
+
+typedef struct BootMark {
+    char     name[BOOT_NAME_MAX];
+    uint64_t ns;
+} BootMark;
+
+static BootMark        g_boot[BOOT_MAX_MARKS];
+static int             g_boot_n = 0;
+static int             g_boot_dirty = 0; // marks added since the log was written
+static pthread_mutex_t g_boot_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Boot readahead (below): files on C: the shell opened, kept for the next boot */
+static void   ra_note(const char *path);
+static void   ra_save(void);
+static size_t ra_format(char *out, size_t outsz);
+
+static uint64_t boottime_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* Safe from any thread */
+static void boot_mark(const char *name) {
+    uint64_t now = boottime_ns();
+    pthread_mutex_lock(&g_boot_lock);
+    if (g_boot_n < BOOT_MAX_MARKS) {
+        snprintf(g_boot[g_boot_n].name, sizeof g_boot[g_boot_n].name, "%s", name);
+        g_boot[g_boot_n].ns = now;
+        g_boot_n++;
+        g_boot_dirty = 1;
+    }
+    pthread_mutex_unlock(&g_boot_lock);
+}
+
+static size_t boot_format(char *out, size_t outsz) {
+    size_t j = 0;
+    int n = snprintf(out, outsz, "     at ms    +ms  phase\n");
+    if (n > 0) j = (size_t)n;
+
+    pthread_mutex_lock(&g_boot_lock);
+    for (int i = 0; i < g_boot_n && j < outsz; i++) {
+        uint64_t prev = i ? g_boot[i - 1].ns : g_boot[0].ns;
+        n = snprintf(out + j, outsz - j, "%10.3f %6.3f  %s\n",
+                     (double)g_boot[i].ns / 1e6, (double)(g_boot[i].ns - prev) / 1e6,
+                     g_boot[i].name);
+        if (n > 0) j += (size_t)n;
+    }
+    pthread_mutex_unlock(&g_boot_lock);
+    if (j < outsz) j += ra_format(out + j, outsz - j);
+    return j < outsz ? j : outsz - 1;
+}
+
+static void boot_write_log(void) {
+    if (g_host) return; // /run is the host's
+    static char buf[BOOT_MAX_MARKS * (BOOT_NAME_MAX + 24) + 192];
+    size_t n = boot_format(buf, sizeof buf);
+    g_boot_dirty = 0;
+
+    int fd = open(BOOT_LOG_PATH ".tmp", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return;
+    (void)write(fd, buf, n);
+    close(fd);
+    (void)rename(BOOT_LOG_PATH ".tmp", BOOT_LOG_PATH);
+}
+
+/* Tick hook: phases that finish after the prompt still reach the file */
+static void boot_log_tick(void) {
+    if (g_boot_dirty) boot_write_log();
+}
+
+/* /run is needed early (the timeline lives there). /proc, /sys and /dev are
+   not needed to show a prompt, so they are mounted on a helper thread while
+   the main thread reads DOS.CFG; early_init_wait() joins it before anything
+   that might depend on them: the first command, whether typed or scripted,
+   AUTOEXEC.SVC services, and shutdown. */
+static pthread_t g_early_tid;
+static int       g_early_started = 0;
+
+static void mount_run_fs(void) {
+    mkdir("/run", 0555);
+    mount("tmpfs", "/run", "tmpfs", 0, "mode=0755");
+    boot_mark("mount /run");
+}
+
+static void *early_mounts_thread(void *arg) {
+    (void)arg;
     mkdir("/proc", 0555);
     mkdir("/sys", 0555);
     mkdir("/dev", 0555);
-    mkdir("/run", 0555);
 
     mount("proc", "/proc", "proc", 0, "");
-    mount("sysfs", "/sys", "sysfs", 0, "");
+    boot_mark("mount /proc");
     mount("devtmpfs", "/dev", "devtmpfs", 0, "");
-    mount("tmpfs", "/run", "tmpfs", 0, "mode=0755");
+    boot_mark("mount /dev");
+    mount("sysfs", "/sys", "sysfs", 0, "");
+    boot_mark("mount /sys");
+    return NULL;
+}
+
+static void early_init_start(void) {
+    if (pthread_create(&g_early_tid, NULL, early_mounts_thread, NULL) == 0) {
+        g_early_started = 1;
+    } else {
+        early_mounts_thread(NULL); // no thread: do it inline
+    }
+}
+
+static void early_init_wait(void) {
+    if (!g_early_started) return;
+    pthread_join(g_early_tid, NULL);
+    g_early_started = 0;
+    boot_mark("early mounts joined");
 }
 
+/* Shutdown (below): stop every process, flush and remount the disks, with deadlines */
+static void shutdown_run(void);
+
 static void do_poweroff(void) {
-    sync();
+    early_init_wait();
+    con_flush();
+    ra_save();
+    if (g_host) exit(0);
+    shutdown_run();
     reboot(RB_POWER_OFF);
 }
 
@@ -167,10 +688,16 @@ static const char *dos_basename(const char *p) {
 }
 
 /* DIR switch parsing + filespec extraction */
-static void parse_dir_switches(const char *arg, int *wide, int *all) {
-    *wide = 0;
-    *all  = 0;
-    if (!arg) return;
+typedef struct DirOpts {
+    int  wide, all, page;
+    char order;   // 0, or N E S D for /O
+    int  reverse; // /O-x
+} DirOpts;
+
+/* Unknown switches are ignored; -1 for an /O that names no known order */
+static int parse_dir_switches(const char *arg, DirOpts *o) {
+    memset(o, 0, sizeof *o);
+    if (!arg) return 0;
 
     const char *p = arg;
     while (*p) {
@@ -182,11 +709,21 @@ static void parse_dir_switches(const char *arg, int *wide, int *all) {
 
         size_t n = (size_t)(p - t);
         if (n >= 2 && t[0] == '/') {
-            char sw = t[1];
-            if (sw == 'w' || sw == 'W') *wide = 1;
-            if (sw == 'a' || sw == 'A') *all  = 1;
+            char sw = (char)toupper((unsigned char)t[1]);
+            if (sw == 'W') o->wide = 1;
+            if (sw == 'A') o->all  = 1;
+            if (sw == 'P') o->page = 1;
+            if (sw == 'O') {
+                // /O, /ON, /O:N, /O-S, /O:-S
+                const char *q = t + 2;
+                if (q < p && *q == ':') q++;
+                if (q < p && *q == '-') { o->reverse = 1; q++; }
+                o->order = (q < p) ? (char)toupper((unsigned char)*q++) : 'N';
+                if (q != p || !strchr("NESD", o->order)) return -1;
+            }
         }
     }
+    return 0;
 }
 
 static const char *dir_find_filespec(const char *arg, char *out, size_t outsz) {
@@ -213,43 +750,105 @@ static const char *dir_find_filespec(const char *arg, char *out, size_t outsz) {
     return NULL;
 }
 
-/* --- DOS path mapping (single drive C:) --- */
+/* --- DOS drives ---
+   Every letter maps to a host directory. C: is the C root, the RAM drive
+   (D: unless DOS.CFG says otherwise) is a size-limited tmpfs mounted at
+   boot, and DRIVE= lines in DOS.CFG map further letters to directories
+   that already exist, typically mount points. Each drive remembers its
+   own current directory, DOS-style; the process cwd is always the
+   current drive's, so relative paths need no translation. */
 
-static void linux_to_dos_cwd(char *out, size_t outlen) {
-    char cwd[PATH_MAX];
-    if (!getcwd(cwd, sizeof cwd)) {
-        snprintf(out, outlen, "C:\\");
-        return;
-    }
+#define RAMDRIVE_SIZE "25%" // tmpfs size= when DOS.CFG gives none
 
-    size_t rootlen = strlen(DOS_C_ROOT);
-    if (strncmp(cwd, DOS_C_ROOT, rootlen) != 0) {
-        snprintf(out, outlen, "C:\\");
-        return;
+typedef struct Drive {
+    char root[PATH_MAX];    // "" if the letter is not mapped
+    char cwd[PATH_MAX];     // host path at or under root
+} Drive;
+
+static Drive g_drives[26];
+static int   g_cur_drive = 'C' - 'A';
+static int   g_ram_drive = 'D' - 'A';   // -1: RAMDRIVE=OFF
+static char  g_ram_size[16] = RAMDRIVE_SIZE;
+
+static int drive_mapped(int d) {
+    return d >= 0 && d < 26 && g_drives[d].root[0];
+}
+
+/* "X:" at the start of s: the drive index, or -1 */
+static int drive_prefix(const char *s) {
+    if (isalpha((unsigned char)s[0]) && s[1] == ':') return toupper((unsigned char)s[0]) - 'A';
+    return -1;
+}
+
+static int path_under(const char *path, const char *root) {
+    size_t n = strlen(root);
+    return !strncmp(path, root, n) && (path[n] == 0 || path[n] == '/');
+}
+
+/* The drive a host path is on: the longest root that contains it, or -1 */
+static int drive_of(const char *path) {
+    int best = -1;
+    size_t best_len = 0;
+    for (int d = 0; d < 26; d++) {
+        size_t n = strlen(g_drives[d].root);
+        if (n > best_len && path_under(path, g_drives[d].root)) {
+            best = d;
+            best_len = n;
+        }
     }
+    return best;
+}
 
-    const char *rel = cwd + rootlen; // "" or "/FOO"
-    if (rel[0] == 0) {
-        snprintf(out, outlen, "C:\\");
-        return;
+static int is_drive_root(const char *path) {
+    for (int d = 0; d < 26; d++) {
+        if (!g_drives[d].root[0] || !path_under(path, g_drives[d].root)) continue;
+        const char *rest = path + strlen(g_drives[d].root);
+        if (!strcmp(rest, "") || !strcmp(rest, "/")) return 1;
     }
+    return 0;
+}
 
-    size_t j = 0;
+/* Host path -> "X:\DIR\SUB". Anything outside every drive shows as the
+   root of the current one. */
+static void linux_to_dos(const char *path, char *out, size_t outlen) {
     if (outlen < 4) { if (outlen) out[0] = 0; return; }
 
-    out[j++] = 'C';
+    int d = drive_of(path);
+    const char *rel = (d >= 0) ? path + strlen(g_drives[d].root) : "";
+    if (d < 0) d = g_cur_drive;
+
+    size_t j = 0;
+    out[j++] = (char)('A' + d);
     out[j++] = ':';
     out[j++] = '\\';
+    while (*rel == '/') rel++;
+    for (; *rel && j + 1 < outlen; rel++) out[j++] = (*rel == '/') ? '\\' : *rel;
+    out[j] = 0;
+}
 
-    for (size_t i = 1; rel[i] && j + 1 < outlen; i++) {
-        char c = rel[i];
-        if (c == '/') c = '\\';
-        out[j++] = c;
+static void linux_to_dos_cwd(char *out, size_t outlen) {
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof cwd)) cwd[0] = 0;
+    linux_to_dos(cwd, out, outlen);
+}
+
+/* Make d the current drive, leaving the one we are on at its cwd */
+static int drive_switch(int d) {
+    if (!drive_mapped(d)) return -1;
+    if (d == g_cur_drive) return 0;
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof cwd) && path_under(cwd, g_drives[g_cur_drive].root))
+        snprintf(g_drives[g_cur_drive].cwd, PATH_MAX, "%s", cwd);
+    if (chdir(g_drives[d].cwd) != 0) {
+        if (chdir(g_drives[d].root) != 0) return -1;
+        memcpy(g_drives[d].cwd, g_drives[d].root, strlen(g_drives[d].root) + 1);
     }
-    out[j] = 0;
+    g_cur_drive = d;
+    return 0;
 }
 
-// Accept: "\FOO\BAR", "FOO\BAR" (relative), "C:\FOO", "C:FOO" (relative), and "/" as "\"
+// Accept: "\FOO\BAR", "FOO\BAR" (relative), "D:\FOO", "D:FOO" (relative to
+// D:'s current directory), and "/" as "\"
 static int dos_to_linux_path(const char *dos, char *out, size_t outlen) {
     if (!dos) return -1;
 
@@ -257,147 +856,674 @@ static int dos_to_linux_path(const char *dos, char *out, size_t outlen) {
     while (*p == ' ' || *p == '\t') p++;
     if (!*p) return -1;
 
-    if (isalpha((unsigned char)p[0]) && p[1] == ':') {
-        char d = (char)toupper((unsigned char)p[0]);
-        if (d != 'C') return -1;
+    int d = drive_prefix(p);
+    if (d >= 0) {
+        if (!drive_mapped(d)) return -1;
         p += 2;
+    } else {
+        d = g_cur_drive;
     }
 
     int absolute = (*p == '\\' || *p == '/');
+    size_t j = 0;
 
-    if (absolute) {
-        int n = snprintf(out, outlen, "%s/", DOS_C_ROOT);
+    if (absolute || d != g_cur_drive) {
+        // Rooted at the drive, or at its own cwd if it is not the current one
+        const char *base = absolute ? g_drives[d].root : g_drives[d].cwd;
+        int n = snprintf(out, outlen, "%s%s", base, *p ? "/" : "");
         if (n < 0 || (size_t)n >= outlen) return -1;
-        size_t j = (size_t)n;
-
+        j = (size_t)n;
         while (*p == '\\' || *p == '/') p++;
+    } else if (!*p) {
+        p = "."; // "D:" on drive D: is the current directory
+    }
 
-        for (; *p && j + 1 < outlen; p++) {
-            char c = *p;
-            if (c == '\\' || c == '/') c = '/';
-            out[j++] = c;
-        }
-        out[j] = 0;
-        return 0;
-    } else {
-        size_t j = 0;
-        for (; *p && j + 1 < outlen; p++) {
-            char c = *p;
-            if (c == '\\' || c == '/') c = '/';
-            out[j++] = c;
-        }
-        out[j] = 0;
-        return 0;
+    for (; *p && j + 1 < outlen; p++) {
+        char c = *p;
+        if (c == '\\' || c == '/') c = '/';
+        out[j++] = c;
     }
+    out[j] = 0;
+    return 0;
 }
 
-/* --- COLOR persistence --- */
+/* After load_config(): C:, the RAM drive, then DRIVE= letters that exist */
+static void drives_init(void) {
+    Drive *c = &g_drives['C' - 'A'];
+    snprintf(c->root, PATH_MAX, "%s", g_c_root);
+
+    if (g_ram_drive >= 0) {
+        Drive *r = &g_drives[g_ram_drive];
+        int ok;
+        if (g_host) {
+            // No mount rights: a directory on the host's own RAM disk
+            const char *base = access("/dev/shm", W_OK) == 0 ? "/dev/shm" : "/tmp";
+            snprintf(r->root, PATH_MAX, "%s/dos64-%u-%c", base, (unsigned)getuid(), 'A' + g_ram_drive);
+            ok = mkdir(r->root, 0700) == 0 || errno == EEXIST;
+        } else {
+            char opts[48];
+            snprintf(r->root, PATH_MAX, "/dos/%c", 'a' + g_ram_drive);
+            snprintf(opts, sizeof opts, "size=%s,mode=0755", g_ram_size);
+            mkdir(r->root, 0755);
+            ok = mount("tmpfs", r->root, "tmpfs", MS_NOSUID | MS_NODEV, opts) == 0;
+        }
+        if (!ok) r->root[0] = 0;
+        else boot_mark("RAM drive");
+    }
 
-static int hexval(int c) {
-    if (c >= '0' && c <= '9') return c - '0';
-    c = tolower((unsigned char)c);
-    if (c >= 'a' && c <= 'f') return 10 + (c - 'a');
-    return -1;
+    // Canonical roots, so getcwd() results compare against them directly
+    for (int d = 0; d < 26; d++) {
+        char real[PATH_MAX];
+        struct stat st;
+        if (!g_drives[d].root[0]) continue;
+        if (!realpath(g_drives[d].root, real) || stat(real, &st) != 0 || !S_ISDIR(st.st_mode)) {
+            g_drives[d].root[0] = 0;
+            continue;
+        }
+        snprintf(g_drives[d].root, PATH_MAX, "%s", real);
+        snprintf(g_drives[d].cwd, PATH_MAX, "%s", real);
+    }
 }
 
-static void apply_color(void) {
-    int fg_code = (g_fg < 8) ? (30 + g_fg) : (90 + (g_fg - 8));
-    int bg_code = (g_bg < 8) ? (40 + g_bg) : (100 + (g_bg - 8));
+/* Expand a DOS filespec (wildcards allowed) and call fn for every regular
+   file it names. Returns the number of matches, or -1 for a bad path. */
+typedef void (*dos_glob_fn)(const char *linuxp, const char *name, void *ctx);
 
-    char seq[32];
-    int n = snprintf(seq, sizeof seq, "\033[%d;%dm", bg_code, fg_code);
-    if (n > 0) (void)write(1, seq, (size_t)n);
-}
+static long dos_glob_files(const char *dos_spec, dos_glob_fn fn, void *ctx) {
+    char linuxspec[PATH_MAX];
+    if (dos_to_linux_path(dos_spec, linuxspec, sizeof linuxspec) != 0) return -1;
 
-static void save_config(void) {
-    // We're already chdir'd into DOS_C_ROOT, so write relative
-    int fd = open("DOS.CFG", O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    if (fd < 0) return;
+    if (!has_wildcards(linuxspec)) {
+        struct stat st;
+        if (stat(linuxspec, &st) != 0 || !S_ISREG(st.st_mode)) return 0;
+        fn(linuxspec, dos_basename(linuxspec), ctx);
+        return 1;
+    }
 
-    char buf[64];
-    int n = snprintf(buf, sizeof buf, "COLOR=%X%X\n", g_bg, g_fg);
-    if (n > 0) (void)write(fd, buf, (size_t)n);
-    close(fd);
-}
+    char dirpath[PATH_MAX];
+    char pattern[PATH_MAX];
+    split_dir_pat(linuxspec, dirpath, sizeof dirpath, pattern, sizeof pattern);
 
-static void load_config(void) {
-    // Try both cases (in case the file was created/edited manually)
-    int fd = open("DOS.CFG", O_RDONLY);
-    if (fd < 0) fd = open("dos.cfg", O_RDONLY);
-    if (fd < 0) return;
+    DIR *d = opendir(dirpath);
+    if (!d) return 0;
 
-    char buf[256];
-    ssize_t n = read(fd, buf, sizeof buf - 1);
-    close(fd);
-    if (n <= 0) return;
-    buf[n] = 0;
+    long count = 0;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        const char *name = de->d_name;
+        if (!wildmatch_ci(pattern, name)) continue;
 
-    // Find a line that starts with COLOR= (case-insensitive)
-    for (char *p = buf; *p; ) {
-        // skip leading whitespace
-        while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
-        if (!*p) break;
+        char full[PATH_MAX * 2];
+        snprintf(full, sizeof full, "%s/%s", dirpath, name);
 
-        if (!strncasecmp(p, "COLOR=", 6)) {
-            p += 6;
-            int a = hexval((unsigned char)p[0]);
-            int b = hexval((unsigned char)p[1]);
-            if (a >= 0 && b >= 0 && a != b) {
-                g_bg = a;
-                g_fg = b;
-            }
-            return;
-        }
+        struct stat st;
+        if (stat(full, &st) != 0 || !S_ISREG(st.st_mode)) continue;
 
-        // next line
-        while (*p && *p != '\n') p++;
-        if (*p == '\n') p++;
+        fn(full, name, ctx);
+        count++;
     }
+    closedir(d);
+    return count;
 }
 
-/* --- prompt --- */
+/* Remove every "/X" token (case-insensitive) from s in place.
+   Returns 1 if at least one was present. */
+static int take_switch(char *s, char sw) {
+    int found = 0;
+    char *p = s;
+    while (*p) {
+        while (*p == ' ' || *p == '\t') p++;
+        if (!*p) break;
 
-static void print_prompt(void) {
-    char dos[PATH_MAX + 8];
-    linux_to_dos_cwd(dos, sizeof dos);
+        char *t = p;
+        while (*p && *p != ' ' && *p != '\t') p++;
 
-    if (!strcmp(dos, "C:\\")) {
-        (void)write(1, "C:\\> ", 5);
-        return;
+        if (p - t == 2 && t[0] == '/' && toupper((unsigned char)t[1]) == toupper((unsigned char)sw)) {
+            t[0] = ' ';
+            t[1] = ' ';
+            found = 1;
+        }
     }
 
-    size_t n = strnlen(dos, sizeof dos);
-    (void)write(1, dos, n);
-    (void)write(1, "> ", 2);
+    // trim trailing blanks left behind by a removed switch
+    size_t n = strlen(s);
+    while (n && (s[n - 1] == ' ' || s[n - 1] == '\t')) s[--n] = 0;
+    return found;
 }
 
-/* --- builtins --- */
-
-static void builtin_cls(void) {
-    const char *seq = "\033[2J\033[H";
-    (void)write(1, seq, 7);
-}
+/* --- CRC32C (Castagnoli) ---
+   SSE4.2 has a dedicated instruction for this polynomial; everything else
+   falls back to slicing-by-8 tables. crc32c_update() chains, so a running
+   checksum can be folded over a stream one buffer at a time. */
 
-static void builtin_pause(void) {
-    const char *msg = "Press any key to continue . . .";
-    (void)write(1, msg, strlen(msg));
+#define CRC32C_POLY 0x82F63B78u
 
-    struct termios oldt, raw;
-    int has_tty = (tcgetattr(0, &oldt) == 0);
-    if (has_tty) {
-        raw = oldt;
-        raw.c_lflag &= ~(ICANON | ECHO | ISIG);
-        raw.c_cc[VMIN] = 1;
-        raw.c_cc[VTIME] = 0;
-        (void)tcsetattr(0, TCSANOW, &raw);
-    }
+static uint32_t g_crc32c_tab[8][256];
+static int g_crc32c_hw = -1; // -1 = not probed yet
 
-    unsigned char c;
-    (void)read(0, &c, 1);
+static void crc32c_init(void) {
+    if (g_crc32c_hw >= 0) return;
 
-    if (has_tty) (void)tcsetattr(0, TCSANOW, &oldt);
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : (c >> 1);
+        g_crc32c_tab[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = g_crc32c_tab[0][i];
+        for (int t = 1; t < 8; t++) {
+            c = g_crc32c_tab[0][c & 0xFF] ^ (c >> 8);
+            g_crc32c_tab[t][i] = c;
+        }
+    }
 
-    (void)write(1, "\r\n", 2);
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    g_crc32c_hw = __builtin_cpu_supports("sse4.2") ? 1 : 0;
+#else
+    g_crc32c_hw = 0;
+#endif
+}
+
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t *p, size_t n) {
+    while (n && ((uintptr_t)p & 7)) {
+        crc = g_crc32c_tab[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        n--;
+    }
+    while (n >= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        w ^= crc;
+        crc = g_crc32c_tab[7][w & 0xFF]         ^ g_crc32c_tab[6][(w >> 8) & 0xFF] ^
+              g_crc32c_tab[5][(w >> 16) & 0xFF] ^ g_crc32c_tab[4][(w >> 24) & 0xFF] ^
+              g_crc32c_tab[3][(w >> 32) & 0xFF] ^ g_crc32c_tab[2][(w >> 40) & 0xFF] ^
+              g_crc32c_tab[1][(w >> 48) & 0xFF] ^ g_crc32c_tab[0][w >> 56];
+        p += 8;
+        n -= 8;
+    }
+    while (n--) crc = g_crc32c_tab[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t *p, size_t n) {
+    uint64_t c = crc;
+    while (n && ((uintptr_t)p & 7)) { c = _mm_crc32_u8((uint32_t)c, *p++); n--; }
+    while (n >= 32) {
+        uint64_t w0, w1, w2, w3;
+        memcpy(&w0, p, 8);
+        memcpy(&w1, p + 8, 8);
+        memcpy(&w2, p + 16, 8);
+        memcpy(&w3, p + 24, 8);
+        c = _mm_crc32_u64(c, w0);
+        c = _mm_crc32_u64(c, w1);
+        c = _mm_crc32_u64(c, w2);
+        c = _mm_crc32_u64(c, w3);
+        p += 32;
+        n -= 32;
+    }
+    while (n >= 8) { uint64_t w; memcpy(&w, p, 8); c = _mm_crc32_u64(c, w); p += 8; n -= 8; }
+    while (n--) c = _mm_crc32_u8((uint32_t)c, *p++);
+    return (uint32_t)c;
+}
+#endif
+
+static uint32_t crc32c_update(uint32_t crc, const void *buf, size_t n) {
+    if (g_crc32c_hw < 0) crc32c_init();
+    crc = ~crc;
+#if defined(__x86_64__)
+    if (g_crc32c_hw) return ~crc32c_hw(crc, (const uint8_t *)buf, n);
+#endif
+    return ~crc32c_sw(crc, (const uint8_t *)buf, n);
+}
+
+/* Checksum a whole file. With direct != 0 the page cache is bypassed
+   (O_DIRECT) where the filesystem allows it, so a just-written copy is
+   really read back from the device. Returns 0 or -1. */
+#define CRC_IO_CHUNK (256 * 1024)
+
+static int crc32c_file(const char *path, int direct, uint32_t *out) {
+    int fd = -1;
+    if (direct) fd = open(path, O_RDONLY | O_DIRECT);
+    if (fd < 0) { direct = 0; fd = open(path, O_RDONLY); }
+    if (fd < 0) return -1;
+
+    void *buf = NULL;
+    if (posix_memalign(&buf, 4096, CRC_IO_CHUNK) != 0) { close(fd); return -1; }
+
+    if (!direct) (void)posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    uint32_t crc = 0;
+    int rc = 0;
+    for (;;) {
+        ssize_t n = read(fd, buf, CRC_IO_CHUNK);
+        if (n == 0) break;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (direct && errno == EINVAL) {
+                // filesystem accepted O_DIRECT at open but not for this I/O
+                int fl = fcntl(fd, F_GETFL);
+                if (fl >= 0 && fcntl(fd, F_SETFL, fl & ~O_DIRECT) == 0) { direct = 0; continue; }
+            }
+            rc = -1;
+            break;
+        }
+        crc = crc32c_update(crc, buf, (size_t)n);
+    }
+
+    free(buf);
+    close(fd);
+    if (rc == 0) *out = crc;
+    return rc;
+}
+
+/* --- COLOR persistence --- */
+
+static int hexval(int c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    c = tolower((unsigned char)c);
+    if (c >= 'a' && c <= 'f') return 10 + (c - 'a');
+    return -1;
+}
+
+static int ansi_fg_code(int c);
+static int ansi_bg_code(int c);
+
+static void apply_color(void) {
+    int fg_code = ansi_fg_code(g_fg);
+    int bg_code = ansi_bg_code(g_bg);
+
+    char seq[32];
+    int n = snprintf(seq, sizeof seq, "\033[%d;%dm", bg_code, fg_code);
+    if (n > 0) con_write(seq, (size_t)n);
+}
+
+/* DOS.CFG lives in C:\ and holds KEY=value lines:
+     COLOR=1F
+     RAMDRIVE=D 64M      (letter and tmpfs size; RAMDRIVE=OFF for none)
+     DRIVE=E /mnt/data   (map a letter to a host directory)
+   COLOR saves itself; other lines are only ever edited by hand, and
+   save_config() keeps them as they are. */
+#define CONFIG_NAME "DOS.CFG"
+#define CONFIG_MAX  4096
+
+static int config_read(char *buf, size_t cap) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof path, "%s/" CONFIG_NAME, g_c_root);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        // in case the file was created/edited manually
+        snprintf(path, sizeof path, "%s/dos.cfg", g_c_root);
+        fd = open(path, O_RDONLY);
+    }
+    if (fd < 0) return -1;
+    ra_note(path);
+    ssize_t n = read(fd, buf, cap - 1);
+    close(fd);
+    if (n < 0) return -1;
+    buf[n] = 0;
+    return 0;
+}
+
+static void save_config(void) {
+    static char old[CONFIG_MAX];
+    if (config_read(old, sizeof old) != 0) old[0] = 0;
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof path, "%s/" CONFIG_NAME, g_c_root);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return;
+
+    char buf[64];
+    int n = snprintf(buf, sizeof buf, "COLOR=%X%X\n", g_bg, g_fg);
+    if (n > 0) (void)write(fd, buf, (size_t)n);
+
+    for (char *p = old; *p; ) {
+        char *e = strchr(p, '\n');
+        size_t len = e ? (size_t)(e - p) + 1 : strlen(p);
+        const char *t = p;
+        while (*t == ' ' || *t == '\t') t++;
+        if (strncasecmp(t, "COLOR=", 6) != 0) {
+            (void)write(fd, p, len);
+            if (!e) (void)write(fd, "\n", 1);
+        }
+        p += len;
+    }
+    close(fd);
+}
+
+/* "D" or "D:" then blanks; returns the drive index and advances *p */
+static int config_letter(char **p) {
+    char *t = *p;
+    if (!isalpha((unsigned char)t[0])) return -1;
+    int d = toupper((unsigned char)t[0]) - 'A';
+    t++;
+    if (*t == ':') t++;
+    if (*t && *t != ' ' && *t != '\t') return -1;
+    while (*t == ' ' || *t == '\t') t++;
+    *p = t;
+    return d;
+}
+
+static void load_config(void) {
+    static char buf[CONFIG_MAX];
+    if (config_read(buf, sizeof buf) != 0) return;
+
+    for (char *p = buf; *p; ) {
+        // skip leading whitespace
+        while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+        if (!*p) break;
+
+        char *line = p;
+        while (*p && *p != '\n') p++;
+        if (*p == '\n') *p++ = 0;
+        char *end = line + strlen(line);
+        while (end > line && (end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t')) *--end = 0;
+
+        if (!strncasecmp(line, "COLOR=", 6)) {
+            int a = hexval((unsigned char)line[6]);
+            int b = hexval((unsigned char)line[7]);
+            if (a >= 0 && b >= 0 && a != b) {
+                g_bg = a;
+                g_fg = b;
+            }
+        } else if (!strncasecmp(line, "RAMDRIVE=", 9)) {
+            char *v = line + 9;
+            if (!strcasecmp(v, "OFF")) {
+                g_ram_drive = -1;
+                continue;
+            }
+            int d = config_letter(&v);
+            if (d < 0 || d == 'C' - 'A') continue;
+            g_ram_drive = d;
+            if (*v && strlen(v) < sizeof g_ram_size && strspn(v, "0123456789kKmMgG%") == strlen(v))
+                snprintf(g_ram_size, sizeof g_ram_size, "%s", v);
+        } else if (!strncasecmp(line, "DRIVE=", 6)) {
+            char *v = line + 6;
+            int d = config_letter(&v);
+            if (d < 0 || d == 'C' - 'A' || *v != '/') continue;
+            size_t n = strlen(v);
+            while (n > 1 && v[n - 1] == '/') v[--n] = 0;
+            snprintf(g_drives[d].root, PATH_MAX, "%s", v);
+        }
+    }
+    if (g_ram_drive >= 0) g_drives[g_ram_drive].root[0] = 0; // the RAM drive wins its letter
+}
+
+/* --- text screen ---
+   A character/attribute model of the console for full-screen tools. Drawing
+   goes to the back buffer and only marks rows dirty; scr_present() diffs
+   dirty rows against the front buffer (what the terminal shows) and emits
+   just the changed runs, with SGR sequences only where the attribute
+   actually changes. Attributes are DOS-style: background << 4 | foreground. */
+
+#define SCR_MAX_COLS 512
+#define SCR_MAX_ROWS 256
+#define SCR_GAP_FILL 6 // rewrite up to this many unchanged cells instead of moving the cursor
+
+typedef struct ScrCell {
+    uint8_t ch;
+    uint8_t attr;
+} ScrCell;
+
+typedef struct Screen {
+    int      open;
+    int      cols, rows;
+    ScrCell *front, *back;
+    uint8_t *dirty;
+    int      cur_x, cur_y;     // where the caller wants the cursor left
+    int      term_x, term_y;   // where the terminal cursor is (-1 = unknown)
+    int      term_attr;        // current terminal SGR state (-1 = unknown)
+    unsigned last_bytes;       // bytes emitted by the last scr_present()
+} Screen;
+
+static Screen g_scr;
+
+static int ansi_fg_code(int c) { return (c < 8) ? (30 + c) : (90 + (c - 8)); }
+static int ansi_bg_code(int c) { return (c < 8) ? (40 + c) : (100 + (c - 8)); }
+
+static void scr_release(void) {
+    free(g_scr.front);
+    free(g_scr.back);
+    free(g_scr.dirty);
+    memset(&g_scr, 0, sizeof g_scr);
+}
+
+/* Open the model at a fixed size; the first present repaints everything */
+static int scr_open_size(int cols, int rows) {
+    if (cols < 1 || rows < 1 || cols > SCR_MAX_COLS || rows > SCR_MAX_ROWS) return -1;
+    scr_release();
+
+    size_t cells = (size_t)cols * (size_t)rows;
+    g_scr.front = (ScrCell *)malloc(cells * sizeof(ScrCell));
+    g_scr.back  = (ScrCell *)malloc(cells * sizeof(ScrCell));
+    g_scr.dirty = (uint8_t *)malloc((size_t)rows);
+    if (!g_scr.front || !g_scr.back || !g_scr.dirty) { scr_release(); return -1; }
+
+    g_scr.open = 1;
+    g_scr.cols = cols;
+    g_scr.rows = rows;
+
+    uint8_t attr = (uint8_t)((g_bg << 4) | g_fg);
+    for (size_t i = 0; i < cells; i++) {
+        g_scr.back[i].ch = ' ';
+        g_scr.back[i].attr = attr;
+        g_scr.front[i].ch = 0; // matches nothing: forces a full first paint
+        g_scr.front[i].attr = 0xFF;
+    }
+    memset(g_scr.dirty, 1, (size_t)rows);
+    g_scr.term_x = g_scr.term_y = -1;
+    g_scr.term_attr = -1;
+    return 0;
+}
+
+static int scr_open(int *cols, int *rows) {
+    struct winsize ws;
+    int c = 80, r = 25;
+    if (ioctl(1, TIOCGWINSZ, &ws) == 0 && ws.ws_col && ws.ws_row) {
+        c = ws.ws_col;
+        r = ws.ws_row;
+    }
+    if (c > SCR_MAX_COLS) c = SCR_MAX_COLS;
+    if (r > SCR_MAX_ROWS) r = SCR_MAX_ROWS;
+    if (scr_open_size(c, r) != 0) return -1;
+    if (cols) *cols = c;
+    if (rows) *rows = r;
+    return 0;
+}
+
+/* Hand the console back to the shell: restore the COLOR attribute */
+static void scr_close(void) {
+    if (!g_scr.open) return;
+    scr_release();
+    apply_color();
+    con_write("\033[2J\033[H", 7);
+    con_flush();
+}
+
+/* CLS behind the model's back: the terminal is now blank in the shell color */
+static void scr_note_cls(void) {
+    if (!g_scr.open) return;
+    uint8_t attr = (uint8_t)((g_bg << 4) | g_fg);
+    size_t cells = (size_t)g_scr.cols * (size_t)g_scr.rows;
+    for (size_t i = 0; i < cells; i++) { g_scr.front[i].ch = ' '; g_scr.front[i].attr = attr; }
+    memset(g_scr.dirty, 1, (size_t)g_scr.rows);
+    g_scr.term_x = g_scr.term_y = 0;
+    g_scr.term_attr = attr;
+}
+
+static void scr_put(int x, int y, int ch, int attr) {
+    if (!g_scr.open || x < 0 || y < 0 || x >= g_scr.cols || y >= g_scr.rows) return;
+    ScrCell *c = &g_scr.back[(size_t)y * (size_t)g_scr.cols + (size_t)x];
+    c->ch = (uint8_t)ch;
+    c->attr = (uint8_t)attr;
+    g_scr.dirty[y] = 1;
+}
+
+static void scr_text(int x, int y, const char *s, int attr) {
+    if (!g_scr.open || !s || y < 0 || y >= g_scr.rows) return;
+    ScrCell *row = &g_scr.back[(size_t)y * (size_t)g_scr.cols];
+    for (; *s && x < g_scr.cols; s++, x++) {
+        if (x < 0) continue;
+        row[x].ch = (uint8_t)*s;
+        row[x].attr = (uint8_t)attr;
+    }
+    g_scr.dirty[y] = 1;
+}
+
+static void scr_fill(int x, int y, int w, int h, int ch, int attr) {
+    if (!g_scr.open) return;
+    int x1 = x + w, y1 = y + h;
+    if (x < 0) x = 0;
+    if (y < 0) y = 0;
+    if (x1 > g_scr.cols) x1 = g_scr.cols;
+    if (y1 > g_scr.rows) y1 = g_scr.rows;
+    for (int r = y; r < y1; r++) {
+        ScrCell *row = &g_scr.back[(size_t)r * (size_t)g_scr.cols];
+        for (int c = x; c < x1; c++) { row[c].ch = (uint8_t)ch; row[c].attr = (uint8_t)attr; }
+        g_scr.dirty[r] = 1;
+    }
+}
+
+static void scr_cursor(int x, int y) {
+    g_scr.cur_x = x;
+    g_scr.cur_y = y;
+}
+
+static void scr_emit(const char *p, size_t n) {
+    con_write(p, n);
+    g_scr.last_bytes += (unsigned)n;
+}
+
+static void scr_move(int x, int y) {
+    if (g_scr.term_x == x && g_scr.term_y == y) return;
+    char seq[24];
+    int n;
+    if (x == 0 && y == 0) n = snprintf(seq, sizeof seq, "\033[H");
+    else if (x == 0)      n = snprintf(seq, sizeof seq, "\033[%dH", y + 1);
+    else                  n = snprintf(seq, sizeof seq, "\033[%d;%dH", y + 1, x + 1);
+    scr_emit(seq, (size_t)n);
+    g_scr.term_x = x;
+    g_scr.term_y = y;
+}
+
+/* Switch the terminal to attr, sending only the half (fg/bg) that changed */
+static void scr_attr(uint8_t attr) {
+    if (g_scr.term_attr == attr) return;
+
+    int fg = attr & 0x0F, bg = attr >> 4;
+    int old = g_scr.term_attr;
+    char seq[24];
+    int n;
+    if (old >= 0 && (old >> 4) == bg)
+        n = snprintf(seq, sizeof seq, "\033[%dm", ansi_fg_code(fg));
+    else if (old >= 0 && (old & 0x0F) == fg)
+        n = snprintf(seq, sizeof seq, "\033[%dm", ansi_bg_code(bg));
+    else
+        n = snprintf(seq, sizeof seq, "\033[%d;%dm", ansi_bg_code(bg), ansi_fg_code(fg));
+    scr_emit(seq, (size_t)n);
+    g_scr.term_attr = attr;
+}
+
+static int scr_cell_eq(const ScrCell *a, const ScrCell *b) {
+    return a->ch == b->ch && a->attr == b->attr;
+}
+
+/* Bring the terminal in line with the back buffer. Returns bytes emitted. */
+static unsigned scr_present(void) {
+    if (!g_scr.open) return 0;
+    g_scr.last_bytes = 0;
+
+    int cols = g_scr.cols;
+    for (int y = 0; y < g_scr.rows; y++) {
+        if (!g_scr.dirty[y]) continue;
+        g_scr.dirty[y] = 0;
+
+        ScrCell *b = &g_scr.back[(size_t)y * (size_t)cols];
+        ScrCell *f = &g_scr.front[(size_t)y * (size_t)cols];
+
+        int x = 0;
+        while (x < cols) {
+            if (scr_cell_eq(&b[x], &f[x])) { x++; continue; }
+
+            // A short unchanged gap on the same row is cheaper to rewrite
+            // than to jump over, as long as it needs no attribute change.
+            if (g_scr.term_y == y && g_scr.term_x >= 0 && g_scr.term_x < x &&
+                x - g_scr.term_x <= SCR_GAP_FILL) {
+                int ok = 1;
+                for (int g = g_scr.term_x; g < x; g++) if (b[g].attr != g_scr.term_attr) { ok = 0; break; }
+                if (ok) {
+                    for (int g = g_scr.term_x; g < x; g++) {
+                        char ch = (b[g].ch >= 0x20 && b[g].ch < 0x7F) ? (char)b[g].ch : (b[g].ch ? '?' : ' ');
+                        scr_emit(&ch, 1);
+                    }
+                    g_scr.term_x = x;
+                }
+            }
+            scr_move(x, y);
+
+            while (x < cols && !scr_cell_eq(&b[x], &f[x])) {
+                scr_attr(b[x].attr);
+                char ch = (b[x].ch >= 0x20 && b[x].ch < 0x7F) ? (char)b[x].ch : (b[x].ch ? '?' : ' ');
+                scr_emit(&ch, 1);
+                f[x] = b[x];
+                x++;
+            }
+            // Past the last column the terminal may or may not have wrapped
+            g_scr.term_x = (x < cols) ? x : -1;
+            if (x >= cols) g_scr.term_y = -1;
+        }
+    }
+
+    if (g_scr.cur_x >= 0 && g_scr.cur_y >= 0 && g_scr.cur_x < cols && g_scr.cur_y < g_scr.rows)
+        scr_move(g_scr.cur_x, g_scr.cur_y);
+
+    con_flush();
+    return g_scr.last_bytes;
+}
+
+/* --- prompt --- */
+
+static void print_prompt(void) {
+    char dos[PATH_MAX + 8];
+    linux_to_dos_cwd(dos, sizeof dos);
+
+    size_t n = strnlen(dos, sizeof dos);
+    con_write(dos, n);
+    con_write("> ", 2);
+}
+
+/* --- builtins --- */
+
+static void builtin_cls(void) {
+    const char *seq = "\033[2J\033[H";
+    con_write(seq, 7);
+    scr_note_cls();
+}
+
+static void builtin_pause(void) {
+    const char *msg = "Press any key to continue . . .";
+    con_write(msg, strlen(msg));
+
+    struct termios oldt, raw;
+    int has_tty = (tcgetattr(0, &oldt) == 0);
+    if (has_tty) {
+        raw = oldt;
+        raw.c_lflag &= ~(ICANON | ECHO | ISIG);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        (void)tcsetattr(0, TCSANOW, &raw);
+    }
+
+    con_flush();
+
+    unsigned char c;
+    (void)con_read(&c, 1);
+
+    if (has_tty) (void)tcsetattr(0, TCSANOW, &oldt);
+
+    con_write("\r\n", 2);
 }
 
 static void builtin_exit(void) {
@@ -409,20 +1535,20 @@ static void builtin_echo(const char *arg) {
         const char *msg =
             "ECHO [ON|OFF|message]\n"
             "  Displays messages, or turns command echoing on or off.\n";
-        (void)write(1, msg, strlen(msg));
+        con_write(msg, strlen(msg));
         return;
     }
 
     if (!arg || !*arg) {
-        if (g_echo_on) (void)write(1, "ECHO is on.\n", 12);
-        else           (void)write(1, "ECHO is off.\n", 13);
+        if (g_echo_on) con_write("ECHO is on.\n", 12);
+        else           con_write("ECHO is off.\n", 13);
         return;
     }
 
     while (*arg == ' ' || *arg == '\t') arg++;
     if (!*arg) {
-        if (g_echo_on) (void)write(1, "ECHO is on.\n", 12);
-        else           (void)write(1, "ECHO is off.\n", 13);
+        if (g_echo_on) con_write("ECHO is on.\n", 12);
+        else           con_write("ECHO is off.\n", 13);
         return;
     }
 
@@ -435,8 +1561,111 @@ static void builtin_echo(const char *arg) {
         return;
     }
 
-    (void)write(1, arg, strlen(arg));
-    (void)write(1, "\n", 1);
+    con_write(arg, strlen(arg));
+    con_write("\n", 1);
+}
+
+static void builtin_iostat(const char *arg) {
+    if (is_help_switch(arg)) {
+        const char *msg =
+            "IOSTAT [ON|OFF]\n"
+            "  Reports console write() calls and bytes after each command,\n"
+            "  and how much heap a COM64 program used at its peak.\n";
+        con_write(msg, strlen(msg));
+        return;
+    }
+
+    if (!arg || !*arg) {
+        if (g_con_stats) con_write("IOSTAT is on.\n", 14);
+        else             con_write("IOSTAT is off.\n", 15);
+        return;
+    }
+
+    if (!strcasecmp(arg, "on"))       g_con_stats = 1;
+    else if (!strcasecmp(arg, "off")) g_con_stats = 0;
+    else con_error("Invalid parameter\n", 18);
+}
+
+static void builtin_bootlog(const char *arg) {
+    if (is_help_switch(arg)) {
+        const char *msg =
+            "BOOTLOG\n"
+            "  Shows how long each init phase took (CLOCK_BOOTTIME).\n";
+        con_write(msg, strlen(msg));
+        return;
+    }
+
+    static char buf[BOOT_MAX_MARKS * (BOOT_NAME_MAX + 24) + 192];
+    size_t n = boot_format(buf, sizeof buf);
+    con_write(buf, n);
+}
+
+static void stat_print_hist(const CmdStat *s) {
+    uint32_t top = 1;
+    for (int b = 0; b < STAT_BUCKETS; b++) if (s->hist[b] > top) top = s->hist[b];
+
+    char line[128];
+    snprintf(line, sizeof line, "%s: %llu call(s)\n  Time under      Calls\n",
+             s->name, (unsigned long long)s->calls);
+    con_write(line, strlen(line));
+    for (int b = 0; b < STAT_BUCKETS; b++) {
+        if (!s->hist[b]) continue;
+        uint64_t us = 1ull << b;
+        char bound[16], bar[41];
+        if (us < 1000)          snprintf(bound, sizeof bound, "%llu us", (unsigned long long)us);
+        else if (us < 1000000)  snprintf(bound, sizeof bound, "%llu ms", (unsigned long long)(us / 1000));
+        else                    snprintf(bound, sizeof bound, "%llu s", (unsigned long long)(us / 1000000));
+        size_t w = (size_t)((uint64_t)s->hist[b] * 40 / top);
+        memset(bar, '#', w ? w : 1);
+        bar[w ? w : 1] = 0;
+        snprintf(line, sizeof line, "  %9s %10u  %s\n", bound, s->hist[b], bar);
+        con_write(line, strlen(line));
+    }
+}
+
+static void builtin_stats(const char *arg) {
+    if (is_help_switch(arg)) {
+        const char *msg =
+            "STATS [command | /RESET]\n"
+            "  Shows, per command since boot: calls, errors, wall time and the\n"
+            "  file bytes COPY and TYPE read and wrote. p50/p99 are log2 bucket\n"
+            "  bounds. With a command name, shows its latency histogram.\n"
+            "  /RESET  Clears all counters\n";
+        con_write(msg, strlen(msg));
+        return;
+    }
+
+    if (!arg || !*arg) {
+        static char buf[STAT_MAX * 80 + 96];
+        con_write(buf, stat_format(buf, sizeof buf));
+        return;
+    }
+
+    if (!strcasecmp(arg, "/RESET")) {
+        memset(g_stat, 0, sizeof g_stat);
+        g_stat_n = 0;
+        g_stat_cur = NULL; // this STATS is not counted either
+        g_stat_dirty = 1;
+        return;
+    }
+
+    size_t len = strcspn(arg, " \t");
+    if (arg[len + strspn(arg + len, " \t")]) { con_error("Too many parameters\n", 20); return; }
+
+    // Counted like stat_begin() names it: upper case, no extension, truncated
+    char name[sizeof g_stat[0].name];
+    size_t n = 0;
+    for (; n < len && arg[n] != '.' && n < sizeof name - 1; n++)
+        name[n] = (char)toupper((unsigned char)arg[n]);
+    name[n] = 0;
+    for (int i = 0; i < g_stat_n; i++) {
+        const CmdStat *s = &g_stat[g_stat_order[i]];
+        if (s->calls && !strcmp(s->name, name)) { stat_print_hist(s); return; }
+    }
+
+    char msg[64];
+    snprintf(msg, sizeof msg, "Command not found - %.*s\n", (int)len, arg);
+    con_error(msg, strlen(msg));
 }
 
 static void builtin_color(const char *arg) {
@@ -445,14 +1674,14 @@ static void builtin_color(const char *arg) {
             "COLOR [attr]\n"
             "  attr: two hex digits. First = background, second = foreground.\n"
             "  Example: COLOR 1F\n";
-        (void)write(1, msg, strlen(msg));
+        con_write(msg, strlen(msg));
         return;
     }
 
     if (!arg || !*arg) {
         char msg[64];
         snprintf(msg, sizeof msg, "Current color: %X%X\n", g_bg, g_fg);
-        (void)write(1, msg, strlen(msg));
+        con_write(msg, strlen(msg));
         return;
     }
 
@@ -460,13 +1689,13 @@ static void builtin_color(const char *arg) {
 
     int a = hexval((unsigned char)arg[0]);
     int b = hexval((unsigned char)arg[1]);
-    if (a < 0 || b < 0) { (void)write(1, "Invalid parameter\n", 18); return; }
+    if (a < 0 || b < 0) { con_error("Invalid parameter\n", 18); return; }
 
     const char *p = arg + 2;
     while (*p == ' ' || *p == '\t') p++;
-    if (*p != 0) { (void)write(1, "Invalid parameter\n", 18); return; }
+    if (*p != 0) { con_error("Invalid parameter\n", 18); return; }
 
-    if (a == b) { (void)write(1, "Invalid parameter\n", 18); return; }
+    if (a == b) { con_error("Invalid parameter\n", 18); return; }
 
     g_bg = a;
     g_fg = b;
@@ -477,45 +1706,48 @@ static void builtin_color(const char *arg) {
 static void builtin_type(const char *arg) {
     if (is_help_switch(arg)) {
         const char *msg = "TYPE file\n  Displays the contents of a text file.\n";
-        (void)write(1, msg, strlen(msg));
+        con_write(msg, strlen(msg));
         return;
     }
 
-    if (!arg || !*arg) { (void)write(1, "File not found\n", 15); return; }
+    if (!arg || !*arg) { con_error("File not found\n", 15); return; }
 
     char linuxp[PATH_MAX];
     if (dos_to_linux_path(arg, linuxp, sizeof linuxp) != 0) {
-        (void)write(1, "File not found\n", 15);
+        con_error("File not found\n", 15);
         return;
     }
 
     int fd = open(linuxp, O_RDONLY);
-    if (fd < 0) { (void)write(1, "File not found\n", 15); return; }
+    if (fd < 0) { con_error("File not found\n", 15); return; }
+    ra_note(linuxp);
 
     char buf[512];
     ssize_t n;
     while ((n = read(fd, buf, sizeof buf)) > 0) {
-        (void)write(1, buf, (size_t)n);
+        con_write(buf, (size_t)n);
+        g_stat_bytes_in += (uint64_t)n;
+        g_stat_bytes_out += (uint64_t)n;
     }
     close(fd);
 }
 
 static void builtin_copy_con(const char *dst_dos) {
     if (!dst_dos || !*dst_dos) {
-        (void)write(1, "Invalid number of parameters\n", 29);
+        con_error("Invalid number of parameters\n", 29);
         return;
     }
 
     char dst_linux[PATH_MAX];
     if (dos_to_linux_path(dst_dos, dst_linux, sizeof dst_linux) != 0) {
-        (void)write(1, "Invalid drive\n", 14);
+        con_error("Invalid drive\n", 14);
         return;
     }
 
     int fd = open(dst_linux, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    if (fd < 0) { (void)write(1, "Access denied\n", 14); return; }
+    if (fd < 0) { con_error("Access denied\n", 14); return; }
 
-    (void)write(1, "Enter text. End with Ctrl+Z.\r\n", 31);
+    con_write("Enter text. End with Ctrl+Z.\r\n", 31);
 
     struct termios oldt, raw;
     int has_tty = (tcgetattr(0, &oldt) == 0);
@@ -531,46 +1763,56 @@ static void builtin_copy_con(const char *dst_dos) {
 
     char linebuf[512];
     size_t len = 0;
+    int done = 0;
 
-    for (;;) {
-        unsigned char c;
-        ssize_t n = read(0, &c, 1);
+    // Take whatever the console has (a pasted block arrives in one read)
+    // and echo it with a single flush rather than a write per key.
+    while (!done) {
+        con_flush();
+
+        unsigned char in[256];
+        ssize_t n = con_read(in, sizeof in);
         if (n <= 0) break;
 
-        if (c == 0x1A) { // Ctrl+Z
-            (void)write(1, "^Z\r\n", 4);
-            if (len) (void)write(fd, linebuf, len);
-            break;
-        }
+        for (ssize_t k = 0; k < n && !done; k++) {
+            unsigned char c = in[k];
 
-        if (c == '\r' || c == '\n') {
-            (void)write(1, "\r\n", 2);
-            if (len) (void)write(fd, linebuf, len);
-            (void)write(fd, "\r\n", 2);
-            len = 0;
-            continue;
-        }
+            if (c == 0x1A) { // Ctrl+Z
+                con_write("^Z\r\n", 4);
+                if (len) (void)write(fd, linebuf, len);
+                done = 1;
+                break;
+            }
 
-        if (c == 0x08 || c == 0x7F) {
-            if (len > 0) {
-                len--;
-                (void)write(1, "\b \b", 3);
+            if (c == '\r' || c == '\n') {
+                con_write("\r\n", 2);
+                if (len) (void)write(fd, linebuf, len);
+                (void)write(fd, "\r\n", 2);
+                len = 0;
+                continue;
+            }
+
+            if (c == 0x08 || c == 0x7F) {
+                if (len > 0) {
+                    len--;
+                    con_write("\b \b", 3);
+                }
+                continue;
             }
-            continue;
-        }
 
-        if (c < 0x20 && c != '\t') continue;
+            if (c < 0x20 && c != '\t') continue;
 
-        if (len + 1 < sizeof linebuf) {
-            linebuf[len++] = (char)c;
-            (void)write(1, &c, 1);
+            if (len + 1 < sizeof linebuf) {
+                linebuf[len++] = (char)c;
+                con_write(&c, 1);
+            }
         }
     }
 
     if (has_tty) (void)tcsetattr(0, TCSANOW, &oldt);
 
     close(fd);
-    (void)write(1, "        1 file(s) copied.\r\n", 28);
+    con_write("        1 file(s) copied.\r\n", 28);
 }
 
 static void builtin_del(const char *arg) {
@@ -578,23 +1820,23 @@ static void builtin_del(const char *arg) {
         const char *msg =
             "DEL [filespec]\nERASE [filespec]\n"
             "  Deletes file(s). Wildcards: * and ?\n";
-        (void)write(1, msg, strlen(msg));
+        con_write(msg, strlen(msg));
         return;
     }
 
-    if (!arg || !*arg) { (void)write(1, "File not found\n", 15); return; }
+    if (!arg || !*arg) { con_error("File not found\n", 15); return; }
 
     char linuxspec[PATH_MAX];
     if (dos_to_linux_path(arg, linuxspec, sizeof linuxspec) != 0) {
-        (void)write(1, "File not found\n", 15);
+        con_error("File not found\n", 15);
         return;
     }
 
     if (!has_wildcards(linuxspec)) {
         struct stat st;
-        if (stat(linuxspec, &st) != 0) { (void)write(1, "File not found\n", 15); return; }
-        if (S_ISDIR(st.st_mode)) { (void)write(1, "Access denied\n", 14); return; }
-        if (unlink(linuxspec) != 0) { (void)write(1, "Access denied\n", 14); return; }
+        if (stat(linuxspec, &st) != 0) { con_error("File not found\n", 15); return; }
+        if (S_ISDIR(st.st_mode)) { con_error("Access denied\n", 14); return; }
+        if (unlink(linuxspec) != 0) { con_error("Access denied\n", 14); return; }
         return;
     }
 
@@ -603,7 +1845,7 @@ static void builtin_del(const char *arg) {
     split_dir_pat(linuxspec, dirpath, sizeof dirpath, pattern, sizeof pattern);
 
     DIR *d = opendir(dirpath);
-    if (!d) { (void)write(1, "File not found\n", 15); return; }
+    if (!d) { con_error("File not found\n", 15); return; }
 
     long long deleted = 0;
 
@@ -624,39 +1866,61 @@ static void builtin_del(const char *arg) {
 
     closedir(d);
 
-    if (deleted == 0) (void)write(1, "File not found\n", 15);
+    if (deleted == 0) con_error("File not found\n", 15);
 }
 
 static void builtin_cd(const char *arg) {
     if (is_help_switch(arg)) {
         const char *msg =
-            "CD [path]\n  Changes the current directory.\n";
-        (void)write(1, msg, strlen(msg));
+            "CD [drive:][path]\n"
+            "  Changes the current directory. With another drive's letter it\n"
+            "  changes (or, alone, shows) that drive's directory instead.\n";
+        con_write(msg, strlen(msg));
         return;
     }
 
-    if (!arg || !*arg) {
+    int d = arg ? drive_prefix(arg) : -1;
+    if ((!arg || !*arg) || (d >= 0 && arg[2] == 0)) {
         char dos[PATH_MAX + 8];
-        linux_to_dos_cwd(dos, sizeof dos);
-        (void)write(1, dos, strnlen(dos, sizeof dos));
-        (void)write(1, "\n", 1);
+        if (d >= 0 && d != g_cur_drive) {
+            if (!drive_mapped(d)) { con_error("Invalid drive\n", 14); return; }
+            linux_to_dos(g_drives[d].cwd, dos, sizeof dos);
+        } else {
+            linux_to_dos_cwd(dos, sizeof dos);
+        }
+        con_write(dos, strnlen(dos, sizeof dos));
+        con_write("\n", 1);
         return;
     }
 
     char linuxp[PATH_MAX];
     if (dos_to_linux_path(arg, linuxp, sizeof linuxp) != 0) {
-        (void)write(1, "Invalid drive\n", 14);
+        con_error("Invalid drive\n", 14);
         return;
     }
 
-    if (chdir(linuxp) == 0) return;
+    if (d >= 0 && d != g_cur_drive) {
+        char real[PATH_MAX];
+        struct stat st;
+        if (realpath(linuxp, real) && stat(real, &st) == 0 && S_ISDIR(st.st_mode) &&
+            path_under(real, g_drives[d].root)) {
+            snprintf(g_drives[d].cwd, PATH_MAX, "%s", real);
+            return;
+        }
+    } else if (chdir(linuxp) == 0) {
+        // CD .. at a drive's root stays on the drive
+        char cwd[PATH_MAX];
+        if (!getcwd(cwd, sizeof cwd) || !path_under(cwd, g_drives[g_cur_drive].root))
+            (void)chdir(g_drives[g_cur_drive].root);
+        return;
+    }
 
-    (void)write(1, "The system cannot find the path specified.\n", 43);
+    con_error("The system cannot find the path specified.\n", 43);
 }
 
-static void dos_print_dir_line(const char *name, const struct stat *st) {
+static void dos_print_dir_line(const char *name, int is_dir, long long size, time_t mtime) {
     struct tm tm;
-    localtime_r(&st->st_mtime, &tm);
+    localtime_r(&mtime, &tm);
 
     int hour = tm.tm_hour;
     const char *ampm = (hour >= 12) ? "PM" : "AM";
@@ -665,7 +1929,7 @@ static void dos_print_dir_line(const char *name, const struct stat *st) {
 
     char buf[512];
 
-    if (S_ISDIR(st->st_mode)) {
+    if (is_dir) {
         snprintf(buf, sizeof buf,
                  "%02d-%02d-%02d  %02d:%02d%s    <DIR>          %s\n",
                  tm.tm_mon + 1, tm.tm_mday, (tm.tm_year % 100),
@@ -676,48 +1940,307 @@ static void dos_print_dir_line(const char *name, const struct stat *st) {
                  "%02d-%02d-%02d  %02d:%02d%s %14lld %s\n",
                  tm.tm_mon + 1, tm.tm_mday, (tm.tm_year % 100),
                  hour, tm.tm_min, ampm,
-                 (long long)st->st_size,
+                 size,
                  name);
     }
 
-    (void)write(1, buf, strnlen(buf, sizeof buf));
+    con_write(buf, strnlen(buf, sizeof buf));
 }
 
-static void builtin_dir(const char *arg) {
-    if (is_help_switch(arg)) {
-        const char *msg =
-            "DIR [filespec] [/W] [/A]\n"
-            "  /W  Wide listing\n"
-            "  /A  Show all (includes . and ..)\n"
-            "  Wildcards: * and ?\n";
-        (void)write(1, msg, strlen(msg));
-        return;
+/* DIR /O collects the listing before printing it. Entries go into two
+   arenas, each one reservation that is only committed as it fills:
+   fixed 24-byte DirRec records, and the names they refer to by offset,
+   packed with their NULs. Ordering is an LSD radix sort of (key, index)
+   pairs on a 64-bit key: size, time, or the first 8 bytes of the
+   upper-cased name or extension; runs of equal keys are then settled by
+   comparing whole names. An entry costs 24 bytes of record, 32 of sort
+   pairs (the pairs and the radix scratch copy) and its name plus one:
+   about 70 bytes for an 8.3 name, and no malloc at all. */
+
+#define DIR_ARENA_RESERVE (4ull << 30)
+#define DIR_ARENA_MIN     (16u << 20)
+#define DIR_RUN_INSERTION 16 // equal-key runs up to this long use insertion sort
+
+typedef struct DirArena {
+    uint8_t *base;
+    size_t   used, cap;
+} DirArena;
+
+typedef struct DirRec {
+    int64_t  mtime;
+    uint64_t size;
+    uint32_t name;   // offset into the name arena
+    uint16_t len;
+    uint8_t  ext;    // offset of the extension in the name, len if none
+    uint8_t  is_dir;
+} DirRec;
+
+typedef struct DirKey {
+    uint64_t key;
+    uint64_t rec;    // index into the records
+} DirKey;
+
+typedef struct DirList {
+    DirArena recs;   // DirRec[n], then the sort pairs
+    DirArena names;
+    size_t   n;
+    long long files, dirs, bytes;
+} DirList;
+
+static void *dir_arena_alloc(DirArena *a, size_t n) {
+    if (!a->base) {
+        for (size_t sz = DIR_ARENA_RESERVE; sz >= DIR_ARENA_MIN; sz /= 2) {
+            void *p = mmap(NULL, sz, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (p != MAP_FAILED) {
+                a->base = p;
+                a->cap = sz;
+                break;
+            }
+        }
+        if (!a->base) return NULL;
     }
+    n = (n + 7) & ~(size_t)7;
+    if (n > a->cap - a->used) return NULL;
+    void *p = a->base + a->used;
+    a->used += n;
+    return p;
+}
 
-    int wide = 0, all = 0;
-    parse_dir_switches(arg, &wide, &all);
+static void dir_list_free(DirList *l) {
+    if (l->recs.base) munmap(l->recs.base, l->recs.cap);
+    if (l->names.base) munmap(l->names.base, l->names.cap);
+    memset(l, 0, sizeof *l);
+}
 
-    char filespec_tok[PATH_MAX];
-    const char *filespec = dir_find_filespec(arg, filespec_tok, sizeof filespec_tok);
+static DirRec *dir_recs(const DirList *l) { return (DirRec *)l->recs.base; }
 
-    char linuxspec[PATH_MAX];
-    const char *spec_linux = NULL;
+static const char *dir_name(const DirList *l, const DirRec *r) {
+    return (const char *)l->names.base + r->name;
+}
 
-    if (filespec && *filespec) {
-        if (dos_to_linux_path(filespec, linuxspec, sizeof linuxspec) != 0) {
-            (void)write(1, "Invalid drive\n", 14);
-            return;
-        }
-        spec_linux = linuxspec;
+/* Entries of an open directory that match pattern. -1: out of memory. */
+static int dir_collect(DIR *d, const char *pattern, int all, DirList *l) {
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        const char *name = de->d_name;
+        if (!all && (!strcmp(name, ".") || !strcmp(name, ".."))) continue;
+        if (!wildmatch_ci(pattern, name)) continue;
+
+        struct stat st;
+        if (fstatat(dirfd(d), name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+
+        size_t len = strlen(name);
+        DirRec *r = (DirRec *)dir_arena_alloc(&l->recs, sizeof *r);
+        char *s = (char *)dir_arena_alloc(&l->names, len + 1);
+        if (!r || !s || (size_t)(s - (char *)l->names.base) > UINT32_MAX) return -1;
+        memcpy(s, name, len + 1);
+
+        const char *dot = strrchr(name, '.');
+        r->mtime = (int64_t)st.st_mtime;
+        r->size = S_ISDIR(st.st_mode) ? 0 : (uint64_t)st.st_size;
+        r->name = (uint32_t)(s - (char *)l->names.base);
+        r->len = (uint16_t)len;
+        r->ext = (uint8_t)((dot && dot != name) ? (size_t)(dot + 1 - name) : len);
+        r->is_dir = S_ISDIR(st.st_mode) != 0;
+        l->n++;
+
+        if (r->is_dir) l->dirs++;
+        else { l->files++; l->bytes += (long long)st.st_size; }
     }
+    return 0;
+}
 
-    char dirpath[PATH_MAX];
-    char pattern[PATH_MAX];
+/* First 8 bytes of s, upper-cased and big-endian, so keys order like strings */
+static uint64_t dir_text_key(const char *s, size_t n) {
+    uint64_t k = 0;
+    for (size_t i = 0; i < 8; i++) k = (k << 8) | (i < n ? (uint8_t)toupper((unsigned char)s[i]) : 0);
+    return k;
+}
 
-    if (!spec_linux) {
-        snprintf(dirpath, sizeof dirpath, ".");
-        snprintf(pattern, sizeof pattern, "*");
-    } else {
+static int dir_name_cmp(const DirList *l, const DirKey *a, const DirKey *b) {
+    const DirRec *r = dir_recs(l);
+    return strcasecmp(dir_name(l, &r[a->rec]), dir_name(l, &r[b->rec]));
+}
+
+static int dir_qcmp(const void *a, const void *b, void *l) {
+    return dir_name_cmp((const DirList *)l, (const DirKey *)a, (const DirKey *)b);
+}
+
+/* Extension, then name, for the few extensions longer than a key */
+static int dir_ext_cmp(const DirList *l, const DirKey *a, const DirKey *b) {
+    const DirRec *r = dir_recs(l);
+    const DirRec *x = &r[a->rec], *y = &r[b->rec];
+    int c = strcasecmp(dir_name(l, x) + x->ext, dir_name(l, y) + y->ext);
+    return c ? c : dir_name_cmp(l, a, b);
+}
+
+static int dir_ext_long(const DirRec *x, const DirRec *y) {
+    return x->len - x->ext >= 8 || y->len - y->ext >= 8;
+}
+
+static uint64_t dir_key(const DirList *l, const DirRec *r, char by) {
+    const char *name = dir_name(l, r);
+    switch (by) {
+    case 'S': return r->size;
+    case 'D': return (uint64_t)r->mtime ^ (1ull << 63);
+    case 'E': return dir_text_key(name + r->ext, (size_t)(r->len - r->ext));
+    default:  return dir_text_key(name, r->len);
+    }
+}
+
+/* Stable LSD radix sort of k on its keys, using tmp; returns whichever of
+   the two holds the result. Bytes every key shares are skipped. */
+static DirKey *dir_radix(DirKey *k, DirKey *tmp, size_t n) {
+    size_t count[8][256];
+    memset(count, 0, sizeof count);
+    for (size_t i = 0; i < n; i++)
+        for (int b = 0; b < 8; b++) count[b][(k[i].key >> (8 * b)) & 0xFF]++;
+
+    for (int b = 0; b < 8; b++) {
+        size_t *c = count[b];
+        if (c[(k[0].key >> (8 * b)) & 0xFF] == n) continue;
+        size_t sum = 0;
+        for (int v = 0; v < 256; v++) { size_t t = c[v]; c[v] = sum; sum += t; }
+        for (size_t i = 0; i < n; i++) tmp[c[(k[i].key >> (8 * b)) & 0xFF]++] = k[i];
+        DirKey *swap = k; k = tmp; tmp = swap;
+    }
+    return k;
+}
+
+/* Order the collected entries by N, E, S or D. Returns the pairs, or NULL
+   if the arena is full. */
+static DirKey *dir_sort(DirList *l, char by) {
+    size_t n = l->n;
+    DirKey *k = (DirKey *)dir_arena_alloc(&l->recs, n * sizeof *k);
+    DirKey *tmp = (DirKey *)dir_arena_alloc(&l->recs, n * sizeof *tmp);
+    if (!k || !tmp || n == 0) return k;
+
+    // /OE has a handful of distinct keys, so its ties would all go to the
+    // comparison sort: put the names in order first, then sort stably on
+    // the extension, which keeps that order within each extension.
+    const DirRec *r = dir_recs(l);
+    for (size_t i = 0; i < n; i++) {
+        k[i].key = dir_key(l, &r[i], by == 'E' ? 'N' : by);
+        k[i].rec = i;
+    }
+    DirKey *s = dir_radix(k, tmp, n);
+    if (s != k) tmp = k;
+
+    // Equal keys: by full name
+    for (size_t i = 0; i < n;) {
+        size_t j = i + 1;
+        while (j < n && s[j].key == s[i].key) j++;
+        if (j - i > DIR_RUN_INSERTION) {
+            qsort_r(s + i, j - i, sizeof *s, dir_qcmp, l);
+        } else {
+            for (size_t a = i + 1; a < j; a++) {
+                DirKey x = s[a];
+                size_t b = a;
+                while (b > i && dir_name_cmp(l, &s[b - 1], &x) > 0) { s[b] = s[b - 1]; b--; }
+                s[b] = x;
+            }
+        }
+        i = j;
+    }
+    if (by != 'E') return s;
+
+    for (size_t i = 0; i < n; i++) s[i].key = dir_key(l, &r[s[i].rec], 'E');
+    DirKey *e = dir_radix(s, tmp, n);
+
+    // Only extensions that differ past the key's 8 bytes are out of order;
+    // anywhere else this pass just confirms the runs, in linear time.
+    for (size_t a = 1; a < n; a++) {
+        DirKey x = e[a];
+        size_t b = a;
+        while (b > 0 && e[b - 1].key == x.key && dir_ext_long(&r[x.rec], &r[e[b - 1].rec]) &&
+               dir_ext_cmp(l, &e[b - 1], &x) > 0) {
+            e[b] = e[b - 1];
+            b--;
+        }
+        e[b] = x;
+    }
+    return e;
+}
+
+/* DIR /P: pause after each screenful. Only on a terminal, where PAUSE's
+   key comes from a person rather than from the next line of input. */
+typedef struct DirPager {
+    int rows;  // 0: not paging
+    int lines;
+} DirPager;
+
+static void dir_pager_init(DirPager *pg, int on) {
+    struct winsize ws;
+    pg->lines = 0;
+    pg->rows = 0;
+    if (!on || !isatty(0)) return;
+    pg->rows = (ioctl(1, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 2) ? ws.ws_row : 25;
+}
+
+static void dir_pager_line(DirPager *pg) {
+    if (!pg->rows || ++pg->lines < pg->rows - 1) return;
+    builtin_pause();
+    pg->lines = 0;
+}
+
+static void dir_print_entry(const char *name, int is_dir, long long size, time_t mtime,
+                            const DirOpts *o, int *col, DirPager *pg) {
+    if (o->wide) {
+        char out[32];
+        snprintf(out, sizeof out, "%-15s", name);
+        con_write(out, strlen(out));
+        if (++*col == 5) {
+            con_write("\n", 1);
+            *col = 0;
+            dir_pager_line(pg);
+        }
+    } else {
+        dos_print_dir_line(name, is_dir, size, mtime);
+        dir_pager_line(pg);
+    }
+}
+
+static void builtin_dir(const char *arg) {
+    if (is_help_switch(arg)) {
+        const char *msg =
+            "DIR [filespec] [/W] [/A] [/P] [/O[:][-]N|E|S|D]\n"
+            "  /W  Wide listing\n"
+            "  /A  Show all (includes . and ..)\n"
+            "  /P  Pause after each screenful\n"
+            "  /O  Sort by Name, Extension, Size or Date; - reverses\n"
+            "  Wildcards: * and ?\n";
+        con_write(msg, strlen(msg));
+        return;
+    }
+
+    DirOpts o;
+    if (parse_dir_switches(arg, &o) != 0) {
+        con_error("Invalid switch\n", 15);
+        return;
+    }
+
+    char filespec_tok[PATH_MAX];
+    const char *filespec = dir_find_filespec(arg, filespec_tok, sizeof filespec_tok);
+
+    char linuxspec[PATH_MAX];
+    const char *spec_linux = NULL;
+
+    if (filespec && *filespec) {
+        if (dos_to_linux_path(filespec, linuxspec, sizeof linuxspec) != 0) {
+            con_error("Invalid drive\n", 14);
+            return;
+        }
+        spec_linux = linuxspec;
+    }
+
+    char dirpath[PATH_MAX];
+    char pattern[PATH_MAX];
+
+    if (!spec_linux) {
+        snprintf(dirpath, sizeof dirpath, ".");
+        snprintf(pattern, sizeof pattern, "*");
+    } else {
         if (has_wildcards(spec_linux)) {
             split_dir_pat(spec_linux, dirpath, sizeof dirpath, pattern, sizeof pattern);
         } else if (is_dir_path(spec_linux)) {
@@ -731,7 +2254,7 @@ static void builtin_dir(const char *arg) {
 
     DIR *d = opendir(dirpath);
     if (!d) {
-        (void)write(1, "File not found\n", 15);
+        con_error("File not found\n", 15);
         return;
     }
 
@@ -740,7 +2263,7 @@ static void builtin_dir(const char *arg) {
     if (!filespec) {
         linux_to_dos_cwd(doshdr, sizeof doshdr);
     } else {
-        if (filespec[0] == '\\' || filespec[0] == '/') snprintf(doshdr, sizeof doshdr, "C:%s", filespec);
+        if (filespec[0] == '\\' || filespec[0] == '/') snprintf(doshdr, sizeof doshdr, "%c:%s", 'A' + g_cur_drive, filespec);
         else if (isalpha((unsigned char)filespec[0]) && filespec[1] == ':') snprintf(doshdr, sizeof doshdr, "%s", filespec);
         else linux_to_dos_cwd(doshdr, sizeof doshdr);
         for (size_t i = 0; doshdr[i]; i++) if (doshdr[i] == '/') doshdr[i] = '\\';
@@ -749,7 +2272,7 @@ static void builtin_dir(const char *arg) {
     {
         char hdr[PATH_MAX + 96];
         snprintf(hdr, sizeof hdr, "\n Directory of %s\n\n", doshdr);
-        (void)write(1, hdr, strnlen(hdr, sizeof hdr));
+        con_write(hdr, strnlen(hdr, sizeof hdr));
     }
 
     long long total_bytes = 0;
@@ -758,70 +2281,89 @@ static void builtin_dir(const char *arg) {
     long long shown = 0;
 
     int col = 0;
+    DirPager pg;
+    dir_pager_init(&pg, o.page);
+    pg.lines = 3; // the header
+
+    if (o.order) {
+        DirList l;
+        memset(&l, 0, sizeof l);
+        DirKey *k = NULL;
+        if (dir_collect(d, pattern, o.all, &l) != 0 || (l.n && !(k = dir_sort(&l, o.order)))) {
+            closedir(d);
+            dir_list_free(&l);
+            con_error("Insufficient memory\n", 20);
+            return;
+        }
+        closedir(d);
 
-    struct dirent *de;
-    while ((de = readdir(d)) != NULL) {
-        const char *name = de->d_name;
-
-        if (!all) {
-            if (!strcmp(name, ".") || !strcmp(name, ".."))
-                continue;
+        const DirRec *r = dir_recs(&l);
+        for (size_t i = 0; i < l.n; i++) {
+            const DirRec *e = &r[k[o.reverse ? l.n - 1 - i : i].rec];
+            dir_print_entry(dir_name(&l, e), e->is_dir, (long long)e->size, (time_t)e->mtime, &o, &col, &pg);
         }
+        shown = (long long)l.n;
+        file_count = l.files;
+        dir_count = l.dirs;
+        total_bytes = l.bytes;
+        dir_list_free(&l);
+    } else {
+        struct dirent *de;
+        while ((de = readdir(d)) != NULL) {
+            const char *name = de->d_name;
 
-        if (!wildmatch_ci(pattern, name))
-            continue;
+            if (!o.all) {
+                if (!strcmp(name, ".") || !strcmp(name, ".."))
+                    continue;
+            }
 
-        char full[PATH_MAX * 2];
-        snprintf(full, sizeof full, "%s/%s", dirpath, name);
+            if (!wildmatch_ci(pattern, name))
+                continue;
 
-        struct stat st;
-        if (lstat(full, &st) != 0) continue;
+            char full[PATH_MAX * 2];
+            snprintf(full, sizeof full, "%s/%s", dirpath, name);
 
-        if (wide) {
-            char out[32];
-            snprintf(out, sizeof out, "%-15s", name);
-            (void)write(1, out, strlen(out));
-            col++;
-            if (col == 5) {
-                (void)write(1, "\n", 1);
-                col = 0;
-            }
-        } else {
-            dos_print_dir_line(name, &st);
-        }
+            struct stat st;
+            if (lstat(full, &st) != 0) continue;
 
-        shown++;
+            dir_print_entry(name, S_ISDIR(st.st_mode), (long long)st.st_size, st.st_mtime, &o, &col, &pg);
+            shown++;
 
-        if (S_ISDIR(st.st_mode)) dir_count++;
-        else { file_count++; total_bytes += (long long)st.st_size; }
+            if (S_ISDIR(st.st_mode)) dir_count++;
+            else { file_count++; total_bytes += (long long)st.st_size; }
+        }
+        closedir(d);
     }
 
-    closedir(d);
-
-    if (wide && col != 0) (void)write(1, "\n", 1);
+    if (o.wide && col != 0) con_write("\n", 1);
 
     if (shown == 0) {
-        (void)write(1, "File not found\n", 15);
+        con_error("File not found\n", 15);
         return;
     }
 
     {
         char tail[256];
-        snprintf(tail, sizeof tail,
-                 "\n%8lld File(s) %14lld bytes\n%8lld Dir(s)\n\n",
-                 file_count, total_bytes, dir_count);
-        (void)write(1, tail, strnlen(tail, sizeof tail));
+        int n = snprintf(tail, sizeof tail, "\n%8lld File(s) %14lld bytes\n%8lld Dir(s)",
+                         file_count, total_bytes, dir_count);
+        // Space the caller could still use, as df shows it (f_bavail)
+        struct statfs fs;
+        if (statfs(dirpath, &fs) == 0)
+            snprintf(tail + n, sizeof tail - (size_t)n, " %14llu bytes free",
+                     (unsigned long long)fs.f_bavail * (unsigned long long)fs.f_bsize);
+        strncat(tail, "\n\n", sizeof tail - strlen(tail) - 1);
+        con_write(tail, strnlen(tail, sizeof tail));
     }
 }
 
 static void builtin_ren(const char *arg) {
     if (is_help_switch(arg)) {
         const char *msg = "REN src dest\nRENAME src dest\n  Renames a file.\n";
-        (void)write(1, msg, strlen(msg));
+        con_write(msg, strlen(msg));
         return;
     }
 
-    if (!arg || !*arg) { (void)write(1, "File not found\n", 15); return; }
+    if (!arg || !*arg) { con_error("File not found\n", 15); return; }
 
     char tmp[1024];
     strncpy(tmp, arg, sizeof tmp - 1);
@@ -829,7 +2371,7 @@ static void builtin_ren(const char *arg) {
 
     char *p = tmp;
     while (*p == ' ' || *p == '\t') p++;
-    if (!*p) { (void)write(1, "File not found\n", 15); return; }
+    if (!*p) { con_error("File not found\n", 15); return; }
 
     char *src = p;
     while (*p && *p != ' ' && *p != '\t') p++;
@@ -837,33 +2379,33 @@ static void builtin_ren(const char *arg) {
 
     while (*p == ' ' || *p == '\t') p++;
     char *dst = *p ? p : NULL;
-    if (!dst || !*dst) { (void)write(1, "File not found\n", 15); return; }
+    if (!dst || !*dst) { con_error("File not found\n", 15); return; }
 
     char src_linux[PATH_MAX];
     char dst_linux[PATH_MAX];
 
     if (dos_to_linux_path(src, src_linux, sizeof src_linux) != 0) {
-        (void)write(1, "File not found\n", 15);
+        con_error("File not found\n", 15);
         return;
     }
 
     if (strchr(dst, '\\') || strchr(dst, '/') || (isalpha((unsigned char)dst[0]) && dst[1] == ':')) {
         if (dos_to_linux_path(dst, dst_linux, sizeof dst_linux) != 0) {
-            (void)write(1, "File not found\n", 15);
+            con_error("File not found\n", 15);
             return;
         }
     } else {
         char cwd[PATH_MAX];
-        if (!getcwd(cwd, sizeof cwd)) { (void)write(1, "Access denied\n", 14); return; }
+        if (!getcwd(cwd, sizeof cwd)) { con_error("Access denied\n", 14); return; }
         snprintf(dst_linux, sizeof dst_linux, "%s/%s", cwd, dst);
     }
 
     struct stat st;
-    if (stat(src_linux, &st) != 0) { (void)write(1, "File not found\n", 15); return; }
-    if (S_ISDIR(st.st_mode)) { (void)write(1, "Access denied\n", 14); return; }
+    if (stat(src_linux, &st) != 0) { con_error("File not found\n", 15); return; }
+    if (S_ISDIR(st.st_mode)) { con_error("Access denied\n", 14); return; }
 
     if (rename(src_linux, dst_linux) != 0) {
-        (void)write(1, "Access denied\n", 14);
+        con_error("Access denied\n", 14);
         return;
     }
 }
@@ -871,49 +2413,96 @@ static void builtin_ren(const char *arg) {
 static void builtin_md(const char *arg) {
     if (is_help_switch(arg)) {
         const char *msg = "MD dir\nMKDIR dir\n  Creates a directory.\n";
-        (void)write(1, msg, strlen(msg));
+        con_write(msg, strlen(msg));
         return;
     }
 
-    if (!arg || !*arg) { (void)write(1, "Invalid directory\n", 18); return; }
+    if (!arg || !*arg) { con_error("Invalid directory\n", 18); return; }
 
     char linuxp[PATH_MAX];
     if (dos_to_linux_path(arg, linuxp, sizeof linuxp) != 0) {
-        (void)write(1, "Invalid drive\n", 14);
+        con_error("Invalid drive\n", 14);
         return;
     }
 
     if (mkdir(linuxp, 0755) == 0) return;
 
-    if (errno == EEXIST) (void)write(1, "A subdirectory or file already exists.\n", 39);
-    else                 (void)write(1, "Access denied\n", 14);
+    if (errno == EEXIST) con_error("A subdirectory or file already exists.\n", 39);
+    else                 con_error("Access denied\n", 14);
 }
 
 static void builtin_rd(const char *arg) {
     if (is_help_switch(arg)) {
         const char *msg = "RD dir\nRMDIR dir\n  Removes an empty directory.\n";
-        (void)write(1, msg, strlen(msg));
+        con_write(msg, strlen(msg));
         return;
     }
 
-    if (!arg || !*arg) { (void)write(1, "Invalid directory\n", 18); return; }
+    if (!arg || !*arg) { con_error("Invalid directory\n", 18); return; }
 
     char linuxp[PATH_MAX];
     if (dos_to_linux_path(arg, linuxp, sizeof linuxp) != 0) {
-        (void)write(1, "Invalid drive\n", 14);
+        con_error("Invalid drive\n", 14);
         return;
     }
 
-    if (!strcmp(linuxp, DOS_C_ROOT) || !strcmp(linuxp, DOS_C_ROOT "/")) {
-        (void)write(1, "Access denied\n", 14);
+    if (is_drive_root(linuxp)) {
+        con_error("Access denied\n", 14);
         return;
     }
 
     if (rmdir(linuxp) == 0) return;
 
-    if (errno == ENOTEMPTY || errno == EEXIST)      (void)write(1, "The directory is not empty.\n", 28);
-    else if (errno == ENOENT)                       (void)write(1, "The system cannot find the file specified.\n", 44);
-    else                                            (void)write(1, "Access denied\n", 14);
+    if (errno == ENOTEMPTY || errno == EEXIST)      con_error("The directory is not empty.\n", 28);
+    else if (errno == ENOENT)                       con_error("The system cannot find the file specified.\n", 44);
+    else                                            con_error("Access denied\n", 14);
+}
+
+/* Copy in -> out through one shared buffer. If crc is non-NULL the data is
+   checksummed on its way through, so /V costs no extra read of the source. */
+#define COPY_CHUNK (128 * 1024)
+
+static int copy_fd(int in, int out, uint32_t *crc) {
+    static uint8_t buf[COPY_CHUNK];
+
+    (void)posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    for (;;) {
+        ssize_t n = read(in, buf, sizeof buf);
+        if (n == 0) return 0;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+
+        if (crc) *crc = crc32c_update(*crc, buf, (size_t)n);
+        g_stat_bytes_in += (uint64_t)n;
+
+        ssize_t off = 0;
+        while (off < n) {
+            ssize_t w = write(out, buf + off, (size_t)(n - off));
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                return -1;
+            }
+            off += w;
+        }
+        g_stat_bytes_out += (uint64_t)n;
+    }
+}
+
+/* Second half of COPY /V: the destination has already been fdatasync()ed,
+   so its cached pages are clean and can be dropped before reading it back. */
+static int copy_verify(const char *dst_linux, uint32_t want) {
+    int fd = open(dst_linux, O_RDONLY);
+    if (fd >= 0) {
+        (void)posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+
+    uint32_t got;
+    if (crc32c_file(dst_linux, 1, &got) != 0) return -1;
+    return got == want ? 0 : -1;
 }
 
 static void builtin_copy(const char *arg) {
@@ -923,20 +2512,23 @@ static void builtin_copy(const char *arg) {
             "COPY src1+src2 dest\n"
             "  Copies file(s).\n"
             "  Wildcards supported in src: * and ?\n"
+            "  /V  Verify each copy (CRC32C, re-read from disk)\n"
             "  Use: COPY CON file   (create file from keyboard)\n";
-        (void)write(1, msg, strlen(msg));
+        con_write(msg, strlen(msg));
         return;
     }
 
-    if (!arg || !*arg) { (void)write(1, "File not found\n", 15); return; }
+    if (!arg || !*arg) { con_error("File not found\n", 15); return; }
 
     char tmp[1024];
     strncpy(tmp, arg, sizeof tmp - 1);
     tmp[sizeof tmp - 1] = 0;
 
+    int verify = take_switch(tmp, 'V');
+
     char *p = tmp;
     while (*p == ' ' || *p == '\t') p++;
-    if (!*p) { (void)write(1, "File not found\n", 15); return; }
+    if (!*p) { con_error("File not found\n", 15); return; }
 
     // src token
     char *src = p;
@@ -948,19 +2540,20 @@ static void builtin_copy(const char *arg) {
 
     // Concat mode: SRC1+SRC2 DEST (no wildcards here)
     if (strchr(src, '+')) {
-        if (!dst || !*dst) { (void)write(1, "Invalid number of parameters\n", 29); return; }
+        if (!dst || !*dst) { con_error("Invalid number of parameters\n", 29); return; }
         if (has_wildcards(src) || (dst && has_wildcards(dst))) {
-            (void)write(1, "Invalid number of parameters\n", 29);
+            con_error("Invalid number of parameters\n", 29);
             return;
         }
 
         char dst_linux[PATH_MAX];
         if (dos_to_linux_path(dst, dst_linux, sizeof dst_linux) != 0) {
-            (void)write(1, "Invalid drive\n", 14);
+            con_error("Invalid drive\n", 14);
             return;
         }
 
         int files_copied = 0;
+        uint32_t crc = 0; // running over the whole concatenation
 
         for (;;) {
             char *plus = strchr(src, '+');
@@ -968,33 +2561,26 @@ static void builtin_copy(const char *arg) {
 
             char src_linux[PATH_MAX];
             if (dos_to_linux_path(src, src_linux, sizeof src_linux) != 0) {
-                (void)write(1, "File not found\n", 15);
+                con_error("File not found\n", 15);
                 return;
             }
 
             int in = open(src_linux, O_RDONLY);
-            if (in < 0) { (void)write(1, "File not found\n", 15); return; }
+            if (in < 0) { con_error("File not found\n", 15); return; }
+            ra_note(src_linux);
 
             int out_flags = O_WRONLY | O_CREAT;
             out_flags |= (files_copied == 0) ? O_TRUNC : O_APPEND;
 
             int out = open(dst_linux, out_flags, 0644);
-            if (out < 0) { close(in); (void)write(1, "Access denied\n", 14); return; }
-
-            char buf[4096];
-            ssize_t n;
-            while ((n = read(in, buf, sizeof buf)) > 0) {
-                ssize_t off = 0;
-                while (off < n) {
-                    ssize_t w = write(out, buf + off, (size_t)(n - off));
-                    if (w < 0) { close(in); close(out); (void)write(1, "Access denied\n", 14); return; }
-                    off += w;
-                }
-            }
+            if (out < 0) { close(in); con_error("Access denied\n", 14); return; }
+
+            int rc = copy_fd(in, out, verify ? &crc : NULL);
+            if (rc == 0 && verify && fdatasync(out) != 0) rc = -1;
 
             close(in);
             close(out);
-            if (n < 0) { (void)write(1, "Access denied\n", 14); return; }
+            if (rc != 0) { con_error("Access denied\n", 14); return; }
 
             files_copied++;
 
@@ -1004,16 +2590,21 @@ static void builtin_copy(const char *arg) {
             if (!*src) break;
         }
 
+        if (verify && copy_verify(dst_linux, crc) != 0) {
+            con_error("Verify error\n", 13);
+            return;
+        }
+
         char msg[64];
         snprintf(msg, sizeof msg, "        %d file(s) copied.\n", files_copied);
-        (void)write(1, msg, strlen(msg));
+        con_write(msg, strlen(msg));
         return;
     }
 
     // Normal mode (supports wildcards in src)
     char src_linuxspec[PATH_MAX];
     if (dos_to_linux_path(src, src_linuxspec, sizeof src_linuxspec) != 0) {
-        (void)write(1, "File not found\n", 15);
+        con_error("File not found\n", 15);
         return;
     }
 
@@ -1022,7 +2613,7 @@ static void builtin_copy(const char *arg) {
 
     if (have_dst) {
         if (dos_to_linux_path(dst, dst_linux, sizeof dst_linux) != 0) {
-            (void)write(1, "Invalid drive\n", 14);
+            con_error("Invalid drive\n", 14);
             return;
         }
     }
@@ -1030,7 +2621,7 @@ static void builtin_copy(const char *arg) {
     // Wildcard source
     if (has_wildcards(src_linuxspec)) {
         if (!have_dst) {
-            (void)write(1, "Invalid number of parameters\n", 29);
+            con_error("Invalid number of parameters\n", 29);
             return;
         }
 
@@ -1039,7 +2630,7 @@ static void builtin_copy(const char *arg) {
         split_dir_pat(src_linuxspec, dirpath, sizeof dirpath, pattern, sizeof pattern);
 
         DIR *d = opendir(dirpath);
-        if (!d) { (void)write(1, "File not found\n", 15); return; }
+        if (!d) { con_error("File not found\n", 15); return; }
 
         int dst_is_dir = is_dir_path(dst_linux);
         int files_copied = 0;
@@ -1063,7 +2654,7 @@ static void builtin_copy(const char *arg) {
             } else {
                 if (files_copied >= 1) {
                     closedir(d);
-                    (void)write(1, "Invalid number of parameters\n", 29);
+                    con_error("Invalid number of parameters\n", 29);
                     return;
                 }
                 snprintf(fulldst, sizeof fulldst, "%s", dst_linux);
@@ -1071,35 +2662,35 @@ static void builtin_copy(const char *arg) {
 
             int in = open(fullsrc, O_RDONLY);
             if (in < 0) continue;
+            ra_note(fullsrc);
 
             int out = open(fulldst, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-            if (out < 0) { close(in); closedir(d); (void)write(1, "Access denied\n", 14); return; }
-
-            char buf[4096];
-            ssize_t n;
-            while ((n = read(in, buf, sizeof buf)) > 0) {
-                ssize_t off = 0;
-                while (off < n) {
-                    ssize_t w = write(out, buf + off, (size_t)(n - off));
-                    if (w < 0) { close(in); close(out); closedir(d); (void)write(1, "Access denied\n", 14); return; }
-                    off += w;
-                }
-            }
+            if (out < 0) { close(in); closedir(d); con_error("Access denied\n", 14); return; }
+
+            uint32_t crc = 0;
+            int rc = copy_fd(in, out, verify ? &crc : NULL);
+            if (rc == 0 && verify && fdatasync(out) != 0) rc = -1;
 
             close(in);
             close(out);
-            if (n < 0) { closedir(d); (void)write(1, "Access denied\n", 14); return; }
+            if (rc != 0) { closedir(d); con_error("Access denied\n", 14); return; }
+
+            if (verify && copy_verify(fulldst, crc) != 0) {
+                closedir(d);
+                con_error("Verify error\n", 13);
+                return;
+            }
 
             files_copied++;
         }
 
         closedir(d);
 
-        if (files_copied == 0) { (void)write(1, "File not found\n", 15); return; }
+        if (files_copied == 0) { con_error("File not found\n", 15); return; }
 
         char msg[64];
         snprintf(msg, sizeof msg, "        %d file(s) copied.\n", files_copied);
-        (void)write(1, msg, strlen(msg));
+        con_write(msg, strlen(msg));
         return;
     }
 
@@ -1109,7 +2700,7 @@ static void builtin_copy(const char *arg) {
     if (!have_dst) {
         const char *base = dos_basename(src);
         char cwd[PATH_MAX];
-        if (!getcwd(cwd, sizeof cwd)) { (void)write(1, "Access denied\n", 14); return; }
+        if (!getcwd(cwd, sizeof cwd)) { con_error("Access denied\n", 14); return; }
         snprintf(final_dst, sizeof final_dst, "%s/%s", cwd, base);
     } else if (is_dir_path(dst_linux)) {
         const char *base = dos_basename(src);
@@ -1119,385 +2710,5589 @@ static void builtin_copy(const char *arg) {
     }
 
     int in = open(src_linuxspec, O_RDONLY);
-    if (in < 0) { (void)write(1, "File not found\n", 15); return; }
+    if (in < 0) { con_error("File not found\n", 15); return; }
+    ra_note(src_linuxspec);
 
     int out = open(final_dst, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    if (out < 0) { close(in); (void)write(1, "Access denied\n", 14); return; }
+    if (out < 0) { close(in); con_error("Access denied\n", 14); return; }
 
-    char buf[4096];
-    ssize_t n;
-    while ((n = read(in, buf, sizeof buf)) > 0) {
-        ssize_t off = 0;
-        while (off < n) {
-            ssize_t w = write(out, buf + off, (size_t)(n - off));
-            if (w < 0) { close(in); close(out); (void)write(1, "Access denied\n", 14); return; }
-            off += w;
-        }
-    }
+    uint32_t crc = 0;
+    int rc = copy_fd(in, out, verify ? &crc : NULL);
+    if (rc == 0 && verify && fdatasync(out) != 0) rc = -1;
 
     close(in);
     close(out);
-    if (n < 0) { (void)write(1, "Access denied\n", 14); return; }
-
-    (void)write(1, "        1 file(s) copied.\n", 27);
-}
+    if (rc != 0) { con_error("Access denied\n", 14); return; }
 
-/* ============================================================
-   COM64 LOADER (runs in a child process so PID 1 never dies)
-   ============================================================ */
+    if (verify && copy_verify(final_dst, crc) != 0) {
+        con_error("Verify error\n", 13);
+        return;
+    }
 
-typedef struct DosApi {
-    void (*print)(const char* s);
-} DosApi;
+    con_write("        1 file(s) copied.\n", 27);
+}
 
-typedef struct Com64Hdr {
-    char     magic[8];      // "64DOSCOM"
-    uint32_t header_size;   // 64
-    uint32_t flags;         // 0
-    uint64_t entry_rva;     // from payload start (immediately after header)
-    uint64_t bss_size;      // bytes to zero after payload
-    uint64_t reserved0;
-    uint64_t reserved1;
-    uint64_t reserved2;
-} Com64Hdr;
+/* CRC: files are collected first, hashed by a small set of worker threads,
+   then printed in the order they were named. */
+#define CRC_MAX_THREADS 8
+
+typedef struct CrcJob {
+    size_t   path; // offsets into CrcList.names
+    size_t   name;
+    uint32_t crc;
+    int      rc;
+} CrcJob;
+
+typedef struct CrcList {
+    CrcJob  *jobs;
+    size_t   count, cap;
+    char    *names;
+    size_t   names_len, names_cap;
+    size_t   next; // claimed with __atomic_fetch_add by the workers
+    int      oom;  // a file could not be added
+} CrcList;
+
+static int crc_add(CrcList *l, const char *linuxp, const char *name) {
+    size_t np = strlen(linuxp) + 1, nn = strlen(name) + 1;
+
+    if (l->count == l->cap) {
+        size_t cap = l->cap ? l->cap * 2 : 64;
+        CrcJob *j = (CrcJob *)realloc(l->jobs, cap * sizeof *j);
+        if (!j) return -1;
+        l->jobs = j;
+        l->cap = cap;
+    }
+    if (l->names_len + np + nn > l->names_cap) {
+        size_t cap = l->names_cap ? l->names_cap * 2 : 4096;
+        while (cap < l->names_len + np + nn) cap *= 2;
+        char *s = (char *)realloc(l->names, cap);
+        if (!s) return -1;
+        l->names = s;
+        l->names_cap = cap;
+    }
 
-typedef int (*Com64Entry)(DosApi* api, int argc, const char** argv);
+    CrcJob *j = &l->jobs[l->count++];
+    j->path = l->names_len;
+    memcpy(l->names + l->names_len, linuxp, np);
+    l->names_len += np;
+    j->name = l->names_len;
+    memcpy(l->names + l->names_len, name, nn);
+    l->names_len += nn;
+    j->rc = -1;
+    return 0;
+}
 
-static void dosapi_print_impl(const char* s) {
-    if (!s) return;
-    (void)write(1, s, strlen(s));
+static void crc_collect(const char *linuxp, const char *name, void *ctx) {
+    CrcList *l = (CrcList *)ctx;
+    if (!l->oom && crc_add(l, linuxp, name) != 0) l->oom = 1;
 }
 
-static int read_all(int fd, void* buf, size_t n) {
-    uint8_t* p = (uint8_t*)buf;
-    size_t got = 0;
-    while (got < n) {
-        ssize_t r = read(fd, p + got, n - got);
-        if (r == 0) return -1;
-        if (r < 0) {
-            if (errno == EINTR) continue;
-            return -1;
-        }
-        got += (size_t)r;
+static void *crc_worker(void *arg) {
+    CrcList *l = (CrcList *)arg;
+    for (;;) {
+        size_t i = __atomic_fetch_add(&l->next, 1, __ATOMIC_RELAXED);
+        if (i >= l->count) break;
+        l->jobs[i].rc = crc32c_file(l->names + l->jobs[i].path, 0, &l->jobs[i].crc);
     }
-    return 0;
+    return NULL;
 }
 
-static int run_com64_hostpath(const char* host_path, int argc, const char** argv) {
-    int fd = open(host_path, O_RDONLY);
-    if (fd < 0) return -1;
-
-    struct stat st;
-    if (fstat(fd, &st) != 0) { close(fd); return -1; }
-    if (st.st_size < (off_t)sizeof(Com64Hdr)) { close(fd); return -1; }
+static void builtin_crc(const char *arg) {
+    if (is_help_switch(arg)) {
+        const char *msg =
+            "CRC filespec [filespec...]\n"
+            "  Prints the CRC32C checksum of each file. Wildcards: * and ?\n";
+        con_write(msg, strlen(msg));
+        return;
+    }
 
-    Com64Hdr hdr;
-    if (read_all(fd, &hdr, sizeof(hdr)) != 0) { close(fd); return -1; }
+    if (!arg || !*arg) { con_error("Required parameter missing\n", 27); return; }
 
-    if (memcmp(hdr.magic, "64DOSCOM", 8) != 0) { close(fd); return -1; }
-    if (hdr.header_size != 64) { close(fd); return -1; }
+    CrcList l;
+    memset(&l, 0, sizeof l);
 
-    size_t file_size = (size_t)st.st_size;
-    size_t payload_size = file_size - sizeof(Com64Hdr);
-    if (hdr.entry_rva >= payload_size) { close(fd); return -1; }
+    const char *p = arg;
+    while (*p) {
+        while (*p == ' ' || *p == '\t') p++;
+        if (!*p) break;
 
-    size_t image_size = payload_size + (size_t)hdr.bss_size;
+        const char *t = p;
+        while (*p && *p != ' ' && *p != '\t') p++;
 
-    void* image = mmap(NULL, image_size,
-                       PROT_READ | PROT_WRITE | PROT_EXEC,
-                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if (image == MAP_FAILED) { close(fd); return -1; }
+        char spec[PATH_MAX];
+        size_t n = (size_t)(p - t);
+        if (n >= sizeof spec) n = sizeof spec - 1;
+        memcpy(spec, t, n);
+        spec[n] = 0;
 
-    // fd is already positioned just after header
-    if (read_all(fd, image, payload_size) != 0) {
-        munmap(image, image_size);
-        close(fd);
-        return -1;
+        (void)dos_glob_files(spec, crc_collect, &l);
     }
-    close(fd);
 
-    if (hdr.bss_size) {
-        memset((uint8_t*)image + payload_size, 0, (size_t)hdr.bss_size);
+    if (l.oom || l.count == 0) {
+        free(l.jobs);
+        free(l.names);
+        if (l.oom) con_error("Insufficient memory\n", 20);
+        else con_error("File not found\n", 15);
+        return;
     }
 
-    DosApi api;
-    api.print = dosapi_print_impl;
+    crc32c_init(); // probe once here, not racily from the workers
 
-    uint8_t* payload_base = (uint8_t*)image;
-    Com64Entry entry = (Com64Entry)(payload_base + hdr.entry_rva);
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t nthreads = (ncpu > 0) ? (size_t)ncpu : 1;
+    if (nthreads > CRC_MAX_THREADS) nthreads = CRC_MAX_THREADS;
+    if (nthreads > l.count) nthreads = l.count;
 
-    int rc = entry(&api, argc, argv);
+    pthread_t tids[CRC_MAX_THREADS];
+    size_t started = 0;
+    for (size_t i = 1; i < nthreads; i++) {
+        if (pthread_create(&tids[started], NULL, crc_worker, &l) != 0) break;
+        started++;
+    }
+    crc_worker(&l); // the calling thread works too
+    for (size_t i = 0; i < started; i++) pthread_join(tids[i], NULL);
+
+    for (size_t i = 0; i < l.count; i++) {
+        char line[NAME_MAX + 64];
+        if (l.jobs[i].rc == 0)
+            snprintf(line, sizeof line, "%08X  %s\n", l.jobs[i].crc, l.names + l.jobs[i].name);
+        else
+            snprintf(line, sizeof line, "Read error  %s\n", l.names + l.jobs[i].name);
+        if (l.jobs[i].rc == 0) con_write(line, strlen(line));
+        else con_error(line, strlen(line));
+    }
 
-    munmap(image, image_size);
-    return rc;
+    free(l.jobs);
+    free(l.names);
 }
 
-/* Run COM64 in a child so init (PID 1) never dies if it crashes. */
-static int run_com64_sandboxed(const char* host_path, int argc, const char** argv) {
-    pid_t pid = fork();
-    if (pid < 0) {
-        (void)write(1, "Insufficient memory\n", 20);
-        return 1; // we handled the command attempt
-    }
+/* --- disk cache ---
+   CACHE (also SMARTDRV) drives the kernel's page cache instead of keeping
+   one of its own: mincore() tells which pages of a file are resident,
+   readahead() pulls a file in, POSIX_FADV_DONTNEED drops it and mlock()
+   pins it. A directory stands for every file below it. /LOAD hands the
+   list to detached threads and returns; CACHE alone shows their progress. */
+
+#define CACHE_MAX_FILES    65536
+#define CACHE_MAX_THREADS  4
+#define CACHE_MAX_LOCKS    64
+#define CACHE_MAX_DEPTH    32
+#define CACHE_WINDOW_PAGES (256u << 10) // mincore() this many pages per mapping
+#define CACHE_RA_CHUNK     (2u << 20)
+
+typedef struct CacheFile {
+    size_t   name; // offset into CacheList.names
+    uint64_t size;
+} CacheFile;
+
+typedef struct CacheList {
+    CacheFile *files;
+    size_t     count, cap;
+    char      *names;
+    size_t     names_len, names_cap;
+    size_t     next;    // claimed with __atomic_fetch_add by the loaders
+    int        workers; // loaders still running; the last one frees the list
+} CacheList;
+
+typedef struct CacheLock {
+    dev_t  dev;
+    ino_t  ino;
+    void  *map;
+    size_t len;
+    char   dos[PATH_MAX];
+} CacheLock;
+
+static CacheLock g_cache_locks[CACHE_MAX_LOCKS];
+static int       g_cache_nlocks = 0;
+
+/* /LOAD progress, updated by the loader threads */
+static struct {
+    int      running;
+    uint64_t files, files_done;
+    uint64_t bytes, bytes_done;
+} g_cache_load;
+
+static void cache_list_free(CacheList *l) {
+    free(l->files);
+    free(l->names);
+    free(l);
+}
 
-    if (pid == 0) {
-        int rc = run_com64_hostpath(host_path, argc, argv);
-        if (rc < 0) _exit(127);
-        _exit(rc & 0xFF);
-    }
+static const char *cache_path(const CacheList *l, size_t i) {
+    return l->names + l->files[i].name;
+}
 
-    int st = 0;
-    for (;;) {
-        if (waitpid(pid, &st, 0) >= 0) break;
-        if (errno == EINTR) continue;
-        break;
-    }
+static int cache_add(CacheList *l, const char *path, uint64_t size) {
+    if (l->count >= CACHE_MAX_FILES) return -1;
+    size_t n = strlen(path) + 1;
 
-    if (WIFSIGNALED(st)) {
-        (void)write(1, "Program terminated\n", 19);
+    if (l->count == l->cap) {
+        size_t cap = l->cap ? l->cap * 2 : 256;
+        CacheFile *f = (CacheFile *)realloc(l->files, cap * sizeof *f);
+        if (!f) return -1;
+        l->files = f;
+        l->cap = cap;
+    }
+    if (l->names_len + n > l->names_cap) {
+        size_t cap = l->names_cap ? l->names_cap * 2 : 16384;
+        while (cap < l->names_len + n) cap *= 2;
+        char *s = (char *)realloc(l->names, cap);
+        if (!s) return -1;
+        l->names = s;
+        l->names_cap = cap;
     }
 
-    return 1;
+    memcpy(l->names + l->names_len, path, n);
+    l->files[l->count].name = l->names_len;
+    l->files[l->count].size = size;
+    l->names_len += n;
+    l->count++;
+    return 0;
 }
 
-static int file_exists_regular(const char* path) {
+static void cache_collect(const char *linuxp, const char *name, void *ctx) {
+    (void)name;
     struct stat st;
-    if (stat(path, &st) != 0) return 0;
-    return S_ISREG(st.st_mode);
+    if (stat(linuxp, &st) == 0) (void)cache_add((CacheList *)ctx, linuxp, (uint64_t)st.st_size);
 }
 
-/* returns 1 if it ran something, 0 if not found/not runnable */
-static int try_run_external_com64(const char* line) {
-    // Extract first token (command)
-    char cmd[PATH_MAX];
-    size_t i = 0;
-    const char* p = line;
+/* Every regular file below dir; symlinks are not followed */
+static void cache_walk(const char *dir, CacheList *l, int depth) {
+    if (depth > CACHE_MAX_DEPTH) return;
+    DIR *d = opendir(dir);
+    if (!d) return;
 
-    while (*p == ' ' || *p == '\t') p++;
-    if (!*p) return 0;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) continue;
+
+        char full[PATH_MAX];
+        if (snprintf(full, sizeof full, "%s/%s", dir, de->d_name) >= (int)sizeof full) continue;
 
-    while (*p && *p != ' ' && *p != '\t' && i + 1 < sizeof(cmd)) {
-        cmd[i++] = *p++;
+        struct stat st;
+        if (lstat(full, &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) cache_walk(full, l, depth + 1);
+        else if (S_ISREG(st.st_mode) && cache_add(l, full, (uint64_t)st.st_size) != 0) break;
     }
-    cmd[i] = 0;
+    closedir(d);
+}
 
-    // Minimal argv (argv parsing later)
-    const char* argv[2];
-    argv[0] = cmd;
-    argv[1] = NULL;
-    int argc = 1;
+/* A file, a wildcard spec or a directory tree. Returns 1 for a tree,
+   0 otherwise, -1 for a bad path. */
+static int cache_collect_spec(const char *spec, CacheList *l) {
+    char linuxp[PATH_MAX];
+    if (dos_to_linux_path(spec, linuxp, sizeof linuxp) != 0) return -1;
+    if (!has_wildcards(linuxp) && is_dir_path(linuxp)) {
+        cache_walk(linuxp, l, 0);
+        return 1;
+    }
+    return dos_glob_files(spec, cache_collect, l) < 0 ? -1 : 0;
+}
 
-    int has_path = (strchr(cmd, '\\') || strchr(cmd, '/') ||
-                    (isalpha((unsigned char)cmd[0]) && cmd[1] == ':'));
-    int has_ext = (strchr(cmd, '.') != NULL);
+/* Resident pages of a file and its size in pages; -1 if it cannot be mapped */
+static int cache_resident(const char *path, uint64_t *resident, uint64_t *pages) {
+    static unsigned char vec[CACHE_WINDOW_PAGES];
+    uint64_t pg = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t window = (uint64_t)CACHE_WINDOW_PAGES * pg;
 
-    char host_path[PATH_MAX];
-    char host_try[PATH_MAX];
+    *resident = *pages = 0;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0) { close(fd); return -1; }
 
-    if (has_path) {
-        // cmd includes a path/drive
+    uint64_t size = (uint64_t)st.st_size;
+    *pages = (size + pg - 1) / pg;
+    for (uint64_t off = 0; off < size; off += window) {
+        size_t len = (size_t)(size - off < window ? size - off : window);
+        void *m = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, (off_t)off);
+        if (m == MAP_FAILED) { close(fd); return -1; }
+        if (mincore(m, len, vec) == 0) {
+            size_t n = (size_t)((len + pg - 1) / pg);
+            for (size_t i = 0; i < n; i++) *resident += vec[i] & 1;
+        }
+        munmap(m, len);
+    }
+    close(fd);
+    return 0;
+}
+
+/* Start reading a whole file into the page cache; returns bytes asked for */
+static uint64_t cache_prefetch(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC | O_NOATIME);
+    if (fd < 0) fd = open(path, O_RDONLY | O_CLOEXEC); // O_NOATIME needs ownership
+    if (fd < 0) return 0;
+
+    // The kernel trims each request to the device's readahead window, so
+    // a large file is asked for a chunk at a time
+    struct stat st;
+    uint64_t size = 0;
+    if (fstat(fd, &st) == 0) size = (uint64_t)st.st_size;
+    for (uint64_t off = 0; off < size; off += CACHE_RA_CHUNK) {
+        if (readahead(fd, (off64_t)off, CACHE_RA_CHUNK) != 0 &&
+            posix_fadvise(fd, (off_t)off, CACHE_RA_CHUNK, POSIX_FADV_WILLNEED) != 0) break;
+    }
+    close(fd);
+    return size;
+}
+
+static void *cache_load_worker(void *arg) {
+    CacheList *l = (CacheList *)arg;
+    for (;;) {
+        size_t i = __atomic_fetch_add(&l->next, 1, __ATOMIC_RELAXED);
+        if (i >= l->count) break;
+        (void)cache_prefetch(cache_path(l, i));
+        __atomic_fetch_add(&g_cache_load.bytes_done, l->files[i].size, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&g_cache_load.files_done, 1, __ATOMIC_RELAXED);
+    }
+    if (__atomic_sub_fetch(&l->workers, 1, __ATOMIC_ACQ_REL) == 0) {
+        cache_list_free(l);
+        __atomic_fetch_sub(&g_cache_load.running, 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+/* Takes ownership of l. Returns the number of loader threads started. */
+static int cache_load_start(CacheList *l) {
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int nthreads = (ncpu > 0) ? (int)ncpu : 1;
+    if (nthreads > CACHE_MAX_THREADS) nthreads = CACHE_MAX_THREADS;
+    if ((size_t)nthreads > l->count) nthreads = (int)l->count;
+    if (nthreads == 0) { cache_list_free(l); return 0; }
+
+    if (__atomic_load_n(&g_cache_load.running, __ATOMIC_ACQUIRE) == 0) {
+        g_cache_load.files = g_cache_load.files_done = 0;
+        g_cache_load.bytes = g_cache_load.bytes_done = 0;
+    }
+    __atomic_fetch_add(&g_cache_load.running, 1, __ATOMIC_RELAXED);
+    for (size_t i = 0; i < l->count; i++) g_cache_load.bytes += l->files[i].size;
+    g_cache_load.files += l->count;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    l->workers = nthreads;
+    int started = 0;
+    for (int i = 0; i < nthreads; i++) {
+        pthread_t tid;
+        if (pthread_create(&tid, &attr, cache_load_worker, l) != 0) break;
+        started++;
+    }
+    pthread_attr_destroy(&attr);
+
+    // Threads that did not start are settled here; with none, load inline
+    int missing = nthreads - started;
+    if (missing == nthreads) {
+        l->workers = 1;
+        cache_load_worker(l);
+    } else if (__atomic_sub_fetch(&l->workers, missing, __ATOMIC_ACQ_REL) == 0) {
+        cache_list_free(l);
+        __atomic_fetch_sub(&g_cache_load.running, 1, __ATOMIC_RELEASE);
+    }
+    return started;
+}
+
+static void cache_print_line(uint64_t resident, uint64_t pages, const char *name) {
+    uint64_t kb = (uint64_t)sysconf(_SC_PAGESIZE) / 1024;
+    char line[PATH_MAX + 64];
+    snprintf(line, sizeof line, "%12llu KB %12llu KB %4u%%  %s\n",
+             (unsigned long long)(resident * kb), (unsigned long long)(pages * kb),
+             pages ? (unsigned)(resident * 100 / pages) : 100u, name);
+    con_write(line, strlen(line));
+}
+
+static void cache_status(void) {
+    char line[PATH_MAX + 96];
+    if (__atomic_load_n(&g_cache_load.running, __ATOMIC_ACQUIRE)) {
+        snprintf(line, sizeof line, "Loading %llu of %llu file(s), %llu of %llu KB\n",
+                 (unsigned long long)__atomic_load_n(&g_cache_load.files_done, __ATOMIC_RELAXED),
+                 (unsigned long long)g_cache_load.files,
+                 (unsigned long long)(__atomic_load_n(&g_cache_load.bytes_done, __ATOMIC_RELAXED) >> 10),
+                 (unsigned long long)(g_cache_load.bytes >> 10));
+    } else {
+        snprintf(line, sizeof line, "No load in progress\n");
+    }
+    con_write(line, strlen(line));
+
+    for (int i = 0; i < g_cache_nlocks; i++) {
+        snprintf(line, sizeof line, "Locked %12llu KB  %s\n",
+                 (unsigned long long)(g_cache_locks[i].len >> 10), g_cache_locks[i].dos);
+        con_write(line, strlen(line));
+    }
+}
+
+static int cache_find_lock(const struct stat *st) {
+    for (int i = 0; i < g_cache_nlocks; i++)
+        if (g_cache_locks[i].dev == st->st_dev && g_cache_locks[i].ino == st->st_ino) return i;
+    return -1;
+}
+
+/* Map and mlock() a file; 1 if it was locked, 0 if it already was, -1 on failure */
+static int cache_lock(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) { close(fd); return -1; }
+    if (cache_find_lock(&st) >= 0) { close(fd); return 0; }
+    if (g_cache_nlocks >= CACHE_MAX_LOCKS) { close(fd); return -1; }
+
+    size_t len = (size_t)st.st_size;
+    void *m = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) return -1;
+    if (mlock(m, len) != 0) { munmap(m, len); return -1; }
+
+    CacheLock *k = &g_cache_locks[g_cache_nlocks++];
+    char real[PATH_MAX];
+    k->dev = st.st_dev;
+    k->ino = st.st_ino;
+    k->map = m;
+    k->len = len;
+    linux_to_dos(realpath(path, real) ? real : path, k->dos, sizeof k->dos);
+    return 1;
+}
+
+static int cache_unlock(const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0) return -1;
+    int i = cache_find_lock(&st);
+    if (i < 0) return 0;
+    munmap(g_cache_locks[i].map, g_cache_locks[i].len); // also unlocks
+    g_cache_locks[i] = g_cache_locks[--g_cache_nlocks];
+    return 1;
+}
+
+/* Write back, then ask the kernel to let go; pages still mapped stay.
+   1 if it was dropped, -1 if it could not be written back or let go. */
+static int cache_drop(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    int rc = (fdatasync(fd) == 0 && posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0) ? 1 : -1;
+    close(fd);
+    return rc;
+}
+
+static void cache_report(const char *spec) {
+    CacheList *l = (CacheList *)calloc(1, sizeof *l);
+    if (!l) { con_error("Insufficient memory\n", 20); return; }
+
+    int tree = cache_collect_spec(spec, l);
+    if (tree < 0 || l->count == 0) {
+        char line[PATH_MAX + 32];
+        snprintf(line, sizeof line, "File not found - %s\n", spec);
+        con_error(line, strlen(line));
+        cache_list_free(l);
+        return;
+    }
+
+    uint64_t res_total = 0, pages_total = 0;
+    for (size_t i = 0; i < l->count; i++) {
+        uint64_t res, pages;
+        if (cache_resident(cache_path(l, i), &res, &pages) != 0) continue;
+        if (!tree) cache_print_line(res, pages, dos_basename(cache_path(l, i)));
+        res_total += res;
+        pages_total += pages;
+    }
+    if (tree) {
+        char line[PATH_MAX + 32];
+        snprintf(line, sizeof line, "%s (%zu file(s))", spec, l->count);
+        cache_print_line(res_total, pages_total, line);
+    }
+    cache_list_free(l);
+}
+
+static void builtin_cache(const char *arg) {
+    if (is_help_switch(arg)) {
+        const char *msg =
+            "CACHE [filespec|dir ...]\n"
+            "CACHE /LOAD | /DROP | /LOCK | /UNLOCK filespec|dir [...]\n"
+            "SMARTDRV is the same command.\n"
+            "  Shows how much of each file (or of each directory tree) is in\n"
+            "  the page cache. Alone, shows /LOAD progress and locked files.\n"
+            "  /LOAD    Reads files into the cache in the background\n"
+            "  /DROP    Writes files back and evicts them from the cache\n"
+            "  /LOCK    Keeps files resident until /UNLOCK (at most 64)\n"
+            "  /UNLOCK  Releases files locked with /LOCK\n"
+            "  Wildcards: * and ?\n";
+        con_write(msg, strlen(msg));
+        return;
+    }
+
+    if (!arg || !*arg) { cache_status(); return; }
+
+    enum { C_REPORT, C_LOAD, C_DROP, C_LOCK, C_UNLOCK } op = C_REPORT;
+    const char *p = arg;
+    if (*p == '/') {
+        size_t n = strcspn(p, " \t");
+        if      (n == 5 && !strncasecmp(p, "/LOAD", 5))   op = C_LOAD;
+        else if (n == 5 && !strncasecmp(p, "/DROP", 5))   op = C_DROP;
+        else if (n == 5 && !strncasecmp(p, "/LOCK", 5))   op = C_LOCK;
+        else if (n == 7 && !strncasecmp(p, "/UNLOCK", 7)) op = C_UNLOCK;
+        else { con_error("Invalid switch\n", 15); return; }
+        p += n;
+        while (*p == ' ' || *p == '\t') p++;
+        if (!*p) { con_error("Required parameter missing\n", 27); return; }
+    }
+
+    if (op == C_REPORT)
+        con_write("    Resident         Size  Cached  Name\n", 40);
+
+    CacheList *l = (CacheList *)calloc(1, sizeof *l);
+    if (!l) { con_error("Insufficient memory\n", 20); return; }
+
+    while (*p) {
+        const char *t = p;
+        while (*p && *p != ' ' && *p != '\t') p++;
+
+        char spec[PATH_MAX];
+        size_t n = (size_t)(p - t);
+        if (n >= sizeof spec) n = sizeof spec - 1;
+        memcpy(spec, t, n);
+        spec[n] = 0;
+        while (*p == ' ' || *p == '\t') p++;
+
+        if (op == C_REPORT) cache_report(spec);
+        else (void)cache_collect_spec(spec, l);
+    }
+
+    if (op == C_REPORT) { cache_list_free(l); return; }
+    if (l->count == 0) {
+        cache_list_free(l);
+        con_error("File not found\n", 15);
+        return;
+    }
+
+    char line[128];
+    if (op == C_LOAD) {
+        uint64_t bytes = 0;
+        size_t files = l->count;
+        for (size_t i = 0; i < files; i++) bytes += l->files[i].size;
+        int threads = cache_load_start(l); // l belongs to the loaders now
+        snprintf(line, sizeof line, "Loading %zu file(s), %llu KB on %d thread(s)\n",
+                 files, (unsigned long long)(bytes >> 10), threads ? threads : 1);
+        con_write(line, strlen(line));
+        return;
+    }
+
+    size_t done = 0, failed = 0;
+    for (size_t i = 0; i < l->count; i++) {
+        const char *path = cache_path(l, i);
+        int rc = (op == C_DROP) ? cache_drop(path) : (op == C_LOCK) ? cache_lock(path) : cache_unlock(path);
+        if (rc > 0) done++;
+        else if (rc < 0) failed++;
+    }
+
+    static const char *const verb[] = { "", "", "Dropped", "Locked", "Unlocked" };
+    snprintf(line, sizeof line, "%s %zu file(s)\n", verb[op], done);
+    con_write(line, strlen(line));
+    if (failed) {
+        static const char *const what[] = { "", "", "drop", "lock", "unlock" };
+        snprintf(line, sizeof line, "Cannot %s %zu file(s)\n", what[op], failed);
+        con_error(line, strlen(line));
+    }
+    cache_list_free(l);
+}
+
+/* --- boot readahead ---
+   The shell notes every file on C: it opens for a command (programs,
+   COM64.LIB, TYPE and COPY sources, DOS.CFG) and saves the list as
+   C:\PREFETCH.TRC, with files from earlier sessions kept until they go
+   unused RA_KEEP times in a row. At the next boot a thread at idle I/O
+   priority reads them back into the page cache, sorted by where they sit
+   on the disk, while the prompt is already up. A later open of a file it
+   already read is a hit; BOOTLOG shows the totals. */
+
+#define RA_TRACE_NAME "PREFETCH.TRC"
+#define RA_MAGIC      "64RA1\n" // then "age path" per line
+#define RA_MAX        512
+#define RA_REL_MAX    240 // longer paths are not traced
+#define RA_KEEP       4   // sessions a file stays in the trace without being opened
+#define RA_SAVE_SEC   60  // a changed trace is saved this often (and at POWEROFF)
+
+#ifndef FS_IOC_FIEMAP
+#define FS_IOC_FIEMAP _IOWR('f', 11, struct fiemap)
+#endif
+#define IOPRIO_IDLE_VALUE (3 << 13) // IOPRIO_CLASS_IDLE, level 0
+
+typedef struct RaFile {
+    char     rel[RA_REL_MAX]; // relative to C:'s root
+    uint64_t key;             // first physical byte, or the inode number
+    int      mapped;          // key came from FIEMAP
+    int      age;             // sessions since it was last opened
+    int      done;            // read in by the thread (atomic)
+} RaFile;
+
+typedef struct RaNote {
+    dev_t dev;
+    ino_t ino;
+    char  rel[RA_REL_MAX];
+} RaNote;
+
+static struct {
+    RaFile  *files;        // last session's trace, read at boot
+    size_t   count;
+    RaNote   notes[RA_MAX]; // this session's trace, first open first
+    size_t   nnotes;
+    size_t   saved_n;      // nnotes when the trace was last saved
+    uint64_t saved_ns;
+    long     hits, late, misses;
+} g_ra;
+
+static int ra_find(const char *rel) {
+    for (size_t i = 0; i < g_ra.count; i++)
+        if (!strcmp(g_ra.files[i].rel, rel)) return (int)i;
+    return -1;
+}
+
+/* Main thread only */
+static void ra_note(const char *path) {
+    struct stat st;
+    if (g_ra.nnotes >= RA_MAX || stat(path, &st) != 0 || !S_ISREG(st.st_mode)) return;
+    for (size_t i = 0; i < g_ra.nnotes; i++)
+        if (g_ra.notes[i].ino == st.st_ino && g_ra.notes[i].dev == st.st_dev) return;
+
+    char real[PATH_MAX];
+    if (!realpath(path, real) || !path_under(real, g_c_root)) return;
+    const char *rel = real + strlen(g_c_root);
+    while (*rel == '/') rel++;
+    if (strlen(rel) >= RA_REL_MAX || !strcmp(rel, RA_TRACE_NAME)) return;
+
+    RaNote *n = &g_ra.notes[g_ra.nnotes++];
+    n->dev = st.st_dev;
+    n->ino = st.st_ino;
+    memcpy(n->rel, rel, strlen(rel) + 1);
+
+    if (!g_ra.files) return; // nothing was read in: no totals to keep
+    int i = ra_find(rel);
+    if (i < 0) {
+        g_ra.misses++;
+    } else if (__atomic_load_n(&g_ra.files[i].done, __ATOMIC_ACQUIRE)) {
+        g_ra.hits++;
+    } else {
+        g_ra.late++;
+    }
+    g_boot_dirty = 1; // BOOTLOG's totals changed
+}
+
+static int ra_noted(const char *rel) {
+    for (size_t i = 0; i < g_ra.nnotes; i++)
+        if (!strcmp(g_ra.notes[i].rel, rel)) return 1;
+    return 0;
+}
+
+/* Unchanged only if this session opened exactly the files of the last one */
+static int ra_changed(void) {
+    if (g_ra.nnotes != g_ra.count) return 1;
+    for (size_t i = 0; i < g_ra.nnotes; i++) {
+        int f = ra_find(g_ra.notes[i].rel);
+        if (f < 0 || g_ra.files[f].age != 0) return 1;
+    }
+    return 0;
+}
+
+static void ra_save(void) {
+    g_ra.saved_n = g_ra.nnotes;
+    g_ra.saved_ns = boottime_ns();
+    if (!ra_changed()) return;
+
+    char path[PATH_MAX], tmp[PATH_MAX];
+    snprintf(path, sizeof path, "%s/" RA_TRACE_NAME, g_c_root);
+    snprintf(tmp, sizeof tmp, "%s.tmp", path);
+    FILE *f = fopen(tmp, "we");
+    if (!f) return;
+    fputs(RA_MAGIC, f);
+    for (size_t i = 0; i < g_ra.nnotes; i++) fprintf(f, "0 %s\n", g_ra.notes[i].rel);
+    for (size_t i = 0; i < g_ra.count; i++) {
+        const RaFile *r = &g_ra.files[i];
+        if (r->age + 1 < RA_KEEP && !ra_noted(r->rel)) fprintf(f, "%d %s\n", r->age + 1, r->rel);
+    }
+    if (fclose(f) != 0 || rename(tmp, path) != 0) unlink(tmp);
+}
+
+/* Tick hook: a crash should not lose a whole session's trace */
+static void ra_tick(void) {
+    if (g_ra.nnotes != g_ra.saved_n && boottime_ns() - g_ra.saved_ns >= RA_SAVE_SEC * 1000000000ull) ra_save();
+}
+
+static int ra_load(void) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof path, "%s/" RA_TRACE_NAME, g_c_root);
+    FILE *f = fopen(path, "re");
+    if (!f) return -1;
+
+    char line[PATH_MAX];
+    if (!fgets(line, sizeof line, f) || strcmp(line, RA_MAGIC) != 0 ||
+        !(g_ra.files = (RaFile *)calloc(RA_MAX, sizeof(RaFile)))) {
+        fclose(f);
+        return -1;
+    }
+    while (g_ra.count < RA_MAX && fgets(line, sizeof line, f)) {
+        line[strcspn(line, "\n")] = 0;
+        char *rel;
+        long age = strtol(line, &rel, 10);
+        if (*rel++ != ' ' || age < 0 || age >= RA_KEEP) continue;
+        if (!*rel || strlen(rel) >= RA_REL_MAX || ra_find(rel) >= 0) continue;
+        g_ra.files[g_ra.count].age = (int)age;
+        memcpy(g_ra.files[g_ra.count++].rel, rel, strlen(rel) + 1);
+    }
+    fclose(f);
+    return 0;
+}
+
+/* Where the file starts on its device; the inode number is the fallback
+   where FIEMAP is not supported, which keeps files of one directory close */
+static void ra_locate(int dirfd, RaFile *r) {
+    int fd = openat(dirfd, r->rel, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) { r->key = UINT64_MAX; return; }
+
+    struct {
+        struct fiemap        m;
+        struct fiemap_extent e;
+    } fm;
+    memset(&fm, 0, sizeof fm);
+    fm.m.fm_length = FIEMAP_MAX_OFFSET;
+    fm.m.fm_extent_count = 1;
+    struct stat st;
+    if (ioctl(fd, FS_IOC_FIEMAP, &fm.m) == 0 && fm.m.fm_mapped_extents == 1) {
+        r->key = fm.e.fe_physical;
+        r->mapped = 1;
+    } else {
+        r->key = fstat(fd, &st) == 0 ? (uint64_t)st.st_ino : UINT64_MAX;
+    }
+    close(fd);
+}
+
+static int ra_cmp(const void *a, const void *b) {
+    const RaFile *x = *(RaFile *const *)a, *y = *(RaFile *const *)b;
+    if (x->mapped != y->mapped) return y->mapped - x->mapped;
+    return (x->key > y->key) - (x->key < y->key);
+}
+
+static void *ra_thread(void *arg) {
+    (void)arg;
+    // Never compete with the user: lowest CPU priority, idle I/O class
+    pid_t tid = (pid_t)syscall(SYS_gettid);
+    (void)setpriority(PRIO_PROCESS, (id_t)tid, 19);
+    (void)syscall(SYS_ioprio_set, 1 /* IOPRIO_WHO_PROCESS */, tid, IOPRIO_IDLE_VALUE);
+
+    uint64_t t0 = boottime_ns();
+    RaFile **order = (RaFile **)malloc(g_ra.count * sizeof *order);
+    int dirfd = open(g_c_root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (!order || dirfd < 0) { free(order); if (dirfd >= 0) close(dirfd); return NULL; }
+
+    for (size_t i = 0; i < g_ra.count; i++) {
+        order[i] = &g_ra.files[i];
+        ra_locate(dirfd, order[i]);
+    }
+    qsort(order, g_ra.count, sizeof *order, ra_cmp);
+
+    size_t files = 0;
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < g_ra.count && order[i]->key != UINT64_MAX; i++) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof path, "%s/%s", g_c_root, order[i]->rel);
+        bytes += cache_prefetch(path);
+        files++;
+        __atomic_store_n(&order[i]->done, 1, __ATOMIC_RELEASE);
+    }
+    close(dirfd);
+    free(order);
+
+    char mark[sizeof "readahead  files  KB  ms" + 3 * 20]; // three 64-bit numbers at their widest
+    snprintf(mark, sizeof mark, "readahead %zu files %llu KB %llu ms", files,
+             (unsigned long long)(bytes >> 10), (unsigned long long)((boottime_ns() - t0) / 1000000));
+    boot_mark(mark);
+    return NULL;
+}
+
+/* After the prompt: nothing here may hold it up */
+static void ra_start(void) {
+    g_ra.saved_ns = boottime_ns();
+    if (ra_load() != 0 || g_ra.count == 0) return;
+
+    pthread_t tid;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&tid, &attr, ra_thread, NULL) != 0) {
+        free(g_ra.files); // no thread, no prefetch: just record
+        g_ra.files = NULL;
+        g_ra.count = 0;
+    }
+    pthread_attr_destroy(&attr);
+}
+
+/* BOOTLOG footer */
+static size_t ra_format(char *out, size_t outsz) {
+    if (!g_ra.files) return 0;
+    int n = snprintf(out, outsz,
+                     "readahead: %zu file(s) traced, %ld hit(s), %ld opened before read in, %ld not traced\n",
+                     g_ra.count, g_ra.hits, g_ra.late, g_ra.misses);
+    return (n > 0 && (size_t)n < outsz) ? (size_t)n : 0;
+}
+
+/* --- CHKDSK ---
+   CHKDSK (also DU) adds up a directory tree: files, bytes, and what the
+   directories themselves take, against the volume's totals from statfs().
+   Directories are read by a pool of threads sharing one growing list, so
+   several reads are in flight even on one CPU. What each directory held
+   directly is kept in C:\CHKDSK.DAT, keyed by device, inode and mtime;
+   a directory whose mtime has not moved is not read again, only its
+   subdirectories are stat()ed. A file rewritten in place does not change
+   its directory's mtime, so /R rescans everything. The walk stays on the
+   starting directory's filesystem. */
+
+#define DU_CACHE_NAME  "CHKDSK.DAT"
+#define DU_MAGIC       "64DU1\n"
+#define DU_MAX_THREADS 8
+#define DU_MIN_THREADS 4    // reads, not CPU, are what the threads wait on
+#define DU_CHUNK       4096 // nodes per chunk; chunks never move
+#define DU_MAX_CHUNKS  4096
+
+/* One directory in the size cache, as stored in the file */
+typedef struct DuRec {
+    uint64_t dev, ino;
+    uint64_t parent;        // inode of the directory holding it
+    int64_t  mtime_ns;
+    uint64_t files, bytes;  // regular files directly inside
+    uint64_t alloc;         // their st_blocks, in bytes
+    uint64_t names_off;     // subdirectory names, NUL-separated
+    uint64_t names_len;
+} DuRec;
+
+typedef struct DuHeader {
+    char     magic[8];
+    uint64_t count, names_len;
+    uint32_t crc;           // CRC32C of the records and names
+    uint32_t pad;
+} DuHeader;
+
+typedef struct DuIndex {
+    uint32_t *slot;         // record index + 1, 0 when empty
+    size_t    mask;
+} DuIndex;
+
+static struct {
+    DuRec  *recs;
+    size_t  count;
+    char   *names;
+    size_t  names_len;
+    DuIndex ix;
+    int     loaded;
+    int     one_block;      // names share the records' allocation (as loaded)
+} g_du;
+
+typedef struct DuSum {
+    uint64_t files, bytes, alloc;
+    uint64_t dirs, dir_alloc; // subdirectories, and what the directories take
+} DuSum;
+
+/* A directory met in this walk */
+typedef struct DuNode {
+    char    *path;
+    uint64_t dev, ino, parent;
+    int64_t  mtime_ns;
+    size_t   up;            // parent's node index; 0 for the root itself
+    DuSum    own;           // directly inside (and the directory itself)
+    DuSum    tree;          // the whole subtree, summed after the walk
+    char    *names;
+    size_t   names_len;
+    int      cached;
+} DuNode;
+
+typedef struct DuWalk {
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    DuNode         *chunk[DU_MAX_CHUNKS];
+    size_t          count, next, busy;
+    uint64_t        dev;
+    int             rescan, full;
+} DuWalk;
+
+static DuNode *du_node(DuWalk *w, size_t i) { return &w->chunk[i / DU_CHUNK][i % DU_CHUNK]; }
+
+static int64_t du_mtime(const struct stat *st) {
+    return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+static size_t du_hash(uint64_t dev, uint64_t ino) {
+    return (size_t)((ino * 0x9E3779B97F4A7C15ull) ^ (dev * 0xC2B2AE3D27D4EB4Full) ^ (ino >> 29));
+}
+
+static int du_index_build(DuIndex *ix, const DuRec *r, size_t n) {
+    size_t cap = 64;
+    while (cap < n * 2) cap *= 2;
+    ix->slot = (uint32_t *)calloc(cap, sizeof *ix->slot);
+    ix->mask = cap - 1;
+    if (!ix->slot) return -1;
+    for (size_t i = 0; i < n; i++) {
+        size_t h = du_hash(r[i].dev, r[i].ino) & ix->mask;
+        while (ix->slot[h]) h = (h + 1) & ix->mask;
+        ix->slot[h] = (uint32_t)(i + 1);
+    }
+    return 0;
+}
+
+static const DuRec *du_index_find(const DuIndex *ix, const DuRec *r, uint64_t dev, uint64_t ino) {
+    if (!ix->slot) return NULL;
+    for (size_t h = du_hash(dev, ino) & ix->mask; ix->slot[h]; h = (h + 1) & ix->mask) {
+        const DuRec *e = &r[ix->slot[h] - 1];
+        if (e->ino == ino && e->dev == dev) return e;
+    }
+    return NULL;
+}
+
+static void du_cache_path(char *out, size_t outsz) {
+    snprintf(out, outsz, "%s/" DU_CACHE_NAME, g_drives['C' - 'A'].root);
+}
+
+/* Once per boot; a file that does not check out is simply ignored */
+static void du_cache_load(void) {
+    if (g_du.loaded) return;
+    g_du.loaded = 1;
+
+    char path[PATH_MAX];
+    du_cache_path(path, sizeof path);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+
+    DuHeader h;
+    struct stat st;
+    char *buf = NULL;
+    if (read(fd, &h, sizeof h) != (ssize_t)sizeof h || memcmp(h.magic, DU_MAGIC, sizeof DU_MAGIC) != 0 ||
+        fstat(fd, &st) != 0 || h.count > UINT32_MAX - 1 || h.names_len > (uint64_t)st.st_size ||
+        (uint64_t)st.st_size != sizeof h + h.count * sizeof(DuRec) + h.names_len ||
+        !(buf = (char *)malloc((size_t)st.st_size - sizeof h + 1))) {
+        close(fd);
+        return;
+    }
+    size_t len = (size_t)st.st_size - sizeof h;
+    ssize_t got = read(fd, buf, len);
+    close(fd);
+
+    DuRec *recs = (DuRec *)buf;
+    char *names = buf + h.count * sizeof(DuRec);
+    int ok = got == (ssize_t)len && crc32c_update(0, buf, len) == h.crc;
+    for (size_t i = 0; ok && i < h.count; i++) {
+        const DuRec *r = &recs[i];
+        ok = r->names_off <= h.names_len && r->names_len <= h.names_len - r->names_off &&
+             (r->names_len == 0 || names[r->names_off + r->names_len - 1] == 0);
+    }
+    if (!ok || du_index_build(&g_du.ix, recs, (size_t)h.count) != 0) {
+        free(buf);
+        return;
+    }
+    g_du.recs = recs;
+    g_du.one_block = 1; // the names follow the records
+    g_du.count = (size_t)h.count;
+    g_du.names = names;
+    g_du.names_len = (size_t)h.names_len;
+}
+
+/* Written in place rather than renamed over, so C:\'s own mtime (and with
+   it the root's cache entry) only changes the first time */
+static void du_cache_save(const DuRec *recs, size_t count, const char *names, size_t names_len) {
+    DuHeader h;
+    memset(&h, 0, sizeof h);
+    memcpy(h.magic, DU_MAGIC, sizeof DU_MAGIC);
+    h.count = count;
+    h.names_len = names_len;
+    h.crc = crc32c_update(crc32c_update(0, recs, count * sizeof *recs), names, names_len);
+
+    char path[PATH_MAX];
+    du_cache_path(path, sizeof path);
+    int fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) return;
+    struct iovec v[3] = {
+        { &h, sizeof h }, { (void *)recs, count * sizeof *recs }, { (void *)names, names_len },
+    };
+    size_t total = sizeof h + count * sizeof *recs + names_len;
+    if (writev(fd, v, 3) == (ssize_t)total) (void)ftruncate(fd, (off_t)total);
+    close(fd);
+}
+
+/* A subdirectory found by a worker, not yet on the shared list */
+typedef struct DuKids {
+    struct DuKid {
+        uint64_t ino, blocks;
+        int64_t  mtime_ns;
+        size_t   name;      // offset into names
+    } *k;
+    size_t n, cap;
+    char  *names;
+    size_t len, lcap;
+} DuKids;
+
+static void du_kid_set(struct DuKid *k, const struct stat *st) {
+    k->ino = (uint64_t)st->st_ino;
+    k->blocks = (uint64_t)st->st_blocks;
+    k->mtime_ns = du_mtime(st);
+}
+
+static int du_kids_add(DuKids *kd, const char *name, const struct stat *st) {
+    size_t n = strlen(name) + 1;
+    if (kd->n == kd->cap) {
+        size_t cap = kd->cap ? kd->cap * 2 : 16;
+        void *p = realloc(kd->k, cap * sizeof *kd->k);
+        if (!p) return -1;
+        kd->k = (struct DuKid *)p;
+        kd->cap = cap;
+    }
+    if (kd->len + n > kd->lcap) {
+        size_t cap = kd->lcap ? kd->lcap * 2 : 256;
+        while (cap < kd->len + n) cap *= 2;
+        char *p = (char *)realloc(kd->names, cap);
+        if (!p) return -1;
+        kd->names = p;
+        kd->lcap = cap;
+    }
+    struct DuKid *k = &kd->k[kd->n++];
+    du_kid_set(k, st);
+    k->name = kd->len;
+    memcpy(kd->names + kd->len, name, n);
+    kd->len += n;
+    return 0;
+}
+
+/* Caller holds the lock */
+static int du_push(DuWalk *w, const char *path, const struct DuKid *k, uint64_t parent, size_t up) {
+    size_t i = w->count;
+    if (i / DU_CHUNK >= DU_MAX_CHUNKS) return -1;
+    if (!w->chunk[i / DU_CHUNK] && !(w->chunk[i / DU_CHUNK] = (DuNode *)calloc(DU_CHUNK, sizeof(DuNode))))
+        return -1;
+    DuNode *nd = du_node(w, i);
+    if (!(nd->path = strdup(path))) return -1;
+    nd->dev = w->dev;
+    nd->ino = k->ino;
+    nd->parent = parent;
+    nd->mtime_ns = k->mtime_ns;
+    nd->up = up;
+    nd->own.dir_alloc = k->blocks * 512;
+    w->count++;
+    return 0;
+}
+
+static void du_scan(DuWalk *w, size_t idx) {
+    DuNode *nd = du_node(w, idx);
+    DuKids kd;
+    memset(&kd, 0, sizeof kd);
+
+    int fd = open(nd->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return; // unreadable: counted as empty
+
+    const DuRec *c = w->rescan ? NULL : du_index_find(&g_du.ix, g_du.recs, nd->dev, nd->ino);
+    struct stat st;
+    if (c && c->mtime_ns == nd->mtime_ns) {
+        // Unchanged since the last walk: only the subdirectories need a look
+        nd->own.files = c->files;
+        nd->own.bytes = c->bytes;
+        nd->own.alloc = c->alloc;
+        nd->cached = 1;
+        for (size_t off = 0; off < c->names_len;) {
+            const char *name = g_du.names + c->names_off + off;
+            off += strlen(name) + 1;
+            if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode) &&
+                (uint64_t)st.st_dev == w->dev && du_kids_add(&kd, name, &st) != 0) break;
+        }
+        close(fd);
+    } else {
+        DIR *d = fdopendir(fd);
+        if (!d) { close(fd); return; }
+        struct dirent *de;
+        while ((de = readdir(d)) != NULL) {
+            const char *name = de->d_name;
+            if (!strcmp(name, ".") || !strcmp(name, "..")) continue;
+            // d_type saves nothing here: the sizes need the stat anyway
+            if (fstatat(dirfd(d), name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+            if (S_ISREG(st.st_mode)) {
+                nd->own.files++;
+                nd->own.bytes += (uint64_t)st.st_size;
+                nd->own.alloc += (uint64_t)st.st_blocks * 512;
+            } else if (S_ISDIR(st.st_mode) && (uint64_t)st.st_dev == w->dev) {
+                if (du_kids_add(&kd, name, &st) != 0) break;
+            }
+        }
+        closedir(d);
+    }
+
+    // The names this directory had are kept for the cache; the nodes for
+    // its subdirectories go onto the shared list in one go
+    nd->names = kd.names;
+    nd->names_len = kd.len;
+    if (kd.n == 0) { free(kd.k); return; }
+
+    pthread_mutex_lock(&w->lock);
+    for (size_t i = 0; i < kd.n; i++) {
+        char path[PATH_MAX];
+        if (snprintf(path, sizeof path, "%s/%s", nd->path, kd.names + kd.k[i].name) >= (int)sizeof path) continue;
+        if (du_push(w, path, &kd.k[i], nd->ino, idx) != 0) { w->full = 1; break; }
+    }
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    free(kd.k);
+}
+
+static void *du_worker(void *arg) {
+    DuWalk *w = (DuWalk *)arg;
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (w->next == w->count && w->busy > 0) pthread_cond_wait(&w->cond, &w->lock);
+        if (w->next == w->count) break; // nothing queued and nobody to queue more
+        size_t i = w->next++;
+        w->busy++;
+        pthread_mutex_unlock(&w->lock);
+
+        du_scan(w, i);
+
+        pthread_mutex_lock(&w->lock);
+        w->busy--;
+        if (w->busy == 0 && w->next == w->count) pthread_cond_broadcast(&w->cond);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+/* The cache after this walk: every directory seen, plus the old entries
+   from elsewhere. An old entry whose parent was read this time but which
+   was not met itself is gone from the disk, and is dropped. */
+static void du_cache_update(DuWalk *w) {
+    size_t names_len = 0;
+    for (size_t i = 0; i < w->count; i++) names_len += du_node(w, i)->names_len;
+    for (size_t i = 0; i < g_du.count; i++) names_len += g_du.recs[i].names_len;
+
+    DuRec *recs = (DuRec *)malloc((w->count + g_du.count) * sizeof *recs);
+    char *names = (char *)malloc(names_len + 1);
+    DuIndex ix = { NULL, 0 };
+    if (!recs || !names) goto out;
+
+    size_t n = 0, len = 0;
+    for (size_t i = 0; i < w->count; i++) {
+        const DuNode *nd = du_node(w, i);
+        DuRec *r = &recs[n++];
+        r->dev = nd->dev;
+        r->ino = nd->ino;
+        r->parent = nd->parent;
+        r->mtime_ns = nd->mtime_ns;
+        r->files = nd->own.files;
+        r->bytes = nd->own.bytes;
+        r->alloc = nd->own.alloc;
+        r->names_off = len;
+        r->names_len = nd->names_len;
+        if (nd->names_len) memcpy(names + len, nd->names, nd->names_len);
+        len += nd->names_len;
+    }
+    if (du_index_build(&ix, recs, n) != 0) goto out;
+    for (size_t i = 0; i < g_du.count; i++) {
+        const DuRec *o = &g_du.recs[i];
+        if (du_index_find(&ix, recs, o->dev, o->ino) || du_index_find(&ix, recs, o->dev, o->parent)) continue;
+        recs[n] = *o;
+        recs[n].names_off = len;
+        if (o->names_len) memcpy(names + len, g_du.names + o->names_off, o->names_len);
+        len += o->names_len;
+        n++;
+    }
+    free(ix.slot);
+    if (du_index_build(&ix, recs, n) != 0) goto out;
+
+    du_cache_save(recs, n, names, len);
+    if (!g_du.one_block) free(g_du.names);
+    free(g_du.recs);
+    free(g_du.ix.slot);
+    g_du.one_block = 0;
+    g_du.recs = recs;
+    g_du.count = n;
+    g_du.names = names;
+    g_du.names_len = len;
+    g_du.ix = ix;
+    return;
+out:
+    free(recs);
+    free(names);
+    free(ix.slot);
+}
+
+static void du_walk_free(DuWalk *w) {
+    for (size_t i = 0; i < w->count; i++) {
+        free(du_node(w, i)->path);
+        free(du_node(w, i)->names);
+    }
+    for (size_t c = 0; c < DU_MAX_CHUNKS && w->chunk[c]; c++) free(w->chunk[c]);
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->cond);
+}
+
+static int du_cmp_size(const void *a, const void *b) {
+    const DuNode *x = *(DuNode *const *)a, *y = *(DuNode *const *)b;
+    return (y->tree.bytes > x->tree.bytes) - (y->tree.bytes < x->tree.bytes);
+}
+
+/* CHKDSK /S: the subdirectories right below the root, largest first */
+static void du_print_subdirs(DuWalk *w) {
+    size_t n = 0;
+    for (size_t i = 1; i < w->count; i++) n += du_node(w, i)->up == 0;
+    DuNode **v = (DuNode **)malloc((n ? n : 1) * sizeof *v);
+    if (!v) return;
+    n = 0;
+    for (size_t i = 1; i < w->count; i++)
+        if (du_node(w, i)->up == 0) v[n++] = du_node(w, i);
+    qsort(v, n, sizeof *v, du_cmp_size);
+
+    con_write("\n         Bytes      Files   Dirs  Directory\n", 45);
+    for (size_t i = 0; i < n; i++) {
+        char dos[PATH_MAX], line[PATH_MAX + 64];
+        linux_to_dos(v[i]->path, dos, sizeof dos);
+        snprintf(line, sizeof line, "%14llu %10llu %6llu  %s\n", (unsigned long long)v[i]->tree.bytes,
+                 (unsigned long long)v[i]->tree.files, (unsigned long long)v[i]->tree.dirs, dos);
+        con_write(line, strlen(line));
+    }
+    free(v);
+}
+
+static void builtin_chkdsk(const char *arg) {
+    if (is_help_switch(arg)) {
+        const char *msg =
+            "CHKDSK [drive:][path] [/S] [/R]\n"
+            "DU is the same command.\n"
+            "  Totals the files and directories below path (default: the\n"
+            "  current drive's root) against the space on its volume.\n"
+            "  /S  Also lists each subdirectory of path with its size\n"
+            "  /R  Rereads every directory instead of trusting CHKDSK.DAT\n";
+        con_write(msg, strlen(msg));
+        return;
+    }
+
+    int subdirs = 0, rescan = 0;
+    char spec[PATH_MAX] = "";
+    for (const char *p = arg ? arg : ""; *p;) {
+        while (*p == ' ' || *p == '\t') p++;
+        if (!*p) break;
+        size_t n = strcspn(p, " \t");
+        if (*p == '/') {
+            if (n == 2 && toupper((unsigned char)p[1]) == 'S') subdirs = 1;
+            else if (n == 2 && toupper((unsigned char)p[1]) == 'R') rescan = 1;
+            else { con_error("Invalid switch\n", 15); return; }
+        } else if (!spec[0] && n < sizeof spec) {
+            memcpy(spec, p, n);
+            spec[n] = 0;
+        } else {
+            con_error("Too many parameters\n", 20);
+            return;
+        }
+        p += n;
+    }
+
+    // "D:" and nothing at all mean a drive's root, as in DOS
+    char linuxp[PATH_MAX];
+    int d = spec[0] ? drive_prefix(spec) : g_cur_drive;
+    if (!spec[0] || (d >= 0 && !spec[2])) {
+        if (!drive_mapped(d)) { con_error("Invalid drive specification\n", 28); return; }
+        snprintf(linuxp, sizeof linuxp, "%s", g_drives[d].root);
+    } else if (dos_to_linux_path(spec, linuxp, sizeof linuxp) != 0) {
+        con_error("Invalid path\n", 13);
+        return;
+    }
+
+    struct stat st, up;
+    struct statfs fs;
+    char real[PATH_MAX];
+    if (!realpath(linuxp, real) || lstat(real, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        con_error("Invalid path\n", 13);
+        return;
+    }
+    memcpy(linuxp, real, strlen(real) + 1); // "..\X" is shown and walked as C:\X
+    if (statfs(linuxp, &fs) != 0) memset(&fs, 0, sizeof fs);
+    char dotdot[PATH_MAX + 4];
+    snprintf(dotdot, sizeof dotdot, "%s/..", linuxp);
+    if (stat(dotdot, &up) != 0) up.st_ino = 0;
+
+    du_cache_load();
+    uint64_t t0 = stat_clock_ns();
+
+    DuWalk *w = (DuWalk *)calloc(1, sizeof *w);
+    if (!w) { con_error("Insufficient memory\n", 20); return; }
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    w->dev = (uint64_t)st.st_dev;
+    w->rescan = rescan;
+    struct DuKid top;
+    du_kid_set(&top, &st);
+    if (du_push(w, linuxp, &top, (uint64_t)up.st_ino, 0) != 0) {
+        du_walk_free(w);
+        free(w);
+        con_error("Insufficient memory\n", 20);
+        return;
+    }
+
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t nthreads = (ncpu > DU_MIN_THREADS) ? (size_t)ncpu : DU_MIN_THREADS;
+    if (nthreads > DU_MAX_THREADS) nthreads = DU_MAX_THREADS;
+    pthread_t tids[DU_MAX_THREADS];
+    size_t started = 0;
+    for (size_t i = 1; i < nthreads; i++) {
+        if (pthread_create(&tids[started], NULL, du_worker, w) != 0) break;
+        started++;
+    }
+    du_worker(w); // the calling thread works too
+    for (size_t i = 0; i < started; i++) pthread_join(tids[i], NULL);
+
+    // Children always come after their parent: one backwards pass sums the tree
+    size_t cached = 0;
+    for (size_t i = 0; i < w->count; i++) {
+        du_node(w, i)->tree = du_node(w, i)->own;
+        cached += (size_t)du_node(w, i)->cached;
+    }
+    for (size_t i = w->count; i-- > 1;) {
+        const DuSum *c = &du_node(w, i)->tree;
+        DuSum *p = &du_node(w, du_node(w, i)->up)->tree;
+        p->files += c->files;
+        p->bytes += c->bytes;
+        p->alloc += c->alloc;
+        p->dir_alloc += c->dir_alloc;
+        p->dirs += c->dirs + 1;
+    }
+    const DuSum *root = &du_node(w, 0)->tree;
+    uint64_t ms = (stat_clock_ns() - t0) / 1000000;
+
+    char dos[PATH_MAX], out[PATH_MAX + 1024];
+    linux_to_dos(linuxp, dos, sizeof dos);
+    unsigned long long unit = (unsigned long long)fs.f_bsize;
+    int n = snprintf(out, sizeof out,
+                     "\n Directory %s\n\n"
+                     "%16llu bytes total disk space\n"
+                     "%16llu bytes in %llu directories\n"
+                     "%16llu bytes in %llu user files (%llu on disk)\n"
+                     "%16llu bytes available on disk\n\n"
+                     "%16llu bytes in each allocation unit\n"
+                     "%16llu total allocation units on disk\n"
+                     "%16llu available allocation units on disk\n",
+                     dos, (unsigned long long)fs.f_blocks * unit,
+                     (unsigned long long)root->dir_alloc, (unsigned long long)root->dirs + 1, // and itself
+                     (unsigned long long)root->bytes, (unsigned long long)root->files,
+                     (unsigned long long)root->alloc, (unsigned long long)fs.f_bavail * unit, unit,
+                     (unsigned long long)fs.f_blocks, (unsigned long long)fs.f_bavail);
+    con_write(out, (size_t)n < sizeof out ? (size_t)n : sizeof out - 1);
+
+    if (subdirs) du_print_subdirs(w);
+
+    snprintf(out, sizeof out, "\nChecked %zu directories in %llu ms, %zu unchanged since the last CHKDSK\n",
+             w->count, (unsigned long long)ms, cached);
+    con_write(out, strlen(out));
+    if (w->full) con_error("Too many directories: totals are partial\n", 41);
+
+    if (g_drives['C' - 'A'].root[0]) du_cache_update(w);
+    du_walk_free(w);
+    free(w);
+}
+
+/* --- EDIT ---
+   A full-screen editor for files of any size. The file is mapped, never
+   read in: the document is a piece table over the mapping plus an
+   append-only buffer of typed text, so opening a multi-gigabyte log costs
+   one mmap() and drawing a screen touches only the pages on it. The view
+   is kept by byte offset. Line numbers come from an index of every
+   EDIT_IDX_STEP-th line start, built only as far as the cursor has gone
+   (in the idle time between keys) and cut back to the point of an edit.
+   Saving writes just the typed pieces when all of the original text still
+   sits at its own offset (overtyping, appending, cutting the end off);
+   otherwise the pieces are streamed to a new file, the mapped parts with
+   copy_file_range(), which then replaces the old one.
+
+   Another program may truncate the file while it is open (a service
+   rotating its log). Reading the mapping past the new end raises SIGBUS,
+   which would take PID 1 down with it, so while EDIT runs a handler
+   catches faults inside the mapping and jumps back to the editor loop;
+   there the document is cut to what is left of the file. */
+
+#define EDIT_IDX_STEP  1024        // lines between index checkpoints
+#define EDIT_IDX_CHUNK (32u << 20) // bytes indexed per idle slice
+#define EDIT_TAB       8
+#define EDIT_ESC_MS    50          // a lone Esc: no sequence byte follows within this
+
+#define EDIT_ATTR_TEXT   0x47 // white on blue (the attribute is ANSI-numbered)
+#define EDIT_ATTR_BAR    0x70
+#define EDIT_ATTR_STATUS 0x60
+
+enum { ED_ORIG, ED_ADD };
+
+typedef struct EdPiece {
+    uint64_t off, len;
+    int      src;         // ED_ORIG: the mapping, ED_ADD: typed text
+} EdPiece;
+
+typedef struct Edit {
+    char        path[PATH_MAX];
+    char        dos[PATH_MAX];
+    int         fd;       // the file as opened; -1 for a new one
+    const char *orig;     // its mapping
+    uint64_t    orig_len;
+    char       *add;
+    uint64_t    add_len, add_cap;
+    EdPiece    *pc;
+    size_t      npc, pc_cap;
+    uint64_t    len;      // of the document
+    uint64_t   *idx;      // idx[i]: where line i * EDIT_IDX_STEP starts
+    size_t      nidx, idx_cap;
+    uint64_t    scanned;  // [0, scanned) is indexed and holds `lines` newlines
+    uint64_t    lines;
+    int         crlf;     // Enter inserts \r\n
+    int         modified;
+    uint64_t    top, cur; // first line on screen (its start), cursor
+    uint64_t    left, want; // horizontal scroll; the column Up/Down keep
+    int         cols, rows; // of the text area
+    char        msg[128]; // shown on the status line for one frame
+} Edit;
+
+/* The mapping the SIGBUS handler answers for, and where it goes back to */
+static const char *volatile g_ed_map_lo, *volatile g_ed_map_hi;
+static sigjmp_buf           g_ed_jmp;
+
+static void ed_sigbus(int sig, siginfo_t *si, void *uc) {
+    (void)uc;
+    const char *a = (const char *)si->si_addr;
+    if (a >= g_ed_map_lo && a < g_ed_map_hi) siglongjmp(g_ed_jmp, 1);
+    signal(sig, SIG_DFL); // not ours: the fault repeats and takes its course
+}
+
+static const char *ed_src(const Edit *e, const EdPiece *p) {
+    return (p->src == ED_ORIG ? e->orig : e->add) + p->off;
+}
+
+/* Piece holding pos; *at gets pos's offset inside it */
+static size_t ed_piece(const Edit *e, uint64_t pos, uint64_t *at) {
+    uint64_t p = 0;
+    for (size_t i = 0; i < e->npc; i++) {
+        if (pos < p + e->pc[i].len) { *at = pos - p; return i; }
+        p += e->pc[i].len;
+    }
+    *at = 0;
+    return e->npc;
+}
+
+/* The bytes from pos to the end of its piece; 0 at the end */
+static uint64_t ed_span(const Edit *e, uint64_t pos, const char **s) {
+    uint64_t at;
+    size_t i = ed_piece(e, pos, &at);
+    if (i == e->npc) return 0;
+    *s = ed_src(e, &e->pc[i]) + at;
+    return e->pc[i].len - at;
+}
+
+/* The bytes from the start of pos-1's piece up to pos */
+static uint64_t ed_span_before(const Edit *e, uint64_t pos, const char **s) {
+    if (pos == 0) return 0;
+    uint64_t at;
+    size_t i = ed_piece(e, pos - 1, &at);
+    *s = ed_src(e, &e->pc[i]);
+    return at + 1;
+}
+
+static int ed_byte(const Edit *e, uint64_t pos) {
+    const char *s;
+    return ed_span(e, pos, &s) ? (unsigned char)*s : -1;
+}
+
+/* The '\n' ending pos's line, or len for the last line */
+static uint64_t ed_eol(const Edit *e, uint64_t pos) {
+    const char *s;
+    uint64_t n;
+    while ((n = ed_span(e, pos, &s)) > 0) {
+        const char *nl = memchr(s, '\n', n);
+        if (nl) return pos + (uint64_t)(nl - s);
+        pos += n;
+    }
+    return e->len;
+}
+
+static uint64_t ed_bol(const Edit *e, uint64_t pos) {
+    const char *s;
+    uint64_t n;
+    while ((n = ed_span_before(e, pos, &s)) > 0) {
+        const char *nl = memrchr(s, '\n', n);
+        if (nl) return pos - n + (uint64_t)(nl - s) + 1;
+        pos -= n;
+    }
+    return 0;
+}
+
+/* Where the line's text ends: before its \n or \r\n */
+static uint64_t ed_text_end(const Edit *e, uint64_t bol) {
+    uint64_t eol = ed_eol(e, bol);
+    if (eol < e->len && eol > bol && ed_byte(e, eol - 1) == '\r') eol--;
+    return eol;
+}
+
+static uint64_t ed_next_col(uint64_t col, int c) {
+    return c == '\t' ? (col / EDIT_TAB + 1) * EDIT_TAB : col + 1;
+}
+
+/* Screen column of pos on the line starting at bol */
+static uint64_t ed_col(const Edit *e, uint64_t bol, uint64_t pos) {
+    uint64_t col = 0;
+    const char *s;
+    uint64_t n;
+    while (bol < pos && (n = ed_span(e, bol, &s)) > 0) {
+        if (n > pos - bol) n = pos - bol;
+        for (uint64_t i = 0; i < n; i++) col = ed_next_col(col, s[i]);
+        bol += n;
+    }
+    return col;
+}
+
+/* The position on the line at bol that shows at col, or the text end */
+static uint64_t ed_at_col(const Edit *e, uint64_t bol, uint64_t col) {
+    uint64_t end = ed_text_end(e, bol), pos = bol, c = 0;
+    const char *s;
+    uint64_t n;
+    while (pos < end && (n = ed_span(e, pos, &s)) > 0) {
+        if (n > end - pos) n = end - pos;
+        for (uint64_t i = 0; i < n; i++, pos++) {
+            uint64_t next = ed_next_col(c, s[i]);
+            if (next > col) return pos;
+            c = next;
+        }
+    }
+    return pos;
+}
+
+static int ed_idx_reserve(Edit *e, size_t more) {
+    if (e->nidx + more <= e->idx_cap) return 0;
+    size_t cap = e->idx_cap ? e->idx_cap : 64;
+    while (cap < e->nidx + more) cap *= 2;
+    uint64_t *p = (uint64_t *)realloc(e->idx, cap * sizeof *p);
+    if (!p) return -1;
+    e->idx = p;
+    e->idx_cap = cap;
+    return 0;
+}
+
+/* Index up to `budget` more bytes */
+static void ed_idx_extend(Edit *e, uint64_t budget) {
+    uint64_t stop = (e->len - e->scanned > budget) ? e->scanned + budget : e->len;
+    while (e->scanned < stop) {
+        const char *s;
+        uint64_t n = ed_span(e, e->scanned, &s);
+        if (n > stop - e->scanned) n = stop - e->scanned;
+        if (ed_idx_reserve(e, (size_t)(n / EDIT_IDX_STEP) + 1) != 0) return;
+
+        const char *q = s, *end = s + n;
+        while ((q = memchr(q, '\n', (size_t)(end - q))) != NULL) {
+            q++;
+            if (++e->lines % EDIT_IDX_STEP == 0) e->idx[e->nidx++] = e->scanned + (uint64_t)(q - s);
+        }
+        e->scanned += n;
+    }
+}
+
+/* An edit at pos leaves everything before it alone: keep the checkpoints
+   up to pos and index on from the last of them */
+static void ed_idx_cut(Edit *e, uint64_t pos) {
+    if (e->scanned <= pos) return;
+    size_t lo = 0, hi = e->nidx; // idx[0] is 0, so some idx[k] <= pos
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (e->idx[mid] <= pos) lo = mid; else hi = mid;
+    }
+    e->nidx = lo + 1;
+    e->scanned = e->idx[lo];
+    e->lines = (uint64_t)lo * EDIT_IDX_STEP;
+}
+
+/* 0-based line of pos, or -1 while the index has not got that far */
+static int64_t ed_line_of(const Edit *e, uint64_t pos) {
+    if (pos > e->scanned) return -1;
+    size_t lo = 0, hi = e->nidx;
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (e->idx[mid] <= pos) lo = mid; else hi = mid;
+    }
+    uint64_t line = (uint64_t)lo * EDIT_IDX_STEP, p = e->idx[lo];
+    const char *s;
+    uint64_t n;
+    while (p < pos && (n = ed_span(e, p, &s)) > 0) {
+        if (n > pos - p) n = pos - p;
+        for (const char *q = s, *end = s + n; (q = memchr(q, '\n', (size_t)(end - q))) != NULL; q++) line++;
+        p += n;
+    }
+    return (int64_t)line;
+}
+
+/* Start of 0-based line; the last line if there are fewer */
+static uint64_t ed_line_start(Edit *e, uint64_t line) {
+    while (e->lines < line && e->scanned < e->len) ed_idx_extend(e, EDIT_IDX_CHUNK);
+    if (line > e->lines) line = e->lines;
+    size_t k = (size_t)(line / EDIT_IDX_STEP);
+    if (k >= e->nidx) k = e->nidx - 1;
+    uint64_t pos = e->idx[k];
+    for (uint64_t i = (uint64_t)k * EDIT_IDX_STEP; i < line; i++) pos = ed_eol(e, pos) + 1;
+    return pos;
+}
+
+static int ed_pc_reserve(Edit *e, size_t more) {
+    if (e->npc + more <= e->pc_cap) return 0;
+    size_t cap = e->pc_cap ? e->pc_cap * 2 : 64;
+    while (cap < e->npc + more) cap *= 2;
+    EdPiece *p = (EdPiece *)realloc(e->pc, cap * sizeof *p);
+    if (!p) return -1;
+    e->pc = p;
+    e->pc_cap = cap;
+    return 0;
+}
+
+/* Make pos a piece boundary; returns the index of the piece starting
+   there (npc at the end). Needs one free slot. */
+static size_t ed_split(Edit *e, uint64_t pos) {
+    uint64_t p = 0;
+    for (size_t i = 0; i < e->npc; i++) {
+        if (pos == p) return i;
+        if (pos < p + e->pc[i].len) {
+            uint64_t k = pos - p;
+            memmove(&e->pc[i + 2], &e->pc[i + 1], (e->npc - i - 1) * sizeof *e->pc);
+            e->pc[i + 1] = e->pc[i];
+            e->pc[i + 1].off += k;
+            e->pc[i + 1].len -= k;
+            e->pc[i].len = k;
+            e->npc++;
+            return i + 1;
+        }
+        p += e->pc[i].len;
+    }
+    return e->npc;
+}
+
+static int ed_insert(Edit *e, uint64_t pos, const char *s, uint64_t n) {
+    if (e->add_len + n > e->add_cap) {
+        uint64_t cap = e->add_cap ? e->add_cap * 2 : 4096;
+        while (cap < e->add_len + n) cap *= 2;
+        char *p = (char *)realloc(e->add, (size_t)cap);
+        if (!p) return -1;
+        e->add = p;
+        e->add_cap = cap;
+    }
+    if (ed_pc_reserve(e, 2) != 0) return -1;
+    memcpy(e->add + e->add_len, s, (size_t)n);
+
+    // Typing on from the last insertion just grows that piece
+    uint64_t at;
+    size_t i = pos ? ed_piece(e, pos - 1, &at) : e->npc;
+    if (i < e->npc && at + 1 == e->pc[i].len && e->pc[i].src == ED_ADD &&
+        e->pc[i].off + e->pc[i].len == e->add_len) {
+        e->pc[i].len += n;
+    } else {
+        i = ed_split(e, pos);
+        memmove(&e->pc[i + 1], &e->pc[i], (e->npc - i) * sizeof *e->pc);
+        e->pc[i].src = ED_ADD;
+        e->pc[i].off = e->add_len;
+        e->pc[i].len = n;
+        e->npc++;
+    }
+    e->add_len += n;
+    e->len += n;
+    e->modified = 1;
+    ed_idx_cut(e, pos);
+    return 0;
+}
+
+static int ed_delete(Edit *e, uint64_t pos, uint64_t n) {
+    if (n > e->len - pos) n = e->len - pos;
+    if (n == 0) return 0;
+    if (ed_pc_reserve(e, 2) != 0) return -1;
+    size_t i = ed_split(e, pos);
+    size_t j = ed_split(e, pos + n);
+    memmove(&e->pc[i], &e->pc[j], (e->npc - j) * sizeof *e->pc);
+    e->npc -= j - i;
+    e->len -= n;
+    e->modified = 1;
+    ed_idx_cut(e, pos);
+    return 0;
+}
+
+static int ed_map(Edit *e) {
+    struct stat st;
+    e->fd = open(e->path, O_RDONLY | O_CLOEXEC);
+    if (e->fd < 0) return errno == ENOENT ? 0 : -1; // a new file
+    if (fstat(e->fd, &st) != 0 || !S_ISREG(st.st_mode)) { errno = EISDIR; return -1; }
+
+    e->orig_len = (uint64_t)st.st_size;
+    e->npc = 0;
+    if (e->orig_len) {
+        void *m = mmap(NULL, (size_t)e->orig_len, PROT_READ, MAP_SHARED, e->fd, 0);
+        if (m == MAP_FAILED) return -1;
+        e->orig = (const char *)m;
+        g_ed_map_lo = e->orig;
+        g_ed_map_hi = e->orig + e->orig_len;
+        if (ed_pc_reserve(e, 1) != 0) return -1;
+        e->pc[0].src = ED_ORIG;
+        e->pc[0].off = 0;
+        e->pc[0].len = e->orig_len;
+        e->npc = 1;
+    }
+    e->len = e->orig_len;
+    e->add_len = 0; // every piece is the file's again
+    e->modified = 0;
+    return 0;
+}
+
+static void ed_unmap(Edit *e) {
+    g_ed_map_lo = g_ed_map_hi = NULL;
+    if (e->orig) munmap((void *)e->orig, (size_t)e->orig_len);
+    if (e->fd >= 0) close(e->fd);
+    e->orig = NULL;
+    e->orig_len = 0;
+    e->fd = -1;
+}
+
+static int ed_open(Edit *e, const char *linuxp) {
+    snprintf(e->path, sizeof e->path, "%s", linuxp);
+    linux_to_dos(linuxp, e->dos, sizeof e->dos);
+    e->fd = -1;
+    if (ed_map(e) != 0 || ed_idx_reserve(e, 1) != 0) return -1;
+    e->idx[e->nidx++] = 0;
+
+    // Keep the file's line ends (judged by the first line, if it ends
+    // within 64 KB); a new file gets DOS ones. Read, not mapped: the
+    // SIGBUS handler is not in place yet.
+    e->crlf = 1;
+    static char head[65536];
+    ssize_t n = e->fd >= 0 ? pread(e->fd, head, sizeof head, 0) : 0;
+    const char *nl = n > 0 ? memchr(head, '\n', (size_t)n) : NULL;
+    if (nl) e->crlf = nl > head && nl[-1] == '\r';
+    return 0;
+}
+
+/* The file shrank under the mapping and a read past its new end faulted.
+   What is gone from the file is gone from the document too: the mapping
+   is cut to the file's size, original text past it is dropped from the
+   pieces, and the line index starts over. */
+static void ed_recover(Edit *e) {
+    struct stat st;
+    uint64_t size = fstat(e->fd, &st) == 0 ? (uint64_t)st.st_size : 0;
+    if (size > e->orig_len) size = e->orig_len; // grown again: the rest is not ours
+    g_ed_map_lo = g_ed_map_hi = NULL;
+    munmap((void *)e->orig, (size_t)e->orig_len);
+    e->orig = NULL;
+    if (size) {
+        void *m = mmap(NULL, (size_t)size, PROT_READ, MAP_SHARED, e->fd, 0);
+        if (m != MAP_FAILED) {
+            e->orig = (const char *)m;
+            g_ed_map_lo = e->orig;
+            g_ed_map_hi = e->orig + size;
+        } else {
+            size = 0;
+        }
+    }
+    e->orig_len = size;
+
+    size_t j = 0;
+    e->len = 0;
+    for (size_t i = 0; i < e->npc; i++) {
+        EdPiece p = e->pc[i];
+        if (p.src == ED_ORIG) {
+            if (p.off >= size) continue;
+            if (p.len > size - p.off) p.len = size - p.off;
+        }
+        e->pc[j++] = p;
+        e->len += p.len;
+    }
+    e->npc = j;
+    e->nidx = 1; // idx[0] is 0
+    e->scanned = 0;
+    e->lines = 0;
+    if (e->cur > e->len) e->cur = e->len;
+    e->top = ed_bol(e, e->top < e->len ? e->top : e->len);
+    e->modified = 1;
+    snprintf(e->msg, sizeof e->msg, "The file was cut short by another program");
+}
+
+static void ed_close(Edit *e) {
+    ed_unmap(e);
+    free(e->add);
+    free(e->pc);
+    free(e->idx);
+}
+
+static int ed_write(int fd, const char *s, uint64_t n, int64_t off) {
+    while (n) {
+        ssize_t w = off >= 0 ? pwrite(fd, s, (size_t)n, (off_t)off) : write(fd, s, (size_t)n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return -1;
+        s += w;
+        n -= (uint64_t)w;
+        if (off >= 0) off += w;
+    }
+    return 0;
+}
+
+/* Every original byte still at its own offset: the typed pieces cover
+   only bytes nothing else refers to, so they can go straight into the file */
+static int ed_in_place(const Edit *e) {
+    if (e->fd < 0) return 0;
+    uint64_t p = 0;
+    for (size_t i = 0; i < e->npc; i++) {
+        if (e->pc[i].src == ED_ORIG && e->pc[i].off != p) return 0;
+        p += e->pc[i].len;
+    }
+    return 1;
+}
+
+/* Returns bytes written, or -1 */
+static int64_t ed_save(Edit *e) {
+    uint64_t written = 0;
+    if (ed_in_place(e)) {
+        int fd = open(e->path, O_WRONLY | O_CLOEXEC);
+        if (fd < 0) return -1;
+        uint64_t p = 0;
+        int rc = 0;
+        for (size_t i = 0; i < e->npc && rc == 0; i++) {
+            if (e->pc[i].src == ED_ADD) {
+                rc = ed_write(fd, ed_src(e, &e->pc[i]), e->pc[i].len, (int64_t)p);
+                written += e->pc[i].len;
+            }
+            p += e->pc[i].len;
+        }
+        if (rc == 0 && e->len != e->orig_len) rc = ftruncate(fd, (off_t)e->len);
+        if (rc == 0) rc = fdatasync(fd);
+        close(fd);
+        if (rc != 0) return -1;
+    } else {
+        char tmp[PATH_MAX + 8];
+        snprintf(tmp, sizeof tmp, "%s.$$$", e->path);
+        struct stat st;
+        mode_t mode = (e->fd >= 0 && fstat(e->fd, &st) == 0) ? (st.st_mode & 07777) : 0644;
+        int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+        if (fd < 0) return -1;
+
+        int rc = 0;
+        for (size_t i = 0; i < e->npc && rc == 0; i++) {
+            const EdPiece *pc = &e->pc[i];
+            uint64_t done = 0;
+            if (pc->src == ED_ORIG) {
+                // In the kernel, and a reflink where the filesystem can
+                loff_t in = (loff_t)pc->off;
+                while (done < pc->len) {
+                    ssize_t c = copy_file_range(e->fd, &in, fd, NULL, (size_t)(pc->len - done), 0);
+                    if (c <= 0) break;
+                    done += (uint64_t)c;
+                }
+            }
+            rc = ed_write(fd, ed_src(e, pc) + done, pc->len - done, -1);
+        }
+        if (rc == 0) rc = fdatasync(fd);
+        if (close(fd) != 0) rc = -1;
+        if (rc != 0 || rename(tmp, e->path) != 0) { unlink(tmp); return -1; }
+        written = e->len;
+    }
+
+    // The file is the document now: map it again as one piece. The line
+    // index stays valid, the text being the same.
+    ed_unmap(e);
+    if (ed_map(e) != 0) return -1;
+    g_stat_bytes_out += written;
+    return (int64_t)written;
+}
+
+enum {
+    K_NONE = -1, K_EOF = -2,
+    K_UP = 0x100, K_DOWN, K_LEFT, K_RIGHT, K_HOME, K_END, K_PGUP, K_PGDN,
+    K_DEL, K_DOC_HOME, K_DOC_END, K_F2, K_ESC
+};
+
+static unsigned char g_ed_kb[256];
+static size_t        g_ed_kn = 0, g_ed_kp = 0;
+
+/* A byte within ms milliseconds (-1: wait for it); K_NONE if none came */
+static int ed_in(int ms) {
+    if (g_ed_kp < g_ed_kn) return g_ed_kb[g_ed_kp++];
+    if (!g_con_in_len) {
+        struct pollfd pfd = { 0, POLLIN, 0 };
+        if (poll(&pfd, 1, ms) <= 0) return K_NONE;
+    }
+    ssize_t n = con_read(g_ed_kb, sizeof g_ed_kb);
+    if (n <= 0) return K_EOF;
+    g_ed_kn = (size_t)n;
+    g_ed_kp = 1;
+    return g_ed_kb[0];
+}
+
+/* Keys as xterm and the Linux console send them */
+static int ed_key(int ms) {
+    int c = ed_in(ms);
+    if (c != 0x1B) return c;
+    int c1 = ed_in(EDIT_ESC_MS);
+    if (c1 >= 0 && c1 != '[' && c1 != 'O') g_ed_kp--; // Esc, then an ordinary key
+    if (c1 != '[' && c1 != 'O') return K_ESC;
+
+    int c2 = ed_in(EDIT_ESC_MS);
+    if (c1 == '[' && c2 == '[') return ed_in(EDIT_ESC_MS) == 'B' ? K_F2 : K_NONE; // console F1-F5
+
+    int n[2] = { 0, 0 }, k = 0;
+    while ((c2 >= '0' && c2 <= '9') || c2 == ';') {
+        if (c2 == ';') k = 1;
+        else n[k] = n[k] * 10 + (c2 - '0');
+        c2 = ed_in(EDIT_ESC_MS);
+    }
+    int ctrl = (n[1] == 5);
+    switch (c2) {
+    case 'A': return K_UP;
+    case 'B': return K_DOWN;
+    case 'C': return K_RIGHT;
+    case 'D': return K_LEFT;
+    case 'H': return ctrl ? K_DOC_HOME : K_HOME;
+    case 'F': return ctrl ? K_DOC_END : K_END;
+    case 'Q': return K_F2;
+    case '~':
+        switch (n[0]) {
+        case 1: case 7: return ctrl ? K_DOC_HOME : K_HOME;
+        case 4: case 8: return ctrl ? K_DOC_END : K_END;
+        case 3:  return K_DEL;
+        case 5:  return K_PGUP;
+        case 6:  return K_PGDN;
+        case 12: return K_F2;
+        }
+    }
+    return K_NONE;
+}
+
+/* Keep the cursor on screen: its line within the rows from top, its column
+   within the width */
+static void ed_scroll(Edit *e) {
+    uint64_t bol = ed_bol(e, e->cur);
+    if (bol < e->top) {
+        e->top = bol;
+    } else {
+        uint64_t t = e->top;
+        for (int r = 0; r < e->rows - 1 && t < bol; r++) t = ed_eol(e, t) + 1;
+        if (t < bol) { // further down: put it on the last row
+            t = bol;
+            for (int r = 0; r < e->rows - 1 && t > 0; r++) t = ed_bol(e, t - 1);
+            e->top = t;
+        }
+    }
+
+    uint64_t col = ed_col(e, bol, e->cur);
+    if (col < e->left) e->left = col;
+    if (col >= e->left + (uint64_t)e->cols) e->left = col - (uint64_t)e->cols + 1;
+}
+
+static void ed_draw(Edit *e) {
+    int W = e->cols;
+    char line[PATH_MAX + 64];
+
+    scr_fill(0, 0, W, 1, ' ', EDIT_ATTR_BAR);
+    snprintf(line, sizeof line, " EDIT  %s%s", e->dos, e->modified ? "  (modified)" : "");
+    scr_text(0, 0, line, EDIT_ATTR_BAR);
+
+    uint64_t bol = ed_bol(e, e->cur);
+    int cy = 1;
+    uint64_t t = e->top;
+    int more = 1;
+    for (int y = 1; y <= e->rows; y++) {
+        scr_fill(0, y, W, 1, ' ', EDIT_ATTR_TEXT);
+        if (!more) continue;
+        if (t == bol) cy = y;
+
+        // Only as much of the line as reaches the right edge is read
+        uint64_t pos = t, col = 0;
+        const char *s;
+        uint64_t n;
+        int eol_seen = 0;
+        while (!eol_seen && col < e->left + (uint64_t)W && (n = ed_span(e, pos, &s)) > 0) {
+            for (uint64_t i = 0; i < n && col < e->left + (uint64_t)W; i++) {
+                if (s[i] == '\n' || (s[i] == '\r' && (i + 1 < n ? s[i + 1] : ed_byte(e, pos + i + 1)) == '\n')) {
+                    eol_seen = 1;
+                    break;
+                }
+                uint64_t next = ed_next_col(col, s[i]);
+                for (; col < next; col++)
+                    if (col >= e->left) scr_put((int)(col - e->left), y, s[i] == '\t' ? ' ' : s[i], EDIT_ATTR_TEXT);
+            }
+            pos += n;
+        }
+
+        uint64_t eol = ed_eol(e, t);
+        if (eol >= e->len) more = 0;
+        else t = eol + 1;
+    }
+
+    int64_t ln = ed_line_of(e, e->cur);
+    uint64_t col = ed_col(e, bol, e->cur);
+    char where[64];
+    if (ln >= 0) snprintf(where, sizeof where, "Ln %lld Col %llu ", (long long)ln + 1, (unsigned long long)col + 1);
+    else snprintf(where, sizeof where, "Ln ? Col %llu ", (unsigned long long)col + 1);
+
+    int sy = e->rows + 1;
+    scr_fill(0, sy, W, 1, ' ', EDIT_ATTR_STATUS);
+    scr_text(1, sy, e->msg[0] ? e->msg : "F2=Save  Ctrl+G=Go to line  Ctrl+Y=Delete line  Esc=Exit", EDIT_ATTR_STATUS);
+    int wl = (int)strlen(where);
+    scr_text(W - wl, sy, where, EDIT_ATTR_STATUS);
+    e->msg[0] = 0;
+
+    scr_cursor((int)(col - e->left), cy);
+}
+
+static void ed_status(Edit *e, const char *text) {
+    int sy = e->rows + 1;
+    scr_fill(0, sy, e->cols, 1, ' ', EDIT_ATTR_STATUS);
+    scr_text(0, sy, text, EDIT_ATTR_STATUS);
+    scr_cursor((int)strlen(text), sy);
+    scr_present();
+}
+
+/* A question on the status line; returns 1 with the answer, 0 on Esc */
+static int ed_prompt(Edit *e, const char *q, char *out, size_t outsz) {
+    size_t n = 0;
+    out[0] = 0;
+    for (;;) {
+        char line[160];
+        snprintf(line, sizeof line, " %s%s", q, out);
+        ed_status(e, line);
+
+        int k = ed_key(-1);
+        if (k == '\r' || k == '\n') return 1;
+        if (k == K_ESC || k == K_EOF) return 0;
+        if ((k == 0x7F || k == 0x08) && n) out[--n] = 0;
+        else if (k >= 0x20 && k < 0x7F && n + 1 < outsz) { out[n++] = (char)k; out[n] = 0; }
+    }
+}
+
+static int ed_save_msg(Edit *e) {
+    int had_file = e->fd >= 0;
+    int in_place = ed_in_place(e);
+    int64_t w = ed_save(e);
+    if (w < 0) {
+        snprintf(e->msg, sizeof e->msg, "Cannot save: %s", strerror(errno));
+        return -1;
+    }
+    if (had_file && in_place)
+        snprintf(e->msg, sizeof e->msg, "Saved in place: %lld of %llu bytes written",
+                 (long long)w, (unsigned long long)e->len);
+    else
+        snprintf(e->msg, sizeof e->msg, "Saved %llu bytes", (unsigned long long)e->len);
+    return 0;
+}
+
+/* Cursor one line up or down, keeping the wanted column */
+static int ed_vmove(Edit *e, int down) {
+    uint64_t bol = ed_bol(e, e->cur);
+    if (down) {
+        uint64_t eol = ed_eol(e, bol);
+        if (eol >= e->len) return 0;
+        e->cur = ed_at_col(e, eol + 1, e->want);
+    } else {
+        if (bol == 0) return 0;
+        e->cur = ed_at_col(e, ed_bol(e, bol - 1), e->want);
+    }
+    return 1;
+}
+
+static void ed_run(Edit *e) {
+    if (sigsetjmp(g_ed_jmp, 1)) ed_recover(e); // from ed_sigbus()
+    for (;;) {
+        ed_scroll(e);
+        ed_draw(e);
+        scr_present();
+
+        // Line numbers the index has not reached yet are counted while
+        // no key is waiting, a slice at a time
+        int counting = ed_line_of(e, e->cur) < 0;
+        int k = ed_key(counting ? 0 : -1);
+        if (k == K_NONE) {
+            if (counting) ed_idx_extend(e, EDIT_IDX_CHUNK);
+            continue;
+        }
+
+        uint64_t bol = ed_bol(e, e->cur);
+        int keep_want = 0;
+        switch (k) {
+        case K_EOF:
+            return;
+        case K_ESC:
+        case 0x11: { // Ctrl+Q
+            if (!e->modified) return;
+            ed_status(e, " Save changes (Y/N)? ");
+            int a = ed_key(-1);
+            if (a == K_EOF || a == 'n' || a == 'N') return;
+            if ((a == 'y' || a == 'Y') && ed_save_msg(e) == 0) return;
+            break;
+        }
+        case K_F2:
+        case 0x13: // Ctrl+S
+            (void)ed_save_msg(e);
+            break;
+        case 0x07: { // Ctrl+G
+            char a[24];
+            if (ed_prompt(e, "Go to line: ", a, sizeof a) && atoll(a) > 0) {
+                snprintf(e->msg, sizeof e->msg, "Counting lines...");
+                ed_draw(e);
+                scr_present();
+                e->msg[0] = 0;
+                e->cur = ed_line_start(e, (uint64_t)atoll(a) - 1);
+            }
+            break;
+        }
+        case K_UP:   ed_vmove(e, 0); keep_want = 1; break;
+        case K_DOWN: ed_vmove(e, 1); keep_want = 1; break;
+        case K_PGUP:
+        case K_PGDN:
+            // The page moves with the cursor
+            for (int i = 0; i < e->rows - 1 && ed_vmove(e, k == K_PGDN); i++) {
+                if (k == K_PGDN) { uint64_t eol = ed_eol(e, e->top); if (eol < e->len) e->top = eol + 1; }
+                else if (e->top > 0) e->top = ed_bol(e, e->top - 1);
+            }
+            keep_want = 1;
+            break;
+        case K_LEFT:
+            if (e->cur > bol) e->cur--;
+            else if (e->cur > 0) e->cur = ed_text_end(e, ed_bol(e, e->cur - 1));
+            break;
+        case K_RIGHT:
+            if (e->cur < ed_text_end(e, bol)) e->cur++;
+            else if (ed_eol(e, bol) < e->len) e->cur = ed_eol(e, bol) + 1;
+            break;
+        case K_HOME:     e->cur = bol; break;
+        case K_END:      e->cur = ed_text_end(e, bol); break;
+        case K_DOC_HOME: e->cur = 0; break;
+        case K_DOC_END:  e->cur = e->len; break;
+        case 0x7F:
+        case 0x08: // Backspace: at a line start, joins it to the line above
+            if (e->cur == 0) break;
+            if (e->cur == bol) {
+                uint64_t n = (e->cur >= 2 && ed_byte(e, e->cur - 2) == '\r') ? 2 : 1;
+                e->cur -= n;
+                (void)ed_delete(e, e->cur, n);
+            } else {
+                (void)ed_delete(e, --e->cur, 1);
+            }
+            break;
+        case K_DEL: {
+            uint64_t end = ed_text_end(e, bol);
+            (void)ed_delete(e, e->cur, e->cur < end ? 1 : ed_eol(e, bol) + 1 - e->cur);
+            break;
+        }
+        case 0x19: // Ctrl+Y
+            (void)ed_delete(e, bol, ed_eol(e, bol) + 1 - bol);
+            e->cur = bol;
+            break;
+        case '\r':
+        case '\n':
+            if (ed_insert(e, e->cur, e->crlf ? "\r\n" : "\n", e->crlf ? 2 : 1) == 0) e->cur += e->crlf ? 2 : 1;
+            break;
+        default:
+            if (k == '\t' || (k >= 0x20 && k <= 0xFF && k != 0x7F)) {
+                char c = (char)k;
+                if (ed_insert(e, e->cur, &c, 1) == 0) e->cur++;
+                else snprintf(e->msg, sizeof e->msg, "Insufficient memory");
+            }
+            break;
+        }
+        if (e->cur > e->len) e->cur = e->len;
+        if (!keep_want) e->want = ed_col(e, ed_bol(e, e->cur), e->cur);
+    }
+}
+
+static void builtin_edit(const char *arg) {
+    if (is_help_switch(arg)) {
+        const char *msg =
+            "EDIT filename\n"
+            "  Full-screen text editor. Files of any size open at once.\n"
+            "  Arrows, Home/End, PgUp/PgDn, Ctrl+Home/Ctrl+End  move\n"
+            "  Ctrl+G  go to line      Ctrl+Y  delete line\n"
+            "  F2 or Ctrl+S  save      Esc or Ctrl+Q  exit\n";
+        con_write(msg, strlen(msg));
+        return;
+    }
+    if (!arg || !*arg) {
+        con_error("Required parameter missing\n", 27);
+        return;
+    }
+
+    char linuxp[PATH_MAX];
+    if (dos_to_linux_path(arg, linuxp, sizeof linuxp) != 0) {
+        con_error("Invalid path\n", 13);
+        return;
+    }
+
+    Edit *e = (Edit *)calloc(1, sizeof *e);
+    if (!e) { con_error("Insufficient memory\n", 20); return; }
+    if (ed_open(e, linuxp) != 0) {
+        con_error(errno == EISDIR ? "Invalid path\n" : "Access denied\n", errno == EISDIR ? 13 : 14);
+        ed_close(e);
+        free(e);
+        return;
+    }
+    ra_note(linuxp);
+
+    int cols, rows;
+    if (scr_open(&cols, &rows) != 0 || rows < 3) {
+        con_error("Insufficient memory\n", 20);
+        ed_close(e);
+        free(e);
+        return;
+    }
+    e->cols = cols;
+    e->rows = rows - 2; // title and status lines
+
+    struct termios oldt, raw;
+    int has_tty = (tcgetattr(0, &oldt) == 0);
+    if (has_tty) {
+        raw = oldt;
+        raw.c_lflag &= ~(ICANON | ECHO | ISIG | IEXTEN);
+        raw.c_iflag &= ~(ICRNL | IXON);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        (void)tcsetattr(0, TCSANOW, &raw);
+    }
+
+    struct sigaction sa, old_sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_sigaction = ed_sigbus;
+    sa.sa_flags = SA_SIGINFO;
+    sigaction(SIGBUS, &sa, &old_sa);
+
+    g_ed_kn = g_ed_kp = 0;
+    ed_run(e);
+    sigaction(SIGBUS, &old_sa, NULL);
+    // Keys typed ahead of the exit belong to the shell
+    if (g_ed_kp < g_ed_kn && g_con_in_len + (g_ed_kn - g_ed_kp) <= sizeof g_con_in) {
+        memmove(g_con_in + (g_ed_kn - g_ed_kp), g_con_in, g_con_in_len);
+        memcpy(g_con_in, g_ed_kb + g_ed_kp, g_ed_kn - g_ed_kp);
+        g_con_in_len += g_ed_kn - g_ed_kp;
+    }
+    g_ed_kn = g_ed_kp = 0;
+
+    if (has_tty) (void)tcsetattr(0, TCSANOW, &oldt);
+    scr_close();
+    ed_close(e);
+    free(e);
+}
+
+/* --- FC / COMP ---
+   Both inputs are mapped read-only. Equal data is skipped 64 bytes per
+   loop iteration with SSE2 compares folded into a single mask test; only
+   the stride holding a mismatch is walked byte by byte. */
+
+typedef struct MappedFile {
+    const uint8_t *p;
+    size_t         n;
+} MappedFile;
+
+static int map_file_ro(const char *linuxp, MappedFile *m) {
+    m->p = NULL;
+    m->n = 0;
+
+    int fd = open(linuxp, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) { close(fd); return -1; }
+
+    if (st.st_size > 0) {
+        void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) { close(fd); return -1; }
+        (void)madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+        m->p = (const uint8_t *)p;
+        m->n = (size_t)st.st_size;
+    }
+    close(fd);
+    return 0;
+}
+
+static void unmap_file(MappedFile *m) {
+    if (m->p) munmap((void *)m->p, m->n);
+    m->p = NULL;
+    m->n = 0;
+}
+
+/* Offset of the first differing byte, or n if the ranges are equal. */
+static size_t mem_first_diff(const uint8_t *a, const uint8_t *b, size_t n) {
+    size_t i = 0;
+#if defined(__x86_64__)
+    for (; i + 64 <= n; i += 64) {
+        __m128i e0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i)),
+                                    _mm_loadu_si128((const __m128i *)(b + i)));
+        __m128i e1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i + 16)),
+                                    _mm_loadu_si128((const __m128i *)(b + i + 16)));
+        __m128i e2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i + 32)),
+                                    _mm_loadu_si128((const __m128i *)(b + i + 32)));
+        __m128i e3 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i + 48)),
+                                    _mm_loadu_si128((const __m128i *)(b + i + 48)));
+        __m128i all = _mm_and_si128(_mm_and_si128(e0, e1), _mm_and_si128(e2, e3));
+        if (_mm_movemask_epi8(all) != 0xFFFF) break;
+    }
+#else
+    for (; i + 4096 <= n; i += 4096) {
+        if (memcmp(a + i, b + i, 4096) != 0) break;
+    }
+#endif
+    for (; i < n; i++) if (a[i] != b[i]) return i;
+    return n;
+}
+
+static int open_compare_pair(const char *arg, char *name1, char *name2, size_t namesz,
+                             MappedFile *f1, MappedFile *f2) {
+    char tmp[1024];
+    strncpy(tmp, arg, sizeof tmp - 1);
+    tmp[sizeof tmp - 1] = 0;
+
+    char *p = tmp;
+    while (*p == ' ' || *p == '\t') p++;
+    char *a = p;
+    while (*p && *p != ' ' && *p != '\t') p++;
+    if (*p) *p++ = 0;
+    while (*p == ' ' || *p == '\t') p++;
+    char *b = p;
+    while (*p && *p != ' ' && *p != '\t') p++;
+    *p = 0;
+
+    if (!*a || !*b) { con_error("Invalid number of parameters\n", 29); return -1; }
+
+    snprintf(name1, namesz, "%s", a);
+    snprintf(name2, namesz, "%s", b);
+
+    char la[PATH_MAX], lb[PATH_MAX];
+    if (dos_to_linux_path(a, la, sizeof la) != 0 || map_file_ro(la, f1) != 0) {
+        char msg[PATH_MAX + 32];
+        snprintf(msg, sizeof msg, "File not found - %s\n", a);
+        con_error(msg, strlen(msg));
+        return -1;
+    }
+    if (dos_to_linux_path(b, lb, sizeof lb) != 0 || map_file_ro(lb, f2) != 0) {
+        unmap_file(f1);
+        char msg[PATH_MAX + 32];
+        snprintf(msg, sizeof msg, "File not found - %s\n", b);
+        con_error(msg, strlen(msg));
+        return -1;
+    }
+    return 0;
+}
+
+#define COMP_MAX_ERRORS 10
+
+static void builtin_comp(const char *arg) {
+    if (is_help_switch(arg)) {
+        const char *msg =
+            "COMP file1 file2\n"
+            "  Compares two files byte by byte and reports differing offsets.\n";
+        con_write(msg, strlen(msg));
+        return;
+    }
+
+    if (!arg || !*arg) { con_error("Invalid number of parameters\n", 29); return; }
+
+    char n1[PATH_MAX], n2[PATH_MAX];
+    MappedFile f1, f2;
+    if (open_compare_pair(arg, n1, n2, sizeof n1, &f1, &f2) != 0) return;
+
+    char msg[PATH_MAX * 2 + 64];
+    snprintf(msg, sizeof msg, "Comparing %s and %s...\n", n1, n2);
+    con_write(msg, strlen(msg));
+
+    if (f1.n != f2.n) {
+        con_write("Files are different sizes.\n\n", 28);
+        unmap_file(&f1);
+        unmap_file(&f2);
+        return;
+    }
+
+    int errors = 0;
+    size_t off = 0;
+    while (off < f1.n) {
+        size_t d = mem_first_diff(f1.p + off, f2.p + off, f1.n - off);
+        if (d == f1.n - off) break;
+        off += d;
+
+        snprintf(msg, sizeof msg, "Compare error at OFFSET %llX\nfile1 = %02X\nfile2 = %02X\n",
+                 (unsigned long long)off, f1.p[off], f2.p[off]);
+        con_write(msg, strlen(msg));
+
+        if (++errors == COMP_MAX_ERRORS) {
+            con_write("10 Mismatches - ending compare\n", 31);
+            break;
+        }
+        off++;
+    }
+
+    if (errors == 0) con_write("Files compare OK\n", 17);
+    con_write("\n", 1);
+
+    unmap_file(&f1);
+    unmap_file(&f2);
+}
+
+/* FC text mode: lines are reduced to 64-bit hashes and diffed with Myers'
+   linear-space bisection (middle snake), so memory stays O(lines) no
+   matter how far apart the files are. Time grows with lines times
+   differences, so each bisection gives up after FC_MAX_COST steps out
+   from either end and reports its whole range as changed: PID 1 must not
+   spend minutes on two files that have nothing in common. */
+
+#define FC_MAX_COST 4096
+
+typedef struct FcLine {
+    const uint8_t *s;
+    uint32_t       len;  // without the line terminator
+    uint64_t       hash;
+} FcLine;
+
+typedef struct FcSide {
+    FcLine  *lines;
+    long     count;
+    uint8_t *chg;        // 1 = line is not part of the common subsequence
+} FcSide;
+
+typedef struct FcDiff {
+    FcSide a, b;
+    long  *v1, *v2;      // scratch diagonals, sized for the whole problem
+    int    nocase;
+} FcDiff;
+
+static int fc_split_lines(const MappedFile *f, int nocase, FcSide *out) {
+    long cap = 1024;
+    out->lines = (FcLine *)malloc(sizeof(FcLine) * (size_t)cap);
+    out->count = 0;
+    if (!out->lines) return -1;
+
+    const uint8_t *p = f->p, *end = f->p + f->n;
+    while (p < end) {
+        const uint8_t *nl = (const uint8_t *)memchr(p, '\n', (size_t)(end - p));
+        const uint8_t *e = nl ? nl : end;
+        size_t len = (size_t)(e - p);
+        if (len && p[len - 1] == '\r') len--;
+
+        uint64_t h = 0xcbf29ce484222325ull;
+        for (size_t i = 0; i < len; i++) {
+            uint8_t c = nocase ? (uint8_t)tolower(p[i]) : p[i];
+            h = (h ^ c) * 0x100000001b3ull;
+        }
+
+        if (out->count == cap) {
+            cap *= 2;
+            FcLine *n = (FcLine *)realloc(out->lines, sizeof(FcLine) * (size_t)cap);
+            if (!n) return -1;
+            out->lines = n;
+        }
+        out->lines[out->count].s = p;
+        out->lines[out->count].len = (uint32_t)len;
+        out->lines[out->count].hash = h;
+        out->count++;
+
+        p = nl ? nl + 1 : end;
+    }
+
+    out->chg = (uint8_t *)calloc((size_t)out->count + 1, 1);
+    return out->chg ? 0 : -1;
+}
+
+static int fc_line_eq(const FcDiff *d, long i, long j) {
+    const FcLine *x = &d->a.lines[i], *y = &d->b.lines[j];
+    if (x->hash != y->hash || x->len != y->len) return 0;
+    if (!d->nocase) return memcmp(x->s, y->s, x->len) == 0;
+    for (uint32_t i = 0; i < x->len; i++) // not strncasecmp(): lines may hold NULs
+        if (tolower(x->s[i]) != tolower(y->s[i])) return 0;
+    return 1;
+}
+
+static void fc_diff_range(FcDiff *d, long a0, long a1, long b0, long b1);
+
+/* Find the middle snake of A[a0,a1) x B[b0,b1) and recurse on both halves. */
+static void fc_bisect(FcDiff *d, long a0, long a1, long b0, long b1) {
+    long n = a1 - a0, m = b1 - b0;
+    long max_d = (n + m + 1) / 2;
+    long v_off = max_d, v_len = 2 * max_d;
+    long *v1 = d->v1, *v2 = d->v2;
+
+    for (long i = 0; i < v_len; i++) { v1[i] = -1; v2[i] = -1; }
+    v1[v_off + 1] = 0;
+    v2[v_off + 1] = 0;
+
+    long delta = n - m;
+    int front = (delta % 2 != 0);
+    long k1start = 0, k1end = 0, k2start = 0, k2end = 0;
+
+    long limit = max_d < FC_MAX_COST ? max_d : FC_MAX_COST;
+    for (long dd = 0; dd < limit; dd++) {
+        for (long k1 = -dd + k1start; k1 <= dd - k1end; k1 += 2) {
+            long k1o = v_off + k1, x1;
+            if (k1 == -dd || (k1 != dd && v1[k1o - 1] < v1[k1o + 1])) x1 = v1[k1o + 1];
+            else x1 = v1[k1o - 1] + 1;
+            long y1 = x1 - k1;
+            while (x1 < n && y1 < m && fc_line_eq(d, a0 + x1, b0 + y1)) { x1++; y1++; }
+            v1[k1o] = x1;
+            if (x1 > n) k1end += 2;
+            else if (y1 > m) k1start += 2;
+            else if (front) {
+                long k2o = v_off + delta - k1;
+                if (k2o >= 0 && k2o < v_len && v2[k2o] != -1 && x1 >= n - v2[k2o]) {
+                    fc_diff_range(d, a0, a0 + x1, b0, b0 + y1);
+                    fc_diff_range(d, a0 + x1, a1, b0 + y1, b1);
+                    return;
+                }
+            }
+        }
+
+        for (long k2 = -dd + k2start; k2 <= dd - k2end; k2 += 2) {
+            long k2o = v_off + k2, x2;
+            if (k2 == -dd || (k2 != dd && v2[k2o - 1] < v2[k2o + 1])) x2 = v2[k2o + 1];
+            else x2 = v2[k2o - 1] + 1;
+            long y2 = x2 - k2;
+            while (x2 < n && y2 < m && fc_line_eq(d, a1 - x2 - 1, b1 - y2 - 1)) { x2++; y2++; }
+            v2[k2o] = x2;
+            if (x2 > n) k2end += 2;
+            else if (y2 > m) k2start += 2;
+            else if (!front) {
+                long k1o = v_off + delta - k2;
+                if (k1o >= 0 && k1o < v_len && v1[k1o] != -1) {
+                    long x1 = v1[k1o];
+                    long y1 = v_off + x1 - k1o;
+                    if (x1 >= n - x2) {
+                        fc_diff_range(d, a0, a0 + x1, b0, b0 + y1);
+                        fc_diff_range(d, a0 + x1, a1, b0 + y1, b1);
+                        return;
+                    }
+                }
+            }
+        }
+    }
+
+    // No common line at all, or too far apart to be worth finding out
+    memset(d->a.chg + a0, 1, (size_t)n);
+    memset(d->b.chg + b0, 1, (size_t)m);
+}
+
+static void fc_diff_range(FcDiff *d, long a0, long a1, long b0, long b1) {
+    while (a0 < a1 && b0 < b1 && fc_line_eq(d, a0, b0)) { a0++; b0++; }
+    while (a1 > a0 && b1 > b0 && fc_line_eq(d, a1 - 1, b1 - 1)) { a1--; b1--; }
+
+    if (a0 == a1) { memset(d->b.chg + b0, 1, (size_t)(b1 - b0)); return; }
+    if (b0 == b1) { memset(d->a.chg + a0, 1, (size_t)(a1 - a0)); return; }
+
+    fc_bisect(d, a0, a1, b0, b1);
+}
+
+static void fc_print_lines(const FcSide *s, long from, long to) {
+    for (long i = from; i < to; i++) {
+        if (i < 0 || i >= s->count) continue;
+        con_write(s->lines[i].s, s->lines[i].len);
+        con_write("\n", 1);
+    }
+}
+
+static int fc_text(const char *n1, const char *n2, const MappedFile *f1, const MappedFile *f2, int nocase) {
+    FcDiff d;
+    memset(&d, 0, sizeof d);
+    d.nocase = nocase;
+
+    int rc = -1;
+    if (fc_split_lines(f1, nocase, &d.a) != 0 || fc_split_lines(f2, nocase, &d.b) != 0) goto out;
+
+    long vsz = d.a.count + d.b.count + 2;
+    d.v1 = (long *)malloc(sizeof(long) * (size_t)vsz);
+    d.v2 = (long *)malloc(sizeof(long) * (size_t)vsz);
+    if (!d.v1 || !d.v2) goto out;
+
+    fc_diff_range(&d, 0, d.a.count, 0, d.b.count);
+
+    int diffs = 0;
+    long i = 0, j = 0;
+    while (i < d.a.count || j < d.b.count) {
+        if (i < d.a.count && j < d.b.count && !d.a.chg[i] && !d.b.chg[j]) { i++; j++; continue; }
+
+        long i0 = i, j0 = j;
+        while (i < d.a.count && d.a.chg[i]) i++;
+        while (j < d.b.count && d.b.chg[j]) j++;
+
+        // Each side: last common line, the differing block, first resync line
+        char hdr[PATH_MAX + 16];
+        snprintf(hdr, sizeof hdr, "***** %s\n", n1);
+        con_write(hdr, strlen(hdr));
+        fc_print_lines(&d.a, i0 - 1, i + 1);
+        snprintf(hdr, sizeof hdr, "***** %s\n", n2);
+        con_write(hdr, strlen(hdr));
+        fc_print_lines(&d.b, j0 - 1, j + 1);
+        con_write("*****\n\n", 7);
+        diffs++;
+    }
+
+    if (diffs == 0) con_write("FC: no differences encountered\n\n", 32);
+    rc = 0;
+
+out:
+    free(d.a.lines); free(d.a.chg);
+    free(d.b.lines); free(d.b.chg);
+    free(d.v1); free(d.v2);
+    return rc;
+}
+
+static void fc_binary(const MappedFile *f1, const MappedFile *f2, const char *n1, const char *n2) {
+    size_t n = f1->n < f2->n ? f1->n : f2->n;
+    int diffs = 0;
+
+    size_t off = 0;
+    while (off < n) {
+        size_t d = mem_first_diff(f1->p + off, f2->p + off, n - off);
+        if (d == n - off) break;
+        off += d;
+
+        char line[64];
+        snprintf(line, sizeof line, "%08llX: %02X %02X\n",
+                 (unsigned long long)off, f1->p[off], f2->p[off]);
+        con_write(line, strlen(line));
+        diffs++;
+        off++;
+    }
+
+    char msg[PATH_MAX * 2 + 64];
+    if (f1->n > f2->n)      snprintf(msg, sizeof msg, "FC: %s longer than %s\n\n", n1, n2);
+    else if (f2->n > f1->n) snprintf(msg, sizeof msg, "FC: %s longer than %s\n\n", n2, n1);
+    else if (diffs == 0)    snprintf(msg, sizeof msg, "FC: no differences encountered\n\n");
+    else                    snprintf(msg, sizeof msg, "\n");
+    con_write(msg, strlen(msg));
+}
+
+static int fc_is_binary_name(const char *name) {
+    static const char *exts[] = { ".EXE", ".COM", ".COM64", ".SYS", ".OBJ", ".LIB", ".BIN", NULL };
+    const char *dot = strrchr(dos_basename(name), '.');
+    if (!dot) return 0;
+    for (int i = 0; exts[i]; i++) if (!strcasecmp(dot, exts[i])) return 1;
+    return 0;
+}
+
+static void builtin_fc(const char *arg) {
+    if (is_help_switch(arg)) {
+        const char *msg =
+            "FC [/B] [/C] file1 file2\n"
+            "  Compares two files and displays the differences.\n"
+            "  /B  Binary comparison\n"
+            "  /C  Ignore case (text mode)\n";
+        con_write(msg, strlen(msg));
+        return;
+    }
+
+    if (!arg || !*arg) { con_error("Invalid number of parameters\n", 29); return; }
+
+    char tmp[1024];
+    strncpy(tmp, arg, sizeof tmp - 1);
+    tmp[sizeof tmp - 1] = 0;
+    int binary = take_switch(tmp, 'B');
+    int nocase = take_switch(tmp, 'C');
+
+    char n1[PATH_MAX], n2[PATH_MAX];
+    MappedFile f1, f2;
+    if (open_compare_pair(tmp, n1, n2, sizeof n1, &f1, &f2) != 0) return;
+
+    if (fc_is_binary_name(n1) || fc_is_binary_name(n2)) binary = 1;
+
+    char msg[PATH_MAX * 2 + 64];
+    snprintf(msg, sizeof msg, "Comparing files %s and %s\n", n1, n2);
+    con_write(msg, strlen(msg));
+
+    if (binary) fc_binary(&f1, &f2, n1, n2);
+    else if (fc_text(n1, n2, &f1, &f2, nocase) != 0) con_error("Insufficient memory\n", 20);
+
+    unmap_file(&f1);
+    unmap_file(&f2);
+}
+
+/* --- SORT ---
+   Input that fits in SORT_MEM_BUDGET is sorted in memory. Larger input is
+   cut into budget-sized chunks; each chunk is sorted and spilled as a run
+   under C:\TEMP, and the runs are merged with a k-way heap. Records
+   carry the first 8 key bytes (upper-cased, big-endian) so most compares
+   never touch the line itself. */
+
+#define DOS_TEMP_DIR       "TEMP" // under the RAM drive's root, or C:'s if there is none
+#define SORT_MEM_BUDGET    (32u << 20)
+#define SORT_MERGE_FANIN   64
+#define SORT_RUN_BUF       (128 * 1024)
+#define SORT_OUT_BUF       (64 * 1024)
+#define SORT_MAX_THREADS   8
+#define SORT_PAR_MIN       65536 // records; below this one thread is faster
+#define SORT_RUN_NAMES     (1u << 28) // run files SORTxxxx.xxx, in hex
+
+typedef struct SortRec {
+    const uint8_t *s;
+    uint64_t       prefix;
+    uint32_t       len;      // without the '\n'
+} SortRec;
+
+typedef struct SortCtx {
+    size_t col;              // /+n, zero-based
+    int    reverse;          // /R
+} SortCtx;
+
+static uint64_t sort_prefix(const uint8_t *s, size_t len, size_t col) {
+    if (len && s[len - 1] == '\r') len--;
+    uint64_t k = 0;
+    for (size_t i = 0; i < 8; i++) {
+        size_t at = col + i;
+        uint8_t c = (at < len) ? (uint8_t)toupper(s[at]) : 0;
+        k = (k << 8) | c;
+    }
+    return k;
+}
+
+static int sort_cmp(const SortRec *a, const SortRec *b, const SortCtx *c) {
+    int r;
+    if (a->prefix != b->prefix) {
+        r = (a->prefix < b->prefix) ? -1 : 1;
+    } else {
+        size_t la = a->len, lb = b->len;
+        if (la && a->s[la - 1] == '\r') la--;
+        if (lb && b->s[lb - 1] == '\r') lb--;
+        size_t ka = (c->col < la) ? la - c->col : 0;
+        size_t kb = (c->col < lb) ? lb - c->col : 0;
+        const uint8_t *pa = a->s + (la - ka), *pb = b->s + (lb - kb);
+
+        r = 0;
+        size_t n = ka < kb ? ka : kb;
+        for (size_t i = 8; i < n; i++) {
+            int x = toupper(pa[i]), y = toupper(pb[i]);
+            if (x != y) { r = x - y; break; }
+        }
+        if (r == 0 && ka != kb) r = (ka < kb) ? -1 : 1;
+    }
+    return c->reverse ? -r : r;
+}
+
+static int sort_qcmp(const void *x, const void *y, void *arg) {
+    return sort_cmp((const SortRec *)x, (const SortRec *)y, (const SortCtx *)arg);
+}
+
+/* Buffered line writer for runs and the final output */
+typedef struct SortOut {
+    int     fd;
+    int     err;
+    size_t  n;
+    uint8_t buf[SORT_OUT_BUF];
+} SortOut;
+
+static void sort_out_flush(SortOut *o) {
+    if (o->fd == 1) { con_write(o->buf, o->n); o->n = 0; return; }
+
+    size_t off = 0;
+    while (off < o->n && !o->err) {
+        ssize_t w = write(o->fd, o->buf + off, o->n - off);
+        if (w < 0) { if (errno != EINTR) o->err = 1; continue; }
+        off += (size_t)w;
+    }
+    o->n = 0;
+}
+
+static void sort_out_line(SortOut *o, const uint8_t *s, size_t len) {
+    if (o->n + len + 1 > sizeof o->buf) sort_out_flush(o);
+    if (len + 1 > sizeof o->buf && o->fd == 1) {
+        con_write(s, len);
+    } else if (len + 1 > sizeof o->buf) {
+        // longer than the buffer: write the body through, buffer the '\n'
+        size_t off = 0;
+        while (off < len && !o->err) {
+            ssize_t w = write(o->fd, s + off, len - off);
+            if (w < 0) { if (errno != EINTR) o->err = 1; continue; }
+            off += (size_t)w;
+        }
+    } else {
+        memcpy(o->buf + o->n, s, len);
+        o->n += len;
+    }
+    o->buf[o->n++] = '\n';
+}
+
+/* One input to the k-way merge: a sorted slice in memory or a run file */
+typedef struct SortSrc {
+    SortRec        cur;
+    const SortRec *mem, *mem_end;
+    int            fd;
+    uint8_t       *buf;
+    size_t         cap, pos, len;
+    int            eof;
+} SortSrc;
+
+static int sort_src_next(SortSrc *s, const SortCtx *c) {
+    if (s->mem) {
+        if (s->mem == s->mem_end) return 0;
+        s->cur = *s->mem++;
+        return 1;
+    }
+
+    for (;;) {
+        uint8_t *nl = (s->pos < s->len) ? memchr(s->buf + s->pos, '\n', s->len - s->pos) : NULL;
+        if (nl || (s->eof && s->pos < s->len)) {
+            size_t end = nl ? (size_t)(nl - s->buf) : s->len;
+            s->cur.s = s->buf + s->pos;
+            s->cur.len = (uint32_t)(end - s->pos);
+            s->cur.prefix = sort_prefix(s->cur.s, s->cur.len, c->col);
+            s->pos = nl ? end + 1 : s->len;
+            return 1;
+        }
+        if (s->eof) return 0;
+
+        // compact, grow for an oversized line, refill
+        memmove(s->buf, s->buf + s->pos, s->len - s->pos);
+        s->len -= s->pos;
+        s->pos = 0;
+        if (s->len == s->cap) {
+            uint8_t *nb = (uint8_t *)realloc(s->buf, s->cap * 2);
+            if (!nb) return 0;
+            s->buf = nb;
+            s->cap *= 2;
+        }
+        ssize_t r = read(s->fd, s->buf + s->len, s->cap - s->len);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) s->eof = 1;
+        else s->len += (size_t)r;
+    }
+}
+
+static void sort_heap_down(SortSrc **h, size_t n, size_t i, const SortCtx *c) {
+    for (;;) {
+        size_t l = 2 * i + 1, r = l + 1, m = i;
+        if (l < n && sort_cmp(&h[l]->cur, &h[m]->cur, c) < 0) m = l;
+        if (r < n && sort_cmp(&h[r]->cur, &h[m]->cur, c) < 0) m = r;
+        if (m == i) return;
+        SortSrc *t = h[i]; h[i] = h[m]; h[m] = t;
+        i = m;
+    }
+}
+
+static void sort_merge(SortSrc *src, size_t nsrc, SortOut *out, const SortCtx *c) {
+    SortSrc *heap[SORT_MERGE_FANIN > SORT_MAX_THREADS ? SORT_MERGE_FANIN : SORT_MAX_THREADS];
+    size_t n = 0;
+    for (size_t i = 0; i < nsrc; i++) if (sort_src_next(&src[i], c)) heap[n++] = &src[i];
+    for (size_t i = n; i-- > 0; ) sort_heap_down(heap, n, i, c);
+
+    while (n) {
+        sort_out_line(out, heap[0]->cur.s, heap[0]->cur.len);
+        if (!sort_src_next(heap[0], c)) heap[0] = heap[--n];
+        sort_heap_down(heap, n, 0, c);
+    }
+}
+
+typedef struct SortPart {
+    SortRec       *recs;
+    size_t         n;
+    const SortCtx *ctx;
+} SortPart;
+
+static void *sort_part_worker(void *arg) {
+    SortPart *p = (SortPart *)arg;
+    qsort_r(p->recs, p->n, sizeof(SortRec), sort_qcmp, (void *)p->ctx);
+    return NULL;
+}
+
+/* Sort recs (on several threads when it pays) and write them out in order */
+static void sort_chunk(SortRec *recs, size_t n, SortOut *out, const SortCtx *c) {
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t nt = (ncpu > 0) ? (size_t)ncpu : 1;
+    if (nt > SORT_MAX_THREADS) nt = SORT_MAX_THREADS;
+    if (n < SORT_PAR_MIN) nt = 1;
+
+    SortPart parts[SORT_MAX_THREADS];
+    pthread_t tids[SORT_MAX_THREADS];
+    int started[SORT_MAX_THREADS] = {0};
+
+    size_t per = (n + nt - 1) / nt;
+    for (size_t i = 0; i < nt; i++) {
+        size_t lo = i * per, hi = lo + per;
+        if (lo > n) lo = n;
+        if (hi > n) hi = n;
+        parts[i].recs = recs + lo;
+        parts[i].n = hi - lo;
+        parts[i].ctx = c;
+        if (i > 0 && pthread_create(&tids[i], NULL, sort_part_worker, &parts[i]) == 0) started[i] = 1;
+    }
+    sort_part_worker(&parts[0]);
+    for (size_t i = 1; i < nt; i++) {
+        if (started[i]) pthread_join(tids[i], NULL);
+        else sort_part_worker(&parts[i]);
+    }
+
+    SortSrc src[SORT_MAX_THREADS];
+    memset(src, 0, sizeof src);
+    for (size_t i = 0; i < nt; i++) {
+        src[i].mem = parts[i].recs;
+        src[i].mem_end = parts[i].recs + parts[i].n;
+    }
+    sort_merge(src, nt, out, c);
+}
+
+typedef struct SortRuns {
+    char   (*paths)[PATH_MAX];
+    size_t count, cap;
+    unsigned serial;
+} SortRuns;
+
+/* Scratch space for SORT-style jobs: off the disk whenever there is a RAM drive */
+static void scratch_dir(char *out, size_t n) {
+    const char *root = drive_mapped(g_ram_drive) ? g_drives[g_ram_drive].root : g_c_root;
+    snprintf(out, n, "%s/" DOS_TEMP_DIR, root);
+}
+
+static int sort_new_run(SortRuns *r, int *fd_out) {
+    if (r->count == r->cap) {
+        size_t nc = r->cap ? r->cap * 2 : 16;
+        char (*np)[PATH_MAX] = realloc(r->paths, nc * sizeof *np);
+        if (!np) return -1;
+        r->paths = np;
+        r->cap = nc;
+    }
+
+    char *path = r->paths[r->count];
+    char dir[PATH_MAX];
+    scratch_dir(dir, sizeof dir);
+    // 8.3 names from a 28-bit serial. O_EXCL: a name in use (a run not yet
+    // merged, another SORT's) is skipped, never truncated.
+    int fd = -1;
+    while (fd < 0) {
+        if (r->serial >= SORT_RUN_NAMES) { errno = EEXIST; return -1; }
+        unsigned k = r->serial++;
+        snprintf(path, PATH_MAX, "%s/SORT%04X.%03X", dir, k >> 12, k & 0xFFF);
+        fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (fd < 0 && errno != EEXIST) return -1;
+    }
+    r->count++;
+    *fd_out = fd;
+    return 0;
+}
+
+static void sort_drop_runs(SortRuns *r) {
+    for (size_t i = 0; i < r->count; i++) unlink(r->paths[i]);
+    free(r->paths);
+    memset(r, 0, sizeof *r);
+}
+
+/* Merge runs [first, first+k) into out */
+static int sort_merge_runs(SortRuns *r, size_t first, size_t k, SortOut *out, const SortCtx *c) {
+    SortSrc src[SORT_MERGE_FANIN];
+    memset(src, 0, sizeof src);
+
+    int rc = 0;
+    for (size_t i = 0; i < k; i++) {
+        src[i].fd = open(r->paths[first + i], O_RDONLY);
+        src[i].cap = SORT_RUN_BUF;
+        src[i].buf = (uint8_t *)malloc(SORT_RUN_BUF);
+        if (src[i].fd < 0 || !src[i].buf) rc = -1;
+        else (void)posix_fadvise(src[i].fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+
+    if (rc == 0) sort_merge(src, k, out, c);
+
+    for (size_t i = 0; i < k; i++) {
+        if (src[i].fd >= 0) close(src[i].fd);
+        free(src[i].buf);
+    }
+    return rc;
+}
+
+/* Read until the buffer is full or input ends; console input also ends at Ctrl+Z */
+static size_t sort_fill(int fd, uint8_t *buf, size_t want, int console, int *eof) {
+    size_t got = 0;
+    while (got < want && !*eof) {
+        ssize_t r = console ? con_read(buf + got, want - got) : read(fd, buf + got, want - got);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) { *eof = 1; break; }
+        if (console) {
+            uint8_t *z = memchr(buf + got, 0x1A, (size_t)r);
+            if (z) { got = (size_t)(z - buf); *eof = 1; break; }
+        }
+        got += (size_t)r;
+    }
+    return got;
+}
+
+static void builtin_sort(const char *arg) {
+    if (is_help_switch(arg)) {
+        const char *msg =
+            "SORT [/R] [/+n] [infile] [/O outfile]\n"
+            "  Sorts lines of text (case-insensitive).\n"
+            "  /R   Reverse order\n"
+            "  /+n  Sort on the key starting in column n\n"
+            "  /O   Write to outfile instead of the screen\n"
+            "  With no infile, reads the keyboard until Ctrl+Z.\n";
+        con_write(msg, strlen(msg));
+        return;
+    }
+
+    SortCtx ctx = { 0, 0 };
+    char in_dos[PATH_MAX] = "", out_dos[PATH_MAX] = "";
+
+    const char *p = arg ? arg : "";
+    int want_out = 0;
+    while (*p) {
+        while (*p == ' ' || *p == '\t') p++;
+        if (!*p) break;
+        const char *t = p;
+        while (*p && *p != ' ' && *p != '\t') p++;
+        size_t n = (size_t)(p - t);
+
+        if (n == 2 && t[0] == '/' && toupper((unsigned char)t[1]) == 'R') { ctx.reverse = 1; continue; }
+        if (n == 2 && t[0] == '/' && toupper((unsigned char)t[1]) == 'O') { want_out = 1; continue; }
+        if (n >= 2 && t[0] == '/' && t[1] == '+') {
+            long col = strtol(t + 2, NULL, 10);
+            if (col < 1) { con_error("Invalid parameter\n", 18); return; }
+            ctx.col = (size_t)(col - 1);
+            continue;
+        }
+        if (t[0] == '/') { con_error("Invalid switch\n", 15); return; }
+
+        char *dst = want_out ? out_dos : in_dos;
+        if (*dst) { con_error("Too many parameters\n", 20); return; }
+        if (n >= PATH_MAX) n = PATH_MAX - 1;
+        memcpy(dst, t, n);
+        dst[n] = 0;
+        want_out = 0;
+    }
+    if (want_out) { con_error("Required parameter missing\n", 27); return; }
+
+    int in = 0, console = 1;
+    if (*in_dos) {
+        char lp[PATH_MAX];
+        if (dos_to_linux_path(in_dos, lp, sizeof lp) != 0 || (in = open(lp, O_RDONLY)) < 0) {
+            con_error("File not found\n", 15);
+            return;
+        }
+        (void)posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+        console = 0;
+    }
+
+    // Keep line editing but let Ctrl+Z through as a character, not SIGTSTP
+    struct termios oldt;
+    int has_tty = console && tcgetattr(0, &oldt) == 0;
+    if (has_tty) {
+        struct termios t = oldt;
+        t.c_lflag &= ~ISIG;
+        (void)tcsetattr(0, TCSANOW, &t);
+    }
+
+    int outfd = 1;
+    if (*out_dos) {
+        char lp[PATH_MAX];
+        if (dos_to_linux_path(out_dos, lp, sizeof lp) != 0 ||
+            (outfd = open(lp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+            if (!console) close(in);
+            if (has_tty) (void)tcsetattr(0, TCSANOW, &oldt);
+            con_error("Access denied\n", 14);
+            return;
+        }
+    }
+
+    // Three quarters of the budget hold text, the rest holds records
+    size_t text_cap = (SORT_MEM_BUDGET / 4) * 3;
+    size_t rec_cap = (SORT_MEM_BUDGET / 4) / sizeof(SortRec);
+    uint8_t *text = (uint8_t *)malloc(text_cap);
+    SortRec *recs = (SortRec *)malloc(rec_cap * sizeof(SortRec));
+    SortOut *out = (SortOut *)malloc(sizeof(SortOut));
+    SortRuns runs;
+    memset(&runs, 0, sizeof runs);
+
+    const char *fail = NULL;
+    if (!text || !recs || !out) { fail = "Insufficient memory\n"; goto done; }
+
+    size_t carry = 0;
+    int eof = 0;
+    int first = 1;
+    while (!eof || carry) {
+        size_t len = carry + sort_fill(in, text + carry, text_cap - carry, console, &eof);
+
+        size_t n = 0, pos = 0;
+        while (pos < len && n < rec_cap) {
+            uint8_t *nl = memchr(text + pos, '\n', len - pos);
+            if (!nl && !eof) break;
+            size_t end = nl ? (size_t)(nl - text) : len;
+            recs[n].s = text + pos;
+            recs[n].len = (uint32_t)(end - pos);
+            recs[n].prefix = sort_prefix(recs[n].s, recs[n].len, ctx.col);
+            n++;
+            pos = nl ? end + 1 : len;
+        }
+
+        if (n == 0 && pos < len) { fail = "Record too long\n"; goto done; }
+
+        carry = len - pos;
+        if (has_tty && eof) { (void)tcsetattr(0, TCSANOW, &oldt); has_tty = 0; }
+
+        if (first && eof && carry == 0) {
+            // Everything fit: sort in memory straight to the output
+            out->fd = outfd; out->err = 0; out->n = 0;
+            sort_chunk(recs, n, out, &ctx);
+            sort_out_flush(out);
+            if (out->err) fail = "Access denied\n";
+            goto done;
+        }
+        first = 0;
+
+        if (n) {
+            char tmpdir[PATH_MAX];
+            scratch_dir(tmpdir, sizeof tmpdir);
+            mkdir(tmpdir, 0755);
+            int rfd;
+            if (sort_new_run(&runs, &rfd) != 0) { fail = "Unable to create temporary file\n"; goto done; }
+            out->fd = rfd; out->err = 0; out->n = 0;
+            sort_chunk(recs, n, out, &ctx);
+            sort_out_flush(out);
+            close(rfd);
+            if (out->err) { fail = "Insufficient disk space\n"; goto done; }
+        }
+
+        memmove(text, text + pos, carry);
+    }
+
+    // Free the chunk memory before merging so readers fit in the budget
+    free(text); text = NULL;
+    free(recs); recs = NULL;
+
+    // Reduce to one final merge of at most SORT_MERGE_FANIN runs
+    size_t first_run = 0;
+    while (runs.count - first_run > SORT_MERGE_FANIN) {
+        int rfd;
+        if (sort_new_run(&runs, &rfd) != 0) { fail = "Unable to create temporary file\n"; goto done; }
+        out->fd = rfd; out->err = 0; out->n = 0;
+        int rc = sort_merge_runs(&runs, first_run, SORT_MERGE_FANIN, out, &ctx);
+        sort_out_flush(out);
+        close(rfd);
+        if (rc != 0 || out->err) { fail = "Insufficient disk space\n"; goto done; }
+        for (size_t i = 0; i < SORT_MERGE_FANIN; i++) unlink(runs.paths[first_run + i]);
+        first_run += SORT_MERGE_FANIN;
+    }
+
+    out->fd = outfd; out->err = 0; out->n = 0;
+    if (sort_merge_runs(&runs, first_run, runs.count - first_run, out, &ctx) != 0) fail = "Read fault\n";
+    sort_out_flush(out);
+    if (!fail && out->err) fail = "Access denied\n";
+
+done:
+    if (has_tty) (void)tcsetattr(0, TCSANOW, &oldt);
+    if (fail) con_error(fail, strlen(fail));
+    sort_drop_runs(&runs);
+    free(text);
+    free(recs);
+    free(out);
+    if (!console) close(in);
+    if (outfd != 1) close(outfd);
+}
+
+/* ============================================================
+   COM64 LOADER (runs in a child process so PID 1 never dies)
+   ============================================================ */
+
+/* Layout shared with COM64 programs via sdk/dosapi.h. New services are
+   only ever appended, so older images keep working. */
+typedef struct DosTaskGroup {
+    int pending; // tasks spawned into the group and not yet finished
+} DosTaskGroup;
+
+typedef struct DosApi {
+    void (*print)(const char* s);
+
+    // text screen
+    int      (*scr_open)(int* cols, int* rows);
+    void     (*scr_close)(void);
+    void     (*scr_put)(int x, int y, int ch, int attr);
+    void     (*scr_text)(int x, int y, const char* s, int attr);
+    void     (*scr_fill)(int x, int y, int w, int h, int ch, int attr);
+    void     (*scr_cursor)(int x, int y);
+    unsigned (*scr_present)(void);
+
+    // heap: arena (bump, mark/release, reset) and size-class pools
+    void*    (*arena_alloc)(size_t n);
+    size_t   (*arena_mark)(void);
+    void     (*arena_release)(size_t mark);
+    void     (*arena_reset)(void);
+    void*    (*pool_alloc)(size_t n);
+    void     (*pool_free)(void* p, size_t n);
+
+    // tasks: work-stealing worker pool, task groups, futex
+    int      (*task_workers)(void);
+    void     (*task_spawn)(DosTaskGroup* g, void (*fn)(void* arg), void* arg);
+    void     (*task_wait)(DosTaskGroup* g);
+    int      (*futex_wait)(int* addr, int expected, int timeout_ms);
+    int      (*futex_wake)(int* addr, int n);
+
+    // shared memory: named segments held by init
+    void*    (*shm_open)(const char* name, size_t size, int flags, size_t* size_out);
+    int      (*shm_close)(void* p);
+    int      (*shm_unlink)(const char* name);
+} DosApi;
+
+typedef struct Com64Hdr {
+    char     magic[8];      // "64DOSCOM"
+    uint32_t header_size;   // 64
+    uint32_t flags;         // 0
+    uint64_t entry_rva;     // from payload start (immediately after header)
+    uint64_t bss_size;      // bytes to zero after payload
+    uint64_t packed_size;   // COM64_F_LZ4: bytes stored after the header
+    uint64_t payload_size;  // COM64_F_LZ4: bytes once decompressed
+    uint64_t reserved2;
+} Com64Hdr;
+
+/* A compressed payload is a run of blocks, each COM64_LZ4_BLOCK bytes once
+   decoded (the last may be shorter) and stored as a 32-bit little-endian
+   length followed by an LZ4 block; bit 31 of the length marks a block kept
+   raw because it did not compress. */
+#define COM64_F_LZ4      0x1u
+#define COM64_LZ4_BLOCK  (64u << 10)
+#define COM64_LZ4_RAW    0x80000000u
+
+typedef int (*Com64Entry)(DosApi* api, int argc, const char** argv);
+
+static void dosapi_print_impl(const char* s) {
+    if (!s) return;
+    (void)write(1, s, strlen(s)); // child side: unbuffered, so a crash loses nothing
+}
+
+/* --- COM64 tasks ---
+   A pool of one worker thread per CPU, started by the child on first use.
+   Each thread, the program's own included, owns a deque: it pushes and
+   pops at the bottom, and an idle thread steals from the top of another's.
+   The deques are short critical sections under a spin lock rather than
+   lock-free; with one owner and rare thieves they are almost never
+   contended. Idle workers sleep on a futex bumped by every spawn. A
+   waiting thread runs tasks itself until its group drains, so nested
+   spawn/wait cannot deadlock, even with no workers at all. */
+
+#define TASK_MAX_WORKERS 64
+#define TASK_DEQUE       1024u      // power of two; a full deque runs the task inline
+#define TASK_SPIN        200
+
+typedef struct Task {
+    void (*fn)(void*);
+    void* arg;
+    DosTaskGroup* group;
+} Task;
+
+typedef struct TaskDeque {
+    int      lock;
+    unsigned top, bottom;           // thieves take at top, the owner at bottom
+    Task     ring[TASK_DEQUE];
+} __attribute__((aligned(64))) TaskDeque;
+
+static struct {
+    int        started;
+    int        nworkers;            // the program's thread counts as worker 0
+    unsigned   seq;                 // futex word, bumped on every spawn
+    int        sleepers;
+    TaskDeque* dq;
+} g_task;
+
+static __thread int t_task_self;
+
+static void cpu_relax(void) {
+#if defined(__x86_64__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static void spin_lock(int* l) {
+    while (__atomic_exchange_n(l, 1, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(l, __ATOMIC_RELAXED)) cpu_relax();
+    }
+}
+
+static void spin_unlock(int* l) {
+    __atomic_store_n(l, 0, __ATOMIC_RELEASE);
+}
+
+/* The pool's own futexes are process-private; the DosApi ones are not,
+   so programs can also wait on words in a shared memory segment. */
+static int futex_wait_op(int* addr, int op, int expected, int timeout_ms) {
+    struct timespec ts = { timeout_ms / 1000, (long)(timeout_ms % 1000) * 1000000L };
+    long r = syscall(SYS_futex, addr, op, expected, timeout_ms >= 0 ? &ts : NULL, NULL, 0);
+    return (r < 0 && errno == ETIMEDOUT) ? 1 : 0;
+}
+
+static int futex_wake_op(int* addr, int op, int n) {
+    long r = syscall(SYS_futex, addr, op, n, NULL, NULL, 0);
+    return r < 0 ? 0 : (int)r;
+}
+
+static int futex_wait_ms(int* addr, int expected, int timeout_ms) {
+    return futex_wait_op(addr, FUTEX_WAIT_PRIVATE, expected, timeout_ms);
+}
+
+static int futex_wake_n(int* addr, int n) {
+    return futex_wake_op(addr, FUTEX_WAKE_PRIVATE, n);
+}
+
+static int dosapi_futex_wait(int* addr, int expected, int timeout_ms) {
+    return futex_wait_op(addr, FUTEX_WAIT, expected, timeout_ms);
+}
+
+static int dosapi_futex_wake(int* addr, int n) {
+    return futex_wake_op(addr, FUTEX_WAKE, n);
+}
+
+static int task_pop(TaskDeque* d, Task* t) {
+    if (__atomic_load_n(&d->bottom, __ATOMIC_RELAXED) == __atomic_load_n(&d->top, __ATOMIC_RELAXED))
+        return 0;
+    int got = 0;
+    spin_lock(&d->lock);
+    if (d->bottom != d->top) {
+        *t = d->ring[--d->bottom & (TASK_DEQUE - 1)];
+        got = 1;
+    }
+    spin_unlock(&d->lock);
+    return got;
+}
+
+static int task_steal(TaskDeque* d, Task* t) {
+    if (__atomic_load_n(&d->bottom, __ATOMIC_RELAXED) == __atomic_load_n(&d->top, __ATOMIC_RELAXED))
+        return 0; // peek first, so idle threads do not bounce the lock
+    int got = 0;
+    spin_lock(&d->lock);
+    if (d->bottom != d->top) {
+        *t = d->ring[d->top++ & (TASK_DEQUE - 1)];
+        got = 1;
+    }
+    spin_unlock(&d->lock);
+    return got;
+}
+
+static int task_find(Task* t) {
+    if (!g_task.dq) return 0;
+    int self = t_task_self, n = g_task.nworkers;
+    if (task_pop(&g_task.dq[self], t)) return 1;
+    for (int i = 1; i < n; i++) {
+        if (task_steal(&g_task.dq[(self + i) % n], t)) return 1;
+    }
+    return 0;
+}
+
+static void task_run(const Task* t) {
+    t->fn(t->arg);
+    if (__atomic_sub_fetch(&t->group->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+        futex_wake_n(&t->group->pending, INT_MAX);
+    }
+}
+
+static void* task_worker(void* arg) {
+    t_task_self = (int)(intptr_t)arg;
+    for (;;) {
+        Task t;
+        int found = 0;
+        for (int spin = 0; spin < TASK_SPIN && !(found = task_find(&t)); spin++) cpu_relax();
+        if (found) {
+            task_run(&t);
+            continue;
+        }
+
+        // Register as a sleeper, then look once more: a spawn either sees
+        // us in sleepers or pushed before this last look
+        int seq = (int)__atomic_load_n(&g_task.seq, __ATOMIC_ACQUIRE);
+        __atomic_add_fetch(&g_task.sleepers, 1, __ATOMIC_SEQ_CST);
+        if (task_find(&t)) {
+            __atomic_sub_fetch(&g_task.sleepers, 1, __ATOMIC_SEQ_CST);
+            task_run(&t);
+            continue;
+        }
+        futex_wait_ms((int*)&g_task.seq, seq, -1);
+        __atomic_sub_fetch(&g_task.sleepers, 1, __ATOMIC_SEQ_CST);
+    }
+    return NULL;
+}
+
+static void task_start(void) {
+    if (g_task.started) return;
+    g_task.started = 1;
+
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int n = (ncpu > 0) ? (int)ncpu : 1;
+    if (n > TASK_MAX_WORKERS) n = TASK_MAX_WORKERS;
+
+    g_task.dq = calloc((size_t)n, sizeof *g_task.dq);
+    if (!g_task.dq) n = 0; // spawn then runs every task inline
+    g_task.nworkers = n ? 1 : 0;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for (int i = 1; i < n; i++) {
+        pthread_t tid;
+        // Workers only steal from deques below nworkers, so publish each first
+        __atomic_store_n(&g_task.nworkers, i + 1, __ATOMIC_RELEASE);
+        if (pthread_create(&tid, &attr, task_worker, (void*)(intptr_t)i) != 0) {
+            __atomic_store_n(&g_task.nworkers, i, __ATOMIC_RELEASE);
+            break;
+        }
+    }
+    pthread_attr_destroy(&attr);
+}
+
+static int dosapi_task_workers(void) {
+    task_start();
+    return g_task.nworkers ? g_task.nworkers : 1;
+}
+
+static void dosapi_task_spawn(DosTaskGroup* g, void (*fn)(void*), void* arg) {
+    task_start();
+    Task t = { fn, arg, g };
+    __atomic_add_fetch(&g->pending, 1, __ATOMIC_RELAXED);
+
+    TaskDeque* d = g_task.dq ? &g_task.dq[t_task_self] : NULL;
+    int pushed = 0;
+    if (d) {
+        spin_lock(&d->lock);
+        if (d->bottom - d->top < TASK_DEQUE) {
+            d->ring[d->bottom++ & (TASK_DEQUE - 1)] = t;
+            pushed = 1;
+        }
+        spin_unlock(&d->lock);
+    }
+    if (!pushed) {
+        task_run(&t);
+        return;
+    }
+
+    __atomic_add_fetch(&g_task.seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&g_task.sleepers, __ATOMIC_SEQ_CST)) futex_wake_n((int*)&g_task.seq, 1);
+}
+
+static void dosapi_task_wait(DosTaskGroup* g) {
+    for (;;) {
+        int pending = __atomic_load_n(&g->pending, __ATOMIC_ACQUIRE);
+        if (pending == 0) return;
+        Task t;
+        if (task_find(&t)) {
+            task_run(&t);
+            continue;
+        }
+        // Everything left is running elsewhere; the last one wakes us
+        futex_wait_ms(&g->pending, pending, -1);
+    }
+}
+
+/* --- COM64 heap ---
+   The DosApi arena and pools share one region that the child reserves
+   (without committing it) on first use. The arena bumps up from the
+   bottom and pool slabs are cut from the top down, so no allocation costs
+   a syscall and neither side fragments the other. Freed pool blocks go on
+   a per-class free list; pool requests above the largest class get a
+   mapping of their own. Peak use lands in the report page PID 1 shares
+   with the child, so it survives a crash. */
+
+#define HEAP_RESERVE  (4ull << 30)
+#define HEAP_MIN      (64u << 20)
+#define HEAP_ALIGN    16u
+#define POOL_CLASSES  8             // 16, 32, ... 2048 bytes
+#define POOL_MAX      (HEAP_ALIGN << (POOL_CLASSES - 1))
+#define POOL_SLAB     (64u << 10)
+
+enum { PERF_CYCLES, PERF_INSTR, PERF_CACHE_MISS, PERF_BRANCH_MISS, PERF_FAULTS, PERF_TASK_CLOCK, PERF_EVENTS };
+
+typedef struct Com64Report {
+    uint64_t heap_peak;     // arena + pool slabs + large blocks, at the worst moment
+    uint32_t perf_valid;    // PERFSTAT: bit per PERF_* counter read (see COM64 perf counters)
+    uint64_t perf[PERF_EVENTS];
+} Com64Report;
+
+static Com64Report* g_com64_report; // MAP_SHARED, set up by PID 1
+
+static struct {
+    uint8_t* base;
+    size_t   size;
+    size_t   top;                    // arena bytes from base
+    size_t   slabs;                  // pool bytes cut from base + size
+    size_t   big;                    // bytes in large pool blocks
+    size_t   peak;
+    int      lock;                   // taken only once task workers exist
+    void*    free[POOL_CLASSES];
+    uint8_t* cur[POOL_CLASSES];      // bump range in the class's newest slab
+    uint8_t* end[POOL_CLASSES];
+    Com64Report* report;             // NULL unless run by the shell
+} g_heap;
+
+static int heap_reserve(void) {
+    if (g_heap.base) return 0;
+    for (size_t sz = HEAP_RESERVE; sz >= HEAP_MIN; sz /= 2) {
+        void* p = mmap(NULL, sz, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (p != MAP_FAILED) {
+            g_heap.base = p;
+            g_heap.size = sz;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static void heap_note(void) {
+    size_t used = g_heap.top + g_heap.slabs + g_heap.big;
+    if (used > g_heap.peak) {
+        g_heap.peak = used;
+        if (g_heap.report) g_heap.report->heap_peak = used;
+    }
+}
+
+// Single-threaded programs never pay for the lock
+static void heap_lock(void) {
+    if (g_task.started) spin_lock(&g_heap.lock);
+}
+
+static void heap_unlock(void) {
+    if (g_task.started) spin_unlock(&g_heap.lock);
+}
+
+static void* heap_arena_alloc(size_t n) {
+    void* p = NULL;
+    heap_lock();
+    if (heap_reserve() == 0 && n <= g_heap.size) {
+        n = (n + HEAP_ALIGN - 1) & ~(size_t)(HEAP_ALIGN - 1);
+        if (n <= g_heap.size - g_heap.slabs - g_heap.top) {
+            p = g_heap.base + g_heap.top;
+            g_heap.top += n;
+            heap_note();
+        }
+    }
+    heap_unlock();
+    return p;
+}
+
+static size_t heap_arena_mark(void) {
+    return __atomic_load_n(&g_heap.top, __ATOMIC_RELAXED);
+}
+
+static void heap_arena_release(size_t mark) {
+    heap_lock();
+    if (mark < g_heap.top) g_heap.top = mark;
+    heap_unlock();
+}
+
+static void heap_arena_reset(void) {
+    heap_arena_release(0);
+}
+
+static int pool_class(size_t n) {
+    if (n <= HEAP_ALIGN) return 0;
+    return 64 - __builtin_clzll((unsigned long long)(n - 1)) - 4;
+}
+
+static void* heap_pool_alloc(size_t n) {
+    if (n > POOL_MAX) {
+        size_t len = (n + 4095) & ~(size_t)4095;
+        void* p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) return NULL;
+        heap_lock();
+        g_heap.big += len;
+        heap_note();
+        heap_unlock();
+        return p;
+    }
+
+    int c = pool_class(n);
+    size_t sz = (size_t)HEAP_ALIGN << c;
+    heap_lock();
+    void* p = g_heap.free[c];
+    if (p) {
+        g_heap.free[c] = *(void**)p;
+    } else {
+        if (g_heap.cur[c] == g_heap.end[c]) {
+            if (heap_reserve() != 0 || POOL_SLAB > g_heap.size - g_heap.top - g_heap.slabs) {
+                heap_unlock();
+                return NULL;
+            }
+            g_heap.slabs += POOL_SLAB;
+            g_heap.cur[c] = g_heap.base + g_heap.size - g_heap.slabs;
+            g_heap.end[c] = g_heap.cur[c] + POOL_SLAB;
+            heap_note();
+        }
+        p = g_heap.cur[c];
+        g_heap.cur[c] += sz;
+    }
+    heap_unlock();
+    return p;
+}
+
+static void heap_pool_free(void* p, size_t n) {
+    if (!p) return;
+    if (n > POOL_MAX) {
+        size_t len = (n + 4095) & ~(size_t)4095;
+        munmap(p, len);
+        heap_lock();
+        g_heap.big -= len;
+        heap_unlock();
+        return;
+    }
+    int c = pool_class(n);
+    heap_lock();
+    *(void**)p = g_heap.free[c];
+    g_heap.free[c] = p;
+    heap_unlock();
+}
+
+/* --- COM64 perf counters ---
+   With PERFSTAT ON the child opens perf_event counters on itself. They
+   are inherited by the task workers it starts, enabled just before the
+   entry call and read into the report page when the program returns or
+   dies of a fatal signal; PID 1 prints them once it has reaped the child.
+   Where the CPU's counters are not available (most VMs) only the
+   software ones are shown. Kernel time is counted when perf_event_paranoid
+   allows it and left out otherwise. */
+
+static int g_perf_on = 0;
+static int g_perf_fd[PERF_EVENTS] = { -1, -1, -1, -1, -1, -1 };
+
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} g_perf_ev[PERF_EVENTS] = {
+    [PERF_CYCLES]      = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    [PERF_INSTR]       = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    [PERF_CACHE_MISS]  = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+    [PERF_BRANCH_MISS] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    [PERF_FAULTS]      = { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+    [PERF_TASK_CLOCK]  = { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+};
+
+static int perf_open(int i) {
+    struct perf_event_attr a;
+    memset(&a, 0, sizeof a);
+    a.type = g_perf_ev[i].type;
+    a.size = sizeof a;
+    a.config = g_perf_ev[i].config;
+    a.disabled = 1;
+    a.inherit = 1;
+    a.exclude_hv = 1;
+    a.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    int fd = (int)syscall(SYS_perf_event_open, &a, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    if (fd < 0 && (errno == EACCES || errno == EPERM)) {
+        a.exclude_kernel = 1;
+        fd = (int)syscall(SYS_perf_event_open, &a, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    }
+    return fd;
+}
+
+/* Safe in a signal handler: ioctl() and read() only */
+static void perf_snapshot(void) {
+    Com64Report* r = g_heap.report;
+    for (int i = 0; i < PERF_EVENTS; i++) {
+        if (g_perf_fd[i] < 0) continue;
+        (void)ioctl(g_perf_fd[i], PERF_EVENT_IOC_DISABLE, 0);
+
+        uint64_t v[3]; // value, time enabled, time running
+        if (read(g_perf_fd[i], v, sizeof v) != (ssize_t)sizeof v) continue;
+        // Scale up if the counter shared the PMU with others
+        if (v[2] && v[2] < v[1]) v[0] = (uint64_t)((double)v[0] * (double)v[1] / (double)v[2]);
+        if (r) {
+            r->perf[i] = v[0];
+            r->perf_valid |= 1u << i;
+        }
+        close(g_perf_fd[i]);
+        g_perf_fd[i] = -1;
+    }
+}
+
+static void perf_fatal(int sig) {
+    (void)sig;
+    perf_snapshot(); // SA_RESETHAND: the fault repeats and kills the child
+}
+
+/* Child side, just before the entry call */
+static void perf_start(void) {
+    if (!g_perf_on || !g_heap.report) return;
+    for (int i = 0; i < PERF_EVENTS; i++) g_perf_fd[i] = perf_open(i);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = perf_fatal;
+    sa.sa_flags = SA_RESETHAND | SA_NODEFER;
+    static const int fatal[] = { SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT };
+    for (size_t i = 0; i < sizeof fatal / sizeof fatal[0]; i++) sigaction(fatal[i], &sa, NULL);
+
+    for (int i = 0; i < PERF_EVENTS; i++)
+        if (g_perf_fd[i] >= 0) (void)ioctl(g_perf_fd[i], PERF_EVENT_IOC_ENABLE, 0);
+}
+
+/* PID 1 side, after waitpid(); a counter that could not be opened shows as 0 */
+static void perf_print(const Com64Report* r) {
+    char line[160];
+    const uint64_t* v = r->perf;
+    unsigned long long u[PERF_EVENTS];
+    for (int i = 0; i < PERF_EVENTS; i++) u[i] = (r->perf_valid & (1u << i)) ? v[i] : 0;
+
+    if (r->perf_valid & (1u << PERF_CYCLES)) {
+        snprintf(line, sizeof line, "[PERF] %llu cycles, %llu instructions (%.2f IPC)\n"
+                 "[PERF] %llu cache misses, %llu branch misses\n",
+                 u[PERF_CYCLES], u[PERF_INSTR], u[PERF_CYCLES] ? (double)u[PERF_INSTR] / (double)u[PERF_CYCLES] : 0.0,
+                 u[PERF_CACHE_MISS], u[PERF_BRANCH_MISS]);
+        con_write(line, strlen(line));
+    } else {
+        con_write("[PERF] hardware counters unavailable\n", 37);
+    }
+    snprintf(line, sizeof line, "[PERF] %.3f ms task clock, %llu page faults\n",
+             (double)u[PERF_TASK_CLOCK] / 1e6, u[PERF_FAULTS]);
+    con_write(line, strlen(line));
+}
+
+/* --- shared memory ---
+   Named segments are memfds held by a registry thread in PID 1, so they
+   outlive the programs that use them until SHM_UNLINK. A program asks for
+   one over an abstract unix socket (one short connection per request)
+   and gets the memfd back with SCM_RIGHTS; after that, it and every other
+   program that opened the name share the pages directly. The thread owns
+   the table outright, and it is a thread (not an ev source) because PID 1
+   may be blocked in waitpid() on the very program that is asking. */
+
+#define SHM_MAX       64
+#define SHM_NAME_MAX  32            // including the terminator
+#define SHM_F_CREATE  0x1u          // same values as DOS_SHM_* in dosapi.h
+#define SHM_F_EXCL    0x2u
+
+enum { SHM_OP_OPEN = 1, SHM_OP_UNLINK };
+
+typedef struct ShmReq {
+    uint32_t op;
+    uint32_t flags;
+    uint64_t size;
+    char     name[SHM_NAME_MAX];
+} ShmReq;
+
+typedef struct ShmRep {
+    int32_t  err;                   // 0 or an errno value
+    uint32_t reserved;
+    uint64_t size;
+} ShmRep;
+
+static struct {
+    char     name[SHM_NAME_MAX];
+    int      fd;                    // 0: free slot
+    uint64_t size;
+} g_shm[SHM_MAX];                   // registry thread only
+
+static pid_t g_shm_owner;           // PID 1's pid names the socket; children inherit it
+
+static struct {
+    void*  p;
+    size_t len;
+} g_shm_maps[SHM_MAX];              // child side: what shm_close unmaps
+static int g_shm_maps_lock;
+
+static socklen_t shm_addr(struct sockaddr_un* a) {
+    memset(a, 0, sizeof *a);
+    a->sun_family = AF_UNIX;
+    int n = snprintf(a->sun_path + 1, sizeof a->sun_path - 1, "dos64-shm.%d", (int)g_shm_owner);
+    return (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 + (size_t)n);
+}
+
+static int shm_serve(const ShmReq* rq, ShmRep* rp) {
+    char name[SHM_NAME_MAX];
+    memcpy(name, rq->name, sizeof name);
+    name[SHM_NAME_MAX - 1] = 0;
+    if (!name[0]) { rp->err = EINVAL; return -1; }
+
+    int slot = -1, free_slot = -1;
+    for (int i = 0; i < SHM_MAX; i++) {
+        if (!g_shm[i].fd) {
+            if (free_slot < 0) free_slot = i;
+        } else if (!strcasecmp(g_shm[i].name, name)) {
+            slot = i;
+        }
+    }
+
+    if (rq->op == SHM_OP_UNLINK) {
+        if (slot < 0) { rp->err = ENOENT; return -1; }
+        close(g_shm[slot].fd);
+        g_shm[slot].fd = 0;
+        return -1;
+    }
+
+    if (slot >= 0) {
+        if ((rq->flags & SHM_F_CREATE) && (rq->flags & SHM_F_EXCL)) { rp->err = EEXIST; return -1; }
+        rp->size = g_shm[slot].size;
+        return g_shm[slot].fd;
+    }
+    if (!(rq->flags & SHM_F_CREATE)) { rp->err = ENOENT; return -1; }
+    if (rq->size == 0) { rp->err = EINVAL; return -1; }
+    if (free_slot < 0) { rp->err = ENOSPC; return -1; }
+
+    int fd = memfd_create(name, MFD_CLOEXEC);
+    if (fd < 0) { rp->err = errno; return -1; }
+    if (ftruncate(fd, (off_t)rq->size) != 0) {
+        rp->err = ENOMEM;
+        close(fd);
+        return -1;
+    }
+    snprintf(g_shm[free_slot].name, SHM_NAME_MAX, "%s", name);
+    g_shm[free_slot].fd = fd;
+    g_shm[free_slot].size = rq->size;
+    rp->size = rq->size;
+    return fd;
+}
+
+static void* shm_registry_thread(void* arg) {
+    int ls = (int)(intptr_t)arg;
+    for (;;) {
+        int c = accept4(ls, NULL, NULL, SOCK_CLOEXEC);
+        if (c < 0) {
+            if (errno != EINTR && errno != ECONNABORTED) {
+                struct timespec ts = { 0, 10 * 1000000L }; // out of fds: do not spin
+                nanosleep(&ts, NULL);
+            }
+            continue;
+        }
+
+        struct timeval tv = { 1, 0 }; // a stuck program cannot stall the registry
+        setsockopt(c, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+        setsockopt(c, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof tv);
+
+        ShmReq rq;
+        ShmRep rp;
+        memset(&rp, 0, sizeof rp);
+        int fd = -1;
+        if (recv(c, &rq, sizeof rq, 0) == (ssize_t)sizeof rq) fd = shm_serve(&rq, &rp);
+        else rp.err = EINVAL;
+
+        struct iovec iov = { &rp, sizeof rp };
+        union { struct cmsghdr h; char buf[CMSG_SPACE(sizeof(int))]; } cm;
+        struct msghdr msg;
+        memset(&msg, 0, sizeof msg);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        if (fd >= 0) {
+            msg.msg_control = cm.buf;
+            msg.msg_controllen = sizeof cm.buf;
+            struct cmsghdr* h = CMSG_FIRSTHDR(&msg);
+            h->cmsg_level = SOL_SOCKET;
+            h->cmsg_type = SCM_RIGHTS;
+            h->cmsg_len = CMSG_LEN(sizeof(int));
+            memcpy(CMSG_DATA(h), &fd, sizeof fd);
+        }
+        (void)sendmsg(c, &msg, MSG_NOSIGNAL);
+        close(c);
+    }
+    return NULL;
+}
+
+/* Called once from main, after ev_block_signals() */
+static void shm_registry_start(void) {
+    g_shm_owner = getpid();
+    struct sockaddr_un a;
+    socklen_t alen = shm_addr(&a);
+
+    int ls = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (ls < 0) return;
+    if (bind(ls, (struct sockaddr*)&a, alen) != 0 || listen(ls, 16) != 0) {
+        close(ls);
+        return;
+    }
+
+    pthread_t tid;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&tid, &attr, shm_registry_thread, (void*)(intptr_t)ls) != 0) close(ls);
+    pthread_attr_destroy(&attr);
+}
+
+/* Child side: one request, one reply, maybe an fd. Returns 0 or an errno value. */
+static int shm_request(const ShmReq* rq, ShmRep* rp, int* fd_out) {
+    *fd_out = -1;
+    struct sockaddr_un a;
+    socklen_t alen = shm_addr(&a);
+    int c = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (c < 0) return EMFILE;
+    if (connect(c, (struct sockaddr*)&a, alen) != 0 || send(c, rq, sizeof *rq, MSG_NOSIGNAL) != (ssize_t)sizeof *rq) {
+        close(c);
+        return ENOSYS;
+    }
+
+    struct iovec iov = { rp, sizeof *rp };
+    union { struct cmsghdr h; char buf[CMSG_SPACE(sizeof(int))]; } cm;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cm.buf;
+    msg.msg_controllen = sizeof cm.buf;
+    ssize_t r = recvmsg(c, &msg, MSG_CMSG_CLOEXEC);
+    close(c);
+    if (r != (ssize_t)sizeof *rp) return EIO;
+
+    struct cmsghdr* h = CMSG_FIRSTHDR(&msg);
+    if (h && h->cmsg_level == SOL_SOCKET && h->cmsg_type == SCM_RIGHTS) memcpy(fd_out, CMSG_DATA(h), sizeof(int));
+    return rp->err;
+}
+
+static void* dosapi_shm_open(const char* name, size_t size, int flags, size_t* size_out) {
+    ShmReq rq;
+    ShmRep rp;
+    memset(&rq, 0, sizeof rq);
+    memset(&rp, 0, sizeof rp);
+    if (!name || strlen(name) >= SHM_NAME_MAX) return NULL;
+    rq.op = SHM_OP_OPEN;
+    rq.flags = (uint32_t)flags;
+    rq.size = size;
+    snprintf(rq.name, sizeof rq.name, "%s", name);
+
+    int fd;
+    if (shm_request(&rq, &rp, &fd) != 0 || fd < 0) return NULL;
+    void* p = mmap(NULL, (size_t)rp.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return NULL;
+
+    if (g_task.started) spin_lock(&g_shm_maps_lock);
+    for (int i = 0; i < SHM_MAX; i++) {
+        if (g_shm_maps[i].p) continue;
+        g_shm_maps[i].p = p;
+        g_shm_maps[i].len = (size_t)rp.size;
+        break;
+    }
+    if (g_task.started) spin_unlock(&g_shm_maps_lock);
+
+    if (size_out) *size_out = (size_t)rp.size;
+    return p;
+}
+
+static int dosapi_shm_close(void* p) {
+    int rc = -1;
+    if (g_task.started) spin_lock(&g_shm_maps_lock);
+    for (int i = 0; i < SHM_MAX; i++) {
+        if (!p || g_shm_maps[i].p != p) continue;
+        rc = munmap(p, g_shm_maps[i].len);
+        g_shm_maps[i].p = NULL;
+        break;
+    }
+    if (g_task.started) spin_unlock(&g_shm_maps_lock);
+    return rc;
+}
+
+static int dosapi_shm_unlink(const char* name) {
+    ShmReq rq;
+    ShmRep rp;
+    memset(&rq, 0, sizeof rq);
+    if (!name || strlen(name) >= SHM_NAME_MAX) return -1;
+    rq.op = SHM_OP_UNLINK;
+    snprintf(rq.name, sizeof rq.name, "%s", name);
+    int fd;
+    return shm_request(&rq, &rp, &fd) == 0 ? 0 : -1;
+}
+
+static int read_all(int fd, void* buf, size_t n) {
+    uint8_t* p = (uint8_t*)buf;
+    size_t got = 0;
+    while (got < n) {
+        ssize_t r = read(fd, p + got, n - got);
+        if (r == 0) return -1;
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        got += (size_t)r;
+    }
+    return 0;
+}
+
+/* Decode one LZ4 block (the plain block format, no frame). Every length and
+   offset is checked, so a corrupt image fails to load instead of writing
+   outside the mapping. Returns the decoded size or -1. */
+static long lz4_decode_block(const uint8_t* src, size_t n, uint8_t* dst, size_t cap) {
+    size_t ip = 0, op = 0;
+    while (ip < n) {
+        unsigned tok = src[ip++];
+
+        size_t lit = tok >> 4;
+        if (lit == 15) {
+            unsigned b;
+            do {
+                if (ip >= n) return -1;
+                b = src[ip++];
+                lit += b;
+            } while (b == 255);
+        }
+        if (lit > n - ip || lit > cap - op) return -1;
+        if (lit <= 16 && n - ip >= 16 && cap - op >= 16) {
+            memcpy(dst + op, src + ip, 16); // fixed size: one unaligned copy, the excess is overwritten next
+        } else {
+            memcpy(dst + op, src + ip, lit);
+        }
+        ip += lit;
+        op += lit;
+        if (ip == n) break; // the last sequence has literals only
+
+        if (n - ip < 2) return -1;
+        size_t off = (size_t)src[ip] | ((size_t)src[ip + 1] << 8);
+        ip += 2;
+        if (off == 0 || off > op) return -1;
+
+        size_t len = tok & 15;
+        if (len == 15) {
+            unsigned b;
+            do {
+                if (ip >= n) return -1;
+                b = src[ip++];
+                len += b;
+            } while (b == 255);
+        }
+        len += 4;
+        if (len > cap - op) return -1;
+
+        uint8_t* d = dst + op;
+        const uint8_t* m = d - off;
+        op += len;
+        if (off >= 8 && cap - op >= 8) {
+            // Source runs at least 8 bytes behind, so 8-byte steps never read
+            // what they are writing; the last step may spill up to 7 bytes
+            uint8_t* end = d + len;
+            do {
+                memcpy(d, m, 8);
+                d += 8;
+                m += 8;
+            } while (d < end);
+        } else {
+            while (len--) *d++ = *m++;
+        }
+    }
+    return (long)op;
+}
+
+/* Decompress the block stream at fd straight into the image. Each read
+   takes one block plus the next block's length word. */
+static int com64_read_lz4(int fd, const Com64Hdr* hdr, uint8_t* image) {
+    size_t zcap = COM64_LZ4_BLOCK + COM64_LZ4_BLOCK / 255 + 16 + 4;
+    uint8_t* z = malloc(zcap);
+    if (!z) return -1;
+
+    int rc = -1;
+    uint64_t packed_left = hdr->packed_size;
+    size_t done = 0;
+    uint8_t len4[4];
+    if (packed_left < 4 || read_all(fd, len4, 4) != 0) goto out;
+    packed_left -= 4;
+
+    while (done < hdr->payload_size) {
+        uint32_t len = (uint32_t)len4[0] | (uint32_t)len4[1] << 8 |
+                       (uint32_t)len4[2] << 16 | (uint32_t)len4[3] << 24;
+        size_t clen = len & ~COM64_LZ4_RAW;
+        size_t want = hdr->payload_size - done;
+        if (want > COM64_LZ4_BLOCK) want = COM64_LZ4_BLOCK;
+        int more = (done + want < hdr->payload_size);
+
+        size_t rd = clen + (more ? 4 : 0);
+        if (rd > zcap || rd > packed_left || read_all(fd, z, rd) != 0) goto out;
+        packed_left -= rd;
+
+        if (len & COM64_LZ4_RAW) {
+            if (clen != want) goto out;
+            memcpy(image + done, z, clen);
+        } else if (lz4_decode_block(z, clen, image + done, want) != (long)want) {
+            goto out;
+        }
+        done += want;
+        if (more) memcpy(len4, z + clen, 4);
+    }
+    rc = 0;
+out:
+    free(z);
+    return rc;
+}
+
+/* Checks shared by plain files and library members; stored is the number
+   of bytes after the header. Returns the payload size once loaded, or 0. */
+static size_t com64_check_hdr(const Com64Hdr* hdr, size_t stored) {
+    if (memcmp(hdr->magic, "64DOSCOM", 8) != 0) return 0;
+    if (hdr->header_size != 64) return 0;
+
+    size_t payload_size = stored;
+    if (hdr->flags & COM64_F_LZ4) {
+        if (hdr->packed_size != stored || hdr->payload_size > (1ull << 32)) return 0;
+        payload_size = (size_t)hdr->payload_size;
+    }
+    if (hdr->entry_rva >= payload_size) return 0;
+    return payload_size;
+}
+
+/* The block stream again, this time already in memory (a library member) */
+static int com64_unpack_lz4(const uint8_t* src, const Com64Hdr* hdr, uint8_t* image) {
+    size_t left = (size_t)hdr->packed_size, done = 0;
+    while (done < hdr->payload_size) {
+        if (left < 4) return -1;
+        uint32_t len = (uint32_t)src[0] | (uint32_t)src[1] << 8 |
+                       (uint32_t)src[2] << 16 | (uint32_t)src[3] << 24;
+        size_t clen = len & ~COM64_LZ4_RAW;
+        size_t want = hdr->payload_size - done;
+        if (want > COM64_LZ4_BLOCK) want = COM64_LZ4_BLOCK;
+        src += 4;
+        left -= 4;
+        if (clen > left) return -1;
+
+        if (len & COM64_LZ4_RAW) {
+            if (clen != want) return -1;
+            memcpy(image + done, src, clen);
+        } else if (lz4_decode_block(src, clen, image + done, want) != (long)want) {
+            return -1;
+        }
+        src += clen;
+        left -= clen;
+        done += want;
+    }
+    return 0;
+}
+
+static int com64_call(uint8_t* image, const Com64Hdr* hdr, int argc, const char** argv) {
+    DosApi api;
+    memset(&api, 0, sizeof api);
+    api.print       = dosapi_print_impl;
+    api.scr_open    = scr_open;
+    api.scr_close   = scr_close;
+    api.scr_put     = scr_put;
+    api.scr_text    = scr_text;
+    api.scr_fill    = scr_fill;
+    api.scr_cursor  = scr_cursor;
+    api.scr_present = scr_present;
+    api.arena_alloc   = heap_arena_alloc;
+    api.arena_mark    = heap_arena_mark;
+    api.arena_release = heap_arena_release;
+    api.arena_reset   = heap_arena_reset;
+    api.pool_alloc    = heap_pool_alloc;
+    api.pool_free     = heap_pool_free;
+    api.task_workers  = dosapi_task_workers;
+    api.task_spawn    = dosapi_task_spawn;
+    api.task_wait     = dosapi_task_wait;
+    api.futex_wait    = dosapi_futex_wait;
+    api.futex_wake    = dosapi_futex_wake;
+    api.shm_open      = dosapi_shm_open;
+    api.shm_close     = dosapi_shm_close;
+    api.shm_unlink    = dosapi_shm_unlink;
+
+    Com64Entry entry = (Com64Entry)(image + hdr->entry_rva);
+    perf_start();
+    int rc = entry(&api, argc, argv);
+    perf_snapshot();
+    return rc;
+}
+
+static int run_com64_hostpath(const char* host_path, int argc, const char** argv) {
+    int fd = open(host_path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) { close(fd); return -1; }
+    if (st.st_size < (off_t)sizeof(Com64Hdr)) { close(fd); return -1; }
+
+    Com64Hdr hdr;
+    if (read_all(fd, &hdr, sizeof(hdr)) != 0) { close(fd); return -1; }
+
+    size_t payload_size = com64_check_hdr(&hdr, (size_t)st.st_size - sizeof(Com64Hdr));
+    if (!payload_size) { close(fd); return -1; }
+
+    size_t image_size = payload_size + (size_t)hdr.bss_size;
+
+    void* image = mmap(NULL, image_size,
+                       PROT_READ | PROT_WRITE | PROT_EXEC,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (image == MAP_FAILED) { close(fd); return -1; }
+
+    // fd is already positioned just after header
+    int packed = (hdr.flags & COM64_F_LZ4) != 0;
+    if ((packed ? com64_read_lz4(fd, &hdr, image) : read_all(fd, image, payload_size)) != 0) {
+        munmap(image, image_size);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    if (hdr.bss_size) {
+        memset((uint8_t*)image + payload_size, 0, (size_t)hdr.bss_size);
+    }
+
+    int rc = com64_call(image, &hdr, argc, argv);
+
+    munmap(image, image_size);
+    return rc;
+}
+
+/* --- COM64 library ---
+   C:\COM64.LIB (mkcom64 -l) holds many images behind a name index sorted
+   by name. It is mapped once; a bare command name is found by binary
+   search and an uncompressed member's payload, which mkcom64 places on a
+   page boundary, is mapped straight from the open library. A launch costs
+   no path lookups at all. A tick hook notices when the file is replaced.
+   PID 1 searches a private copy of the index and never touches member
+   pages itself: if the file is truncated under the mapping, only the
+   program's child process can take the SIGBUS. */
+
+#define COM64_LIB_NAME  "COM64.LIB"
+#define COM64_LIB_ALIGN 4096u
+
+typedef struct Com64LibHdr {
+    char     magic[8];      // "64DOSLIB"
+    uint32_t version;       // 1
+    uint32_t count;
+    uint64_t index_off;     // Com64LibEntry[count]
+    uint64_t reserved;
+} Com64LibHdr;
+
+typedef struct Com64LibEntry {
+    char     name[24];      // upper case, no extension, NUL-padded
+    uint64_t offset;        // of the COM64 header; the payload after it is page-aligned
+    uint64_t size;
+} Com64LibEntry;
+
+static struct {
+    int                  fd;
+    const uint8_t*       map;
+    size_t               len;
+    Com64LibEntry*       index;
+    uint32_t             count;
+    struct stat          st;  // identity of the mapped file
+    int                  bad; // st is a file that failed validation
+} g_lib = { .fd = -1 };
+
+static void lib_close(void) {
+    if (g_lib.map) munmap((void*)g_lib.map, g_lib.len);
+    if (g_lib.fd >= 0) close(g_lib.fd);
+    free(g_lib.index);
+    g_lib.fd = -1;
+    g_lib.map = NULL;
+    g_lib.index = NULL;
+    g_lib.count = 0;
+    g_lib.bad = 0;
+}
+
+static int lib_valid(const uint8_t* p, size_t len) {
+    if (len < sizeof(Com64LibHdr)) return 0;
+    const Com64LibHdr* h = (const Com64LibHdr*)p;
+    if (memcmp(h->magic, "64DOSLIB", 8) != 0 || h->version != 1) return 0;
+    if (h->index_off > len || h->count > (len - h->index_off) / sizeof(Com64LibEntry)) return 0;
+    if (h->index_off % 8) return 0;
+
+    const Com64LibEntry* e = (const Com64LibEntry*)(p + h->index_off);
+    for (uint32_t i = 0; i < h->count; i++) {
+        if (e[i].name[sizeof e[i].name - 1] != 0) return 0;
+        if (i && strcmp(e[i - 1].name, e[i].name) >= 0) return 0; // bsearch needs the order
+        if ((e[i].offset + sizeof(Com64Hdr)) % COM64_LIB_ALIGN) return 0;
+        if (e[i].size < sizeof(Com64Hdr) || e[i].offset > len || e[i].size > len - e[i].offset) return 0;
+    }
+    return 1;
+}
+
+static void lib_refresh(void) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof path, "%s/" COM64_LIB_NAME, g_c_root);
+
+    struct stat st;
+    if (stat(path, &st) != 0) { lib_close(); return; }
+    if ((g_lib.map || g_lib.bad) && st.st_dev == g_lib.st.st_dev && st.st_ino == g_lib.st.st_ino &&
+        st.st_size == g_lib.st.st_size && st.st_mtim.tv_sec == g_lib.st.st_mtim.tv_sec &&
+        st.st_mtim.tv_nsec == g_lib.st.st_mtim.tv_nsec) {
+        return;
+    }
+    lib_close();
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) { close(fd); return; }
+    ra_note(path);
+
+    void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) { close(fd); return; }
+    if (!lib_valid(p, (size_t)st.st_size)) {
+        munmap(p, (size_t)st.st_size);
+        close(fd);
+        con_write("Invalid COM64.LIB\n", 18);
+        g_lib.st = st;
+        g_lib.bad = 1; // say so once, not on every tick
+        return;
+    }
+
+    const Com64LibHdr* h = (const Com64LibHdr*)p;
+    size_t index_bytes = (size_t)h->count * sizeof(Com64LibEntry);
+    Com64LibEntry* index = malloc(index_bytes ? index_bytes : 1);
+    if (!index) { munmap(p, (size_t)st.st_size); close(fd); return; }
+    memcpy(index, (const uint8_t*)p + h->index_off, index_bytes);
+
+    g_lib.fd = fd;
+    g_lib.map = p;
+    g_lib.len = (size_t)st.st_size;
+    g_lib.index = index;
+    g_lib.count = h->count;
+    g_lib.st = st;
+}
+
+static int lib_entry_cmp(const void* key, const void* ent) {
+    return strcmp((const char*)key, ((const Com64LibEntry*)ent)->name);
+}
+
+/* "FOO" or "foo.com64" -> member FOO; anything with a path or another
+   extension is not a library command. */
+static const Com64LibEntry* lib_find(const char* cmd) {
+    if (!g_lib.count) return NULL;
+
+    char key[sizeof ((Com64LibEntry*)0)->name];
+    size_t n = 0;
+    for (; cmd[n] && cmd[n] != '.'; n++) {
+        if (n + 1 >= sizeof key) return NULL;
+        key[n] = (char)toupper((unsigned char)cmd[n]);
+    }
+    key[n] = 0;
+    if (cmd[n] && strcasecmp(cmd + n, ".COM64") != 0) return NULL;
+
+    return bsearch(key, g_lib.index, g_lib.count, sizeof *g_lib.index, lib_entry_cmp);
+}
+
+static int run_com64_member(const Com64LibEntry* e, int argc, const char** argv) {
+    const Com64Hdr* hdr = (const Com64Hdr*)(g_lib.map + e->offset);
+    size_t payload_size = com64_check_hdr(hdr, (size_t)e->size - sizeof(Com64Hdr));
+    if (!payload_size) return -1;
+
+    size_t pg = COM64_LIB_ALIGN;
+    size_t image_size = payload_size + (size_t)hdr->bss_size;
+    size_t map_len = (image_size + pg - 1) & ~(pg - 1);
+
+    // Anonymous first: it supplies the zeroed bss beyond the file's pages
+    uint8_t* image = mmap(NULL, map_len, PROT_READ | PROT_WRITE | PROT_EXEC,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (image == MAP_FAILED) return -1;
+
+    const uint8_t* stored = (const uint8_t*)(hdr + 1);
+    if (hdr->flags & COM64_F_LZ4) {
+        if (com64_unpack_lz4(stored, hdr, image) != 0) { munmap(image, map_len); return -1; }
+    } else {
+        size_t file_len = (payload_size + pg - 1) & ~(pg - 1);
+        if (mmap(image, file_len, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_FIXED,
+                 g_lib.fd, (off_t)(e->offset + sizeof(Com64Hdr))) == MAP_FAILED) {
+            munmap(image, map_len);
+            return -1;
+        }
+        memset(image + payload_size, 0, file_len - payload_size); // the next member's bytes
+    }
+
+    int rc = com64_call(image, hdr, argc, argv);
+    munmap(image, map_len);
+    return rc;
+}
+
+/* Run COM64 in a child so init (PID 1) never dies if it crashes. The
+   image is host_path, or the library member if one is given. A background
+   (START) program gets its own session and no console input, and is left
+   for ev_reap_children(). */
+static int run_com64_sandboxed(const char* host_path, const Com64LibEntry* member,
+                               int argc, const char** argv, int bg) {
+    con_flush(); // or the child inherits, and repeats, pending output
+
+    if (!g_com64_report) {
+        void* p = mmap(NULL, sizeof(Com64Report), PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (p != MAP_FAILED) g_com64_report = p;
+    }
+    if (g_com64_report && !bg) memset(g_com64_report, 0, sizeof *g_com64_report);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        con_error("Insufficient memory\n", 20);
+        return 1; // we handled the command attempt
+    }
+
+    if (pid == 0) {
+        ev_child_unblock();
+        if (bg) {
+            setsid();
+            int fd = open("/dev/null", O_RDONLY);
+            if (fd > 0) {
+                dup2(fd, 0);
+                close(fd);
+            }
+        } else {
+            g_heap.report = g_com64_report;
+        }
+        int rc = member ? run_com64_member(member, argc, argv) : run_com64_hostpath(host_path, argc, argv);
+        if (rc < 0) _exit(127);
+        _exit(rc & 0xFF);
+    }
+    if (bg) return 1;
+
+    int st = 0;
+    for (;;) {
+        if (waitpid(pid, &st, 0) >= 0) break;
+        if (errno == EINTR) continue;
+        break;
+    }
+
+    if (WIFSIGNALED(st)) {
+        con_error("Program terminated\n", 19);
+    } else if (WEXITSTATUS(st) != 0) {
+        g_con_error = 1;
+    }
+    if (g_com64_report) g_con_heap_peak = (long long)g_com64_report->heap_peak;
+    if (g_com64_report && g_perf_on) perf_print(g_com64_report);
+
+    return 1;
+}
+
+static int file_exists_regular(const char* path) {
+    struct stat st;
+    if (stat(path, &st) != 0) return 0;
+    return S_ISREG(st.st_mode);
+}
+
+/* Split a command tail in place into argv[]; "double quotes" group words.
+   Returns argc; argv[argc] is always NULL. */
+static int split_args(char* s, const char** argv, int max) {
+    int argc = 0;
+    while (*s && argc < max) {
+        while (*s == ' ' || *s == '\t') s++;
+        if (!*s) break;
+
+        if (*s == '"') {
+            argv[argc++] = ++s;
+            while (*s && *s != '"') s++;
+        } else {
+            argv[argc++] = s;
+            while (*s && *s != ' ' && *s != '\t') s++;
+        }
+        if (*s) *s++ = 0;
+    }
+    argv[argc] = NULL;
+    return argc;
+}
+
+/* --- native programs ---
+   Static Linux executables on C:\ run as they are. They are started with
+   posix_spawn(), which glibc implements as clone(CLONE_VM|CLONE_VFORK):
+   the child borrows PID 1's address space until it execs, so launch cost
+   does not grow with whatever caches init is holding, unlike fork(). */
+
+enum { PROG_UNKNOWN, PROG_COM64, PROG_ELF };
+
+static int program_kind(const char* path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return PROG_UNKNOWN;
+    char magic[8];
+    ssize_t n = read(fd, magic, sizeof magic);
+    close(fd);
+
+    if (n == 8 && !memcmp(magic, "64DOSCOM", 8)) return PROG_COM64;
+    if (n >= 4 && !memcmp(magic, "\177ELF", 4)) return PROG_ELF;
+    return PROG_UNKNOWN;
+}
+
+extern char** environ;
+
+/* Start host_path with the signal state PID 1 had at entry. A detached
+   child gets its own session and /dev/null on stdin. Returns the pid, or
+   -1 with errno set. */
+static pid_t spawn_native(const char* host_path, const char** argv, int detach) {
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t fa;
+    if (posix_spawnattr_init(&attr) != 0) return -1;
+    posix_spawn_file_actions_init(&fa);
+
+    sigset_t dfl;
+    sigemptyset(&dfl);
+    sigaddset(&dfl, SIGCHLD);
+    sigaddset(&dfl, SIGPIPE);
+    posix_spawnattr_setsigmask(&attr, &g_sigmask_orig);
+    posix_spawnattr_setsigdefault(&attr, &dfl);
+
+    short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+    if (detach) {
+        flags |= POSIX_SPAWN_SETSID;
+        posix_spawn_file_actions_addopen(&fa, 0, "/dev/null", O_RDONLY, 0);
+    }
+    posix_spawnattr_setflags(&attr, flags);
+
+    pid_t pid;
+    int err = posix_spawn(&pid, host_path, &fa, &attr, (char* const*)argv, environ);
+    posix_spawn_file_actions_destroy(&fa);
+    posix_spawnattr_destroy(&attr);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return pid;
+}
+
+static int run_native(const char* host_path, const char** argv, int bg) {
+    con_flush();
+
+    pid_t pid = spawn_native(host_path, argv, bg);
+    if (pid < 0) {
+        if (errno == ENOMEM || errno == EAGAIN) con_error("Insufficient memory\n", 20);
+        else if (errno == EACCES) con_error("Access denied\n", 14);
+        else con_error("Bad command or file name\n", 25);
+        return 1;
+    }
+    if (bg) return 1;
+
+    int st = 0;
+    while (waitpid(pid, &st, 0) < 0 && errno == EINTR) {
+    }
+
+    if (WIFSIGNALED(st)) {
+        con_error("Program terminated\n", 19);
+    } else if (WEXITSTATUS(st) != 0) {
+        g_con_error = 1;
+    }
+    return 1;
+}
+
+static int run_program(const char* host_path, int argc, const char** argv, int bg) {
+    int kind = program_kind(host_path);
+    if (kind != PROG_UNKNOWN) ra_note(host_path);
+    switch (kind) {
+    case PROG_COM64: return run_com64_sandboxed(host_path, NULL, argc, argv, bg);
+    case PROG_ELF:   return run_native(host_path, argv, bg);
+    default:         return 0;
+    }
+}
+
+/* returns 1 if it ran something, 0 if not found/not runnable */
+static int try_run_external_com64(const char* line, int bg) {
+    char args[1024];
+    snprintf(args, sizeof args, "%s", line);
+
+    const char* argv[64];
+    int argc = split_args(args, argv, 63);
+    if (argc == 0) return 0;
+    const char* cmd = argv[0];
+
+    int has_path = (strchr(cmd, '\\') || strchr(cmd, '/') ||
+                    (isalpha((unsigned char)cmd[0]) && cmd[1] == ':'));
+    int has_ext = (strchr(dos_basename(cmd), '.') != NULL);
+
+    // Library members behave like installed commands: they win over the
+    // current directory, and finding one costs no filesystem calls
+    if (!has_path) {
+        const Com64LibEntry* member = lib_find(cmd);
+        if (member) return run_com64_sandboxed(NULL, member, argc, argv, bg);
+    }
+
+    // No path: look in current directory only (PATH later)
+    char host_path[PATH_MAX];
+    if (has_path) {
         if (dos_to_linux_path(cmd, host_path, sizeof(host_path)) != 0) return 0;
+    } else {
+        snprintf(host_path, sizeof host_path, "%s", cmd);
+    }
+
+    if (file_exists_regular(host_path)) {
+        return run_program(host_path, argc, argv, bg);
+    }
+
+    if (!has_ext) {
+        // Try adding .COM64
+        char host_try[PATH_MAX];
+        if (snprintf(host_try, sizeof(host_try), "%s.COM64", host_path) > 0 &&
+            file_exists_regular(host_try)) {
+            return run_program(host_try, argc, argv, bg);
+        }
+    }
+
+    return 0;
+}
+
+static void builtin_perfstat(const char *arg) {
+    if (is_help_switch(arg)) {
+        const char *msg =
+            "PERFSTAT [ON|OFF]\n"
+            "  Reports CPU counters for each COM64 program run in the foreground:\n"
+            "  cycles, instructions, cache and branch misses (when the CPU's\n"
+            "  counters are available), CPU time and page faults.\n";
+        con_write(msg, strlen(msg));
+        return;
+    }
+
+    if (!arg || !*arg) {
+        if (g_perf_on) con_write("PERFSTAT is on.\n", 16);
+        else           con_write("PERFSTAT is off.\n", 17);
+        return;
+    }
+
+    if (!strcasecmp(arg, "on"))       g_perf_on = 1;
+    else if (!strcasecmp(arg, "off")) g_perf_on = 0;
+    else con_error("Invalid parameter\n", 18);
+}
+
+static void builtin_start(const char *arg) {
+    if (is_help_switch(arg)) {
+        const char *msg =
+            "START program [arguments]\n"
+            "  Runs a program in the background and returns to the prompt.\n"
+            "  It keeps the console for output but gets no keyboard input.\n";
+        con_write(msg, strlen(msg));
+        return;
+    }
+
+    if (!arg || !*arg) { con_error("Required parameter missing\n", 27); return; }
+    if (!try_run_external_com64(arg, 1)) con_error("Bad command or file name\n", 25);
+}
+
+/* --- AUTOEXEC services ---
+   C:\AUTOEXEC.SVC lists long-lived helpers to start at every boot, one
+   per line; a lone ':' separates the options from the command:
+
+       ; name  [AFTER=a,b] [READY=START|EXIT|FILE:path] [RESTART=YES|NO] : command args
+       NETD    READY=FILE:\RUN\NETD.RDY : \BIN\NETD.COM64 -q
+       LOGD    AFTER=NETD               : \BIN\LOGD
+
+   Every service whose dependencies are ready starts at once, and a
+   dependent starts as soon as its last dependency becomes ready. READY=START
+   (the default) counts a service ready once it is running, FILE: once the
+   file exists, EXIT once it exits with status 0 (one-shot jobs). A service
+   that dies is restarted with exponential backoff unless RESTART=NO. */
+
+#define SVC_MANIFEST       "AUTOEXEC.SVC" // in the C: root
+#define SVC_MAX            32
+#define SVC_MAX_DEPS       8
+#define SVC_MAX_ARGS       16
+#define SVC_NAME_MAX       16
+#define SVC_BACKOFF_MIN_MS 250
+#define SVC_BACKOFF_MAX_MS 30000
+#define SVC_STABLE_MS      10000 // a run this long resets the backoff
+
+enum { SVC_READY_START, SVC_READY_EXIT, SVC_READY_FILE };
+enum { SVC_WAITING, SVC_RUNNING, SVC_READY, SVC_BACKOFF, SVC_DONE, SVC_FAILED };
+
+typedef struct Service {
+    char     name[SVC_NAME_MAX];
+    char     cmd[256];
+    char     dep_names[SVC_MAX_DEPS][SVC_NAME_MAX];
+    int      deps[SVC_MAX_DEPS];
+    int      ndeps;
+    int      ready_mode;
+    char     ready_path[PATH_MAX];
+    int      restart;
+    int      state;
+    int      was_ready;
+    pid_t    pid;
+    unsigned starts;
+    unsigned backoff_ms;
+    uint64_t started_ns;   // CLOCK_MONOTONIC
+    uint64_t retry_ns;
+} Service;
+
+static Service g_svc[SVC_MAX];
+static int     g_svc_n = 0;
+
+static uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
 
-        if (file_exists_regular(host_path)) {
-            return run_com64_sandboxed(host_path, argc, argv);
+static void svc_say(const Service *sv, const char *what) {
+    char msg[128];
+    int n = snprintf(msg, sizeof msg, "AUTOEXEC: %s: %s\n", sv->name, what);
+    if (n > 0) con_write(msg, (size_t)n);
+}
+
+static int svc_find(const char *name) {
+    for (int i = 0; i < g_svc_n; i++) if (!strcasecmp(g_svc[i].name, name)) return i;
+    return -1;
+}
+
+static int svc_parse_line(char *p, Service *sv) {
+    memset(sv, 0, sizeof *sv);
+    sv->restart = 1;
+
+    int have_name = 0;
+    while (*p) {
+        while (*p == ' ' || *p == '\t') p++;
+        if (!*p) break;
+        char *t = p;
+        while (*p && *p != ' ' && *p != '\t') p++;
+        if (*p) *p++ = 0;
+
+        if (!have_name) { snprintf(sv->name, sizeof sv->name, "%s", t); have_name = 1; continue; }
+
+        if (!strcmp(t, ":")) {
+            while (*p == ' ' || *p == '\t') p++;
+            snprintf(sv->cmd, sizeof sv->cmd, "%s", p);
+            return sv->cmd[0] ? 0 : -1;
+        }
+
+        if (!strncasecmp(t, "AFTER=", 6)) {
+            for (char *d = strtok(t + 6, ","); d && sv->ndeps < SVC_MAX_DEPS; d = strtok(NULL, ","))
+                snprintf(sv->dep_names[sv->ndeps++], SVC_NAME_MAX, "%s", d);
+        } else if (!strcasecmp(t, "READY=START")) {
+            sv->ready_mode = SVC_READY_START;
+        } else if (!strcasecmp(t, "READY=EXIT")) {
+            sv->ready_mode = SVC_READY_EXIT;
+        } else if (!strncasecmp(t, "READY=FILE:", 11)) {
+            if (dos_to_linux_path(t + 11, sv->ready_path, sizeof sv->ready_path) != 0) return -1;
+            sv->ready_mode = SVC_READY_FILE;
+        } else if (!strcasecmp(t, "RESTART=NO")) {
+            sv->restart = 0;
+        } else if (!strcasecmp(t, "RESTART=YES")) {
+            sv->restart = 1;
+        } else {
+            return -1;
         }
+    }
+    return -1; // no ':' command part
+}
 
-        if (!has_ext) {
-            // Try adding .COM64
-            if (snprintf(host_try, sizeof(host_try), "%s.COM64", host_path) > 0) {
-                if (file_exists_regular(host_try)) {
-                    return run_com64_sandboxed(host_try, argc, argv);
-                }
+/* 0 = unvisited, 1 = on the DFS stack, 2 = finished */
+static int svc_has_cycle(int i, uint8_t *mark) {
+    if (mark[i] == 1) return 1;
+    if (mark[i] == 2) return 0;
+    mark[i] = 1;
+    for (int d = 0; d < g_svc[i].ndeps; d++) {
+        if (g_svc[i].deps[d] >= 0 && svc_has_cycle(g_svc[i].deps[d], mark)) return 1;
+    }
+    mark[i] = 2;
+    return 0;
+}
+
+static void svc_load(void) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof path, "%s/" SVC_MANIFEST, g_c_root);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return;
+
+    static char buf[16384];
+    ssize_t n = read(fd, buf, sizeof buf - 1);
+    close(fd);
+    if (n <= 0) return;
+    buf[n] = 0;
+
+    int lineno = 0;
+    for (char *line = buf; line && *line; ) {
+        char *next = strchr(line, '\n');
+        if (next) *next++ = 0;
+        lineno++;
+
+        line[strcspn(line, "\r;")] = 0; // ';' starts a comment
+        char *p = line;
+        while (*p == ' ' || *p == '\t') p++;
+
+        if (*p) {
+            Service sv;
+            if (svc_parse_line(p, &sv) != 0 || svc_find(sv.name) >= 0) {
+                char msg[80];
+                int k = snprintf(msg, sizeof msg, "AUTOEXEC.SVC line %d: Syntax error\n", lineno);
+                if (k > 0) con_write(msg, (size_t)k);
+            } else if (g_svc_n < SVC_MAX) {
+                g_svc[g_svc_n++] = sv;
             }
         }
-
-        return 0;
+        line = next;
     }
 
-    // No path: look in current directory only (PATH later)
-    // Try cmd as typed
-    if (file_exists_regular(cmd)) {
-        return run_com64_sandboxed(cmd, argc, argv);
+    for (int i = 0; i < g_svc_n; i++) {
+        Service *sv = &g_svc[i];
+        for (int d = 0; d < sv->ndeps; d++) {
+            sv->deps[d] = svc_find(sv->dep_names[d]);
+            if (sv->deps[d] < 0) {
+                svc_say(sv, "unknown service in AFTER=");
+                sv->state = SVC_FAILED;
+            }
+        }
     }
 
-    // Try cmd.COM64 if no extension was provided
-    if (!has_ext) {
-        if (snprintf(host_try, sizeof(host_try), "%s.COM64", cmd) > 0) {
-            if (file_exists_regular(host_try)) {
-                return run_com64_sandboxed(host_try, argc, argv);
-            }
+    for (int i = 0; i < g_svc_n; i++) {
+        uint8_t mark[SVC_MAX] = {0};
+        if (g_svc[i].state != SVC_FAILED && svc_has_cycle(i, mark)) {
+            svc_say(&g_svc[i], "dependency cycle");
+            g_svc[i].state = SVC_FAILED;
         }
     }
+}
 
-    return 0;
+static void svc_schedule(void);
+
+static void svc_mark(const Service *sv, const char *what) {
+    char name[BOOT_NAME_MAX];
+    snprintf(name, sizeof name, "svc %s %s", sv->name, what);
+    boot_mark(name);
 }
 
-/* --- main --- */
+static void svc_set_ready(Service *sv) {
+    if (!sv->was_ready) svc_mark(sv, "ready");
+    sv->was_ready = 1;
+    svc_schedule();
+}
 
-int main(void) {
-    setsid();
-    ensure_stdio();
-    mount_basic_fs();
+static void svc_on_exit(pid_t pid, int status, void *ctx) {
+    (void)pid;
+    Service *sv = &g_svc[(intptr_t)ctx];
+    sv->pid = 0;
 
-    mkdir("/dos", 0755);
-    mkdir(DOS_C_ROOT, 0755);
-    (void)chdir(DOS_C_ROOT);
+    if (sv->ready_mode == SVC_READY_EXIT && WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        sv->state = SVC_DONE;
+        svc_set_ready(sv);
+        return;
+    }
 
-    load_config();
-    apply_color();
+    if (!sv->restart) {
+        sv->state = SVC_FAILED;
+        svc_say(sv, "stopped");
+        return;
+    }
 
-    struct sigaction sa;
-    memset(&sa, 0, sizeof sa);
-    sa.sa_handler = on_sigchld;
-    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
-    sigemptyset(&sa.sa_mask);
-    sigaction(SIGCHLD, &sa, 0);
+    uint64_t ran_ms = (mono_ns() - sv->started_ns) / 1000000ull;
+    if (ran_ms >= SVC_STABLE_MS || sv->backoff_ms == 0) sv->backoff_ms = SVC_BACKOFF_MIN_MS;
+    else if (sv->backoff_ms < SVC_BACKOFF_MAX_MS) sv->backoff_ms *= 2;
+    if (sv->backoff_ms > SVC_BACKOFF_MAX_MS) sv->backoff_ms = SVC_BACKOFF_MAX_MS;
 
-    char line[1024];
+    sv->state = SVC_BACKOFF;
+    sv->retry_ns = mono_ns() + (uint64_t)sv->backoff_ms * 1000000ull;
 
-    (void)write(1, "\nDazLab 64-DOS 0.1\nDistributed under a MIT license\n", 52);
-    (void)write(1, "Type 'help' or 'poweroff'\n\n", 27);
+    char what[64];
+    snprintf(what, sizeof what, "exited, restarting in %u ms", sv->backoff_ms);
+    svc_say(sv, what);
+}
 
-    for (;;) {
-        if (g_got_sigchld) reap_children_nonblock();
+static void svc_spawn(int idx) {
+    Service *sv = &g_svc[idx];
 
-        print_prompt();
+    char args[sizeof sv->cmd];
+    snprintf(args, sizeof args, "%s", sv->cmd);
+    const char *argv[SVC_MAX_ARGS + 1];
+    int argc = split_args(args, argv, SVC_MAX_ARGS);
 
-        if (!fgets(line, sizeof line, stdin)) {
-            sleep(1);
-            continue;
-        }
+    char path[PATH_MAX];
+    if (argc == 0 || dos_to_linux_path(argv[0], path, sizeof path) != 0) {
+        sv->state = SVC_FAILED;
+        svc_say(sv, "Bad command or file name");
+        return;
+    }
+    if (!file_exists_regular(path) && !strchr(dos_basename(argv[0]), '.'))
+        strncat(path, ".COM64", sizeof path - strlen(path) - 1);
+    if (!file_exists_regular(path)) {
+        sv->state = SVC_FAILED;
+        svc_say(sv, "Bad command or file name");
+        return;
+    }
 
-        line[strcspn(line, "\r\n")] = 0;
-        if (line[0] == 0) continue;
+    if (sv->starts == 0 && sv->ready_mode == SVC_READY_FILE) unlink(sv->ready_path); // stale from last boot
 
-        if (is_cmd(line, "help")) {
-            const char *msg =
-                "Built-ins (use /? after a command for help):\n"
-                "  HELP  VER  CLS  COLOR  ECHO  PAUSE  EXIT\n"
-                "  CD    DIR  TYPE\n"
-                "  DEL/ERASE   REN/RENAME\n"
-                "  MD/MKDIR    RD/RMDIR\n"
-                "  COPY (also: COPY CON file)\n"
-                "  POWEROFF\n";
-            (void)write(1, msg, strlen(msg));
-            continue;
-        }
+    pid_t pid;
+    if (program_kind(path) == PROG_COM64) {
+        con_flush();
+        pid = fork();
+        if (pid == 0) {
+            ev_child_unblock();
+            setsid(); // keep console signals aimed at the shell away from services
+            int nul = open("/dev/null", O_RDONLY);
+            if (nul >= 0) { dup2(nul, 0); if (nul > 0) close(nul); }
 
-        if (is_cmd(line, "ver")) {
-            (void)write(1, "DOS-modern 0.0.1\n", 17);
-            continue;
+            int rc = run_com64_hostpath(path, argc, argv);
+            _exit(rc < 0 ? 127 : (rc & 0xFF));
         }
+    } else {
+        pid = spawn_native(path, argv, 1);
+    }
 
-        if (is_cmd(line, "cls")) {
-            builtin_cls();
-            continue;
-        }
+    if (pid < 0) {
+        sv->state = SVC_BACKOFF;
+        sv->backoff_ms = SVC_BACKOFF_MAX_MS;
+        sv->retry_ns = mono_ns() + (uint64_t)SVC_BACKOFF_MAX_MS * 1000000ull;
+        return;
+    }
 
-        if (is_cmd(line, "color")) {
-            char *arg = line + 5;
-            while (*arg == ' ' || *arg == '\t') arg++;
-            builtin_color(*arg ? arg : 0);
-            continue;
-        }
+    sv->pid = pid;
+    sv->state = SVC_RUNNING;
+    sv->started_ns = mono_ns();
+    if (sv->starts++ == 0) svc_mark(sv, "started");
+    (void)ev_watch_child(pid, svc_on_exit, (void *)(intptr_t)idx);
 
-        if (is_cmd(line, "echo")) {
-            char *arg = line + 4;
-            while (*arg == ' ' || *arg == '\t') arg++;
-            builtin_echo(*arg ? arg : 0);
-            continue;
-        }
+    if (sv->ready_mode == SVC_READY_START) svc_set_ready(sv);
+}
 
-        if (is_cmd(line, "pause")) {
-            builtin_pause();
-            continue;
-        }
+static int svc_deps_ready(const Service *sv) {
+    for (int d = 0; d < sv->ndeps; d++) {
+        if (sv->deps[d] < 0 || !g_svc[sv->deps[d]].was_ready) return 0;
+    }
+    return 1;
+}
 
-        if (is_cmd(line, "exit")) {
-            builtin_exit();
-            continue;
-        }
+/* Start everything that is waiting and unblocked. Recursion through
+   svc_set_ready() is bounded: each service leaves SVC_WAITING once. */
+static void svc_schedule(void) {
+    for (int i = 0; i < g_svc_n; i++) {
+        if (g_svc[i].state == SVC_WAITING && svc_deps_ready(&g_svc[i])) svc_spawn(i);
+    }
+}
 
-        if (is_cmd(line, "poweroff")) {
-            do_poweroff();
-            continue;
+static void svc_tick(void) {
+    uint64_t now = mono_ns();
+    for (int i = 0; i < g_svc_n; i++) {
+        Service *sv = &g_svc[i];
+        if (sv->state == SVC_BACKOFF && now >= sv->retry_ns) {
+            svc_spawn(i);
+        } else if (sv->state == SVC_RUNNING && sv->ready_mode == SVC_READY_FILE && !sv->was_ready &&
+                   access(sv->ready_path, F_OK) == 0) {
+            svc_set_ready(sv);
         }
+    }
+}
 
-        if (is_cmd(line, "cd")) {
-            char *arg = line + 2;
-            while (*arg == ' ' || *arg == '\t') arg++;
-            builtin_cd(*arg ? arg : 0);
-            continue;
-        }
+static void svc_start_all(void) {
+    svc_load();
+    if (g_svc_n == 0) return;
 
-        if (is_cmd(line, "dir")) {
-            char *arg = line + 3;
-            while (*arg == ' ' || *arg == '\t') arg++;
-            builtin_dir(*arg ? arg : 0);
-            continue;
-        }
+    early_init_wait(); // services may want /dev and /proc
+    boot_mark("AUTOEXEC.SVC loaded");
+    ev_on_tick(svc_tick);
+    svc_schedule();
+}
 
-        if (is_cmd(line, "type")) {
-            char *arg = line + 4;
-            while (*arg == ' ' || *arg == '\t') arg++;
-            builtin_type(*arg ? arg : 0);
-            continue;
+/* --- shutdown ---
+   POWEROFF runs in four phases, each with its own deadline, so a program
+   that ignores SIGTERM or a disk that is slow to flush can delay power-off
+   by at most SHUT_TERM_MS + SHUT_KILL_MS + SHUT_SYNC_MS + SHUT_RO_MS:
+
+     TERM  every process gets SIGTERM (and SIGCONT, should it be stopped)
+           and is reaped as it exits
+     KILL  whatever is left gets SIGKILL
+     SYNC  each disk filesystem is flushed by syncfs() on a thread of its
+           own, so one slow device does not hold up the others
+     RO    each is remounted read-only, which also settles its journal
+
+   A filesystem still flushing at the deadline is left out of the rest and
+   named on the console. Exits are reaped here rather than passed to the
+   child watchers, so no service is restarted. The phase times are shown
+   and written to C:\SHUTDOWN.LOG just before the remount. The log is
+   flushed with fdatasync() on a thread of its own, and the time it takes
+   comes out of RO's deadline, so the bound above still holds. */
+
+#define SHUT_TERM_MS  2000
+#define SHUT_KILL_MS  1000
+#define SHUT_SYNC_MS  5000
+#define SHUT_RO_MS    2000
+#define SHUT_MAX_FS   64
+#define SHUT_LOG_NAME "SHUTDOWN.LOG"
+
+enum { SHUT_SYNC, SHUT_RO };
+
+typedef struct ShutFs {
+    char     dir[256];
+    char     type[32];
+    int      op;    // what its thread is doing
+    int      busy;  // still doing it (under g_shut_lock)
+    int      err;   // errno of the last op, 0 if it worked
+} ShutFs;
+
+static ShutFs          g_shut_fs[SHUT_MAX_FS];
+static int             g_shut_nfs = 0;
+static int             g_shut_busy[2];     // threads still running, per op
+static pthread_mutex_t g_shut_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  g_shut_cond;
+static char            g_shut_log[4096];
+static size_t          g_shut_log_len = 0;
+static size_t          g_shut_log_out = 0;  // bytes the log thread writes
+static int             g_shut_log_busy = 0; // log thread still running (under g_shut_lock)
+
+/* One line to the console and the log */
+static void shut_say(const char *line) {
+    size_t n = strlen(line);
+    if (n < sizeof g_shut_log - g_shut_log_len) {
+        memcpy(g_shut_log + g_shut_log_len, line, n);
+        g_shut_log_len += n;
+    }
+    con_write(line, n);
+    con_flush();
+}
+
+static double shut_ms(uint64_t since) {
+    return (double)(stat_clock_ns() - since) / 1e6;
+}
+
+/* Reap until no child is left (returns 1) or the deadline passes (0) */
+static int shut_reap(uint64_t deadline, int *reaped) {
+    for (;;) {
+        int status;
+        pid_t p;
+        while ((p = waitpid(-1, &status, WNOHANG)) > 0) (*reaped)++;
+        if (p < 0 && errno == ECHILD) return 1;
+
+        uint64_t now = stat_clock_ns();
+        if (now >= deadline) return 0;
+        int ms = (int)((deadline - now + 999999) / 1000000);
+        struct pollfd pf = { g_sigfd, POLLIN, 0 };
+        (void)poll(&pf, 1, g_sigfd >= 0 ? ms : (ms < 10 ? ms : 10));
+        if (g_sigfd >= 0) {
+            struct signalfd_siginfo si;
+            while (read(g_sigfd, &si, sizeof si) == (ssize_t)sizeof si) { }
         }
+    }
+}
 
-        if (is_cmd(line, "del") || is_cmd(line, "erase")) {
-            char *arg = line + (tolower((unsigned char)line[0]) == 'd' ? 3 : 5);
-            while (*arg == ' ' || *arg == '\t') arg++;
-            builtin_del(*arg ? arg : 0);
-            continue;
+/* TERM, then KILL for whatever ignored it */
+static void shut_signal_all(int sig, unsigned ms) {
+    uint64_t t0 = stat_clock_ns();
+    int reaped = 0, gone = 1;
+    const char *name = sig == SIGKILL ? "KILL" : "TERM";
+    if (kill(-1, sig) == 0) { // -1: every process but PID 1
+        if (sig != SIGKILL) (void)kill(-1, SIGCONT);
+        gone = shut_reap(t0 + (uint64_t)ms * 1000000ull, &reaped);
+    } else {
+        shut_reap(t0, &reaped); // ESRCH: nothing is running
+    }
+
+    char line[128];
+    snprintf(line, sizeof line, "%-5s %8.1f ms  %d process(es) ended%s\n", name, shut_ms(t0), reaped,
+             gone ? "" : sig == SIGKILL ? ", some are stuck in the kernel" : ", some are still running");
+    shut_say(line);
+    if (!gone && sig != SIGKILL) shut_signal_all(SIGKILL, SHUT_KILL_MS);
+}
+
+/* Memory-backed and kernel filesystems have nothing to flush */
+static int shut_fs_wanted(const char *type, const char *opts) {
+    static const char *const skip[] = {
+        "proc", "sysfs", "devtmpfs", "devpts", "tmpfs", "ramfs", "rootfs", "cgroup", "cgroup2",
+        "securityfs", "debugfs", "tracefs", "pstore", "bpf", "mqueue", "hugetlbfs", "configfs",
+        "fusectl", "autofs", "binfmt_misc", "efivarfs", "nsfs",
+    };
+    for (size_t i = 0; i < sizeof skip / sizeof skip[0]; i++)
+        if (!strcmp(type, skip[i])) return 0;
+    return strcmp(opts, "ro") != 0 && strncmp(opts, "ro,", 3) != 0; // read-only already
+}
+
+/* /proc/self/mounts writes ' ', '\t', '\n' and '\\' as octal escapes */
+static void shut_unescape(char *s) {
+    char *o = s;
+    for (; *s; s++) {
+        if (s[0] == '\\' && s[1] >= '0' && s[1] <= '3' && s[2] >= '0' && s[2] <= '7' && s[3] >= '0' && s[3] <= '7') {
+            *o++ = (char)((s[1] - '0') * 64 + (s[2] - '0') * 8 + (s[3] - '0'));
+            s += 3;
+        } else {
+            *o++ = *s;
         }
+    }
+    *o = 0;
+}
+
+static void shut_list_fs(void) {
+    FILE *f = fopen("/proc/self/mounts", "re");
+    char line[1024];
+    while (f && g_shut_nfs < SHUT_MAX_FS && fgets(line, sizeof line, f)) {
+        char *save = NULL;
+        char *src = strtok_r(line, " ", &save);
+        char *dir = strtok_r(NULL, " ", &save);
+        char *type = strtok_r(NULL, " ", &save);
+        char *opts = strtok_r(NULL, " ", &save);
+        if (!src || !dir || !type || !opts || !shut_fs_wanted(type, opts)) continue;
+        shut_unescape(dir);
+        if (strlen(dir) >= sizeof g_shut_fs[0].dir) continue;
+
+        ShutFs *s = &g_shut_fs[g_shut_nfs++];
+        snprintf(s->dir, sizeof s->dir, "%s", dir);
+        snprintf(s->type, sizeof s->type, "%s", type);
+    }
+    if (f) fclose(f);
+    if (!f && g_shut_nfs == 0) { // no /proc: flush the root at least
+        snprintf(g_shut_fs[0].dir, sizeof g_shut_fs[0].dir, "/");
+        snprintf(g_shut_fs[0].type, sizeof g_shut_fs[0].type, "?");
+        g_shut_nfs = 1;
+    }
+}
 
-        if (is_cmd(line, "ren") || is_cmd(line, "rename")) {
-            char *arg = line + (tolower((unsigned char)line[0]) == 'r' && tolower((unsigned char)line[1]) == 'e' ? 3 : 6);
-            while (*arg == ' ' || *arg == '\t') arg++;
-            builtin_ren(*arg ? arg : 0);
+static void *shut_fs_thread(void *arg) {
+    ShutFs *s = (ShutFs *)arg;
+    int err = 0;
+    if (s->op == SHUT_SYNC) {
+        int fd = open(s->dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0 || syncfs(fd) != 0) err = errno;
+        if (fd >= 0) close(fd);
+    } else if (mount(NULL, s->dir, NULL, MS_REMOUNT | MS_RDONLY, NULL) != 0) {
+        err = errno;
+    }
+
+    pthread_mutex_lock(&g_shut_lock);
+    s->err = err;
+    s->busy = 0;
+    g_shut_busy[s->op]--;
+    pthread_cond_signal(&g_shut_cond);
+    pthread_mutex_unlock(&g_shut_lock);
+    return NULL;
+}
+
+/* Run op on every filesystem at once and wait for all of them, or for the
+   deadline. Threads that miss it are left behind; power-off ends them. */
+static void shut_fs_phase(int op, unsigned ms) {
+    uint64_t t0 = stat_clock_ns();
+    uint64_t deadline = t0 + (uint64_t)ms * 1000000ull;
+    const char *name = op == SHUT_SYNC ? "SYNC" : "RO";
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setstacksize(&attr, 64 * 1024);
+
+    int started = 0;
+    for (int i = 0; i < g_shut_nfs; i++) {
+        ShutFs *s = &g_shut_fs[i];
+        pthread_mutex_lock(&g_shut_lock);
+        int busy = s->busy; // still flushing from SYNC: a remount would only queue behind it
+        if (!busy) {
+            s->op = op;
+            s->busy = 1;
+            g_shut_busy[op]++;
+        }
+        pthread_mutex_unlock(&g_shut_lock);
+        if (busy) continue;
+
+        pthread_t tid;
+        if (pthread_create(&tid, &attr, shut_fs_thread, s) != 0) {
+            pthread_mutex_lock(&g_shut_lock);
+            s->busy = 0;
+            s->err = EAGAIN;
+            g_shut_busy[op]--;
+            pthread_mutex_unlock(&g_shut_lock);
             continue;
         }
-
-        if (is_cmd(line, "md") || is_cmd(line, "mkdir")) {
-            char *arg = line + (tolower((unsigned char)line[1]) == 'd' ? 2 : 5);
-            while (*arg == ' ' || *arg == '\t') arg++;
-            builtin_md(*arg ? arg : 0);
+        started++;
+    }
+    pthread_attr_destroy(&attr);
+
+    struct timespec abs = { (time_t)(deadline / 1000000000ull), (long)(deadline % 1000000000ull) };
+    pthread_mutex_lock(&g_shut_lock);
+    while (g_shut_busy[op] > 0 && pthread_cond_timedwait(&g_shut_cond, &g_shut_lock, &abs) != ETIMEDOUT) { }
+    int late = g_shut_busy[op];
+    char line[PATH_MAX + 96];
+    snprintf(line, sizeof line, "%-5s %8.1f ms  %d filesystem(s)%s\n", name, shut_ms(t0), started,
+             late ? ", deadline passed" : "");
+    shut_say(line);
+    for (int i = 0; i < g_shut_nfs; i++) {
+        const ShutFs *s = &g_shut_fs[i];
+        if (s->busy && s->op == op) {
+            snprintf(line, sizeof line, "      %s (%s): still %s, left as is\n", s->dir, s->type,
+                     op == SHUT_SYNC ? "flushing" : "remounting");
+        } else if (s->busy) {
+            snprintf(line, sizeof line, "      %s (%s): skipped\n", s->dir, s->type);
+        } else if (s->err && s->op == op) {
+            snprintf(line, sizeof line, "      %s (%s): %s\n", s->dir, s->type, strerror(s->err));
+        } else {
             continue;
         }
+        shut_say(line);
+    }
+    pthread_mutex_unlock(&g_shut_lock);
+}
 
-        if (is_cmd(line, "rd") || is_cmd(line, "rmdir")) {
-            char *arg = line + (tolower((unsigned char)line[1]) == 'd' ? 2 : 5);
-            while (*arg == ' ' || *arg == '\t') arg++;
-            builtin_rd(*arg ? arg : 0);
-            continue;
+static void *shut_log_thread(void *arg) {
+    const char *path = (const char *)arg;
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+        (void)write(fd, g_shut_log, g_shut_log_out); // shut_say() only appends past this
+        (void)fdatasync(fd);
+        close(fd);
+    }
+
+    pthread_mutex_lock(&g_shut_lock);
+    g_shut_log_busy = 0;
+    pthread_cond_signal(&g_shut_cond);
+    pthread_mutex_unlock(&g_shut_lock);
+    return NULL;
+}
+
+/* The log goes on C: unless C:'s filesystem is the one that is stuck.
+   Waits for it to reach the disk until the deadline, then moves on. */
+static void shut_write_log(uint64_t deadline) {
+    static char path[PATH_MAX]; // outlives a late log thread
+    const ShutFs *home = NULL;
+    size_t best = 0;
+    for (int i = 0; i < g_shut_nfs; i++) {
+        const ShutFs *s = &g_shut_fs[i];
+        size_t n = strlen(s->dir);
+        if ((!strcmp(s->dir, "/") || path_under(g_c_root, s->dir)) && n >= best) { home = s; best = n; }
+    }
+    pthread_mutex_lock(&g_shut_lock);
+    int stuck = home && home->busy;
+    pthread_mutex_unlock(&g_shut_lock);
+    if (stuck) return;
+
+    snprintf(path, sizeof path, "%s/" SHUT_LOG_NAME, g_c_root);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setstacksize(&attr, 64 * 1024);
+    g_shut_log_out = g_shut_log_len;
+    g_shut_log_busy = 1;
+    pthread_t tid;
+    int rc = pthread_create(&tid, &attr, shut_log_thread, path);
+    pthread_attr_destroy(&attr);
+    if (rc != 0) { g_shut_log_busy = 0; return; }
+
+    struct timespec abs = { (time_t)(deadline / 1000000000ull), (long)(deadline % 1000000000ull) };
+    pthread_mutex_lock(&g_shut_lock);
+    while (g_shut_log_busy && pthread_cond_timedwait(&g_shut_cond, &g_shut_lock, &abs) != ETIMEDOUT) { }
+    int late = g_shut_log_busy;
+    pthread_mutex_unlock(&g_shut_lock);
+    if (late) shut_say("      C:\\" SHUT_LOG_NAME ": still writing, left as is\n");
+}
+
+/* Everything POWEROFF does between the prompt and reboot() */
+static void shutdown_run(void) {
+    uint64_t t0 = stat_clock_ns();
+    pthread_condattr_t ca;
+    pthread_condattr_init(&ca);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_cond_init(&g_shut_cond, &ca);
+    pthread_condattr_destroy(&ca);
+
+    char line[96];
+    snprintf(line, sizeof line, "Shutting down after %.1f s up\n", (double)boottime_ns() / 1e9);
+    shut_say(line);
+
+    shut_signal_all(SIGTERM, SHUT_TERM_MS);
+    shut_list_fs();
+    shut_fs_phase(SHUT_SYNC, SHUT_SYNC_MS);
+    snprintf(line, sizeof line, "%-5s %8.1f ms  so far\n", "", shut_ms(t0));
+    shut_say(line);
+    uint64_t ro_end = stat_clock_ns() + (uint64_t)SHUT_RO_MS * 1000000ull;
+    shut_write_log(ro_end);
+    uint64_t now = stat_clock_ns();
+    shut_fs_phase(SHUT_RO, now < ro_end ? (unsigned)((ro_end - now) / 1000000ull) : 0);
+
+    snprintf(line, sizeof line, "%-5s %8.1f ms  total\n", "", shut_ms(t0));
+    con_write(line, strlen(line));
+    con_flush();
+}
+
+/* --- command dispatch --- */
+
+static void run_command(char *line) {
+    if (is_cmd(line, "help")) {
+        const char *msg =
+            "Built-ins (use /? after a command for help):\n"
+            "  HELP  VER  CLS  COLOR  ECHO  PAUSE  EXIT\n"
+            "  CD    DIR  TYPE  EDIT\n"
+            "  DEL/ERASE   REN/RENAME\n"
+            "  MD/MKDIR    RD/RMDIR\n"
+            "  COPY (also: COPY CON file)  CRC\n"
+            "  FC    COMP  SORT  IOSTAT  BOOTLOG  START\n"
+            "  CACHE/SMARTDRV  CHKDSK/DU  STATS  PERFSTAT\n"
+            "  POWEROFF    D: (switch drive)\n";
+        con_write(msg, strlen(msg));
+        return;
+    }
+
+    int drive = drive_prefix(line);
+    if (drive >= 0 && line[2 + strspn(line + 2, " \t")] == 0) {
+        if (drive_switch(drive) != 0) con_error("Invalid drive specification\n", 28);
+        return;
+    }
+
+    if (is_cmd(line, "ver")) {
+        con_write("DOS-modern 0.0.1\n", 17);
+        return;
+    }
+
+    if (is_cmd(line, "iostat")) {
+        char *arg = line + 6;
+        while (*arg == ' ' || *arg == '\t') arg++;
+        builtin_iostat(*arg ? arg : 0);
+        return;
+    }
+
+    if (is_cmd(line, "bootlog")) {
+        char *arg = line + 7;
+        while (*arg == ' ' || *arg == '\t') arg++;
+        builtin_bootlog(*arg ? arg : 0);
+        return;
+    }
+
+    if (is_cmd(line, "perfstat")) {
+        char *arg = line + 8;
+        while (*arg == ' ' || *arg == '\t') arg++;
+        builtin_perfstat(*arg ? arg : 0);
+        return;
+    }
+
+    if (is_cmd(line, "stats")) {
+        char *arg = line + 5;
+        while (*arg == ' ' || *arg == '\t') arg++;
+        builtin_stats(*arg ? arg : 0);
+        return;
+    }
+
+    if (is_cmd(line, "cls")) {
+        builtin_cls();
+        return;
+    }
+
+    if (is_cmd(line, "color")) {
+        char *arg = line + 5;
+        while (*arg == ' ' || *arg == '\t') arg++;
+        builtin_color(*arg ? arg : 0);
+        return;
+    }
+
+    if (is_cmd(line, "echo")) {
+        char *arg = line + 4;
+        while (*arg == ' ' || *arg == '\t') arg++;
+        builtin_echo(*arg ? arg : 0);
+        return;
+    }
+
+    if (is_cmd(line, "pause")) {
+        builtin_pause();
+        return;
+    }
+
+    if (is_cmd(line, "exit")) {
+        builtin_exit();
+        return;
+    }
+
+    if (is_cmd(line, "poweroff")) {
+        do_poweroff();
+        return;
+    }
+
+    if (is_cmd(line, "cd")) {
+        char *arg = line + 2;
+        while (*arg == ' ' || *arg == '\t') arg++;
+        builtin_cd(*arg ? arg : 0);
+        return;
+    }
+
+    if (is_cmd(line, "dir")) {
+        char *arg = line + 3;
+        while (*arg == ' ' || *arg == '\t') arg++;
+        builtin_dir(*arg ? arg : 0);
+        return;
+    }
+
+    if (is_cmd(line, "type")) {
+        char *arg = line + 4;
+        while (*arg == ' ' || *arg == '\t') arg++;
+        builtin_type(*arg ? arg : 0);
+        return;
+    }
+
+    if (is_cmd(line, "del") || is_cmd(line, "erase")) {
+        char *arg = line + (tolower((unsigned char)line[0]) == 'd' ? 3 : 5);
+        while (*arg == ' ' || *arg == '\t') arg++;
+        builtin_del(*arg ? arg : 0);
+        return;
+    }
+
+    if (is_cmd(line, "ren") || is_cmd(line, "rename")) {
+        char *arg = line + (tolower((unsigned char)line[0]) == 'r' && tolower((unsigned char)line[1]) == 'e' ? 3 : 6);
+        while (*arg == ' ' || *arg == '\t') arg++;
+        builtin_ren(*arg ? arg : 0);
+        return;
+    }
+
+    if (is_cmd(line, "md") || is_cmd(line, "mkdir")) {
+        char *arg = line + (tolower((unsigned char)line[1]) == 'd' ? 2 : 5);
+        while (*arg == ' ' || *arg == '\t') arg++;
+        builtin_md(*arg ? arg : 0);
+        return;
+    }
+
+    if (is_cmd(line, "rd") || is_cmd(line, "rmdir")) {
+        char *arg = line + (tolower((unsigned char)line[1]) == 'd' ? 2 : 5);
+        while (*arg == ' ' || *arg == '\t') arg++;
+        builtin_rd(*arg ? arg : 0);
+        return;
+    }
+
+    if (is_cmd(line, "copy")) {
+        char *arg = line + 4;
+        while (*arg == ' ' || *arg == '\t') arg++;
+
+        // COPY CON filename
+        if (arg[0] &&
+            tolower((unsigned char)arg[0]) == 'c' &&
+            tolower((unsigned char)arg[1]) == 'o' &&
+            tolower((unsigned char)arg[2]) == 'n' &&
+            (arg[3] == 0 || arg[3] == ' ' || arg[3] == '\t')) {
+
+            char *dst = arg + 3;
+            while (*dst == ' ' || *dst == '\t') dst++;
+            builtin_copy_con(*dst ? dst : 0);
+            return;
         }
 
-        if (is_cmd(line, "copy")) {
-            char *arg = line + 4;
-            while (*arg == ' ' || *arg == '\t') arg++;
+        builtin_copy(*arg ? arg : 0);
+        return;
+    }
+
+    if (is_cmd(line, "crc")) {
+        char *arg = line + 3;
+        while (*arg == ' ' || *arg == '\t') arg++;
+        builtin_crc(*arg ? arg : 0);
+        return;
+    }
 
-            // COPY CON filename
-            if (arg[0] &&
-                tolower((unsigned char)arg[0]) == 'c' &&
-                tolower((unsigned char)arg[1]) == 'o' &&
-                tolower((unsigned char)arg[2]) == 'n' &&
-                (arg[3] == 0 || arg[3] == ' ' || arg[3] == '\t')) {
+    if (is_cmd(line, "fc")) {
+        char *arg = line + 2;
+        while (*arg == ' ' || *arg == '\t') arg++;
+        builtin_fc(*arg ? arg : 0);
+        return;
+    }
 
-                char *dst = arg + 3;
-                while (*dst == ' ' || *dst == '\t') dst++;
-                builtin_copy_con(*dst ? dst : 0);
-                continue;
+    if (is_cmd(line, "comp")) {
+        char *arg = line + 4;
+        while (*arg == ' ' || *arg == '\t') arg++;
+        builtin_comp(*arg ? arg : 0);
+        return;
+    }
+
+    if (is_cmd(line, "sort")) {
+        char *arg = line + 4;
+        while (*arg == ' ' || *arg == '\t') arg++;
+        builtin_sort(*arg ? arg : 0);
+        return;
+    }
+
+    if (is_cmd(line, "cache") || is_cmd(line, "smartdrv")) {
+        char *arg = line + (tolower((unsigned char)line[0]) == 'c' ? 5 : 8);
+        while (*arg == ' ' || *arg == '\t') arg++;
+        builtin_cache(*arg ? arg : 0);
+        return;
+    }
+
+    if (is_cmd(line, "edit")) {
+        char *arg = line + 4;
+        while (*arg == ' ' || *arg == '\t') arg++;
+        builtin_edit(*arg ? arg : 0);
+        return;
+    }
+
+    if (is_cmd(line, "chkdsk") || is_cmd(line, "du")) {
+        char *arg = line + (tolower((unsigned char)line[0]) == 'c' ? 6 : 2);
+        while (*arg == ' ' || *arg == '\t') arg++;
+        builtin_chkdsk(*arg ? arg : 0);
+        return;
+    }
+
+    if (is_cmd(line, "start")) {
+        char *arg = line + 5;
+        while (*arg == ' ' || *arg == '\t') arg++;
+        builtin_start(*arg ? arg : 0);
+        return;
+    }
+
+    if (try_run_external_com64(line, 0)) {
+        return;
+    }
+
+    stat_unknown();
+    con_error("Bad command or file name\n", 25);
+}
+
+/* --- main --- */
+
+/* As PID 1 there are no arguments worth honouring. Run any other way
+   (or with --host) the shell is a plain host program for testing and
+   benchmarks:
+     --root DIR     use DIR as C:\ instead of DOS_C_ROOT
+     --script FILE  read commands from FILE, exit at its end */
+static void parse_args(int argc, char **argv) {
+    g_host = (getpid() != 1);
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--host")) {
+            g_host = 1;
+        } else if (!strcmp(argv[i], "--root") && i + 1 < argc) {
+            if (realpath(argv[++i], g_c_root) == NULL) snprintf(g_c_root, sizeof g_c_root, "%s", argv[i]);
+        } else if (!strcmp(argv[i], "--script") && i + 1 < argc) {
+            int fd = open(argv[++i], O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                fprintf(stderr, "%s: cannot open %s\n", argv[0], argv[i]);
+                exit(1);
             }
+            dup2(fd, 0);
+            close(fd);
+            g_script = 1;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    ev_block_signals();
+    boot_mark("init entered");
+    parse_args(argc, argv);
+
+    if (!g_host) {
+        setsid();
+        ensure_stdio();
+        boot_mark("stdio");
+
+        early_init_start();
+        mount_run_fs();
+        mkdir("/dos", 0755);
+    }
+
+    mkdir(g_c_root, 0755);
+    if (chdir(g_c_root) != 0 && g_host) {
+        fprintf(stderr, "%s: cannot use %s as C:\\\n", argv[0], g_c_root);
+        return 1;
+    }
+    boot_mark("C: ready");
+
+    load_config();
+    apply_color();
+    boot_mark("config loaded");
+    drives_init();
+
+    lib_refresh();
+    shm_registry_start();
+
+    ev_init();
+    ev_on_tick(boot_log_tick);
+    ev_on_tick(lib_refresh);
+    ev_on_tick(ra_tick);
+    ev_on_tick(stat_tick);
+
+    char line[1024];
+
+    con_write("\nDazLab 64-DOS 0.1\nDistributed under a MIT license\n", 52);
+    con_write("Type 'help' or 'poweroff'\n\n", 27);
+    print_prompt();
+    con_flush();
+
+    boot_mark("prompt");
+    boot_write_log();
+
+    svc_start_all();
+    con_flush();
+    ra_start();
 
-            builtin_copy(*arg ? arg : 0);
+    for (;;) {
+        struct pollfd pf[3];
+        pf[0].fd = g_con_in_eof ? -1 : 0;
+        pf[0].events = POLLIN;
+        pf[1].fd = g_sigfd;
+        pf[1].events = POLLIN;
+        pf[2].fd = g_timerfd;
+        pf[2].events = POLLIN;
+        pf[0].revents = pf[1].revents = pf[2].revents = 0;
+
+        if (poll(pf, 3, -1) < 0) {
+            if (errno == EINTR) continue;
+            sleep(1); // should not happen; don't spin if it does
             continue;
         }
 
-        if (try_run_external_com64(line)) {
-            continue;
+        if (pf[1].revents) ev_reap_children();
+        if (pf[2].revents) ev_run_tick();
+        con_flush(); // anything a hook printed
+
+        if (!pf[0].revents) continue;
+
+        ssize_t n = con_fill();
+        if (n == 0 || (n < 0 && errno != EAGAIN)) {
+            // A tty gives one EOF per Ctrl+D and then works again;
+            // a hung-up console or a closed pipe never does.
+            if (!isatty(0) || (pf[0].revents & (POLLHUP | POLLERR))) g_con_in_eof = 1;
+        }
+
+        while (con_take_line(line, sizeof line)) {
+            int ran = (line[0] != 0);
+            if (g_script && g_echo_on) {
+                con_write(line, strlen(line));
+                con_write("\n", 1);
+            }
+            if (ran) {
+                early_init_wait(); // builtins read /proc and /sys too
+                stat_begin(line);
+                run_command(line);
+                stat_end();
+            }
+            con_command_done(ran);
+            print_prompt();
+            con_flush();
         }
 
-        (void)write(1, "Bad command or file name\n", 25);
+        // Out of script or pipe input: nothing will ever come again
+        if (g_host && g_con_in_eof && !g_con_in_len) {
+            con_write("\n", 1);
+            do_poweroff();
+        }
     }
 }
-
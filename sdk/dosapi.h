@@ -0,0 +1,78 @@
+// dosapi.h - services the 64-DOS loader hands to a COM64 program
+//
+// A COM64 entry point is called as
+//
+//     int com64_main(DosApi* api, int argc, const char** argv);
+//
+// This layout must match the DosApi struct in init/init_shell.c. Services
+// are only ever appended, so a program built against an older header keeps
+// working on a newer loader.
+#ifndef DOSAPI_H
+#define DOSAPI_H
+
+#include <stddef.h>
+
+// Zero-initialise a group, spawn tasks into it, then task_wait() on it
+typedef struct DosTaskGroup {
+    int pending; // tasks spawned into the group and not yet finished
+} DosTaskGroup;
+
+typedef struct DosApi {
+    void (*print)(const char* s);
+
+    // Text screen: a character/attribute model repainted by diff.
+    // attr is DOS-style: background << 4 | foreground (0..15 each).
+    // scr_present() returns the number of bytes it sent to the console.
+    int      (*scr_open)(int* cols, int* rows);
+    void     (*scr_close)(void);
+    void     (*scr_put)(int x, int y, int ch, int attr);
+    void     (*scr_text)(int x, int y, const char* s, int attr);
+    void     (*scr_fill)(int x, int y, int w, int h, int ch, int attr);
+    void     (*scr_cursor)(int x, int y);
+    unsigned (*scr_present)(void);
+
+    // Heap, reserved on first use; no call makes a syscall except pool
+    // blocks above 2048 bytes, which get their own mapping. Blocks are
+    // 16-byte aligned and NULL means out of memory.
+    // arena_alloc() bumps a pointer. arena_release(mark) frees everything
+    // allocated since arena_mark() returned mark; arena_reset() frees all.
+    // Pool blocks are freed one at a time, with the size they were asked for.
+    void*    (*arena_alloc)(size_t n);
+    size_t   (*arena_mark)(void);
+    void     (*arena_release)(size_t mark);
+    void     (*arena_reset)(void);
+    void*    (*pool_alloc)(size_t n);
+    void     (*pool_free)(void* p, size_t n);
+
+    // Tasks. The first call starts one worker thread per CPU (the
+    // program's thread is one of them); task_workers() returns the count.
+    // Tasks go on the spawning thread's deque and idle workers steal them.
+    // task_wait() runs tasks itself until the group is empty, so tasks may
+    // spawn and wait too. The heap services are safe to call from tasks;
+    // the screen services are not.
+    // futex_wait() sleeps while *addr == expected (timeout_ms -1: no
+    // limit) and returns 1 on timeout; futex_wake() wakes up to n waiters.
+    // Both work across programs on words in a shared memory segment.
+    int      (*task_workers)(void);
+    void     (*task_spawn)(DosTaskGroup* g, void (*fn)(void* arg), void* arg);
+    void     (*task_wait)(DosTaskGroup* g);
+    int      (*futex_wait)(int* addr, int expected, int timeout_ms);
+    int      (*futex_wake)(int* addr, int n);
+
+    // Shared memory. A segment is named (up to 31 characters, case does
+    // not matter) and lives in init until shm_unlink(), so programs run
+    // one after another or side by side (START) all see the same pages.
+    // shm_open() maps it and stores its size in *size_out; size is only
+    // used when DOS_SHM_CREATE makes a new one. NULL on failure.
+    // sdk/rt's RtRing passes records through a segment without syscalls.
+    void*    (*shm_open)(const char* name, size_t size, int flags, size_t* size_out);
+    int      (*shm_close)(void* p);
+    int      (*shm_unlink)(const char* name);
+} DosApi;
+
+#define DOS_SHM_CREATE 0x1 // create the segment if it does not exist
+#define DOS_SHM_EXCL   0x2 // with CREATE: fail if it already exists
+
+typedef int (*Com64Entry)(DosApi* api, int argc, const char** argv);
+
+#endif
@@ -0,0 +1,118 @@
+// rt.h - freestanding runtime linked into every COM64 program
+//
+// build_init.sh links crt0.o first and the rt_*.o objects after the
+// program, with --gc-sections so only what is used ends up in the image.
+// crt0 calls rt_init() before com64_main(), so everything here is ready
+// when the program starts. The standard names (memcpy, memmove, memset,
+// memcmp, strlen, memchr, strcmp) are provided as well, so calls GCC emits
+// on its own also link.
+#ifndef RT_H
+#define RT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dosapi.h"
+
+// CPU features, found once by rt_init()
+#define RT_CPU_SSE2 0x1u // always set on x86-64
+#define RT_CPU_AVX2 0x2u // and the OS saves YMM state
+#define RT_CPU_ERMS 0x4u // fast rep movsb/stosb
+
+extern unsigned rt_cpu;
+extern DosApi*  rt_api; // the api com64_main was given
+
+void rt_init(DosApi* api);
+void rt_mem_select(unsigned cpu); // pick routines for a feature set (benchmarks)
+
+// Memory and strings: same contracts as the C library functions
+void*  rt_memcpy(void* dst, const void* src, size_t n);
+void*  rt_memmove(void* dst, const void* src, size_t n);
+void*  rt_memset(void* dst, int c, size_t n);
+int    rt_memcmp(const void* a, const void* b, size_t n);
+void*  rt_memchr(const void* s, int c, size_t n);
+size_t rt_strlen(const char* s);
+int    rt_strcmp(const char* a, const char* b);
+
+// The same under their usual names (rt_libc.c)
+void*  memcpy(void* dst, const void* src, size_t n);
+void*  memmove(void* dst, const void* src, size_t n);
+void*  memset(void* dst, int c, size_t n);
+int    memcmp(const void* a, const void* b, size_t n);
+void*  memchr(const void* s, int c, size_t n);
+size_t strlen(const char* s);
+int    strcmp(const char* a, const char* b);
+
+// Atomics on int and uint64_t (compiler builtins; nothing to link).
+// Loads acquire, stores release, read-modify-writes are sequentially
+// consistent. rt_atomic_add returns the new value; rt_atomic_cas returns
+// 1 if *p held expected and now holds desired.
+static inline int rt_atomic_load(const int* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+static inline void rt_atomic_store(int* p, int v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+static inline int rt_atomic_add(int* p, int v) { return __atomic_add_fetch(p, v, __ATOMIC_SEQ_CST); }
+static inline int rt_atomic_cas(int* p, int expected, int desired) {
+    return __atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+static inline uint64_t rt_atomic_add64(uint64_t* p, uint64_t v) { return __atomic_add_fetch(p, v, __ATOMIC_SEQ_CST); }
+static inline void rt_pause(void) { __builtin_ia32_pause(); }
+
+// Single-producer/single-consumer ring of variable-length records, laid
+// out in memory both sides map (usually a shared memory segment). One
+// side formats it with rt_ring_init(), the other checks it with
+// rt_ring_attach(). Push and pop touch only the ring; the _wait forms
+// sleep on a futex when it is full or empty, and the other side wakes
+// them only if they are actually asleep. A record may be at most a
+// quarter of the ring.
+typedef struct RtRing {
+    uint32_t magic;
+    uint32_t cap;             // data bytes, a power of two
+    uint8_t  pad0[56];
+    uint64_t head;            // producer: bytes written
+    uint64_t tail_seen;       // producer's last look at tail
+    int      prod_waiting;
+    uint8_t  pad1[44];
+    uint64_t tail;            // consumer: bytes read
+    uint64_t head_seen;       // consumer's last look at head
+    int      cons_waiting;
+    uint8_t  pad2[44];
+    uint8_t  data[];
+} RtRing;
+
+RtRing* rt_ring_init(void* mem, size_t bytes);                 // NULL if too small
+RtRing* rt_ring_attach(void* mem);                             // NULL if not a ring
+int     rt_ring_push(RtRing* r, const void* rec, uint32_t n);  // 1 pushed, 0 full, -1 too big
+long    rt_ring_pop(RtRing* r, void* buf, uint32_t max);       // length, -1 empty; > max: left queued
+int     rt_ring_push_wait(RtRing* r, const void* rec, uint32_t n);
+long    rt_ring_pop_wait(RtRing* r, void* buf, uint32_t max);
+
+// CLOCK_MONOTONIC in nanoseconds
+uint64_t rt_clock_ns(void);
+
+// Number formatting. Each writes at most RT_FMT_MAX bytes, no terminator,
+// and returns the length written.
+#define RT_FMT_MAX 40 // "-18446744073709551615.000000000000000" is 37
+
+size_t rt_fmt_u64(char* out, uint64_t v);
+size_t rt_fmt_i64(char* out, int64_t v);
+size_t rt_fmt_hex(char* out, uint64_t v, int digits); // digits 0: as many as needed
+size_t rt_fmt_f64(char* out, double v, int prec);     // fixed, prec 0..15; e-notation beyond 2^64
+
+// Buffered output: collects text and hands it to api->print in pieces of
+// up to sizeof buf - 1 bytes, instead of one print call per fragment.
+typedef struct RtOut {
+    DosApi*  api;
+    unsigned n;
+    char     buf[256];
+} RtOut;
+
+void rt_out_init(RtOut* o, DosApi* api);
+void rt_out_mem(RtOut* o, const char* s, size_t n);
+void rt_out_str(RtOut* o, const char* s);
+void rt_out_char(RtOut* o, char c);
+void rt_out_u64(RtOut* o, uint64_t v);
+void rt_out_i64(RtOut* o, int64_t v);
+void rt_out_hex(RtOut* o, uint64_t v, int digits);
+void rt_out_f64(RtOut* o, double v, int prec);
+void rt_out_flush(RtOut* o);
+
+#endif
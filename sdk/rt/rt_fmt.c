@@ -0,0 +1,159 @@
+// rt_fmt.c - number formatting and buffered output through DosApi.print
+#include "rt.h"
+
+static const char digits2[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static const double pow10[16] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+};
+
+// 10^(2^k), for building any power of ten with at most nine roundings
+static const long double pow10_bin[9] = { 1e1L, 1e2L, 1e4L, 1e8L, 1e16L, 1e32L, 1e64L, 1e128L, 1e256L };
+
+// Two digits per division, written backwards into the end of a 20-byte
+// scratch area, then moved to the front
+size_t rt_fmt_u64(char* out, uint64_t v) {
+    char tmp[20];
+    int i = 20;
+    while (v >= 100) {
+        unsigned r = (unsigned)(v % 100);
+        v /= 100;
+        i -= 2;
+        tmp[i] = digits2[2 * r];
+        tmp[i + 1] = digits2[2 * r + 1];
+    }
+    if (v >= 10) {
+        i -= 2;
+        tmp[i] = digits2[2 * v];
+        tmp[i + 1] = digits2[2 * v + 1];
+    } else {
+        tmp[--i] = (char)('0' + v);
+    }
+
+    size_t n = (size_t)(20 - i);
+    for (size_t k = 0; k < n; k++) out[k] = tmp[i + k];
+    return n;
+}
+
+size_t rt_fmt_i64(char* out, int64_t v) {
+    if (v >= 0) return rt_fmt_u64(out, (uint64_t)v);
+    out[0] = '-';
+    return 1 + rt_fmt_u64(out + 1, 0 - (uint64_t)v);
+}
+
+size_t rt_fmt_hex(char* out, uint64_t v, int digits) {
+    int n = 1;
+    while (n < 16 && (v >> (4 * n))) n++;
+    if (digits > n) n = digits > 16 ? 16 : digits;
+    for (int k = n - 1; k >= 0; k--, v >>= 4) out[k] = "0123456789ABCDEF"[v & 15];
+    return (size_t)n;
+}
+
+// Zero-padded to exactly width digits
+static size_t fmt_u64_width(char* out, uint64_t v, int width) {
+    char tmp[20];
+    size_t n = rt_fmt_u64(tmp, v);
+    size_t k = 0;
+    for (; (int)(n + k) < width; k++) out[k] = '0';
+    for (size_t j = 0; j < n; j++) out[k + j] = tmp[j];
+    return n + k;
+}
+
+size_t rt_fmt_f64(char* out, double v, int prec) {
+    uint64_t bits;
+    __builtin_memcpy(&bits, &v, 8);
+    size_t j = 0;
+    if (bits >> 63) {
+        out[j++] = '-';
+        v = -v;
+    }
+    if (v != v) { out[0] = 'n'; out[1] = 'a'; out[2] = 'n'; return 3; }
+    if (v > 1.7976931348623157e308) { out[j] = 'i'; out[j + 1] = 'n'; out[j + 2] = 'f'; return j + 3; }
+    if (prec < 0) prec = 0;
+    if (prec > 15) prec = 15;
+
+    // Too big for the integer part to fit in 64 bits: d.ddde+NN. The
+    // largest power of ten not above v is built in extended precision and
+    // divided out once, so the digits carry one rounding, not one per /10.
+    int exp10 = 0;
+    if (v >= 18446744073709551616.0) {
+        long double p = 1.0L;
+        for (int k = 8; k >= 0; k--) {
+            if ((long double)v >= p * pow10_bin[k]) {
+                p *= pow10_bin[k];
+                exp10 += 1 << k;
+            }
+        }
+        v = (double)((long double)v / p);
+    }
+
+    uint64_t ip = (uint64_t)v;
+    uint64_t scale = (uint64_t)pow10[prec];
+    uint64_t frac = (uint64_t)((v - (double)ip) * pow10[prec] + 0.5);
+    if (frac >= scale) { ip++; frac -= scale; }
+    if (exp10 && ip >= 10) { ip /= 10; exp10++; } // 9.99.. rounded up to 10
+
+    j += rt_fmt_u64(out + j, ip);
+    if (prec) {
+        out[j++] = '.';
+        j += fmt_u64_width(out + j, frac, prec);
+    }
+    if (exp10) {
+        out[j++] = 'e';
+        out[j++] = '+';
+        j += rt_fmt_u64(out + j, (uint64_t)exp10);
+    }
+    return j;
+}
+
+/* --- buffered output --- */
+
+void rt_out_init(RtOut* o, DosApi* api) {
+    o->api = api;
+    o->n = 0;
+}
+
+void rt_out_flush(RtOut* o) {
+    if (!o->n) return;
+    o->buf[o->n] = 0;
+    o->api->print(o->buf);
+    o->n = 0;
+}
+
+void rt_out_mem(RtOut* o, const char* s, size_t n) {
+    while (n) {
+        size_t room = sizeof o->buf - 1 - o->n;
+        if (!room) {
+            rt_out_flush(o);
+            continue;
+        }
+        size_t k = n < room ? n : room;
+        rt_memcpy(o->buf + o->n, s, k);
+        o->n += (unsigned)k;
+        s += k;
+        n -= k;
+    }
+}
+
+void rt_out_str(RtOut* o, const char* s) {
+    rt_out_mem(o, s, rt_strlen(s));
+}
+
+void rt_out_char(RtOut* o, char c) {
+    if (o->n == sizeof o->buf - 1) rt_out_flush(o);
+    o->buf[o->n++] = c;
+}
+
+// Numbers are formatted in place when they fit, which is nearly always
+static char* out_room(RtOut* o) {
+    if (sizeof o->buf - 1 - o->n < RT_FMT_MAX) rt_out_flush(o);
+    return o->buf + o->n;
+}
+
+void rt_out_u64(RtOut* o, uint64_t v) { o->n += (unsigned)rt_fmt_u64(out_room(o), v); }
+void rt_out_i64(RtOut* o, int64_t v) { o->n += (unsigned)rt_fmt_i64(out_room(o), v); }
+void rt_out_hex(RtOut* o, uint64_t v, int digits) { o->n += (unsigned)rt_fmt_hex(out_room(o), v, digits); }
+void rt_out_f64(RtOut* o, double v, int prec) { o->n += (unsigned)rt_fmt_f64(out_room(o), v, prec); }
@@ -0,0 +1,46 @@
+// rt_init.c - runtime start-up: CPU feature detection, and the clock
+#include "rt.h"
+
+unsigned rt_cpu;
+DosApi*  rt_api;
+
+static void cpuid(unsigned leaf, unsigned sub, unsigned r[4]) {
+    __asm__ volatile("cpuid" : "=a"(r[0]), "=b"(r[1]), "=c"(r[2]), "=d"(r[3]) : "a"(leaf), "c"(sub));
+}
+
+static unsigned detect_cpu(void) {
+    unsigned cpu = RT_CPU_SSE2;
+    unsigned r[4];
+
+    cpuid(0, 0, r);
+    unsigned max_leaf = r[0];
+    if (max_leaf < 7) return cpu;
+
+    // AVX2 needs the CPU bit and the OS saving YMM state (OSXSAVE + XCR0)
+    cpuid(1, 0, r);
+    int osxsave = (r[2] >> 27) & 1;
+    int avx = (r[2] >> 28) & 1;
+    cpuid(7, 0, r);
+    if (osxsave && avx && ((r[1] >> 5) & 1)) {
+        unsigned lo, hi;
+        __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        if ((lo & 6) == 6) cpu |= RT_CPU_AVX2;
+    }
+    if ((r[1] >> 9) & 1) cpu |= RT_CPU_ERMS;
+    return cpu;
+}
+
+void rt_init(DosApi* api) {
+    rt_api = api;
+    rt_cpu = detect_cpu();
+    rt_mem_select(rt_cpu);
+}
+
+uint64_t rt_clock_ns(void) {
+    struct { int64_t sec, nsec; } ts;
+    long r;
+    // clock_gettime(CLOCK_MONOTONIC): a raw syscall, there is no vDSO lookup here
+    __asm__ volatile("syscall" : "=a"(r) : "a"(228), "D"(1), "S"(&ts) : "rcx", "r11", "memory");
+    if (r != 0) return 0;
+    return (uint64_t)ts.sec * 1000000000u + (uint64_t)ts.nsec;
+}
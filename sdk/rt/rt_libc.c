@@ -0,0 +1,13 @@
+// rt_libc.c - the C library names GCC calls on its own (struct copies,
+// large initialisers, loops it recognises), forwarded to the runtime.
+// Kept apart from rt_mem.c so host benchmarks can include that file
+// without clashing with the real libc.
+#include "rt.h"
+
+void*  memcpy(void* dst, const void* src, size_t n) { return rt_memcpy(dst, src, n); }
+void*  memmove(void* dst, const void* src, size_t n) { return rt_memmove(dst, src, n); }
+void*  memset(void* dst, int c, size_t n) { return rt_memset(dst, c, n); }
+int    memcmp(const void* a, const void* b, size_t n) { return rt_memcmp(a, b, n); }
+void*  memchr(const void* s, int c, size_t n) { return rt_memchr(s, c, n); }
+size_t strlen(const char* s) { return rt_strlen(s); }
+int    strcmp(const char* a, const char* b) { return rt_strcmp(a, b); }
@@ -0,0 +1,361 @@
+// rt_mem.c - memory and string routines, one variant per CPU level
+//
+// The exported rt_* functions jump through pointers that rt_mem_select()
+// fills in; the pointers are assigned at run time rather than initialised
+// statically because a COM64 image is never relocated. Vector code uses
+// GCC vector extensions plus target attributes, so no -m flags (or
+// intrinsic headers) are needed to build it.
+#include "rt.h"
+
+// These loops must not be turned back into calls to the functions they implement
+#pragma GCC optimize("no-tree-loop-distribute-patterns")
+
+typedef uint64_t u64u __attribute__((aligned(1), may_alias));
+typedef char     v16  __attribute__((vector_size(16)));
+typedef char     v16u __attribute__((vector_size(16), aligned(1), may_alias));
+typedef char     v32  __attribute__((vector_size(32)));
+typedef char     v32u __attribute__((vector_size(32), aligned(1), may_alias));
+
+#define AVX2 __attribute__((target("avx2")))
+
+/* --- portable: 8 bytes at a time --- */
+
+static void* memcpy_scalar(void* dst, const void* src, size_t n) {
+    char* d = dst;
+    const char* s = src;
+    for (; n >= 8; n -= 8, d += 8, s += 8) *(u64u*)d = *(const u64u*)s;
+    while (n--) *d++ = *s++;
+    return dst;
+}
+
+static void* memmove_scalar(void* dst, const void* src, size_t n) {
+    char* d = dst;
+    const char* s = src;
+    if ((uintptr_t)d - (uintptr_t)s >= n) return memcpy_scalar(dst, src, n);
+    while (n--) d[n] = s[n];
+    return dst;
+}
+
+static void* memset_scalar(void* dst, int c, size_t n) {
+    char* d = dst;
+    uint64_t w = 0x0101010101010101ull * (uint8_t)c;
+    for (; n >= 8; n -= 8, d += 8) *(u64u*)d = w;
+    while (n--) *d++ = (char)c;
+    return dst;
+}
+
+static int memcmp_scalar(const void* a, const void* b, size_t n) {
+    const uint8_t* x = a;
+    const uint8_t* y = b;
+    for (; n >= 8 && *(const u64u*)x == *(const u64u*)y; n -= 8, x += 8, y += 8) {
+    }
+    for (; n; n--, x++, y++) {
+        if (*x != *y) return *x - *y;
+    }
+    return 0;
+}
+
+static void* memchr_scalar(const void* s, int c, size_t n) {
+    const uint8_t* p = s;
+    for (; n; n--, p++) {
+        if (*p == (uint8_t)c) return (void*)p;
+    }
+    return NULL;
+}
+
+static size_t strlen_scalar(const char* s) {
+    const char* p = s;
+    while (*p) p++;
+    return (size_t)(p - s);
+}
+
+/* --- SSE2 (every x86-64) --- */
+
+static unsigned mask16(v16 v) {
+    return (unsigned)__builtin_ia32_pmovmskb128(v);
+}
+
+// Copies of up to 32 bytes, with every load done before any store, so
+// they are also safe for overlapping memmove
+static inline void copy_small(char* d, const char* s, size_t n) {
+    if (n >= 16) {
+        v16 a = *(const v16u*)s, b = *(const v16u*)(s + n - 16);
+        *(v16u*)d = a;
+        *(v16u*)(d + n - 16) = b;
+    } else if (n >= 8) {
+        uint64_t a = *(const u64u*)s, b = *(const u64u*)(s + n - 8);
+        *(u64u*)d = a;
+        *(u64u*)(d + n - 8) = b;
+    } else if (n >= 4) {
+        uint32_t a, b;
+        __builtin_memcpy(&a, s, 4);
+        __builtin_memcpy(&b, s + n - 4, 4);
+        __builtin_memcpy(d, &a, 4);
+        __builtin_memcpy(d + n - 4, &b, 4);
+    } else if (n) {
+        char a = s[0], b = s[n / 2], c = s[n - 1];
+        d[0] = a;
+        d[n / 2] = b;
+        d[n - 1] = c;
+    }
+}
+
+static void* memcpy_sse2(void* dst, const void* src, size_t n) {
+    char* d = dst;
+    const char* s = src;
+    if (n <= 32) {
+        copy_small(d, s, n);
+        return dst;
+    }
+    // The tail is loaded first, so a forward overlapping move works too
+    v16 tail = *(const v16u*)(s + n - 16);
+    char* end = d + n - 16;
+    for (; d < end; d += 16, s += 16) *(v16u*)d = *(const v16u*)s;
+    *(v16u*)end = tail;
+    return dst;
+}
+
+static void* memmove_sse2(void* dst, const void* src, size_t n) {
+    char* d = dst;
+    const char* s = src;
+    if ((uintptr_t)d - (uintptr_t)s >= n) return memcpy_sse2(dst, src, n);
+    if (n <= 32) {
+        copy_small(d, s, n);
+        return dst;
+    }
+    // Destination above source: walk down, head loaded first
+    v16 head = *(const v16u*)s;
+    for (size_t i = n; i > 16; i -= 16) *(v16u*)(d + i - 16) = *(const v16u*)(s + i - 16);
+    *(v16u*)d = head;
+    return dst;
+}
+
+static void* memset_sse2(void* dst, int c, size_t n) {
+    char* d = dst;
+    if (n < 16) return memset_scalar(dst, c, n);
+    v16 v = (v16){0} + (char)c;
+    char* end = d + n - 16;
+    for (; d < end; d += 16) *(v16u*)d = v;
+    *(v16u*)end = v;
+    return dst;
+}
+
+static int memcmp_sse2(const void* a, const void* b, size_t n) {
+    const char* x = a;
+    const char* y = b;
+    for (; n >= 16; n -= 16, x += 16, y += 16) {
+        unsigned m = mask16(*(const v16u*)x == *(const v16u*)y) ^ 0xFFFFu;
+        if (m) {
+            int i = __builtin_ctz(m);
+            return (uint8_t)x[i] - (uint8_t)y[i];
+        }
+    }
+    return memcmp_scalar(x, y, n);
+}
+
+static void* memchr_sse2(const void* s, int c, size_t n) {
+    const char* p = s;
+    v16 v = (v16){0} + (char)c;
+    for (; n >= 16; n -= 16, p += 16) {
+        unsigned m = mask16(*(const v16u*)p == v);
+        if (m) return (void*)(p + __builtin_ctz(m));
+    }
+    return memchr_scalar(p, c, n);
+}
+
+// Aligned 16-byte reads never cross a page, so reading a little before
+// the string or past its terminator cannot fault
+static size_t strlen_sse2(const char* s) {
+    const char* p = (const char*)((uintptr_t)s & ~(uintptr_t)15);
+    unsigned m = mask16(*(const v16*)p == (v16){0}) >> (s - p);
+    if (m) return (size_t)__builtin_ctz(m);
+    for (;;) {
+        p += 16;
+        m = mask16(*(const v16*)p == (v16){0});
+        if (m) return (size_t)(p + __builtin_ctz(m) - s);
+    }
+}
+
+/* --- AVX2 --- */
+
+AVX2 static unsigned mask32(v32 v) {
+    return (unsigned)__builtin_ia32_pmovmskb256(v);
+}
+
+AVX2 static void* memcpy_avx2(void* dst, const void* src, size_t n) {
+    char* d = dst;
+    const char* s = src;
+    if (n <= 32) {
+        copy_small(d, s, n);
+        return dst;
+    }
+    if (n <= 64) {
+        v32 a = *(const v32u*)s, b = *(const v32u*)(s + n - 32);
+        *(v32u*)d = a;
+        *(v32u*)(d + n - 32) = b;
+        return dst;
+    }
+    if (n >= 4096 && (rt_cpu & RT_CPU_ERMS) && (uintptr_t)d - (uintptr_t)s >= n) {
+        __asm__ volatile("rep movsb" : "+D"(d), "+S"(s), "+c"(n) : : "memory");
+        return dst;
+    }
+    v32 tail = *(const v32u*)(s + n - 32);
+    char* end = d + n - 32;
+    for (; d + 64 <= end; d += 64, s += 64) {
+        v32 a = *(const v32u*)s, b = *(const v32u*)(s + 32);
+        *(v32u*)d = a;
+        *(v32u*)(d + 32) = b;
+    }
+    for (; d < end; d += 32, s += 32) *(v32u*)d = *(const v32u*)s;
+    *(v32u*)end = tail;
+    return dst;
+}
+
+AVX2 static void* memmove_avx2(void* dst, const void* src, size_t n) {
+    char* d = dst;
+    const char* s = src;
+    if ((uintptr_t)d - (uintptr_t)s >= n) return memcpy_avx2(dst, src, n);
+    if (n <= 32) {
+        copy_small(d, s, n);
+        return dst;
+    }
+    v32 head = *(const v32u*)s;
+    for (size_t i = n; i > 32; i -= 32) *(v32u*)(d + i - 32) = *(const v32u*)(s + i - 32);
+    *(v32u*)d = head;
+    return dst;
+}
+
+AVX2 static void* memset_avx2(void* dst, int c, size_t n) {
+    char* d = dst;
+    if (n < 32) return memset_sse2(dst, c, n);
+    if (n >= 4096 && (rt_cpu & RT_CPU_ERMS)) {
+        __asm__ volatile("rep stosb" : "+D"(d), "+c"(n) : "a"(c) : "memory");
+        return dst;
+    }
+    v32 v = (v32){0} + (char)c;
+    char* end = d + n - 32;
+    for (; d < end; d += 32) *(v32u*)d = v;
+    *(v32u*)end = v;
+    return dst;
+}
+
+// The scans below test 64 bytes per iteration and finish with one
+// overlapping 32-byte step; bytes it revisits are already known equal
+// (or not to match), so the overlap cannot change the answer
+
+AVX2 static int memcmp_diff32(const char* x, const char* y) {
+    unsigned m = ~mask32(*(const v32u*)x == *(const v32u*)y);
+    if (!m) return 0;
+    int i = __builtin_ctz(m);
+    return (uint8_t)x[i] - (uint8_t)y[i];
+}
+
+AVX2 static int memcmp_avx2(const void* a, const void* b, size_t n) {
+    const char* x = a;
+    const char* y = b;
+    if (n < 32) return memcmp_sse2(x, y, n);
+    const char* end = x + n - 32;
+    for (; x + 64 <= end + 32; x += 64, y += 64) {
+        v32 e0 = *(const v32u*)x == *(const v32u*)y;
+        v32 e1 = *(const v32u*)(x + 32) == *(const v32u*)(y + 32);
+        if (mask32(e0 & e1) != 0xFFFFFFFFu) {
+            int r = memcmp_diff32(x, y);
+            return r ? r : memcmp_diff32(x + 32, y + 32);
+        }
+    }
+    if (x < end) {
+        int r = memcmp_diff32(x, y);
+        if (r) return r;
+    }
+    return memcmp_diff32(end, y + (end - x));
+}
+
+AVX2 static void* memchr_avx2(const void* s, int c, size_t n) {
+    const char* p = s;
+    if (n < 32) return memchr_sse2(p, c, n);
+    v32 v = (v32){0} + (char)c;
+    const char* end = p + n - 32;
+    for (; p + 64 <= end + 32; p += 64) {
+        v32 e0 = *(const v32u*)p == v, e1 = *(const v32u*)(p + 32) == v;
+        if (mask32(e0 | e1)) {
+            unsigned m = mask32(e0);
+            if (m) return (void*)(p + __builtin_ctz(m));
+            return (void*)(p + 32 + __builtin_ctz(mask32(e1)));
+        }
+    }
+    if (p < end) {
+        unsigned m = mask32(*(const v32u*)p == v);
+        if (m) return (void*)(p + __builtin_ctz(m));
+    }
+    unsigned m = mask32(*(const v32u*)end == v);
+    return m ? (void*)(end + __builtin_ctz(m)) : NULL;
+}
+
+AVX2 static size_t strlen_avx2(const char* s) {
+    const char* p = (const char*)((uintptr_t)s & ~(uintptr_t)31);
+    unsigned m = mask32(*(const v32*)p == (v32){0}) >> (s - p);
+    if (m) return (size_t)__builtin_ctz(m);
+    p += 32;
+    if ((uintptr_t)p & 32) {
+        m = mask32(*(const v32*)p == (v32){0});
+        if (m) return (size_t)(p + __builtin_ctz(m) - s);
+        p += 32;
+    }
+    // 64-byte aligned pairs stay within one page
+    for (;; p += 64) {
+        v32 e0 = *(const v32*)p == (v32){0}, e1 = *(const v32*)(p + 32) == (v32){0};
+        if (mask32(e0 | e1)) {
+            m = mask32(e0);
+            if (m) return (size_t)(p + __builtin_ctz(m) - s);
+            return (size_t)(p + 32 + __builtin_ctz(mask32(e1)) - s);
+        }
+    }
+}
+
+/* --- dispatch --- */
+
+static void* (*p_memcpy)(void*, const void*, size_t);
+static void* (*p_memmove)(void*, const void*, size_t);
+static void* (*p_memset)(void*, int, size_t);
+static int   (*p_memcmp)(const void*, const void*, size_t);
+static void* (*p_memchr)(const void*, int, size_t);
+static size_t (*p_strlen)(const char*);
+
+void rt_mem_select(unsigned cpu) {
+    if (cpu & RT_CPU_AVX2) {
+        p_memcpy = memcpy_avx2;
+        p_memmove = memmove_avx2;
+        p_memset = memset_avx2;
+        p_memcmp = memcmp_avx2;
+        p_memchr = memchr_avx2;
+        p_strlen = strlen_avx2;
+    } else if (cpu & RT_CPU_SSE2) {
+        p_memcpy = memcpy_sse2;
+        p_memmove = memmove_sse2;
+        p_memset = memset_sse2;
+        p_memcmp = memcmp_sse2;
+        p_memchr = memchr_sse2;
+        p_strlen = strlen_sse2;
+    } else {
+        p_memcpy = memcpy_scalar;
+        p_memmove = memmove_scalar;
+        p_memset = memset_scalar;
+        p_memcmp = memcmp_scalar;
+        p_memchr = memchr_scalar;
+        p_strlen = strlen_scalar;
+    }
+}
+
+void*  rt_memcpy(void* dst, const void* src, size_t n) { return p_memcpy(dst, src, n); }
+void*  rt_memmove(void* dst, const void* src, size_t n) { return p_memmove(dst, src, n); }
+void*  rt_memset(void* dst, int c, size_t n) { return p_memset(dst, c, n); }
+int    rt_memcmp(const void* a, const void* b, size_t n) { return p_memcmp(a, b, n); }
+void*  rt_memchr(const void* s, int c, size_t n) { return p_memchr(s, c, n); }
+size_t rt_strlen(const char* s) { return p_strlen(s); }
+
+int rt_strcmp(const char* a, const char* b) {
+    const uint8_t* x = (const uint8_t*)a;
+    const uint8_t* y = (const uint8_t*)b;
+    while (*x && *x == *y) x++, y++;
+    return *x - *y;
+}
@@ -0,0 +1,115 @@
+// rt_ring.c - SPSC record ring for shared memory segments
+//
+// Records are a 32-bit length, the bytes, and padding to 8. A record that
+// would run past the end of the data area is preceded by a wrap marker and
+// starts again at offset 0. head and tail only grow; each side keeps a
+// cached copy of the other's counter, on its own cache line, and reloads
+// it only when the cached value says full (or empty).
+//
+// Sleeping uses the Dekker pattern on the low 32 bits of the counters:
+// a waiter raises its flag, looks once more, and futex-waits on the
+// counter it saw; the other side publishes its counter, then checks the
+// flag. One of the two always sees the other. The waker clears the flag,
+// so a sleeper costs the other side one wake, not one per record.
+#include "rt.h"
+
+#define RT_RING_MAGIC 0x474E4952u // "RING"
+#define RT_RING_WRAP  0xFFFFFFFFu
+#define RT_RING_MAX   (1u << 30)
+
+static uint32_t rec_bytes(uint32_t n) {
+    return (4 + n + 7) & ~7u;
+}
+
+RtRing* rt_ring_init(void* mem, size_t bytes) {
+    RtRing* r = mem;
+    if (bytes < sizeof *r + 64) return NULL;
+    uint32_t cap = 64;
+    while (cap < RT_RING_MAX && sizeof *r + (size_t)cap * 2 <= bytes) cap *= 2;
+    rt_memset(r, 0, sizeof *r);
+    r->cap = cap;
+    __atomic_store_n(&r->magic, RT_RING_MAGIC, __ATOMIC_RELEASE);
+    return r;
+}
+
+RtRing* rt_ring_attach(void* mem) {
+    RtRing* r = mem;
+    return __atomic_load_n(&r->magic, __ATOMIC_ACQUIRE) == RT_RING_MAGIC ? r : NULL;
+}
+
+// Room for a record at head h, or 0; *skip gets the bytes to the wrap point
+static int ring_fits(RtRing* r, uint64_t h, uint64_t tail, uint32_t need, uint32_t* skip) {
+    uint32_t idx = (uint32_t)h & (r->cap - 1);
+    *skip = (r->cap - idx < need) ? r->cap - idx : 0;
+    return h + *skip + need - tail <= r->cap;
+}
+
+int rt_ring_push(RtRing* r, const void* rec, uint32_t n) {
+    if (n > r->cap / 4) return -1;
+    uint32_t need = rec_bytes(n), skip;
+    uint64_t h = r->head;
+    if (!ring_fits(r, h, r->tail_seen, need, &skip)) {
+        r->tail_seen = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+        if (!ring_fits(r, h, r->tail_seen, need, &skip)) return 0;
+    }
+
+    if (skip) {
+        *(uint32_t*)(r->data + ((uint32_t)h & (r->cap - 1))) = RT_RING_WRAP;
+        h += skip;
+    }
+    uint8_t* p = r->data + ((uint32_t)h & (r->cap - 1));
+    *(uint32_t*)p = n;
+    rt_memcpy(p + 4, rec, n);
+
+    __atomic_store_n(&r->head, h + need, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&r->cons_waiting, __ATOMIC_SEQ_CST) && __atomic_exchange_n(&r->cons_waiting, 0, __ATOMIC_SEQ_CST))
+        rt_api->futex_wake((int*)&r->head, 1);
+    return 1;
+}
+
+long rt_ring_pop(RtRing* r, void* buf, uint32_t max) {
+    uint64_t t = r->tail;
+    if (t == r->head_seen) {
+        r->head_seen = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        if (t == r->head_seen) return -1;
+    }
+
+    uint32_t idx = (uint32_t)t & (r->cap - 1);
+    uint32_t n = *(const uint32_t*)(r->data + idx);
+    if (n == RT_RING_WRAP) {
+        t += r->cap - idx;
+        idx = 0;
+        n = *(const uint32_t*)r->data;
+    }
+    if (n > max) return n;
+    rt_memcpy(buf, r->data + idx + 4, n);
+
+    __atomic_store_n(&r->tail, t + rec_bytes(n), __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&r->prod_waiting, __ATOMIC_SEQ_CST) && __atomic_exchange_n(&r->prod_waiting, 0, __ATOMIC_SEQ_CST))
+        rt_api->futex_wake((int*)&r->tail, 1);
+    return n;
+}
+
+int rt_ring_push_wait(RtRing* r, const void* rec, uint32_t n) {
+    for (;;) {
+        int rc = rt_ring_push(r, rec, n);
+        if (rc) return rc;
+
+        __atomic_store_n(&r->prod_waiting, 1, __ATOMIC_SEQ_CST);
+        uint64_t t = __atomic_load_n(&r->tail, __ATOMIC_SEQ_CST);
+        if (t == r->tail_seen) rt_api->futex_wait((int*)&r->tail, (int)(uint32_t)t, -1);
+        __atomic_store_n(&r->prod_waiting, 0, __ATOMIC_RELAXED);
+    }
+}
+
+long rt_ring_pop_wait(RtRing* r, void* buf, uint32_t max) {
+    for (;;) {
+        long n = rt_ring_pop(r, buf, max);
+        if (n >= 0) return n;
+
+        __atomic_store_n(&r->cons_waiting, 1, __ATOMIC_SEQ_CST);
+        uint64_t h = __atomic_load_n(&r->head, __ATOMIC_SEQ_CST);
+        if (h == r->tail) rt_api->futex_wait((int*)&r->head, (int)(uint32_t)h, -1);
+        __atomic_store_n(&r->cons_waiting, 0, __ATOMIC_RELAXED);
+    }
+}
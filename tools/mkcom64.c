@@ -1,4 +1,15 @@
 // mkcom64.c - host tool to wrap a flat x86-64 binary into .COM64
+//
+//   mkcom64 [-z] <payload.bin> <out.COM64> [entry_rva] [bss_size]
+//   mkcom64 -l <out.LIB> <a.COM64> [b.COM64 ...]
+//
+// -z stores the payload LZ4-compressed in 64 KiB blocks; the loader
+// decompresses it into the image as it reads, so a cold launch from a slow
+// disk reads fewer bytes.
+//
+// -l packs finished COM64 images into one library (C:\COM64.LIB): a
+// sorted name index followed by the images, placed so that each payload
+// starts on a page boundary and the loader can map it in place.
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,20 +19,248 @@
 typedef struct {
     char     magic[8];      // "64DOSCOM"
     uint32_t header_size;   // 64
-    uint32_t flags;         // 0
+    uint32_t flags;         // COM64_F_*
     uint64_t entry_rva;     // from payload start
     uint64_t bss_size;      // bytes to zero after payload
-    uint64_t reserved0;
-    uint64_t reserved1;
+    uint64_t packed_size;   // COM64_F_LZ4: bytes stored after the header
+    uint64_t payload_size;  // COM64_F_LZ4: bytes once decompressed
     uint64_t reserved2;
 } Com64Hdr;
+
+typedef struct {
+    char     magic[8];      // "64DOSLIB"
+    uint32_t version;       // 1
+    uint32_t count;
+    uint64_t index_off;     // Com64LibEntry[count], sorted by name
+    uint64_t reserved;
+} Com64LibHdr;
+
+typedef struct {
+    char     name[24];      // upper case, no extension, NUL-padded
+    uint64_t offset;        // of the COM64 header; offset + 56 is page-aligned
+    uint64_t size;
+} Com64LibEntry;
 #pragma pack(pop)
 
+#define COM64_LIB_ALIGN 4096u
+
+// Must match the loader in init/init_shell.c
+#define COM64_F_LZ4      0x1u
+#define COM64_LZ4_BLOCK  (64u << 10)
+#define COM64_LZ4_RAW    0x80000000u
+
 static void die(const char* msg) { fprintf(stderr, "%s\n", msg); exit(1); }
 
+/* --- LZ4 block compressor ---
+   Greedy single-probe hash matcher: quick and simple, well within the
+   format rules (min match 4, offsets < 64K, the last 5 bytes literal and
+   no match starting in the last 12). */
+
+#define LZ4_HASH_BITS  14
+#define LZ4_MIN_MATCH  4
+#define LZ4_MFLIMIT    12
+#define LZ4_LAST_LIT   5
+
+static uint32_t rd32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static size_t put_len(uint8_t* o, size_t len) {
+    size_t n = 0;
+    for (; len >= 255; len -= 255) o[n++] = 255;
+    o[n++] = (uint8_t)len;
+    return n;
+}
+
+static size_t put_seq(uint8_t* dst, const uint8_t* lit, size_t nlit, size_t off, size_t mlen) {
+    size_t op = 0;
+    uint8_t* tok = dst + op++;
+    *tok = (uint8_t)((nlit >= 15 ? 15 : nlit) << 4);
+    if (nlit >= 15) op += put_len(dst + op, nlit - 15);
+    memcpy(dst + op, lit, nlit);
+    op += nlit;
+    if (!mlen) return op; // final literals-only sequence
+
+    dst[op++] = (uint8_t)off;
+    dst[op++] = (uint8_t)(off >> 8);
+    mlen -= LZ4_MIN_MATCH;
+    *tok |= (uint8_t)(mlen >= 15 ? 15 : mlen);
+    if (mlen >= 15) op += put_len(dst + op, mlen - 15);
+    return op;
+}
+
+// dst needs n + n / 255 + 16 bytes
+static size_t lz4_compress_block(const uint8_t* src, size_t n, uint8_t* dst) {
+    static uint32_t table[1u << LZ4_HASH_BITS];
+    memset(table, 0, sizeof table);
+
+    size_t ip = 0, anchor = 0, op = 0;
+    if (n > LZ4_MFLIMIT) {
+        size_t limit = n - LZ4_MFLIMIT;
+        while (ip < limit) {
+            uint32_t seq = rd32(src + ip);
+            uint32_t h = (seq * 2654435761u) >> (32 - LZ4_HASH_BITS);
+            size_t cand = table[h];
+            table[h] = (uint32_t)ip;
+
+            if (cand >= ip || ip - cand > 65535 || rd32(src + cand) != seq) {
+                ip++;
+                continue;
+            }
+
+            while (ip > anchor && cand > 0 && src[ip - 1] == src[cand - 1]) { ip--; cand--; }
+
+            size_t len = LZ4_MIN_MATCH, max = n - LZ4_LAST_LIT - ip;
+            while (len < max && src[ip + len] == src[cand + len]) len++;
+
+            op += put_seq(dst + op, src + anchor, ip - anchor, ip - cand, len);
+            ip += len;
+            anchor = ip;
+        }
+    }
+    return op + put_seq(dst + op, src + anchor, n - anchor, 0, 0);
+}
+
+/* Block stream as described in init_shell.c. Returns the packed size. */
+static size_t lz4_pack(const uint8_t* src, size_t n, uint8_t** out) {
+    size_t cap = n + n / 255 + (n / COM64_LZ4_BLOCK + 1) * 24;
+    uint8_t* dst = (uint8_t*)malloc(cap);
+    if (!dst) die("malloc failed");
+
+    size_t op = 0;
+    for (size_t at = 0; at < n; at += COM64_LZ4_BLOCK) {
+        size_t blk = n - at < COM64_LZ4_BLOCK ? n - at : COM64_LZ4_BLOCK;
+        uint8_t* lenp = dst + op;
+        op += 4;
+
+        uint32_t len = (uint32_t)lz4_compress_block(src + at, blk, dst + op);
+        if (len >= blk) {
+            memcpy(dst + op, src + at, blk);
+            len = (uint32_t)blk | COM64_LZ4_RAW;
+        }
+        lenp[0] = (uint8_t)len;
+        lenp[1] = (uint8_t)(len >> 8);
+        lenp[2] = (uint8_t)(len >> 16);
+        lenp[3] = (uint8_t)(len >> 24);
+        op += len & ~COM64_LZ4_RAW;
+    }
+    *out = dst;
+    return op;
+}
+
+/* --- library packing --- */
+
+typedef struct {
+    Com64LibEntry e;
+    const char*   path;
+} LibMember;
+
+static int member_cmp(const void* a, const void* b) {
+    return strcmp(((const LibMember*)a)->e.name, ((const LibMember*)b)->e.name);
+}
+
+static int pack_library(const char* out_path, int n, char** paths) {
+    LibMember* m = (LibMember*)calloc((size_t)n, sizeof *m);
+    if (!m) die("malloc failed");
+
+    for (int i = 0; i < n; i++) {
+        const char* base = strrchr(paths[i], '/');
+        base = base ? base + 1 : paths[i];
+        size_t len = strcspn(base, ".");
+        if (len == 0 || len >= sizeof m[i].e.name) {
+            fprintf(stderr, "%s: name must be 1-%zu characters\n", paths[i], sizeof m[i].e.name - 1);
+            exit(1);
+        }
+        for (size_t k = 0; k < len; k++)
+            m[i].e.name[k] = (char)((base[k] >= 'a' && base[k] <= 'z') ? base[k] - 32 : base[k]);
+        m[i].path = paths[i];
+    }
+    qsort(m, (size_t)n, sizeof *m, member_cmp);
+    for (int i = 1; i < n; i++) {
+        if (!strcmp(m[i].e.name, m[i - 1].e.name)) {
+            fprintf(stderr, "duplicate member %s\n", m[i].e.name);
+            exit(1);
+        }
+    }
+
+    FILE* out = fopen(out_path, "wb");
+    if (!out) die("Failed to open output");
+
+    Com64LibHdr h;
+    memset(&h, 0, sizeof h);
+    memcpy(h.magic, "64DOSLIB", 8);
+    h.version = 1;
+    h.count = (uint32_t)n;
+    h.index_off = sizeof h;
+
+    uint64_t at = sizeof h + (uint64_t)n * sizeof(Com64LibEntry);
+    static const uint8_t zero[COM64_LIB_ALIGN];
+
+    // First pass only sizes the members, so the index can go out first
+    for (int i = 0; i < n; i++) {
+        FILE* in = fopen(m[i].path, "rb");
+        if (!in || fseek(in, 0, SEEK_END) != 0) die("Failed to open member");
+        long sz = ftell(in);
+        fclose(in);
+        if (sz < (long)sizeof(Com64Hdr)) die("Member is not a COM64 image");
+
+        // Align the payload, not the header: code linked at 0 keeps its alignment
+        at += sizeof(Com64Hdr);
+        at = (at + COM64_LIB_ALIGN - 1) & ~(uint64_t)(COM64_LIB_ALIGN - 1);
+        m[i].e.offset = at - sizeof(Com64Hdr);
+        m[i].e.size = (uint64_t)sz;
+        at += (uint64_t)sz;
+    }
+
+    if (fwrite(&h, 1, sizeof h, out) != sizeof h) die("write header failed");
+    for (int i = 0; i < n; i++) {
+        if (fwrite(&m[i].e, 1, sizeof m[i].e, out) != sizeof m[i].e) die("write index failed");
+    }
+
+    uint64_t pos = sizeof h + (uint64_t)n * sizeof(Com64LibEntry);
+    for (int i = 0; i < n; i++) {
+        if (fwrite(zero, 1, (size_t)(m[i].e.offset - pos), out) != m[i].e.offset - pos) die("write failed");
+
+        FILE* in = fopen(m[i].path, "rb");
+        if (!in) die("Failed to open member");
+        uint8_t* buf = (uint8_t*)malloc((size_t)m[i].e.size);
+        if (!buf) die("malloc failed");
+        if (fread(buf, 1, (size_t)m[i].e.size, in) != m[i].e.size) die("read failed");
+        fclose(in);
+        if (memcmp(buf, "64DOSCOM", 8) != 0) {
+            fprintf(stderr, "%s: not a COM64 image\n", m[i].path);
+            exit(1);
+        }
+        if (fwrite(buf, 1, (size_t)m[i].e.size, out) != m[i].e.size) die("write member failed");
+        free(buf);
+        pos = m[i].e.offset + m[i].e.size;
+    }
+
+    fclose(out);
+    free(m);
+    return 0;
+}
+
 int main(int argc, char** argv) {
+    if (argc > 1 && !strcmp(argv[1], "-l")) {
+        if (argc < 4) {
+            fprintf(stderr, "Usage: %s -l <out.LIB> <a.COM64> [b.COM64 ...]\n", argv[0]);
+            return 2;
+        }
+        return pack_library(argv[2], argc - 3, argv + 3);
+    }
+
+    int compress = 0;
+    if (argc > 1 && !strcmp(argv[1], "-z")) {
+        compress = 1;
+        argv++;
+        argc--;
+    }
+
     if (argc < 3) {
-        fprintf(stderr, "Usage: %s <payload.bin> <out.COM64> [entry_rva] [bss_size]\n", argv[0]);
+        fprintf(stderr, "Usage: %s [-z] <payload.bin> <out.COM64> [entry_rva] [bss_size]\n", argv[0]);
         return 2;
     }
 
@@ -52,13 +291,23 @@ int main(int argc, char** argv) {
     h.entry_rva = entry_rva;
     h.bss_size = bss_size;
 
+    uint8_t* payload = buf;
+    size_t payload_len = (size_t)sz;
+    if (compress && sz > 0) {
+        payload_len = lz4_pack(buf, (size_t)sz, &payload);
+        h.flags |= COM64_F_LZ4;
+        h.packed_size = payload_len;
+        h.payload_size = (uint64_t)sz;
+    }
+
     FILE* out = fopen(out_path, "wb");
     if (!out) die("Failed to open output");
 
     if (fwrite(&h, 1, sizeof(h), out) != sizeof(h)) die("write header failed");
-    if (fwrite(buf, 1, (size_t)sz, out) != (size_t)sz) die("write payload failed");
+    if (fwrite(payload, 1, payload_len, out) != payload_len) die("write payload failed");
 
     fclose(out);
+    if (payload != buf) free(payload);
     free(buf);
     return 0;
 }